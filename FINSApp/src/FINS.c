@@ -23,6 +23,7 @@
 		r	FINS_CYCLE_TIME_MIN
 		r	FINS_CPU_STATUS
 		r	FINS_CPU_MODE
+		r	FINS_LATENCY_COUNT
 		w	FINS_DM_WRITE
 		w	FINS_DM_WRITE_NOREAD
 		w	FINS_AR_WRITE
@@ -37,6 +38,10 @@
 		w	FINS_IO_WRITE_32
 		w	FINS_IO_WRITE_32_NOREAD
 		w	FINS_SET_RESET_CANCEL
+		w	FINS_SET_MULTI_TYPE
+		w	FINS_SET_MULTI_ADDR
+		w	FINS_CLR_MULTI
+		w	FINS_WRITE_COMMIT
 		r	FINS_ECHO_TEST
 		
 		Int16Array
@@ -55,6 +60,7 @@
 		r	FINS_AR_READ_32
 		r	FINS_IO_READ_32
 		r	FINS_CYCLE_TIME
+		r	FINS_MM_READ
 		w	FINS_DM_WRITE_32
 		w	FINS_AR_WRITE_32
 		w	FINS_IO_WRITE_32
@@ -68,12 +74,17 @@
 		Float64
 		r	FINS_DM_READ_32
 		r	FINS_AR_READ_32
+		r	FINS_LATENCY_P50, FINS_LATENCY_P90, FINS_LATENCY_P99, FINS_LATENCY_P999, FINS_LATENCY_MAX
 		w	FINS_DM_WRITE_32
 		w	FINS_AR_WRITE_32
 		
 	The commands supported by this driver are for CPU units.
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE		/* sendmmsg() and recvmmsg() */
+#endif
+
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
@@ -91,13 +102,20 @@
 #include <epicsExport.h>
 #include <epicsEndian.h>
 #include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
 #include <errlog.h>
 #include <ellLib.h>
+#include <gpHash.h>
 
 #include <asynDriver.h>
 #include <asynDrvUser.h>
 #include <asynOctet.h>
 #include <asynOctetSyncIO.h>
+#include <asynInt32SyncIO.h>
+#include <asynInt16ArraySyncIO.h>
+#include <asynInt32ArraySyncIO.h>
+#include <asynFloat32ArraySyncIO.h>
 #include <asynInt32.h>
 #include <asynFloat64.h>
 #include <asynInt16Array.h>
@@ -115,7 +133,57 @@
 
 #include "FINS.h"
 
+/* batched UDP system calls for the shared sockets, see finsDispatcherInit */
+
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+#define FINS_MMSG
+#endif
+
+/* the shared sockets are waited on with epoll on Linux, where a descriptor can be too large for select() */
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <poll.h>
+#define FINS_EPOLL
+#endif
+
+#ifdef FINS_MMSG
+
+/* the sendmmsg() queue of a shared socket, and the dispatcher's recvmmsg() buffers */
+
+#define FINS_BATCH	32
+
+typedef struct finsBatch
+{
+	epicsMutexId lock;
+	int flushing;			/* a thread is in sendmmsg() */
+	int bank;			/* the bank being filled, the other one may be being sent */
+	int n[2];
+	struct mmsghdr msgs[2][FINS_BATCH];
+	struct iovec iov[2][FINS_BATCH];
+	struct sockaddr_in to[2][FINS_BATCH];
+	epicsUInt8 buffer[2][FINS_BATCH][FINS_MAX_MSG];
+	
+	unsigned long ncalls, nsent, nerrors;
+	
+} finsBatch;
+
+typedef struct finsRing
+{
+	struct mmsghdr msgs[FINS_BATCH];
+	struct iovec iov[FINS_BATCH];
+	struct sockaddr_in from[FINS_BATCH];
+	epicsUInt8 buffer[FINS_BATCH][FINS_MAX_MSG];
+	
+	unsigned long ncalls, nreceived;
+	
+} finsRing;
+
+#endif
+
 static void FINSerror(const drvPvt * const pdrvPvt, asynUser *pasynUser, const char *name, const unsigned char mres, const unsigned char sres);
+static void HistInit(finsHist * const phist);
+static void HistReport(const finsHist * const phist, FILE *fp, const char *name, const int details);
 
 /*** asynCommon methods ***************************************************************************/
 
@@ -178,33 +246,56 @@ static asynDrvUser ifaceDrvUser = { drvUserCreate, drvUserGetType, drvUserDestro
 /**************************************************************************************************/
 
 extern int errno;
-static int finsInit(const char *portName, const char *dev, const int snode);
+static int finsInit(const char *portName, const char *dev, const int snode, const int window, const int shared);
+static int LinkCreate(drvPvt * const pdrvPvt, const char *address, const int window);
+static int DispatchAdd(drvPvt * const pdrvPvt, const char *address, const int window);
+static int SessionAdd(drvPvt * const pdrvPvt, const char *address, const int window);
+static int SessionConnect(drvPvt * const pdrvPvt);
+static int SessionSend(finsSession * const psession, const finsMsg * const pmsg);
+static int LinkResend(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg);
+static void SessionClose(finsSession * const psession);
+#ifdef FINS_MMSG
+static int BatchSend(finsLink * const plink, const finsMsg * const pmsg);
+#endif
+
+/* Multiple Memory Area Read definitions made by finsMultiMemoryAreaInit, for ports without their own */
 
-/* double linked list for Multiple Memory reads */
+static finsMMTable mmDefault;
 
-static ELLLIST mmList;
+/* the shared FINS/UDP sockets and how many to create, see finsUDPSharedInit */
+
+static finsDispatcher *dispatcher;
+static int dispatchSockets = 1;
+static int dispatchBatch = 0;
+
+/* the FINS/TCP reconnect delays, zero if ports connect on demand, see finsReconnectInit */
+
+static double reconnectMin = 0.0;
+static double reconnectMax = 0.0;
 
 /**************************************************************************************************/
 
 int finsNETInit(const char *portName, const char *dev, const int snode)
 {
-	return finsInit(portName, dev, (snode < 0) ? 0 : snode);
+	return finsInit(portName, dev, (snode < 0) ? 0 : snode, 0, FINS_PARENT_PORT);
 }
 
 /**************************************************************************************************/
 
 int finsDEVInit(const char *portName, const char *dev)
 {
-	return finsInit(portName, dev, -1);
+	return finsInit(portName, dev, -1, 0, FINS_PARENT_PORT);
 }
 
 /**************************************************************************************************/
 /*
 	A modified version of the old initialisation function which calls drvAsynIPPortConfigure
 	to set up the UDP connection.
+	
+	window > 1 allows that many requests to be in flight at once.
 */
 
-int finsUDPInit(const char *portName, const char *address, const int node)
+int finsUDPInit(const char *portName, const char *address, const int node, const int window)
 {
 	char *adds = (char *) callocMustSucceed(1, strlen(address) + 10, __func__);
 
@@ -220,12 +311,59 @@ int finsUDPInit(const char *portName, const char *address, const int node)
 
 	if (drvAsynIPPortConfigure(address, adds, 0, 0, 0) == 0)
 	{
-		return finsInit(portName, address, (node == 0) ? FINS_SOURCE_ADDR : node);
+		return finsInit(portName, address, (node == 0) ? FINS_SOURCE_ADDR : node, window, FINS_PARENT_PORT);
 	}
 
 	return (-1);
 }
 
+/*
+	A FINS/UDP port without a parent asyn port, using the shared sockets and dispatcher thread.
+	The window is at least 1.
+*/
+
+int finsUDPSharedInit(const char *portName, const char *address, const int node, const int window)
+{
+	return finsInit(portName, address, (node == 0) ? FINS_SOURCE_ADDR : node, (window < 1) ? 1 : window, FINS_SHARED_UDP);
+}
+
+/*
+	The number of shared sockets, and whether to batch their system calls, before the first
+	finsUDPSharedInit.
+*/
+
+int finsDispatcherInit(const int sockets, const int batch)
+{
+	if (dispatcher)
+	{
+		printf("%s: the shared sockets have already been created\n", __func__);
+		return (-1);
+	}
+	
+	dispatchSockets = (sockets < 1) ? 1 : (sockets > FINS_DISPATCH_MAX_SOCKETS) ? FINS_DISPATCH_MAX_SOCKETS : sockets;
+	dispatchBatch = (batch != 0);
+	
+#ifndef FINS_MMSG
+	if (dispatchBatch)
+	{
+		printf("%s: sendmmsg() and recvmmsg() are not available, not batching\n", __func__);
+		dispatchBatch = 0;
+	}
+#endif
+
+	return (0);
+}
+
+/*
+	A FINS/TCP port without a parent asyn port. Ports for the same address share one connection,
+	with up to window frames in flight on it.
+*/
+
+int finsTCPSharedInit(const char *portName, const char *address, const int window)
+{
+	return finsInit(portName, address, 0, (window < 1) ? 1 : window, FINS_SHARED_TCP);
+}
+
 int finsTCPInit(const char *portName, const char *address)
 {
 	char *adds = (char *) callocMustSucceed(1, strlen(address) + 10, __func__);
@@ -242,7 +380,7 @@ int finsTCPInit(const char *portName, const char *address)
 	
 	if (drvAsynIPPortConfigure(address, adds, 0, 0, 0) == 0)
 	{
-		return finsInit(portName, address, 0);
+		return finsInit(portName, address, 0, 0, FINS_PARENT_PORT);
 	}
 
 	return (-1);
@@ -254,9 +392,9 @@ int finsTCPInit(const char *portName, const char *address)
 	in every FINS message and reply.
 */
 
-static void AddCommand(drvPvt * const pdrvPvt, const size_t sendlen, const unsigned int command)
+static void AddCommand(epicsUInt8 * const message, const size_t sendlen, const unsigned int command)
 {
-	unsigned int *FINSframe = (unsigned int *) pdrvPvt->message;
+	unsigned int *FINSframe = (unsigned int *) message;
 	
 	FINSframe[FINS_MODE_HEADER]  = BSWAP32(FINS_TCP_HEADER);
 	FINSframe[FINS_MODE_COMMAND] = BSWAP32(command);
@@ -279,16 +417,25 @@ static void AddCommand(drvPvt * const pdrvPvt, const size_t sendlen, const unsig
 
 static int FINSnodeRequest(drvPvt * const pdrvPvt)
 {
-	unsigned int *FINSframe = (unsigned int *) pdrvPvt->message;
+	unsigned int FINSframe[FINS_MODE_RECV_SIZE / sizeof(unsigned int)];
 	size_t sentlen = 0, recdlen = 0;
 	int eomReason = 0;
 	asynStatus status;
 	
+/* a shared connection does the exchange once for all its ports */
+
+	if (pdrvPvt->link && pdrvPvt->link->session)
+	{
+		return (SessionConnect(pdrvPvt));
+	}
+	
 /* initialise the buffer */
 
-	AddCommand(pdrvPvt, 0, FINS_NODE_CLIENT_COMMAND);
+	AddCommand((epicsUInt8 *) FINSframe, 0, FINS_NODE_CLIENT_COMMAND);
 	
-	status = pasynOctetSyncIO->writeRead(pdrvPvt->pasynUser, (void *) pdrvPvt->message, FINS_MODE_SEND_SIZE, (void *) pdrvPvt->message, FINS_MODE_RECV_SIZE, 1.0, &sentlen, &recdlen, &eomReason);
+	epicsMutexMustLock(pdrvPvt->mutex);
+	status = pasynOctetSyncIO->writeRead(pdrvPvt->pasynUser, (void *) FINSframe, FINS_MODE_SEND_SIZE, (void *) FINSframe, FINS_MODE_RECV_SIZE, 1.0, &sentlen, &recdlen, &eomReason);
+	epicsMutexUnlock(pdrvPvt->mutex);
 
 	FINSframe[FINS_MODE_COMMAND] = BSWAP32(FINSframe[FINS_MODE_COMMAND]);
 	FINSframe[FINS_MODE_ERROR]   = BSWAP32(FINSframe[FINS_MODE_ERROR]);
@@ -311,6 +458,98 @@ static int FINSnodeRequest(drvPvt * const pdrvPvt)
 	return (-1);
 }
 
+/* drop the TCP connection after an error, the next request reconnects */
+
+static void TCPDisconnect(drvPvt * const pdrvPvt)
+{
+	if (pdrvPvt->link && pdrvPvt->link->session)
+	{
+		SessionClose(pdrvPvt->link->session);
+	}
+	else
+	{
+		pasynCommonSyncIO->disconnectDevice(pdrvPvt->pasynUserCommon);
+	}
+}
+
+/*
+	With finsReconnectInit a thread for each FINS/TCP port connects and exchanges node addresses,
+	so neither finsInit nor a request waits for a PLC that isn't there.
+*/
+
+static void ReconnectThread(void *pvt)
+{
+	drvPvt * const pdrvPvt = (drvPvt *) pvt;
+	finsReconnect * const preconnect = pdrvPvt->reconnect;
+	
+	while (1)
+	{
+		epicsEventMustWait(preconnect->wakeup);
+		
+		while (pdrvPvt->nodevalid != 1)
+		{
+			preconnect->nattempts++;
+			
+			if (FINSnodeRequest(pdrvPvt) == 0)
+			{
+				preconnect->nconnects++;
+				break;
+			}
+			
+			epicsThreadSleep(preconnect->delay);
+			
+			preconnect->delay = (2.0 * preconnect->delay < reconnectMax) ? 2.0 * preconnect->delay : reconnectMax;
+		}
+		
+		preconnect->delay = reconnectMin;
+	}
+}
+
+static int ReconnectStart(drvPvt * const pdrvPvt)
+{
+	finsReconnect * const preconnect = (finsReconnect *) callocMustSucceed(1, sizeof(finsReconnect), __func__);
+	char name[64];
+	
+	preconnect->wakeup = epicsEventMustCreate(epicsEventFull);
+	preconnect->delay = reconnectMin;
+	
+	pdrvPvt->reconnect = preconnect;
+	
+	epicsSnprintf(name, sizeof(name), "%s_R", pdrvPvt->portName);
+	
+	if (epicsThreadCreate(name, epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackMedium), ReconnectThread, pdrvPvt) == NULL)
+	{
+		errlogPrintf("%s: port %s, can't create reconnect thread\n", __func__, pdrvPvt->portName);
+		pdrvPvt->reconnect = NULL;
+		
+		return (-1);
+	}
+	
+	return (0);
+}
+
+/* before sending on a FINS/TCP port make sure that it has its node addresses */
+
+static int NodeReady(drvPvt * const pdrvPvt, asynUser *pasynUser)
+{
+	if ((pdrvPvt->type != FINS_TCP_type) || (pdrvPvt->nodevalid == 1))
+	{
+		return (0);
+	}
+	
+	if (pdrvPvt->reconnect == NULL)
+	{
+		return (FINSnodeRequest(pdrvPvt));
+	}
+	
+	epicsEventSignal(pdrvPvt->reconnect->wakeup);
+	
+	epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize, "port %s, not connected", pdrvPvt->portName);
+	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, not connected, request not sent.\n", __func__, pdrvPvt->portName);
+	
+	return (-1);
+}
+
 /**************************************************************************************************/
 /*
 	Connection management for the TCP asyn port
@@ -337,20 +576,37 @@ static void exceptCallback(asynUser *pasynUser, asynException exception)
 	if (connected == 0)
 	{
 		pdrvPvt->nodevalid = 0;
+		
+		if (pdrvPvt->reconnect)
+		{
+			epicsEventSignal(pdrvPvt->reconnect->wakeup);
+		}
 	}
 }
 
 /**************************************************************************************************/
 
-static int finsInit(const char *portName, const char *dev, const int snode)
+static int finsInit(const char *portName, const char *dev, const int snode, const int window, const int shared)
 {
 	asynStatus status;
 	asynStandardInterfaces *pInterfaces;
 	asynInterface *poctetasynInterface;
+	int i;
 	
 	drvPvt *pdrvPvt = callocMustSucceed(1, sizeof(drvPvt), __func__);
 	pdrvPvt->portName = epicsStrDup(portName);
-	pdrvPvt->tLast = -1.0;
+	pdrvPvt->mutex = epicsMutexMustCreate();
+	pdrvPvt->msgLock = epicsMutexMustCreate();
+	pdrvPvt->tmplLock = epicsMutexMustCreate();
+	ellInit(&pdrvPvt->msgFree);
+	pdrvPvt->blockLock = epicsMutexMustCreate();
+	ellInit(&pdrvPvt->blockList);
+	pdrvPvt->mm.lock = epicsMutexMustCreate();
+	
+	for (i = 0; i < FINS_CLASSES; i++)
+	{
+		HistInit(&pdrvPvt->latency[i]);
+	}
 
 	pdrvPvt->pasynUser = pasynManager->createAsynUser(0, 0);
 	pdrvPvt->pasynUserCommon = pasynManager->createAsynUser(0, 0);
@@ -376,6 +632,15 @@ static int finsInit(const char *portName, const char *dev, const int snode)
 	pInterfaces->int32Array.pinterface = (void *) &ifaceInt32Array;
 	pInterfaces->float32Array.pinterface = (void *) &ifaceFloat32Array;
 
+/* values can be pushed to SCAN="I/O Intr" records by the pollers */
+
+	pInterfaces->octetCanInterrupt = 1;
+	pInterfaces->int32CanInterrupt = 1;
+	pInterfaces->float64CanInterrupt = 1;
+	pInterfaces->int16ArrayCanInterrupt = 1;
+	pInterfaces->int32ArrayCanInterrupt = 1;
+	pInterfaces->float32ArrayCanInterrupt = 1;
+
 	status = pasynStandardInterfacesBase->initialize(pdrvPvt->portName, pInterfaces, pdrvPvt->pasynUser, pdrvPvt);
 	
 	if (status != asynSuccess)
@@ -384,6 +649,30 @@ static int finsInit(const char *portName, const char *dev, const int snode)
 		return (-1);
 	}
 
+/* a port on a shared transport has no parent port, dev is the PLC's address */
+
+	if (shared != FINS_PARENT_PORT)
+	{
+		pdrvPvt->type = (shared == FINS_SHARED_TCP) ? FINS_TCP_type : FINS_UDP_type;
+		pdrvPvt->ipaddr = epicsStrDup(dev);
+		pdrvPvt->snode = snode;
+		
+		if (aToIPAddr(pdrvPvt->ipaddr, FINS_NET_PORT, &pdrvPvt->addr) < 0)
+		{
+			printf("%s: port %s, bad IP address %s\n", __func__, portName, dev);
+			return (-1);
+		}
+		
+		pdrvPvt->dnode = ntohl(pdrvPvt->addr.sin_addr.s_addr) & 0xff;
+		
+		if (shared == FINS_SHARED_TCP)
+		{
+			return (SessionAdd(pdrvPvt, dev, window));
+		}
+		
+		return (DispatchAdd(pdrvPvt, dev, window));
+	}
+	
 /* connect to the parent port and save the asynUser */
 	
   	if (pasynOctetSyncIO->connect(dev, 0, &pdrvPvt->pasynUser, NULL))
@@ -460,7 +749,14 @@ static int finsInit(const char *portName, const char *dev, const int snode)
 
 	if (pdrvPvt->type == FINS_TCP_type)
 	{
-		FINSnodeRequest(pdrvPvt);
+		if (reconnectMax > 0.0)
+		{
+			ReconnectStart(pdrvPvt);
+		}
+		else
+		{
+			FINSnodeRequest(pdrvPvt);
+		}
 
 	/* for monitoring connections/disconnections */
 
@@ -469,6 +765,13 @@ static int finsInit(const char *portName, const char *dev, const int snode)
 	else if (pdrvPvt->type == FINS_UDP_type)
 	{
 		pdrvPvt->snode = (snode != 0) ? snode : FINS_SOURCE_ADDR;
+		
+	/* more than one request in flight needs our own socket and a receive thread */
+	
+		if ((window > 1) && (LinkCreate(pdrvPvt, dev, window) < 0))
+		{
+			return (-1);
+		}
 	}
 	
  	return (0);
@@ -488,7 +791,131 @@ static void report(void *pvt, FILE *fp, int details)
 		fprintf(fp, "    Node: %d -> Node: %d\n", pdrvPvt->snode, pdrvPvt->dnode);
 	}
 	
-	fprintf(fp, "    Min: %.4fs  Max: %.4fs  Last: %.4fs\n", pdrvPvt->tMin, pdrvPvt->tMax, pdrvPvt->tLast);
+	if (pdrvPvt->maxwords)
+	{
+		fprintf(fp, "    Frame: %lu words  MTU: %d\n", (unsigned long) pdrvPvt->maxwords, pdrvPvt->mtu);
+	}
+	
+	if (pdrvPvt->cache)
+	{
+		const finsCache * const pcache = pdrvPvt->cache;
+		
+		fprintf(fp, "    Read cache: TTL %g s  Entries: %d  Hits: %lu  Shared: %lu  Reads: %lu  Full: %lu\n", pcache->ttl, pcache->nentries, pcache->nhits, pcache->nshared, pcache->nreads, pcache->nfull);
+	}
+	
+	if (pdrvPvt->wq)
+	{
+		const finsWriteQueue * const pqueue = pdrvPvt->wq;
+		
+		fprintf(fp, "    Write combining: deadline %g s  Writes: %lu  Superseded words: %lu  Frames: %lu  Errors: %lu  Queued words: %lu\n", pqueue->deadline, pqueue->nwrites, pqueue->nsuperseded, pqueue->nframes, pqueue->nerrors, (unsigned long) pqueue->nqueued);
+	}
+	
+	if (pdrvPvt->breaker)
+	{
+		const finsBreaker * const pbreaker = pdrvPvt->breaker;
+		
+		fprintf(fp, "    Circuit breaker: %s  Threshold: %d  Time outs: %d  Trips: %lu  Rejected: %lu  Probes: %lu\n", pbreaker->open ? "open" : "closed", pbreaker->threshold, pbreaker->timeouts, pbreaker->ntrips, pbreaker->nrejected, pbreaker->nprobes);
+	}
+	
+	if (pdrvPvt->retransmits || pdrvPvt->nretransmits || pdrvPvt->ndiscarded)
+	{
+		fprintf(fp, "    Retransmits: %d  Sent again: %lu  Wrong SID replies dropped: %lu\n", pdrvPvt->retransmits, pdrvPvt->nretransmits, pdrvPvt->ndiscarded);
+	}
+	
+	if (pdrvPvt->reconnect)
+	{
+		const finsReconnect * const preconnect = pdrvPvt->reconnect;
+		
+		fprintf(fp, "    Reconnect: %s  Attempts: %lu  Connects: %lu  Next delay: %g s\n", (pdrvPvt->nodevalid == 1) ? "connected" : "connecting", preconnect->nattempts, preconnect->nconnects, preconnect->delay);
+	}
+	
+	if (pdrvPvt->nnoresp || pdrvPvt->nverified)
+	{
+		fprintf(fp, "    No response writes: %d  Acknowledged: %d  Verify period: %g s\n", pdrvPvt->nnoresp, pdrvPvt->nverified, pdrvPvt->verify);
+	}
+	
+	if (pdrvPvt->status)
+	{
+		const finsStatus * const pstatus = pdrvPvt->status;
+		
+		fprintf(fp, "    Status: period %g s  CPU reads: %lu  shared: %lu  errors: %lu  Cycle time reads: %lu  shared: %lu  errors: %lu\n", pstatus->period,
+			pstatus->frame[FINS_STATUS_CPU].nreads, pstatus->frame[FINS_STATUS_CPU].nshared, pstatus->frame[FINS_STATUS_CPU].nerrors,
+			pstatus->frame[FINS_STATUS_CYCLE].nreads, pstatus->frame[FINS_STATUS_CYCLE].nshared, pstatus->frame[FINS_STATUS_CYCLE].nerrors);
+	}
+	
+	{
+		int i;
+		
+		for (i = 0; i < FINS_CLASSES; i++)
+		{
+			HistReport(&pdrvPvt->latency[i], fp, FINS_classes[i], details);
+		}
+	}
+	
+	if (pdrvPvt->link)
+	{
+		const finsLink * const plink = pdrvPvt->link;
+		
+		fprintf(fp, "    Window: %d  In flight: %d  Sent: %lu  Replies: %lu  Stale: %lu  Timeouts: %lu\n", plink->window, plink->inflight, plink->nsent, plink->nreplies, plink->nstale, plink->ntimeouts);
+		
+		if (plink->session)
+		{
+			const finsSession * const psession = plink->session;
+			
+			fprintf(fp, "    Shared connection to %s: ports %d  Connects: %lu  Closed: %lu%s\n", psession->address, psession->nports, psession->nconnects, psession->nclosed, (plink->fd == INVALID_SOCKET) ? "  (not connected)" : "");
+		}
+		else if (plink->shared && dispatcher)
+		{
+			int i;
+			
+			epicsMutexMustLock(dispatcher->lock);
+			
+			for (i = 0; i < dispatcher->nsockets; i++)
+			{
+				const finsDispatchSocket * const psock = &dispatcher->socket[i];
+				
+				if (psock->fd == plink->fd)
+				{
+					fprintf(fp, "    Shared socket %d of %d: ports %d  Unknown senders: %lu\n", i, dispatcher->nsockets, psock->npeers, psock->nunknown);
+					
+#ifdef FINS_MMSG
+					if (psock->batch)
+					{
+						fprintf(fp, "    sendmmsg() calls: %lu  datagrams: %lu  errors: %lu\n", psock->batch->ncalls, psock->batch->nsent, psock->batch->nerrors);
+					}
+					
+					if (dispatcher->ring)
+					{
+						fprintf(fp, "    recvmmsg() calls: %lu  datagrams: %lu (all sockets)\n", dispatcher->ring->ncalls, dispatcher->ring->nreceived);
+					}
+#endif
+				}
+			}
+			
+			epicsMutexUnlock(dispatcher->lock);
+		}
+	}
+	
+	if (pdrvPvt->multi)
+	{
+		const finsMulti * const pmulti = pdrvPvt->multi;
+		
+		fprintf(fp, "    Poller every %.3fs: polls %lu, Multiple Memory Area Read frames %lu, words %lu, single reads %lu%s\n", pdrvPvt->pollPeriod, pmulti->npolls, pmulti->nframes, pmulti->nwords, pmulti->nfallbacks, (pmulti->disabled ? ", not supported" : ""));
+	}
+	
+	if (details > 0)
+	{
+		const finsBlock *pblock;
+		
+		epicsMutexMustLock(pdrvPvt->blockLock);
+		
+		for (pblock = (finsBlock *) ellFirst(&pdrvPvt->blockList); pblock; pblock = (finsBlock *) ellNext(&pblock->node))
+		{
+			fprintf(fp, "    Block %s %u-%u every %.3fs: %s, polls %lu, errors %lu, hits %lu\n", FINS_names[pblock->reason], pblock->start, pblock->start + pblock->nwords - 1, pblock->period, (pblock->valid ? "valid" : "invalid"), pblock->npolls, pblock->nerrors, pblock->nhits);
+		}
+		
+		epicsMutexUnlock(pdrvPvt->blockLock);
+	}
 }
 
 /**************************************************************************************************/
@@ -562,2779 +989,8741 @@ static asynStatus octetFlush(void *pvt, asynUser *pasynUser)
 {
 	const drvPvt * const pdrvPvt = (drvPvt *) pvt;
 	
-	pasynOctetSyncIO->flush(pdrvPvt->pasynUser);
+	if ((pdrvPvt->link == NULL) || (pdrvPvt->link->shared == 0))
+	{
+		pasynOctetSyncIO->flush(pdrvPvt->pasynUser);
+	}
 
 	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s\n", __func__, pdrvPvt->portName);
 
  	return (asynSuccess);
 }
-		
-/******************************************************************************/
-/*
-
-Standard FINS header. DA1 must be the target node address: the last byte of the IP address
 
+/**************************************************************************************************/
+/*
+	Message buffers
+	
+	Each request uses its own finsMsg so that requests from the port thread and the pollers can be
+	in flight at the same time. Buffers are kept on a free list and only allocated when it is empty.
 */
-/******************************************************************************/
 
-static void InitHeader(drvPvt * const pdrvPvt)
+static finsMsg *MsgGet(drvPvt * const pdrvPvt)
 {
-	pdrvPvt->message[ICF] = 0x80;
-	pdrvPvt->message[RSV] = 0x00;
-	pdrvPvt->message[GCT] = FINS_GATEWAY;
-
-	pdrvPvt->message[DNA] = 0x00;
-	pdrvPvt->message[DA1] = pdrvPvt->dnode;
-	pdrvPvt->message[DA2] = 0x00;
+	finsMsg *pmsg;
+	
+	epicsMutexMustLock(pdrvPvt->msgLock);
+	pmsg = (finsMsg *) ellGet(&pdrvPvt->msgFree);
+	epicsMutexUnlock(pdrvPvt->msgLock);
+	
+	if (pmsg == NULL)
+	{
+		pmsg = (finsMsg *) callocMustSucceed(1, sizeof(finsMsg), __func__);
+		pmsg->message = pmsg->buffer + FINS_SEND_FRAME_SIZE;
+	}
+	
+	return (pmsg);
+}
 
-	pdrvPvt->message[SNA] = 0x00;
-	pdrvPvt->message[SA1] = pdrvPvt->snode;
-	pdrvPvt->message[SA2] = 0x00;
+static void MsgPut(drvPvt * const pdrvPvt, finsMsg * const pmsg)
+{
+	epicsMutexMustLock(pdrvPvt->msgLock);
+	ellAdd(&pdrvPvt->msgFree, &pmsg->node);
+	epicsMutexUnlock(pdrvPvt->msgLock);
 }
 
-/**************************************************************************************************/
-/*
-	We only support word addresses, no bit addressing so COM+3 is zero
-	
-	address:	16-bit address
-	nelements:	number of 16-bit words to transfer
-*/
-/**************************************************************************************************/
+/* the bytes on the wire, which start with the FINS/TCP header for TCP */
 
-static void InitAddrSize(drvPvt * const pdrvPvt, const epicsUInt16 address, const epicsUInt16  nelements, const size_t asynSize)
+static epicsUInt8 *MsgFrame(const drvPvt * const pdrvPvt, finsMsg * const pmsg)
 {
-	pdrvPvt->message[COM+1] = address >> 8;
-	pdrvPvt->message[COM+2] = address & 0xff;
-	pdrvPvt->message[COM+3] = 0x00;
+	return ((pdrvPvt->type == FINS_TCP_type) ? pmsg->buffer : pmsg->message);
+}
 
-	pdrvPvt->message[COM+4] = (nelements * asynSize / sizeof(epicsUInt16)) >> 8;
-	pdrvPvt->message[COM+5] = (nelements * asynSize / sizeof(epicsUInt16)) & 0xff;
+static epicsUInt8 NextSid(drvPvt * const pdrvPvt)
+{
+	epicsUInt8 sid;
+	
+	epicsMutexMustLock(pdrvPvt->msgLock);
+	sid = ++pdrvPvt->sid;
+	epicsMutexUnlock(pdrvPvt->msgLock);
+	
+	return (sid);
 }
 
 /**************************************************************************************************/
 /*
-
-	Populate the FINS message based on pasynUser->reason
-	Called by finsRead
-
-	address	PLC source/destination address for memory/counter/timer commands
-	nelements	number of 16/32 words to read for memory/counter/timer commands
-	sendlen	calculated size of message
-	recvlen	expected size of reply
+	Pipelined FINS/UDP
+	
+	The link has its own socket. Requests are sent as soon as there is room in the window and the
+	caller then waits for its reply. A receive thread matches each reply to its request by the SID
+	and wakes up the caller. Replies with a SID nobody is waiting for, left over from requests which
+	timed out, are counted and dropped.
 */
-/**************************************************************************************************/
 
-static int BuildReadMessage(drvPvt * const pdrvPvt, asynUser *pasynUser, const size_t address, const size_t nelements, size_t *sendlen, size_t *recvlen)
-{
-	InitHeader(pdrvPvt);
+/* pass a reply to the request waiting for it. For FINS/TCP the frame starts with hdrlen bytes of header. */
 
-	switch (pasynUser->reason)
+static void LinkComplete(finsLink * const plink, const epicsUInt8 * const frame, const int recdlen, const int hdrlen)
+{
+	const epicsUInt8 * const buffer = frame + hdrlen;
+	finsPending *pending;
+	
+	epicsMutexMustLock(plink->lock);
+	
+	if (recdlen < hdrlen + MIN_RESP_LEN)
 	{
+		plink->nstale++;
+		epicsMutexUnlock(plink->lock);
+		
+		return;
+	}
 	
-	/* Memory read */
+	pending = &plink->pending[buffer[SID]];
 	
-		case FINS_DM_READ:
-		case FINS_AR_READ:
-		case FINS_IO_READ:
-		case FINS_WR_READ:
-		case FINS_HR_READ:
-		case FINS_EM0_READ ... FINS_EMF_READ:
-		case FINS_DM_WRITE:
-		case FINS_AR_WRITE:
-		case FINS_IO_WRITE:
-		{
-			pdrvPvt->mrc = 0x01;
-			pdrvPvt->src = 0x01;
-
-		/* memory type */
-
-			switch (pasynUser->reason)
-			{	
-				case FINS_DM_READ:
-				case FINS_DM_WRITE:
-				{
-					pdrvPvt->message[COM] = DM;
-					break;
-				}
-				
-				case FINS_AR_READ:
-				case FINS_AR_WRITE:
-				{
-					pdrvPvt->message[COM] = AR;
-					break;
-				}
-				
-				case FINS_IO_READ:
-				case FINS_IO_WRITE:
-				{
-					pdrvPvt->message[COM] = IO;
-					break;
-				}
-				
-				case FINS_WR_READ:
-				{
-					pdrvPvt->message[COM] = WR;
-					break;
-				}
-				
-				case FINS_HR_READ:
-				{
-					pdrvPvt->message[COM] = HR;
-					break;
-				}
-				
-				case FINS_EM0_READ:
-				{
-					pdrvPvt->message[COM] = E0;
-					break;
-				}
-				
-				case FINS_EM1_READ:
-				{
-					pdrvPvt->message[COM] = E1;
-					break;
-				}
-				
-				case FINS_EM2_READ:
-				{
-					pdrvPvt->message[COM] = E2;
-					break;
-				}
-				
-				case FINS_EM3_READ:
-				{
-					pdrvPvt->message[COM] = E3;
-					break;
-				}
-				
-				case FINS_EM4_READ:
-				{
-					pdrvPvt->message[COM] = E4;
-					break;
-				}
-				
-				case FINS_EM5_READ:
-				{
-					pdrvPvt->message[COM] = E5;
-					break;
-				}
-				
-				case FINS_EM6_READ:
-				{
-					pdrvPvt->message[COM] = E6;
-					break;
-				}
-				
-				case FINS_EM7_READ:
-				{
-					pdrvPvt->message[COM] = E7;
-					break;
-				}
-				
-				case FINS_EM8_READ:
-				{
-					pdrvPvt->message[COM] = E8;
-					break;
-				}
-				
-				case FINS_EM9_READ:
-				{
-					pdrvPvt->message[COM] = E9;
-					break;
-				}
-				
-				case FINS_EMA_READ:
-				{
-					pdrvPvt->message[COM] = EA;
-					break;
-				}
-				
-				case FINS_EMB_READ:
-				{
-					pdrvPvt->message[COM] = EB;
-					break;
-				}
-				
-				case FINS_EMC_READ:
-				{
-					pdrvPvt->message[COM] = EC;
-					break;
-				}
-				
-				case FINS_EMD_READ:
-				{
-					pdrvPvt->message[COM] = ED;
-					break;
-				}
-				
-				case FINS_EME_READ:
-				{
-					pdrvPvt->message[COM] = EE;
-					break;
-				}
-				
-				case FINS_EMF_READ:
-				{
-					pdrvPvt->message[COM] = EF;
-					break;
-				}
-				
-				default:
-				{
-					asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, bad switch line %d.\n", __func__, pdrvPvt->portName, __LINE__);
-					return (-1);
-				}
-			}
-			
-			InitAddrSize(pdrvPvt, address, nelements, sizeof(epicsUInt16));
-
-		/* send header + memory type + address + size, receiver header + data */
-				
-			*sendlen = COM + COMMAND_DATA_OFFSET;
-			*recvlen = RESP + sizeof(epicsUInt16) * nelements;
-			
-			break;
-		}
-
-		case FINS_DM_READ_32:
-		case FINS_AR_READ_32:
-		case FINS_IO_READ_32:
-		case FINS_DM_WRITE_32:
-		case FINS_AR_WRITE_32:
-		case FINS_IO_WRITE_32:
-		{
-			pdrvPvt->mrc = 0x01;
-			pdrvPvt->src = 0x01;
-
-		/* memory type */
-
-			switch (pasynUser->reason)
-			{	
-				case FINS_DM_READ_32:
-				case FINS_DM_WRITE_32:
-				{
-					pdrvPvt->message[COM] = DM;
-					break;
-				}
-				
-				case FINS_AR_READ_32:
-				case FINS_AR_WRITE_32:
-				{
-					pdrvPvt->message[COM] = AR;
-					break;
-				}
-				
-				case FINS_IO_READ_32:
-				case FINS_IO_WRITE_32:
-				{
-					pdrvPvt->message[COM] = IO;
-					break;
-				}
-				
-				default:
-				{
-					asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, bad switch line %d.\n", __func__, pdrvPvt->portName, __LINE__);
-					return (-1);
-				}
-			}
-
-			InitAddrSize(pdrvPvt, address, nelements, sizeof(epicsUInt32));
-			
-			*sendlen = COM + COMMAND_DATA_OFFSET;
-			*recvlen = RESP + sizeof(epicsUInt32) * nelements;
-			
-			break;
-		}
-
-		case FINS_MODEL:
-		{
-			pdrvPvt->mrc = 0x05;
-			pdrvPvt->src = 0x02;
-
-		/* address is unit number */
+	if (pending->pmsg && (buffer[MRC] == pending->pmsg->mrc) && (buffer[SRC] == pending->pmsg->src))
+	{
+		memcpy(pending->pmsg->message - hdrlen, frame, recdlen);
 		
-			pdrvPvt->message[COM + 0] = address & 0xff;
-			pdrvPvt->message[COM + 1] = 1;
-			
-			*sendlen = COM + 2;
-			*recvlen = RESP + 2 + FINS_MODEL_LEN;
-			
-			break;
-		}
+		pending->recdlen = recdlen;
+		pending->pmsg = NULL;
+		plink->nreplies++;
 		
-		case FINS_CPU_STATUS:
-		case FINS_CPU_MODE:
-		case FINS_CPU_FATAL:
-		case FINS_CPU_NONFATAL:
-		{
-			pdrvPvt->mrc = 0x06;
-			pdrvPvt->src = 0x01;
-			
-			*sendlen = COM;
-			*recvlen = RESP + FINS_CPU_STATE_LEN;
+		epicsEventSignal(pending->done);
+	}
+	else
+	{
+		plink->nstale++;
+	}
+	
+	epicsMutexUnlock(plink->lock);
+}
 
-			break;
-		}
+static void LinkReceive(void *pvt)
+{
+	drvPvt * const pdrvPvt = (drvPvt *) pvt;
+	finsLink * const plink = pdrvPvt->link;
+	epicsUInt8 *buffer = (epicsUInt8 *) callocMustSucceed(1, FINS_MAX_MSG, __func__);
 	
-		case FINS_CYCLE_TIME:
-		case FINS_CYCLE_TIME_MEAN:
-		case FINS_CYCLE_TIME_MAX:
-		case FINS_CYCLE_TIME_MIN:
+	while (1)
+	{
+		const int recdlen = recv(plink->fd, (char *) buffer, FINS_MAX_MSG, 0);
+		
+		if (recdlen < 0)
 		{
-			pdrvPvt->mrc = 0x06;
-			pdrvPvt->src = 0x20;
-
-			pdrvPvt->message[COM] = 0x01;
+			errlogPrintf("%s: port %s, recv() failed: %s\n", __func__, pdrvPvt->portName, strerror(SOCKERRNO));
+			epicsThreadSleep(1.0);
 			
-			*sendlen = COM + 1;
-			*recvlen = RESP + FINS_CYCLE_TIME_LEN * sizeof(epicsUInt32);
-			
-			break;
+			continue;
 		}
-
-		case FINS_CLOCK_READ:
-		{
-			pdrvPvt->mrc = 0x07;
-			pdrvPvt->src = 0x01;
-			
-			*sendlen = COM;
-			*recvlen = RESP + FINS_CLOCK_READ_LEN * sizeof(epicsUInt8);
 		
-			break;
-		}
+		LinkComplete(plink, buffer, recdlen, 0);
+	}
+}
 
-		case FINS_ECHO_TEST:
-		{
-			pdrvPvt->mrc = 0x08;
-			pdrvPvt->src = 0x01;
-			
-			pdrvPvt->message[COM + 0] = pdrvPvt->snode;
-			pdrvPvt->message[COM + 1] = pdrvPvt->snode;
-			pdrvPvt->message[COM + 2] = pdrvPvt->snode;
-			pdrvPvt->message[COM + 3] = pdrvPvt->snode;
-			
-			*sendlen = COM + 4;
-			*recvlen = RESP + sizeof(epicsUInt32);
-		
-			break;
-		}	
+/* wait for the reply to a request sent by LinkStart, or just release its SID if the send failed */
+
+static asynStatus LinkWait(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg, asynStatus status, size_t *recdlen)
+{
+	finsLink * const plink = pdrvPvt->link;
+	finsPending * const pending = &plink->pending[pmsg->sid];
+	
+/* with retransmits the time out is split between the sends, so a lost datagram costs only a share of it */
+
+	if (status == asynSuccess)
+	{
+		const int retransmits = plink->session ? 0 : pdrvPvt->retransmits;
+		int tries = 0;
 		
-		case FINS_MM_READ:
+		while (epicsEventWaitWithTimeout(pending->done, pasynUser->timeout / (retransmits + 1)) != epicsEventWaitOK)
 		{
-			int i;
-			MultiMemArea *MM;
-			
-			pdrvPvt->mrc = 0x01;
-			pdrvPvt->src = 0x04;
-						
-			MM = (MultiMemArea *) ellNth(&mmList, address + 1);
-						
-			for (i = 0; (i < nelements) && (MM->area[i]); i++)
+			if ((tries++ >= retransmits) || (LinkResend(pdrvPvt, pasynUser, pmsg) < 0))
 			{
-				pdrvPvt->message[COM + 4 * i + 0] = MM->area[i];
-				pdrvPvt->message[COM + 4 * i + 1] = MM->address[i] >> 8;
-				pdrvPvt->message[COM + 4 * i + 2] = MM->address[i] & 0xff;
-				pdrvPvt->message[COM + 4 * i + 3] = 0x00;
+				status = asynTimeout;
+				break;
 			}
-			
-			*sendlen = COM + 4 * i;
-			*recvlen = RESP + 3 * i;
-
-			break;
 		}
+	}
+	
+	epicsMutexMustLock(plink->lock);
+	
+/* the reply may have arrived after we timed out but before we got the lock */
+
+	if (pending->pmsg == pmsg)
+	{
+		pending->pmsg = NULL;
 		
-		default:
+	/* the PLC may still answer, so keep the SID out of use until that reply would be stale anyway */
+	
+		epicsTimeGetCurrent(&pending->quiet);
+		epicsTimeAddSeconds(&pending->quiet, pasynUser->timeout);
+		
+		if (status == asynTimeout)
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
-			return (-1);
+			plink->ntimeouts++;
 		}
 	}
-
-	pdrvPvt->message[MRC] = pdrvPvt->mrc;
-	pdrvPvt->message[SRC] = pdrvPvt->src;
-	pdrvPvt->message[SID] = ++pdrvPvt->sid;
-
-/* add the FINS TCP command */
-
-	if (pdrvPvt->type == FINS_TCP_type)
+	else if (pending->recdlen == 0)
 	{
+		epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize, "port %s, connection closed", pdrvPvt->portName);
+		status = asynError;
+	}
+	else
+	{
+		*recdlen = pending->recdlen;
+		status = asynSuccess;
+	}
 	
-	/* shift the data to make space for the FINS Frame Send Command */
+	plink->inflight--;
+	epicsEventSignal(plink->space);
 	
-		memmove(pdrvPvt->message + FINS_SEND_FRAME_SIZE, pdrvPvt->message, sizeof(pdrvPvt->message) - FINS_SEND_FRAME_SIZE);
-		
-		AddCommand(pdrvPvt, *sendlen, FINS_FRAME_SEND_COMMAND);
-			
-		*sendlen += FINS_SEND_FRAME_SIZE;
-		*recvlen += FINS_SEND_FRAME_SIZE;
-	}
-
-	return (0);
+	epicsMutexUnlock(plink->lock);
+	
+	return (status);
 }
 
-/**************************************************************************************************/
+static int LinkSend(finsLink * const plink, const finsMsg * const pmsg)
+{
+#ifdef FINS_MMSG
+	if (plink->batch)
+	{
+		return (BatchSend(plink, pmsg));
+	}
+#endif
+	if (plink->session)
+	{
+		return (SessionSend(plink->session, pmsg));
+	}
+	
+	if (plink->shared)
+	{
+		return (sendto(plink->fd, (char *) pmsg->message, pmsg->sendlen, 0, (struct sockaddr *) &plink->peer, sizeof(plink->peer)));
+	}
+	
+	return (send(plink->fd, (char *) pmsg->message, pmsg->sendlen, 0));
+}
 
 /*
-	check the response codes MRES & SRES, the SID, message codes and addresses
+	Send a request that has had no reply again, with the same SID so that a late reply to either
+	send completes it. The receive thread may write the reply into pmsg at any time, so the request
+	is copied while the lock is held.
 */
 
-static int CheckData(drvPvt * const pdrvPvt, asynUser *pasynUser)
+static int LinkResend(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg)
 {
+	finsLink * const plink = pdrvPvt->link;
+	finsMsg * const pcopy = MsgGet(pdrvPvt);
+	int n = 0;
 	
-/* check response code */
+	epicsMutexMustLock(plink->lock);
+	
+/* answered meanwhile, LinkWait will find the reply */
 
-	if (pdrvPvt->message[MRES] != 0x00)
+	if (plink->pending[pmsg->sid].pmsg != pmsg)
 	{
-		FINSerror(pdrvPvt, pasynUser, __func__, pdrvPvt->message[MRES], pdrvPvt->message[SRES]);
-		return (-1);
+		epicsMutexUnlock(plink->lock);
+		MsgPut(pdrvPvt, pcopy);
+		
+		return (0);
 	}
 	
-/* SID check - probably received a UDP packet out of order */
+	memcpy(pcopy->message, pmsg->message, pmsg->sendlen);
+	pcopy->sendlen = pmsg->sendlen;
 	
-	if (pdrvPvt->sid != pdrvPvt->message[SID])
-	{
-		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, SID %u sent, wrong SID %u received.\n", __func__, pdrvPvt->portName, (epicsUInt8) pdrvPvt->sid, (epicsUInt8) pdrvPvt->message[SID]);
-		return (-1);
-	}
+	plink->nsent++;
+	pdrvPvt->nretransmits++;
 	
-/* command check */
-
-	if ((pdrvPvt->message[MRC] != pdrvPvt->mrc) || (pdrvPvt->message[SRC] != pdrvPvt->src))
+	epicsMutexUnlock(plink->lock);
+	
+	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, no reply to SID %u, sending it again.\n", __func__, pdrvPvt->portName, (epicsUInt8) pmsg->sid);
+	
+	if ((n = LinkSend(plink, pcopy)) < 0)
 	{
-		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, wrong MRC/SRC received.\n", __func__, pdrvPvt->portName);
-		return (-1);
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, send() failed: %s\n", __func__, pdrvPvt->portName, strerror(SOCKERRNO));
 	}
 	
-/* source address check */
+	MsgPut(pdrvPvt, pcopy);
+	
+	return (n);
+}
+
+/*
+	A SID for a new request, called with the link lock held. After NextSid wraps, a late reply to a
+	request which timed out would complete whichever request has its SID, so those SIDs are passed
+	over until their quiet time is up, unless every free one is quiet.
+*/
+
+static epicsUInt8 LinkSid(drvPvt * const pdrvPvt, const finsLink * const plink)
+{
+	epicsTimeStamp now;
+	epicsUInt8 sid;
+	int i;
 	
-	if ((pdrvPvt->message[DA1] != pdrvPvt->snode) || (pdrvPvt->message[SA1] != pdrvPvt->dnode))
+	epicsTimeGetCurrent(&now);
+	
+	for (i = 0; i < 256; i++)
 	{
-		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, illegal source address received. %d = %d, %d = %d\n", __func__, pdrvPvt->portName, pdrvPvt->message[DA1], pdrvPvt->snode, pdrvPvt->message[SA1], pdrvPvt->dnode);
-		return (-1);
+		sid = NextSid(pdrvPvt);
+		
+		if ((plink->pending[sid].pmsg == NULL) && (epicsTimeDiffInSeconds(&now, &plink->pending[sid].quiet) >= 0.0))
+		{
+			return (sid);
+		}
 	}
+	
+/* there is always a free one because the window is smaller than 256 */
 
-	return (0);
+	do
+	{
+		sid = NextSid(pdrvPvt);
+	}
+	while (plink->pending[sid].pmsg);
+	
+	return (sid);
 }
 
-/**************************************************************************************************/
+/* send a request without waiting for the reply, so that a caller can have several in flight */
 
-static void UpdateTimes(drvPvt * const pdrvPvt, epicsTimeStamp *ets, epicsTimeStamp *ete)
+static asynStatus LinkStart(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg, size_t *sentlen)
 {
-	epicsTimeGetCurrent(ete);
+	finsLink * const plink = pdrvPvt->link;
+	finsPending *pending;
+	epicsUInt8 sid;
+	int n;
+	
+/* wait for room in the window */
 
-	{
-		const double diff = epicsTimeDiffInSeconds(ete, ets);
+	epicsMutexMustLock(plink->lock);
 	
-		if (pdrvPvt->tLast == -1)
-		{
-			pdrvPvt->tMax = diff;
-			pdrvPvt->tMin = diff;
-		}
-		else
+	while (plink->inflight >= plink->window)
+	{
+		epicsMutexUnlock(plink->lock);
+		
+		if (epicsEventWaitWithTimeout(plink->space, pasynUser->timeout) != epicsEventWaitOK)
 		{
-			if (diff > pdrvPvt->tMax) pdrvPvt->tMax = diff;
-			if (diff < pdrvPvt->tMin) pdrvPvt->tMin = diff;
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %d requests already in flight.\n", __func__, pdrvPvt->portName, plink->window);
+			return (asynTimeout);
 		}
 		
-		pdrvPvt->tLast = diff;
+		epicsMutexMustLock(plink->lock);
 	}
-}
-
-/**************************************************************************************************/
-/*
-	Form a FINS read message, send request, wait for the reply and check for errors
 	
-	This function knows about various message types an forms the correct message
-	and processes the reply based on pasynUser->reason.
+	sid = LinkSid(pdrvPvt, plink);
 	
-	data		epicsInt16, epicsInt32 or epicsFloat32
-	nelements	number of items to read
-	address	PLC memory address
-	transferred	normally the same as nelements
-	asynSize	sizeof(epicsInt16) for asynInt16Array or sizeof(epicsInt32) for asynInt32, asynInt32Array, asynFloat32Array, asynFloat64
-			defines the type of data to be returned to asyn
-*/
-/**************************************************************************************************/
-
-static int finsRead(drvPvt * const pdrvPvt, asynUser *pasynUser, void *data, const size_t nelements, const epicsUInt16 address, size_t *transferred, size_t asynSize)
-{
-	size_t sendlen = 0, sentlen = 0, recvlen = 0, recdlen = 0;
-	int eomReason = 0;
-	asynStatus status;
-	epicsTimeStamp ets, ete;
+	pmsg->message[SID] = pmsg->sid = sid;
+	
+	pending = &plink->pending[sid];
+	pending->pmsg = pmsg;
+	pending->recdlen = 0;
+	epicsEventTryWait(pending->done);
+	
+	plink->inflight++;
+	plink->nsent++;
+	
+/* pass the wake up on if there is still room */
 
-	if (nelements < 1)
+	if (plink->inflight < plink->window)
 	{
-		return (0);
+		epicsEventSignal(plink->space);
+	}
+	
+	epicsMutexUnlock(plink->lock);
+	
+	if ((n = LinkSend(plink, pmsg)) < 0)
+	{
+		size_t recdlen = 0;
+		
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, send() failed: %s\n", __func__, pdrvPvt->portName, strerror(SOCKERRNO));
+		
+		return (LinkWait(pdrvPvt, pasynUser, pmsg, asynError, &recdlen));
 	}
+	
+	*sentlen = n;
+	
+	return (asynSuccess);
+}
+
+/* send a request that the PLC won't reply to, under a SID that no request in flight is using */
 
-	if ((pdrvPvt->type == FINS_TCP_type) && (pdrvPvt->nodevalid != 1))
+static asynStatus LinkSendOnly(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg, size_t *sentlen)
+{
+	finsLink * const plink = pdrvPvt->link;
+	epicsUInt8 sid;
+	int n;
+	
+	epicsMutexMustLock(plink->lock);
+	
+	sid = LinkSid(pdrvPvt, plink);
+	
+	pmsg->message[SID] = pmsg->sid = sid;
+	plink->nsent++;
+	
+	epicsMutexUnlock(plink->lock);
+	
+	if ((n = LinkSend(plink, pmsg)) < 0)
 	{
-		if (FINSnodeRequest(pdrvPvt) < 0)
-		{
-			return (-1);
-		}
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, send() failed: %s\n", __func__, pdrvPvt->portName, strerror(SOCKERRNO));
+		return (asynError);
 	}
 	
-/* return the size of the message to write and the expected size of the message to read */
+	*sentlen = n;
+	
+	return (asynSuccess);
+}
 
-	if (BuildReadMessage(pdrvPvt, pasynUser, address, nelements, &sendlen, &recvlen) < 0)
+static finsLink *LinkAlloc(const int window)
+{
+	finsLink * const plink = (finsLink *) callocMustSucceed(1, sizeof(finsLink), __func__);
+	int i;
+	
+	plink->window = (window > 255) ? 255 : window;
+	plink->lock = epicsMutexMustCreate();
+	plink->space = epicsEventMustCreate(epicsEventEmpty);
+	
+	for (i = 0; i < 256; i++)
 	{
-		return (-1);
+		plink->pending[i].done = epicsEventMustCreate(epicsEventEmpty);
 	}
+	
+	return (plink);
+}
 
-/* using %lu and casting to unsigned long instead of using %zu because of our old PPC/vxWorks gcc compiler */
+/* undo LinkAlloc for a link that never got going */
 
-	asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, (char *) pdrvPvt->message, sendlen, "%s: port %s, sending %lu bytes, expecting %lu bytes.\n", __func__, pdrvPvt->portName, (unsigned long) sendlen, (unsigned long) recvlen);
+static void LinkFree(finsLink *plink)
+{
+	int i;
 	
-	if (pasynUser->timeout <= 0.0)
+	for (i = 0; i < 256; i++)
 	{
-		 pasynUser->timeout = FINS_TIMEOUT;
+		epicsEventDestroy(plink->pending[i].done);
 	}
 	
-	epicsTimeGetCurrent(&ets);
-	
-	status = pasynOctetSyncIO->writeRead(pdrvPvt->pasynUser, (char *) pdrvPvt->message, sendlen, (char *) pdrvPvt->message, recvlen, pasynUser->timeout, &sentlen, &recdlen, &eomReason);
+	epicsEventDestroy(plink->space);
+	epicsMutexDestroy(plink->lock);
+	free(plink);
+}
 
-	UpdateTimes(pdrvPvt, &ets, &ete);
+static int LinkCreate(drvPvt * const pdrvPvt, const char *address, const int window)
+{
+	finsLink *plink;
+	struct sockaddr_in peer;
+	char name[64];
 	
-	switch (status)
+	if (aToIPAddr(address, FINS_NET_PORT, &peer) < 0)
 	{
-		case asynSuccess:
-		{
-			break;
-		}
-		
-		case asynTimeout:
-		case asynOverflow:
-		case asynError:
-		case asynDisconnected:
-		case asynDisabled:
-		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, writeRead() failed with %s.\n", __func__, pdrvPvt->portName, asynStatusMessages[status]);
-			return (-1);
-		}
-		
-		default:
-		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, unknown asyn return code %d.\n", __func__, pdrvPvt->portName, status);
-			return (-1);
-		}
+		errlogPrintf("%s: port %s, bad IP address %s\n", __func__, pdrvPvt->portName, address);
+		return (-1);
 	}
+	
+	plink = LinkAlloc(window);
+	
+	if ((plink->fd = epicsSocketCreate(AF_INET, SOCK_DGRAM, 0)) == INVALID_SOCKET)
+	{
+		errlogPrintf("%s: port %s, can't create socket: %s\n", __func__, pdrvPvt->portName, strerror(SOCKERRNO));
+		LinkFree(plink);
+		return (-1);
+	}
+	
+/* connect() so that we only receive datagrams from the PLC */
 
-	asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, (char *) pdrvPvt->message, recdlen, "%s: port %s, received %lu bytes.\n", __func__, pdrvPvt->portName, (unsigned long) recdlen);
-
-	if (sentlen != sendlen)
+	if (connect(plink->fd, (struct sockaddr *) &peer, sizeof(peer)) < 0)
 	{
-		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, writeRead() write failed. %lu != %lu\n", __func__, pdrvPvt->portName, (unsigned long) sentlen, (unsigned long) sendlen);
+		errlogPrintf("%s: port %s, can't connect to %s: %s\n", __func__, pdrvPvt->portName, address, strerror(SOCKERRNO));
+		epicsSocketDestroy(plink->fd);
+		LinkFree(plink);
 		return (-1);
 	}
 	
-	if (recdlen != recvlen)
+	pdrvPvt->link = plink;
+	
+	epicsSnprintf(name, sizeof(name), "%s_L", pdrvPvt->portName);
+	
+	if (epicsThreadCreate(name, epicsThreadPriorityHigh, epicsThreadGetStackSize(epicsThreadStackMedium), LinkReceive, pdrvPvt) == NULL)
 	{
-		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, writeRead() read failed.\n", __func__, pdrvPvt->portName);
+		errlogPrintf("%s: port %s, can't create receive thread\n", __func__, pdrvPvt->portName);
+		pdrvPvt->link = NULL;
+		epicsSocketDestroy(plink->fd);
+		LinkFree(plink);
 		return (-1);
 	}
+	
+	return (0);
+}
 
-/* check and strip the TCP FINS header */
+/**************************************************************************************************/
+/*
+	Shared FINS/UDP
+	
+	Ports created by finsUDPSharedInit have no parent asyn port, socket or receive thread of their
+	own. Their links send with sendto() on one of the dispatcher's unconnected sockets, and a single
+	thread waits on all of them, with epoll on Linux and select() elsewhere. It finds the link by
+	the reply's source address and the link finds the request by the SID, as for a pipelined link.
+	The sockets are created when the first shared port is, finsDispatcherInit can set how many.
+	
+	On Linux the system calls can be batched. Requests are copied into the socket's queue and the
+	thread which finds nobody sending calls sendmmsg() for everything queued, including requests
+	queued by other threads while it is in the system call. Replies are read with recvmmsg() into
+	a ring of buffers. A request that fails to send isn't reported to the caller, which times out.
+*/
 
-	if (pdrvPvt->type == FINS_TCP_type)
+#ifdef FINS_MMSG
+
+static finsBatch *BatchCreate(void)
+{
+	finsBatch * const pbatch = (finsBatch *) callocMustSucceed(1, sizeof(finsBatch), __func__);
+	int b, i;
+	
+	pbatch->lock = epicsMutexMustCreate();
+	
+	for (b = 0; b < 2; b++)
 	{
-		const unsigned int ferror = BSWAP32(((unsigned int *) pdrvPvt->message)[FINS_MODE_ERROR]);
-		 
-		if (ferror != FINS_ERROR_NORMAL) 
+		for (i = 0; i < FINS_BATCH; i++)
 		{
-			pasynCommonSyncIO->disconnectDevice(pdrvPvt->pasynUserCommon);
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, FINS Frame Send error 0x%x.\n", __func__, pdrvPvt->portName, ferror);
-			
-			return (-1);
+			pbatch->iov[b][i].iov_base = pbatch->buffer[b][i];
+			pbatch->msgs[b][i].msg_hdr.msg_iov = &pbatch->iov[b][i];
+			pbatch->msgs[b][i].msg_hdr.msg_iovlen = 1;
+			pbatch->msgs[b][i].msg_hdr.msg_name = &pbatch->to[b][i];
+			pbatch->msgs[b][i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
 		}
-		
-		memmove(pdrvPvt->message, pdrvPvt->message + FINS_SEND_FRAME_SIZE, sizeof(pdrvPvt->message) - FINS_SEND_FRAME_SIZE);
 	}
 	
-	if (CheckData(pdrvPvt, pasynUser) < 0)
+	return (pbatch);
+}
+
+static finsRing *RingCreate(void)
+{
+	finsRing * const pring = (finsRing *) callocMustSucceed(1, sizeof(finsRing), __func__);
+	int i;
+	
+	for (i = 0; i < FINS_BATCH; i++)
 	{
-		return (-1);
+		pring->iov[i].iov_base = pring->buffer[i];
+		pring->iov[i].iov_len = FINS_MAX_MSG;
+		pring->msgs[i].msg_hdr.msg_iov = &pring->iov[i];
+		pring->msgs[i].msg_hdr.msg_iovlen = 1;
+		pring->msgs[i].msg_hdr.msg_name = &pring->from[i];
 	}
+	
+	return (pring);
+}
 
-/* extract data */
+/* queue a request, and send the queue unless another thread is already doing so */
 
-	switch (pasynUser->reason)
+static int BatchSend(finsLink * const plink, const finsMsg * const pmsg)
+{
+	finsBatch * const pbatch = plink->batch;
+	int i;
+	
+	epicsMutexMustLock(pbatch->lock);
+	
+/* both banks in use, don't wait */
+
+	if (pbatch->n[pbatch->bank] == FINS_BATCH)
 	{
-		case FINS_DM_READ:
-		case FINS_AR_READ:
-		case FINS_IO_READ:
-		case FINS_WR_READ:
-		case FINS_HR_READ:
-		case FINS_EM0_READ ... FINS_EMF_READ:
-		case FINS_DM_WRITE:
-		case FINS_AR_WRITE:
-		case FINS_IO_WRITE:
+		epicsMutexUnlock(pbatch->lock);
+		
+		return (sendto(plink->fd, (char *) pmsg->message, pmsg->sendlen, 0, (struct sockaddr *) &plink->peer, sizeof(plink->peer)));
+	}
+	
+	i = pbatch->n[pbatch->bank]++;
+	
+	memcpy(pbatch->buffer[pbatch->bank][i], pmsg->message, pmsg->sendlen);
+	pbatch->iov[pbatch->bank][i].iov_len = pmsg->sendlen;
+	pbatch->to[pbatch->bank][i] = plink->peer;
+	
+	if (pbatch->flushing)
+	{
+		epicsMutexUnlock(pbatch->lock);
+		return (pmsg->sendlen);
+	}
+	
+	pbatch->flushing = 1;
+	
+	while (pbatch->n[pbatch->bank] > 0)
+	{
+		const int bank = pbatch->bank;
+		const int n = pbatch->n[bank];
+		int sent = 0, calls = 0;
+		
+		pbatch->bank ^= 1;
+		
+		epicsMutexUnlock(pbatch->lock);
+		
+		while (sent < n)
 		{
-			int i;
-			epicsUInt16 *ptrs = (epicsUInt16 *) &pdrvPvt->message[RESP];
+			const int r = sendmmsg(plink->fd, &pbatch->msgs[bank][sent], n - sent, 0);
 			
-		/* asynInt16Array */
-		
-			if (asynSize == sizeof(epicsUInt16))
+			if (r < 0)
 			{
-				epicsUInt16 *ptrd = (epicsUInt16 *) data;
-
-				for (i = 0; i < nelements; i++)
+				if (SOCKERRNO == SOCK_EINTR)
 				{
-					ptrd[i] = (epicsUInt16) BSWAP16(ptrs[i]);
+					continue;
 				}
+				
+				errlogPrintf("%s: sendmmsg() failed: %s\n", __func__, strerror(SOCKERRNO));
+				break;
 			}
-			else
 			
-		/* asynInt32 * 1 */
+			sent += r;
+			calls++;
+		}
 		
-			{			
-				epicsUInt32 *ptrd = (epicsUInt32 *) data;
+		epicsMutexMustLock(pbatch->lock);
+		
+		pbatch->n[bank] = 0;
+		pbatch->ncalls += calls;
+		pbatch->nsent += sent;
+		pbatch->nerrors += n - sent;
+	}
+	
+	pbatch->flushing = 0;
+	
+	epicsMutexUnlock(pbatch->lock);
+	
+	return (pmsg->sendlen);
+}
 
-				for (i = 0; i < nelements; i++)
-				{
-					ptrd[i] = (epicsUInt32) BSWAP16(ptrs[i]);
-				}
-			}
+#endif
 
-			asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s: port %s, %s %lu 16-bit word(s).\n", __func__, pdrvPvt->portName, SWAPT, (unsigned long) nelements);
-			
-			break;
-		}
+static int DispatchPeerCompare(const void *a, const void *b)
+{
+	const finsDispatchPeer * const pa = (const finsDispatchPeer *) a;
+	const finsDispatchPeer * const pb = (const finsDispatchPeer *) b;
+	
+	if (pa->ip != pb->ip)
+	{
+		return ((pa->ip < pb->ip) ? -1 : 1);
+	}
+	
+	return ((int) pa->port - (int) pb->port);
+}
 
-		case FINS_DM_READ_32:
-		case FINS_AR_READ_32:
-		case FINS_IO_READ_32:
-		case FINS_DM_WRITE_32:
-		case FINS_AR_WRITE_32:
-		case FINS_IO_WRITE_32:
-		{		
-			int i;
-			epicsUInt32 *ptrs = (epicsUInt32 *) &pdrvPvt->message[RESP];
-			epicsUInt32 *ptrd = (epicsUInt32 *) data;
+/* pass a datagram to the link of the port for the PLC it came from */
 
-			for (i = 0; i < nelements; i++)
+static void DispatchDeliver(finsDispatcher * const pdisp, finsDispatchSocket * const psock, const struct sockaddr_in * const from, const epicsUInt8 * const buffer, const int recdlen)
+{
+	finsDispatchPeer key, *ppeer;
+	finsLink *plink = NULL;
+	
+	key.ip = from->sin_addr.s_addr;
+	key.port = from->sin_port;
+	
+	epicsMutexMustLock(pdisp->lock);
+	
+	if ((ppeer = (finsDispatchPeer *) bsearch(&key, psock->peers, psock->npeers, sizeof(finsDispatchPeer), DispatchPeerCompare)))
+	{
+		plink = ppeer->plink;
+	}
+	else
+	{
+		psock->nunknown++;
+	}
+	
+	epicsMutexUnlock(pdisp->lock);
+	
+	if (plink)
+	{
+		LinkComplete(plink, buffer, recdlen, 0);
+	}
+}
+
+static void DispatchReceive(void *pvt)
+{
+	finsDispatcher * const pdisp = (finsDispatcher *) pvt;
+	epicsUInt8 *buffer = (epicsUInt8 *) callocMustSucceed(1, FINS_MAX_MSG, __func__);
+	
+	while (1)
+	{
+		int ready[FINS_DISPATCH_MAX_SOCKETS];
+		int i;
+#ifdef FINS_EPOLL
+		struct epoll_event events[FINS_DISPATCH_MAX_SOCKETS];
+		int n;
+		
+		if ((n = epoll_wait(pdisp->epfd, events, FINS_DISPATCH_MAX_SOCKETS, -1)) < 0)
+		{
+			if (errno != EINTR)
 			{
-				ptrd[i] = WSWAP32(ptrs[i]);
+				errlogPrintf("%s: epoll_wait() failed: %s\n", __func__, strerror(errno));
+				epicsThreadSleep(1.0);
 			}
-				
-			asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s: port %s, swapping %lu 32-bit word(s).\n", __func__, pdrvPvt->portName, (unsigned long) nelements);
 			
-			break;
+			continue;
 		}
 		
-/* return a string of 20 chars, packed as two characters per word */
-
-		case FINS_MODEL:
-		{
-			memcpy(data, &pdrvPvt->message[RESP + 2], nelements);
-			
-			break;
-		}
-
-/* return status - epicsInt32 */
-
-		case FINS_CPU_STATUS:
-		{
-			*(epicsInt32 *)(data) = pdrvPvt->message[RESP + 0];
-			
-			break;
-		}
-		
-/* return mode - epicsInt32 */
-
-		case FINS_CPU_MODE:
-		{
-			*(epicsInt32 *)(data) = pdrvPvt->message[RESP + 1];			
-			
-			break;
-		}
-
-		case FINS_CPU_FATAL:
-		{
-			epicsUInt16 *ptrs = (epicsUInt16 *) &pdrvPvt->message[RESP + 2];
-			epicsUInt32 *ptrd = (epicsUInt32 *) data;
-			
-			*ptrd = BSWAP16(*ptrs);
-
-			break;
-		}
-
-		case FINS_CPU_NONFATAL:
-		{
-			epicsUInt16 *ptrs = (epicsUInt16 *) &pdrvPvt->message[RESP + 4];
-			epicsUInt32 *ptrd = (epicsUInt32 *) data;
-			
-			*ptrd = BSWAP16(*ptrs);
-			
-			break;
-		}
-
-/* return 3 parameters - epicsInt32 */
-
-		case FINS_CYCLE_TIME:
-		{
-			int i;
-			epicsInt32 *rep = (epicsInt32 *) &pdrvPvt->message[RESP + 0];
-			epicsInt32 *dat = (epicsInt32 *) data;
-
-			for (i = 0; i < nelements; i++)
-			{
-				dat[i] = BSWAP32(rep[i]);
-			}
-				
-			break;
-		}
+		memset(ready, 0, sizeof(ready));
 		
-/* return mean - epicsInt32 */
-
-		case FINS_CYCLE_TIME_MEAN:
+		for (i = 0; i < n; i++)
 		{
-			const epicsInt32 *rep = (epicsInt32 *) &pdrvPvt->message[RESP + 0];
-
-			*(epicsInt32 *)(data) = BSWAP32(*rep);
-
-			break;
+			ready[events[i].data.u32] = 1;
 		}
+#else
+		fd_set readfds;
+		SOCKET maxfd = 0;
 		
-/* return max - epicsInt32 */
-
-		case FINS_CYCLE_TIME_MAX:
-		{
-			const epicsInt32 *rep = (epicsInt32 *) &pdrvPvt->message[RESP + 4];
-
-			*(epicsInt32 *)(data) = BSWAP32(*rep);
-			
-			break;
-		}
+		FD_ZERO(&readfds);
 		
-/* return min - epicsInt32 */
-
-		case FINS_CYCLE_TIME_MIN:
-		{
-			const epicsInt32 *rep = (epicsInt32 *) &pdrvPvt->message[RESP + 8];
-
-			*(epicsInt32 *)(data) = BSWAP32(*rep);
-
-			break;
-		}
-
-/* asynInt16array */
-
-		case FINS_CLOCK_READ:	/* convert from BCD to dec */
+		for (i = 0; i < pdisp->nsockets; i++)
 		{
-			epicsInt8  *rep = (epicsInt8 *)  &pdrvPvt->message[RESP + 0];
-			epicsInt16 *dat = (epicsInt16 *) data;
-			int i;
+			FD_SET(pdisp->socket[i].fd, &readfds);
 			
-			for (i = 0; i < nelements; i++)
+			if (pdisp->socket[i].fd > maxfd)
 			{
-				*dat++ = *rep++;
+				maxfd = pdisp->socket[i].fd;
 			}
-
-			break;
-		}
-
-		case FINS_ECHO_TEST:
-		{
-			const epicsInt32 *rep = (epicsInt32 *) &pdrvPvt->message[RESP + 0];
-
-			*(epicsInt32 *)(data) = BSWAP32(*rep);
-			
-			break;
 		}
-				
-		case FINS_MM_READ:
+		
+		if (select(maxfd + 1, &readfds, NULL, NULL, NULL) < 0)
 		{
-			int i;
-			MultiMemAreaPair *ptrs = (MultiMemAreaPair *) &pdrvPvt->message[RESP];
-			epicsUInt16 *ptrd = (epicsUInt16 *) data;
-			
-			for (i = 0; i < nelements; i++)
+			if (SOCKERRNO != SOCK_EINTR)
 			{
-				ptrd[i] = (epicsUInt16) BSWAP16(ptrs[i].address);
+				errlogPrintf("%s: select() failed: %s\n", __func__, strerror(SOCKERRNO));
+				epicsThreadSleep(1.0);
 			}
 			
-			break;
+			continue;
 		}
 		
-		default:
+		for (i = 0; i < pdisp->nsockets; i++)
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
-			return (-1);
+			ready[i] = FD_ISSET(pdisp->socket[i].fd, &readfds);
 		}
-	}
-	
-	if (transferred) *transferred = nelements;
-
-	return (0);	
-}
-
-/**************************************************************************************************/
-
-static int BuildWriteMessage(drvPvt * const pdrvPvt, asynUser *pasynUser, const epicsUInt16 address, const size_t nelements, size_t *sendlen, size_t *recvlen, const size_t asynSize, const void *data)
-{
-	InitHeader(pdrvPvt);
-	
-	switch (pasynUser->reason)
-	{
-	
-	/* Memory write */
-	
-		case FINS_DM_WRITE:
-		case FINS_DM_WRITE_NOREAD:
-		case FINS_AR_WRITE:
-		case FINS_AR_WRITE_NOREAD:
-		case FINS_IO_WRITE:
-		case FINS_IO_WRITE_NOREAD:
+#endif
+		
+		for (i = 0; i < pdisp->nsockets; i++)
 		{
-			pdrvPvt->mrc = 0x01;
-			pdrvPvt->src = 0x02;
-				
-			switch (pasynUser->reason)
-			{	
-				case FINS_DM_WRITE:
-				case FINS_DM_WRITE_NOREAD:
-				{
-					pdrvPvt->message[COM] = DM;
-					break;
-				}
-				
-				case FINS_AR_WRITE:
-				case FINS_AR_WRITE_NOREAD:
-				{
-					pdrvPvt->message[COM] = AR;
-					break;
-				}
-				
-				case FINS_IO_WRITE:
-				case FINS_IO_WRITE_NOREAD:
-				{
-					pdrvPvt->message[COM] = IO;
-					break;
-				}
-				
-				default:
-				{
-					asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, bad switch.\n", __func__, pdrvPvt->portName);
-					return (-1);
-				}
-			}
+			finsDispatchSocket * const psock = &pdisp->socket[i];
+			struct sockaddr_in from;
+			osiSocklen_t fromlen = sizeof(from);
+			int recdlen;
 			
-			InitAddrSize(pdrvPvt, address, nelements, sizeof(epicsUInt16));
-
-		/* asynInt16Array */
-		
-			if (asynSize == sizeof(epicsUInt16))
+			if (!ready[i])
 			{
-				int i;
-				epicsUInt16 *ptrd = (epicsUInt16 *) &pdrvPvt->message[COM + COMMAND_DATA_OFFSET];
-				epicsUInt16 *ptrs = (epicsUInt16 *) data;
-
-				for (i = 0; i < nelements; i++)
-				{
-					ptrd[i] = BSWAP16(ptrs[i]);
-				}
-
-				asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s: port %s, %s %lu 16-bit word(s).\n", __func__, pdrvPvt->portName, SWAPT, (unsigned long) nelements);
+				continue;
 			}
-			else
 			
-		/* asynInt32 * 1 */
+#ifdef FINS_MMSG
+		/* everything that has arrived, without waiting for more */
 		
+			if (pdisp->ring)
 			{
-				int i;
-				epicsUInt16 *ptrd = (epicsUInt16 *) &pdrvPvt->message[COM + COMMAND_DATA_OFFSET];
-				epicsUInt32 *ptrs = (epicsUInt32 *) data;
-
-				for (i = 0; i < nelements; i++)
-				{
-					ptrd[i] = BSWAP16((epicsUInt16) ptrs[i]);
-				}
-
-				asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s: port %s, %s %lu 16-bit word(s).\n", __func__, pdrvPvt->portName, SWAPT, (unsigned long) nelements);
-			}
-			
-			*sendlen = COM + COMMAND_DATA_OFFSET + nelements * sizeof(epicsUInt16);
-			*recvlen = RESP + 0;
-						
-			break;
-		}
-
-		case FINS_DM_WRITE_32:
-		case FINS_DM_WRITE_32_NOREAD:
-		case FINS_AR_WRITE_32:
-		case FINS_AR_WRITE_32_NOREAD:
-		case FINS_IO_WRITE_32:
-		case FINS_IO_WRITE_32_NOREAD:
-		{
-			pdrvPvt->mrc = 0x01;
-			pdrvPvt->src = 0x02;
+				finsRing * const pring = pdisp->ring;
+				int j, n;
 				
-		/* memory type */
-
-			switch (pasynUser->reason)
-			{	
-				case FINS_DM_WRITE_32:
-				case FINS_DM_WRITE_32_NOREAD:
+				for (j = 0; j < FINS_BATCH; j++)
 				{
-					pdrvPvt->message[COM] = DM;
-					break;
+					pring->msgs[j].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
 				}
 				
-				case FINS_AR_WRITE_32:
-				case FINS_AR_WRITE_32_NOREAD:
+				if ((n = recvmmsg(psock->fd, pring->msgs, FINS_BATCH, MSG_DONTWAIT, NULL)) < 0)
 				{
-					pdrvPvt->message[COM] = AR;
-					break;
+					if ((SOCKERRNO != SOCK_EINTR) && (SOCKERRNO != EAGAIN))
+					{
+						errlogPrintf("%s: socket %d, recvmmsg() failed: %s\n", __func__, i, strerror(SOCKERRNO));
+					}
+					
+					continue;
 				}
 				
-				case FINS_IO_WRITE_32:
-				case FINS_IO_WRITE_32_NOREAD:
-				{
-					pdrvPvt->message[COM] = IO;
-					break;
-				}
+				pring->ncalls++;
+				pring->nreceived += n;
 				
-				default:
+				for (j = 0; j < n; j++)
 				{
-					return (-1);
+					DispatchDeliver(pdisp, psock, &pring->from[j], pring->buffer[j], pring->msgs[j].msg_len);
 				}
+				
+				continue;
 			}
+#endif
 			
-			InitAddrSize(pdrvPvt, address, nelements, sizeof(epicsUInt32));
-			
-		/* convert data  */
-
+			if ((recdlen = recvfrom(psock->fd, (char *) buffer, FINS_MAX_MSG, 0, (struct sockaddr *) &from, &fromlen)) < 0)
 			{
-				int i;
-				epicsUInt32 *ptrd = (epicsUInt32 *) &pdrvPvt->message[COM + COMMAND_DATA_OFFSET];
-				epicsUInt32 *ptrs = (epicsUInt32 *) data;
-				
-				for (i = 0; i < nelements; i++)
-				{
-					ptrd[i] = WSWAP32(ptrs[i]);
-				}
-				
-				asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s: port %s, swapping %lu 32-bit word(s).\n", __func__, pdrvPvt->portName, (unsigned long) nelements);
+				errlogPrintf("%s: socket %d, recvfrom() failed: %s\n", __func__, i, strerror(SOCKERRNO));
+				continue;
 			}
-
-			*sendlen = COM + COMMAND_DATA_OFFSET + nelements * sizeof(epicsUInt32);
-			*recvlen = RESP + 0;
 			
-			break;
+			DispatchDeliver(pdisp, psock, &from, buffer, recdlen);
 		}
+	}
+}
 
-	/* cycle time reset */
+static finsDispatcher *DispatchCreate(void)
+{
+	finsDispatcher * const pdisp = (finsDispatcher *) callocMustSucceed(1, sizeof(finsDispatcher), __func__);
+	int i;
 	
-		case FINS_CYCLE_TIME_RESET:
+#ifdef FINS_EPOLL
+	if ((pdisp->epfd = epoll_create(FINS_DISPATCH_MAX_SOCKETS)) < 0)
+	{
+		errlogPrintf("%s: epoll_create() failed: %s\n", __func__, strerror(errno));
+		free(pdisp);
+		return (NULL);
+	}
+#endif
+	
+	pdisp->lock = epicsMutexMustCreate();
+	
+	for (i = 0; i < dispatchSockets; i++)
+	{
+		struct sockaddr_in local;
+		SOCKET fd;
+		
+		if ((fd = epicsSocketCreate(AF_INET, SOCK_DGRAM, 0)) == INVALID_SOCKET)
 		{
-			pdrvPvt->mrc = 0x06;
-			pdrvPvt->src = 0x20;
-			pdrvPvt->message[COM] = 0x00;
-			
-			*sendlen = COM + 1;
-			*recvlen = RESP + 0;
-			
+			errlogPrintf("%s: can't create socket: %s\n", __func__, strerror(SOCKERRNO));
 			break;
 		}
+		
+#if !defined(FINS_EPOLL) && !defined(_WIN32)
+		if (fd >= FD_SETSIZE)
+		{
+			errlogPrintf("%s: socket %d is too large for select()\n", __func__, (int) fd);
+			epicsSocketDestroy(fd);
+			break;
+		}
+#endif
+		
+	/* bind to an ephemeral port now, the receive thread waits on sockets that haven't sent yet */
 	
-	/* clear all bits that have been forced on or off */
-	
-		case FINS_SET_RESET_CANCEL:
+		memset(&local, 0, sizeof(local));
+		local.sin_family = AF_INET;
+		local.sin_addr.s_addr = htonl(INADDR_ANY);
+		local.sin_port = 0;
+		
+		if (bind(fd, (struct sockaddr *) &local, sizeof(local)) < 0)
 		{
-			pdrvPvt->mrc = 0x23;
-			pdrvPvt->src = 0x02;
+			errlogPrintf("%s: can't bind socket: %s\n", __func__, strerror(SOCKERRNO));
+			epicsSocketDestroy(fd);
+			break;
+		}
+		
+#ifdef FINS_EPOLL
+		{
+			struct epoll_event event;
 			
-			*sendlen = COM + 0;
-			*recvlen = RESP + 0;
+			memset(&event, 0, sizeof(event));
+			event.events = EPOLLIN;
+			event.data.u32 = pdisp->nsockets;
 			
-			break;
+			if (epoll_ctl(pdisp->epfd, EPOLL_CTL_ADD, fd, &event) < 0)
+			{
+				errlogPrintf("%s: epoll_ctl() failed: %s\n", __func__, strerror(errno));
+				epicsSocketDestroy(fd);
+				break;
+			}
 		}
+#endif
 		
-		default:
+		pdisp->socket[pdisp->nsockets].fd = fd;
+		
+#ifdef FINS_MMSG
+		if (dispatchBatch)
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, command %s not supported.\n", __func__, pdrvPvt->portName, FINS_names[pasynUser->reason]);
-			return (-1);
+			pdisp->socket[pdisp->nsockets].batch = BatchCreate();
 		}
+#endif
+		pdisp->nsockets++;
 	}
 	
-	pdrvPvt->message[MRC] = pdrvPvt->mrc;
-	pdrvPvt->message[SRC] = pdrvPvt->src;
-	pdrvPvt->message[SID] = ++pdrvPvt->sid;
-
-/* add the FINS TCP command */
-
-	if (pdrvPvt->type == FINS_TCP_type)
+	if (pdisp->nsockets == 0)
 	{
+#ifdef FINS_EPOLL
+		close(pdisp->epfd);
+#endif
+		epicsMutexDestroy(pdisp->lock);
+		free(pdisp);
+		return (NULL);
+	}
 	
-	/* shift the data to make space for the FINS Frame Send Command */
+#ifdef FINS_MMSG
+	if (dispatchBatch)
+	{
+		pdisp->ring = RingCreate();
+	}
+#endif
 	
-		memmove(pdrvPvt->message + FINS_SEND_FRAME_SIZE, pdrvPvt->message, sizeof(pdrvPvt->message) - FINS_SEND_FRAME_SIZE);
-		
-		AddCommand(pdrvPvt, *sendlen, FINS_FRAME_SEND_COMMAND);
-			
-		*sendlen += FINS_SEND_FRAME_SIZE;
-		*recvlen += FINS_SEND_FRAME_SIZE;
+	if (epicsThreadCreate("finsDispatch", epicsThreadPriorityHigh, epicsThreadGetStackSize(epicsThreadStackMedium), DispatchReceive, pdisp) == NULL)
+	{
+		errlogPrintf("%s: can't create dispatcher thread\n", __func__);
+		return (NULL);
 	}
-		
-	return (0);
+	
+	return (pdisp);
 }
 
-/**************************************************************************************************/
-/*
-	asynSize is either sizeof(epicsInt16) for asynInt16Array or sizeof(epicsInt32) for asynInt16Array and asynInt32Array.
-*/
-/**************************************************************************************************/
-	
-static int finsWrite(drvPvt * const pdrvPvt, asynUser *pasynUser, const void *data, const size_t nelements, const epicsUInt16 address, const size_t asynSize)
-{
-	size_t sendlen = 0, sentlen = 0, recvlen = 0, recdlen = 0;
-	int eomReason = 0;
-	asynStatus status;
-	epicsTimeStamp ets, ete;
+/* give the port a link on the least used socket that doesn't already have a port for the same PLC */
 
-	if ((pdrvPvt->type == FINS_TCP_type) && (pdrvPvt->nodevalid != 1))
+static int DispatchAdd(drvPvt * const pdrvPvt, const char *address, const int window)
+{
+	finsLink *plink;
+	struct sockaddr_in addr;
+	finsDispatchPeer peer;
+	finsDispatchSocket *psock = NULL;
+	int i;
+	
+	if (aToIPAddr(address, FINS_NET_PORT, &addr) < 0)
 	{
-		if (FINSnodeRequest(pdrvPvt) < 0)
-		{
-			return (-1);
-		}
+		errlogPrintf("%s: port %s, bad IP address %s\n", __func__, pdrvPvt->portName, address);
+		return (-1);
 	}
 	
-	BuildWriteMessage(pdrvPvt, pasynUser, address, nelements, &sendlen, &recvlen, asynSize, data);
+	if ((dispatcher == NULL) && ((dispatcher = DispatchCreate()) == NULL))
+	{
+		return (-1);
+	}
 	
-	asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, (char *) pdrvPvt->message, sendlen, "%s: port %s, sending %lu bytes.\n", __func__, pdrvPvt->portName, (unsigned long) sendlen);
+	plink = LinkAlloc(window);
+	plink->shared = 1;
+	plink->peer = addr;
 	
-	epicsTimeGetCurrent(&ets);
+	peer.ip = addr.sin_addr.s_addr;
+	peer.port = addr.sin_port;
+	peer.plink = plink;
 	
-/* set the time out of writes to the asynOctet port to be the time out specified in the record */
-
-	if (pasynUser->timeout <= 0.0)
+	epicsMutexMustLock(dispatcher->lock);
+	
+	for (i = 0; i < dispatcher->nsockets; i++)
 	{
-		pasynUser->timeout = 1.0;
+		finsDispatchSocket * const p = &dispatcher->socket[i];
+		
+		if (bsearch(&peer, p->peers, p->npeers, sizeof(finsDispatchPeer), DispatchPeerCompare))
+		{
+			continue;
+		}
+		
+		if ((psock == NULL) || (p->npeers < psock->npeers))
+		{
+			psock = p;
+		}
 	}
 	
-	status = pasynOctetSyncIO->writeRead(pdrvPvt->pasynUser, (char *) pdrvPvt->message, sendlen, (char *) pdrvPvt->message, recvlen, pasynUser->timeout, &sentlen, &recdlen, &eomReason);
-
-	UpdateTimes(pdrvPvt, &ets, &ete);
+	if (psock == NULL)
+	{
+		epicsMutexUnlock(dispatcher->lock);
+		errlogPrintf("%s: port %s, every shared socket already has a port for %s\n", __func__, pdrvPvt->portName, address);
+		LinkFree(plink);
+		return (-1);
+	}
 	
-	switch (status)
+	if (psock->npeers == psock->maxpeers)
 	{
-		case asynSuccess:
+		psock->maxpeers = (psock->maxpeers) ? psock->maxpeers * 2 : 16;
+		psock->peers = (finsDispatchPeer *) realloc(psock->peers, psock->maxpeers * sizeof(finsDispatchPeer));
+		
+		if (psock->peers == NULL)
 		{
-			break;
+			cantProceed("%s: out of memory\n", __func__);
 		}
+	}
+	
+	psock->peers[psock->npeers++] = peer;
+	qsort(psock->peers, psock->npeers, sizeof(finsDispatchPeer), DispatchPeerCompare);
+	
+	plink->fd = psock->fd;
+	plink->batch = psock->batch;
+	pdrvPvt->link = plink;
+	
+	epicsMutexUnlock(dispatcher->lock);
+	
+	return (0);
+}
+
+/**************************************************************************************************/
+/*
+	Shared FINS/TCP
+	
+	Ports created by finsTCPSharedInit for the same address share a session: one connection, one
+	node address exchange and one link, whose window limits the frames in flight on the stream.
+	The session connects when a port first needs it and after each error. A receive thread reads
+	whole frames and passes them to the link, which finds the request by SID. Frames are sent whole
+	under the session's send lock. A FINS/TCP error frame closes the connection.
+*/
+
+static ELLLIST sessionList;
+static epicsMutexId sessionLock;
+
+/* wait for a session socket to be readable or writable, with poll() on Linux as select() can't take every descriptor */
+
+static int SocketWait(const SOCKET fd, const int write, const double timeout)
+{
+#ifdef FINS_EPOLL
+	struct pollfd pfd;
+	
+	pfd.fd = fd;
+	pfd.events = (write) ? POLLOUT : POLLIN;
+	pfd.revents = 0;
+	
+	return (poll(&pfd, 1, (int) (timeout * 1000.0)));
+#else
+	fd_set fds;
+	struct timeval tv;
+	
+#ifndef _WIN32
+	if (fd >= FD_SETSIZE)
+	{
+		return (-1);
+	}
+#endif
+	FD_ZERO(&fds);
+	FD_SET(fd, &fds);
+	tv.tv_sec = (long) timeout;
+	tv.tv_usec = (long) ((timeout - tv.tv_sec) * 1e6);
+	
+	return (select(fd + 1, (write) ? NULL : &fds, (write) ? &fds : NULL, NULL, &tv));
+#endif
+}
+
+/* read exactly n bytes. With a timeout, give up if nothing arrives for that long. */
+
+static int SessionRecv(const SOCKET fd, epicsUInt8 *buffer, size_t n, const double timeout)
+{
+	while (n > 0)
+	{
+		int r;
 		
-		case asynTimeout:
-		case asynOverflow:
-		case asynError:
-		case asynDisconnected:
-		case asynDisabled:
+		if ((timeout > 0.0) && (SocketWait(fd, 0, timeout) <= 0))
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, writeRead() failed with %s.\n", __func__, pdrvPvt->portName, asynStatusMessages[status]);
 			return (-1);
 		}
 		
-		default:
+		if ((r = recv(fd, (char *) buffer, n, 0)) <= 0)
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, unknown asyn return code %d.\n", __func__, pdrvPvt->portName, status);
+			if ((r < 0) && (SOCKERRNO == SOCK_EINTR))
+			{
+				continue;
+			}
+			
 			return (-1);
 		}
+		
+		buffer += r;
+		n -= r;
 	}
+	
+	return (0);
+}
 
-	asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, (char *) pdrvPvt->message, recvlen, "%s: port %s, received %lu bytes.\n", __func__, pdrvPvt->portName, (unsigned long) recvlen);
+/* the receive thread only closes the socket while holding the send lock, so fd stays ours until we unlock */
 
-	if (sentlen != sendlen)
-	{
-		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, writeRead() write failed. %lu != %lu\n", __func__, pdrvPvt->portName, (unsigned long) sentlen, (unsigned long) sendlen);
-		return (-1);
-	}
+static int SessionSend(finsSession * const psession, const finsMsg * const pmsg)
+{
+	const epicsUInt8 *p = pmsg->buffer;
+	size_t n = pmsg->sendlen;
+	SOCKET fd;
 	
-	if (recdlen != recvlen)
+	epicsMutexMustLock(psession->sendLock);
+	
+	if ((fd = psession->plink->fd) == INVALID_SOCKET)
 	{
-		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, writeRead() read failed.\n", __func__, pdrvPvt->portName);
+		epicsMutexUnlock(psession->sendLock);
+		errno = ENOTCONN;
 		return (-1);
 	}
 	
-/* check and strip the TCP FINS header */
-
-	if (pdrvPvt->type == FINS_TCP_type)
+	while (n > 0)
 	{
-		const unsigned int ferror = BSWAP32(((unsigned int *) pdrvPvt->message)[FINS_MODE_ERROR]);
-		 
-		if (ferror != FINS_ERROR_NORMAL) 
+		const int r = send(fd, (char *) p, n, 0);
+		
+		if (r < 0)
 		{
-			pasynCommonSyncIO->disconnectDevice(pdrvPvt->pasynUserCommon);
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, FINS Frame Send error 0x%x.\n", __func__, pdrvPvt->portName, ferror);
+			if (SOCKERRNO == SOCK_EINTR)
+			{
+				continue;
+			}
 			
+			epicsMutexUnlock(psession->sendLock);
 			return (-1);
 		}
 		
-		memmove(pdrvPvt->message, pdrvPvt->message + FINS_SEND_FRAME_SIZE, sizeof(pdrvPvt->message) - FINS_SEND_FRAME_SIZE);
-	}	
-
-	if (CheckData(pdrvPvt, pasynUser) < 0)
-	{
-		return (-1);
+		p += r;
+		n -= r;
 	}
-
-	return (0);
+	
+	epicsMutexUnlock(psession->sendLock);
+	
+	return (pmsg->sendlen);
 }
 
-/*** asynOctet ************************************************************************************/
+/* wake the receive thread, which closes the connection */
 
-static asynStatus octetRead(void *pvt, asynUser *pasynUser, char *data, size_t maxchars, size_t *nbytesTransferred, int *eomReason)
+static void SessionClose(finsSession * const psession)
 {
-	drvPvt * const pdrvPvt = (drvPvt *) pvt;
-	int addr;
-	asynStatus status;
-	
-	*eomReason = 0;
-	*nbytesTransferred = 0;
+	epicsMutexMustLock(psession->plink->lock);
 	
-	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+	if (psession->plink->fd != INVALID_SOCKET)
 	{
-		return (status);
+		shutdown(psession->plink->fd, SHUT_RDWR);
 	}
 	
-	switch (pasynUser->reason)
+	epicsMutexUnlock(psession->plink->lock);
+}
+
+static void SessionReceive(void *pvt)
+{
+	finsSession * const psession = (finsSession *) pvt;
+	finsLink * const plink = psession->plink;
+	epicsUInt8 *frame = (epicsUInt8 *) callocMustSucceed(1, FINS_SEND_FRAME_SIZE + FINS_MAX_MSG, __func__);
+	
+	while (1)
 	{
-		case FINS_MODEL:
+		SOCKET fd;
+		int i;
+		
+		epicsEventMustWait(psession->connected);
+		
+		epicsMutexMustLock(plink->lock);
+		fd = plink->fd;
+		epicsMutexUnlock(plink->lock);
+		
+		if (fd == INVALID_SOCKET)
 		{
-			if (maxchars < FINS_MODEL_LEN)
+			continue;
+		}
+		
+	/* the header gives the length of the rest of the frame */
+	
+		while (SessionRecv(fd, frame, 8, 0.0) == 0)
+		{
+			const epicsUInt32 * const header = (epicsUInt32 *) frame;
+			const epicsUInt32 magic = BSWAP32(header[FINS_MODE_HEADER]);
+			const size_t length = BSWAP32(header[FINS_MODE_LENGTH]);
+			epicsUInt32 command, ferror;
+			
+			if ((magic != FINS_TCP_HEADER) || (length < 8) || (length > FINS_MAX_MSG + 8))
 			{
-				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, length is not >= %d for FINS_MODEL\n", __func__, pdrvPvt->portName, addr, FINS_MODEL_LEN);
-				return (asynError);
+				errlogPrintf("%s: %s, bad FINS/TCP header\n", __func__, psession->address);
+				break;
 			}
 			
-			break;
+			if (SessionRecv(fd, frame + 8, length, 0.0) < 0)
+			{
+				break;
+			}
+			
+			command = BSWAP32(header[FINS_MODE_COMMAND]);
+			ferror = BSWAP32(header[FINS_MODE_ERROR]);
+			
+			if ((command != FINS_FRAME_SEND_COMMAND) || (ferror != FINS_ERROR_NORMAL))
+			{
+				errlogPrintf("%s: %s, FINS/TCP command %u error 0x%x\n", __func__, psession->address, command, ferror);
+				break;
+			}
+			
+			LinkComplete(plink, frame, length + 8, FINS_SEND_FRAME_SIZE);
 		}
 		
-	/* no more reasons for asynOctetRead */
+	/*
+		The ports need a new node address exchange. Requests in flight fail now rather than
+		time out. The shutdown ends a send blocked on the dead connection, so that the send
+		lock can be taken before the socket is closed and its descriptor reused.
+	*/
 	
-		default:
+		shutdown(fd, SHUT_RDWR);
+		
+		epicsMutexMustLock(psession->connectLock);
+		epicsMutexMustLock(psession->sendLock);
+		epicsMutexMustLock(plink->lock);
+		
+		plink->fd = INVALID_SOCKET;
+		psession->nclosed++;
+		
+		for (i = 0; i < 256; i++)
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
-			return (asynError);
+			if (plink->pending[i].pmsg)
+			{
+				plink->pending[i].recdlen = 0;
+				plink->pending[i].pmsg = NULL;
+				epicsEventSignal(plink->pending[i].done);
+			}
+		}
+		
+		for (i = 0; i < psession->nports; i++)
+		{
+			psession->ports[i]->nodevalid = 0;
+			
+			if (psession->ports[i]->reconnect)
+			{
+				epicsEventSignal(psession->ports[i]->reconnect->wakeup);
+			}
 		}
+		
+		epicsMutexUnlock(plink->lock);
+		
+		epicsSocketDestroy(fd);
+		
+		epicsMutexUnlock(psession->sendLock);
+		epicsMutexUnlock(psession->connectLock);
 	}
+}
 
-	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+/* connect without blocking for longer than FINS_CONNECT_TIMEOUT. Returns 0 or an errno value. */
 
-/* send FINS request */
+static int SessionDial(const finsSession * const psession, const SOCKET fd)
+{
+	osiSockIoctl_t nonblocking = 1;
+	osiSocklen_t len = sizeof(int);
+	int error = 0;
+	
+	socket_ioctl(fd, FIONBIO, &nonblocking);
+	
+	if (connect(fd, (struct sockaddr *) &psession->peer, sizeof(psession->peer)) < 0)
+	{
+		if ((SOCKERRNO != SOCK_EINPROGRESS) && (SOCKERRNO != SOCK_EWOULDBLOCK))
+		{
+			return (SOCKERRNO);
+		}
+		
+		if (SocketWait(fd, 1, FINS_CONNECT_TIMEOUT) <= 0)
+		{
+			return (ETIMEDOUT);
+		}
+		
+		if (getsockopt(fd, SOL_SOCKET, SO_ERROR, (char *) &error, &len) < 0)
+		{
+			return (SOCKERRNO);
+		}
+		
+		if (error)
+		{
+			return (error);
+		}
+	}
+	
+	nonblocking = 0;
+	socket_ioctl(fd, FIONBIO, &nonblocking);
+	
+	return (0);
+}
 
-	if (finsRead(pdrvPvt, pasynUser, (void *) data, maxchars, addr, nbytesTransferred, 0) < 0)
+/* connect and exchange node addresses if the session isn't connected, and give the port the nodes */
+
+static int SessionConnect(drvPvt * const pdrvPvt)
+{
+	finsSession * const psession = pdrvPvt->link->session;
+	finsLink * const plink = psession->plink;
+	unsigned int FINSframe[FINS_MODE_RECV_SIZE / sizeof(unsigned int)];
+	SOCKET fd;
+	int flag = 1, error;
+	
+	epicsMutexMustLock(psession->connectLock);
+	
+	if (plink->fd != INVALID_SOCKET)
 	{
-		return (asynError);
+		pdrvPvt->snode = psession->snode;
+		pdrvPvt->dnode = psession->dnode;
+		pdrvPvt->nodevalid = 1;
+		
+		epicsMutexUnlock(psession->connectLock);
+		return (0);
 	}
 	
-	if (eomReason)
+	if ((fd = epicsSocketCreate(AF_INET, SOCK_STREAM, 0)) == INVALID_SOCKET)
 	{
-		*eomReason |= ASYN_EOM_END;
+		epicsMutexUnlock(psession->connectLock);
+		errlogPrintf("%s: %s, can't create socket: %s\n", __func__, psession->address, strerror(SOCKERRNO));
+		return (-1);
 	}
+	
+	if ((error = SessionDial(psession, fd)) != 0)
+	{
+		epicsMutexUnlock(psession->connectLock);
+		errlogPrintf("%s: %s, can't connect: %s\n", __func__, psession->address, strerror(error));
+		epicsSocketDestroy(fd);
+		return (-1);
+	}
+	
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (char *) &flag, sizeof(flag));
+	
+/* node address exchange, from W421 section 7-4 */
 
-	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, read %lu bytes.\n", __func__, pdrvPvt->portName, addr, (unsigned long) *nbytesTransferred);
-
-   	return (asynSuccess);
+	AddCommand((epicsUInt8 *) FINSframe, 0, FINS_NODE_CLIENT_COMMAND);
+	FINSframe[FINS_MODE_CLIENT] = 0;
+	
+	if ((send(fd, (char *) FINSframe, FINS_MODE_SEND_SIZE, 0) == FINS_MODE_SEND_SIZE) && (SessionRecv(fd, (epicsUInt8 *) FINSframe, FINS_MODE_RECV_SIZE, 1.0) == 0))
+	{
+		FINSframe[FINS_MODE_COMMAND] = BSWAP32(FINSframe[FINS_MODE_COMMAND]);
+		FINSframe[FINS_MODE_ERROR]   = BSWAP32(FINSframe[FINS_MODE_ERROR]);
+	}
+	else
+	{
+		FINSframe[FINS_MODE_COMMAND] = FINS_NODE_CLIENT_COMMAND;
+	}
+	
+	if ((FINSframe[FINS_MODE_COMMAND] != FINS_NODE_SERVER_COMMAND) || (FINSframe[FINS_MODE_ERROR] != 0))
+	{
+		epicsMutexUnlock(psession->connectLock);
+		errlogPrintf("%s: %s, node address exchange failed\n", __func__, psession->address);
+		epicsSocketDestroy(fd);
+		return (-1);
+	}
+	
+	psession->snode = BSWAP32(FINSframe[FINS_MODE_CLIENT]);
+	psession->dnode = BSWAP32(FINSframe[FINS_MODE_SERVER]);
+	psession->nconnects++;
+	
+	epicsMutexMustLock(plink->lock);
+	plink->fd = fd;
+	epicsMutexUnlock(plink->lock);
+	
+	epicsEventSignal(psession->connected);
+	
+	pdrvPvt->snode = psession->snode;
+	pdrvPvt->dnode = psession->dnode;
+	pdrvPvt->nodevalid = 1;
+	
+	epicsMutexUnlock(psession->connectLock);
+	
+	return (0);
 }
 
-/* Form a FINS write message, send request, wait for the reply and check for errors */
+/* join the session for the address, creating it for the first port */
 
-static asynStatus octetWrite(void *pvt, asynUser *pasynUser, const char *data, size_t numchars, size_t *nbytesTransferred)
+static int SessionAdd(drvPvt * const pdrvPvt, const char *address, const int window)
 {
-	drvPvt * const pdrvPvt = (drvPvt *) pvt;
-	int addr;
-	asynStatus status;
+	struct sockaddr_in peer;
+	finsSession *psession;
 	
-	*nbytesTransferred = 0;
-
-	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+	if (aToIPAddr(address, FINS_NET_PORT, &peer) < 0)
 	{
-		return (status);
+		errlogPrintf("%s: port %s, bad IP address %s\n", __func__, pdrvPvt->portName, address);
+		return (-1);
 	}
 	
-	switch (pasynUser->reason)
+	if (sessionLock == NULL)
 	{
-		case FINS_CYCLE_TIME_RESET:
+		sessionLock = epicsMutexMustCreate();
+		ellInit(&sessionList);
+	}
+	
+	epicsMutexMustLock(sessionLock);
+	
+	for (psession = (finsSession *) ellFirst(&sessionList); psession; psession = (finsSession *) ellNext(&psession->node))
+	{
+		if ((psession->peer.sin_addr.s_addr == peer.sin_addr.s_addr) && (psession->peer.sin_port == peer.sin_port))
 		{
 			break;
 		}
-
-		default:
+	}
+	
+	if (psession == NULL)
+	{
+		char name[64];
+		
+		psession = (finsSession *) callocMustSucceed(1, sizeof(finsSession), __func__);
+		psession->address = epicsStrDup(address);
+		psession->peer = peer;
+		psession->connectLock = epicsMutexMustCreate();
+		psession->sendLock = epicsMutexMustCreate();
+		psession->connected = epicsEventMustCreate(epicsEventEmpty);
+		
+		psession->plink = LinkAlloc(window);
+		psession->plink->fd = INVALID_SOCKET;
+		psession->plink->shared = 1;
+		psession->plink->session = psession;
+		
+		epicsSnprintf(name, sizeof(name), "%s_S", pdrvPvt->portName);
+		
+		if (epicsThreadCreate(name, epicsThreadPriorityHigh, epicsThreadGetStackSize(epicsThreadStackMedium), SessionReceive, psession) == NULL)
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
-			return (asynError);
+			epicsMutexUnlock(sessionLock);
+			errlogPrintf("%s: port %s, can't create receive thread\n", __func__, pdrvPvt->portName);
+			return (-1);
 		}
+		
+		ellAdd(&sessionList, &psession->node);
 	}
+	
+/* the window is the largest any of the ports asked for */
 
-	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+	epicsMutexMustLock(psession->connectLock);
+	epicsMutexMustLock(psession->plink->lock);
 	
-/* form FINS message and send data */
+	psession->ports = (drvPvt **) realloc(psession->ports, (psession->nports + 1) * sizeof(drvPvt *));
 	
-	if (finsWrite(pdrvPvt, pasynUser, (void *) data, numchars, addr, 0) < 0)
+	if (psession->ports == NULL)
 	{
-		return (asynError);
+		cantProceed("%s: out of memory\n", __func__);
 	}
+	
+	psession->ports[psession->nports++] = pdrvPvt;
+	
+	if (window > psession->plink->window)
+	{
+		psession->plink->window = (window > 255) ? 255 : window;
+	}
+	
+	epicsMutexUnlock(psession->plink->lock);
+	epicsMutexUnlock(psession->connectLock);
+	
+	epicsMutexUnlock(sessionLock);
+	
+	pdrvPvt->link = psession->plink;
+	
+/* connect now if we can, as finsTCPInit does */
 
-/* assume for now that we can always write the full request */
-
-	*nbytesTransferred = numchars;
-
-	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, wrote %lu bytes.\n", __func__, pdrvPvt->portName, addr, (unsigned long) numchars);
-
-   	return (asynSuccess);
+	if (reconnectMax > 0.0)
+	{
+		return (ReconnectStart(pdrvPvt));
+	}
+	
+	SessionConnect(pdrvPvt);
+	
+	return (0);
 }
 
-/*** asynInt32 ************************************************************************************/
+/**************************************************************************************************/
+/*
+	Send a request and wait for the reply, either over the pipelined link or through the parent
+	asyn port one request at a time. finsTransferStart only sends on a link, so that a chunked
+	transfer can have several requests in flight before it waits for the first reply. Every
+	successful finsTransferStart must be followed by a finsTransferWait.
+*/
 
-static asynStatus ReadInt32(void *pvt, asynUser *pasynUser, epicsInt32 *value)
-{
-	drvPvt * const pdrvPvt = (drvPvt *) pvt;
-	int addr;
-	asynStatus status;
+/* with the circuit breaker open everything but the probe fails without being sent */
 
-	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+static int BreakerOpen(drvPvt * const pdrvPvt, asynUser *pasynUser)
+{
+	finsBreaker * const pbreaker = pdrvPvt->breaker;
+	int open;
+	
+	if ((pbreaker == NULL) || (pasynUser == pbreaker->pasynUser))
 	{
-		return (status);
+		return (0);
 	}
-
-	switch (pasynUser->reason)
-	{
-		case FINS_DM_READ:
-		case FINS_AR_READ:
-		case FINS_IO_READ:
-		case FINS_WR_READ:
-		case FINS_HR_READ:
-		case FINS_DM_READ_32:
-		case FINS_AR_READ_32:
-		case FINS_IO_READ_32:
-		case FINS_CYCLE_TIME_MEAN:
-		case FINS_CYCLE_TIME_MAX:
-		case FINS_CYCLE_TIME_MIN:
-		case FINS_CPU_STATUS:
-		case FINS_CPU_MODE:
-		case FINS_CPU_FATAL:
-		case FINS_CPU_NONFATAL:
-		case FINS_ECHO_TEST:
-		{
-			break;
-		}
-
-	/* these get called at initialisation by write methods */
-	
-		case FINS_DM_WRITE:
-		case FINS_IO_WRITE:
-		case FINS_AR_WRITE:
-		case FINS_CT_WRITE:
-		case FINS_DM_WRITE_32:
-		case FINS_IO_WRITE_32:
-		case FINS_AR_WRITE_32:
-		case FINS_CT_WRITE_32:
-		{
-			break;
-		}
-
-	/* user selects these when they don't want to initialise the record by performing a read first */
 	
-		case FINS_DM_WRITE_NOREAD:
-		case FINS_IO_WRITE_NOREAD:
-		case FINS_AR_WRITE_NOREAD:
-		case FINS_DM_WRITE_32_NOREAD:
-		case FINS_IO_WRITE_32_NOREAD:
-		case FINS_AR_WRITE_32_NOREAD:
-		{
-			asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, WRITE_NOREAD\n", __func__, pdrvPvt->portName, addr);
-			return (asynError);
-		}
-
-	/* don't try and perform a read to initialise the PV */
+	epicsMutexMustLock(pbreaker->lock);
 	
-		case FINS_SET_RESET_CANCEL:
-		{
-			return (asynError);
-		}
-		
-		default:
-		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, no such command %d.\n", __func__, pdrvPvt->portName, addr, pasynUser->reason);
-			return (asynError);
-		}
+	if ((open = pbreaker->open))
+	{
+		pbreaker->nrejected++;
 	}
-
-	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
 	
-/* send FINS request */
-
-	if (finsRead(pdrvPvt, pasynUser, (void *) value, ONE_ELEMENT, addr, NULL, sizeof(epicsUInt32)) < 0)
+	epicsMutexUnlock(pbreaker->lock);
+	
+	if (open)
 	{
-		return (asynError);
+		epicsSnprintf(pasynUser->errorMessage, pasynUser->errorMessageSize, "port %s, PLC not answering", pdrvPvt->portName);
+		asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, circuit breaker open, request not sent.\n", __func__, pdrvPvt->portName);
 	}
-
-	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, read 1 value.\n", __func__, pdrvPvt->portName, addr);
-
-	return (asynSuccess);
+	
+	return (open);
 }
 
-static asynStatus WriteInt32(void *pvt, asynUser *pasynUser, epicsInt32 value)
+static void BreakerResult(drvPvt * const pdrvPvt, asynUser *pasynUser, const asynStatus status)
 {
-	drvPvt * const pdrvPvt = (drvPvt *) pvt;
-	int addr;
-	asynStatus status;
+	finsBreaker * const pbreaker = pdrvPvt->breaker;
+	int trip = 0;
 	
-	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+	if ((pbreaker == NULL) || (pasynUser == pbreaker->pasynUser) || ((status != asynSuccess) && (status != asynTimeout)))
 	{
-		return (status);
+		return;
 	}
 	
-	switch (pasynUser->reason)
+	epicsMutexMustLock(pbreaker->lock);
+	
+	if (status == asynSuccess)
 	{
-		case FINS_DM_WRITE:
-		case FINS_DM_WRITE_NOREAD:
-		case FINS_AR_WRITE:
-		case FINS_AR_WRITE_NOREAD:
-		case FINS_IO_WRITE:
-		case FINS_IO_WRITE_NOREAD:
-		case FINS_CYCLE_TIME_RESET:
-		case FINS_DM_WRITE_32:
-		case FINS_DM_WRITE_32_NOREAD:
-		case FINS_AR_WRITE_32:
-		case FINS_AR_WRITE_32_NOREAD:
-		case FINS_IO_WRITE_32:
-		case FINS_IO_WRITE_32_NOREAD:
-		case FINS_SET_RESET_CANCEL:
-		{
-			break;
-		}
-		
-		default:
-		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, command %s not supported.\n", __func__, pdrvPvt->portName, FINS_names[pasynUser->reason]);
-			return (asynError);
-		}
+		pbreaker->timeouts = 0;
 	}
+	else if ((++pbreaker->timeouts >= pbreaker->threshold) && (pbreaker->threshold > 0) && !pbreaker->open)
+	{
+		pbreaker->open = trip = 1;
+		pbreaker->ntrips++;
+	}
+	
+	epicsMutexUnlock(pbreaker->lock);
+	
+	if (trip)
+	{
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %d time outs in a row, failing requests until the PLC answers.\n", __func__, pdrvPvt->portName, pbreaker->threshold);
+		epicsEventSignal(pbreaker->wakeup);
+	}
+}
 
-	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
-
-/* form FINS message and send data */
+/* what the interfaces return when a request fails */
 
-	if (finsWrite(pdrvPvt, pasynUser, (void *) &value, ONE_ELEMENT, addr, sizeof(epicsUInt32)) < 0)
+static asynStatus FailStatus(const drvPvt * const pdrvPvt)
+{
+	if (pdrvPvt->reconnect && (pdrvPvt->nodevalid != 1))
 	{
-		return (asynError);
+		return (asynDisconnected);
 	}
 	
-	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, wrote 1 value.\n", __func__, pdrvPvt->portName, addr);
+	return ((pdrvPvt->breaker && pdrvPvt->breaker->open) ? asynDisconnected : asynError);
+}
 
-	return (asynSuccess);
+/* a request refused by an open breaker or while reconnecting is expected, so it is traced as flow */
+
+static int FailTrace(const drvPvt * const pdrvPvt, const asynStatus status)
+{
+	return (((status == asynDisconnected) && (FailStatus(pdrvPvt) == asynDisconnected)) ? ASYN_TRACE_FLOW : ASYN_TRACE_ERROR);
 }
 
-/*** asynFloat64 **********************************************************************************/
+/*
+	FINS/UDP through the parent port. A reply left over from a request which timed out would fail the
+	SID check of the next one, so replies with the wrong SID are dropped and the read goes on for the
+	rest of the current share of the time out, which is all of it without retransmits. With
+	retransmits the request is sent again, with the same SID, after each share without a reply.
+*/
 
-static asynStatus ReadFloat64(void *pvt, asynUser *pasynUser, epicsFloat64 *value)
+static asynStatus UDPWriteRead(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg, size_t *sentlen, size_t *recdlen, int *eomReason)
 {
-	drvPvt * const pdrvPvt = (drvPvt *) pvt;
-	int addr;
+	epicsUInt8 * const frame = MsgFrame(pdrvPvt, pmsg);
+	const double slice = pasynUser->timeout / (pdrvPvt->retransmits + 1);
+	finsMsg *pcopy = NULL;
+	epicsTimeStamp sent, now;
 	asynStatus status;
-	epicsFloat32 val;
+	int tries = 0;
 	
-	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+/* the reply overwrites the request */
+
+	if (pdrvPvt->retransmits > 0)
 	{
-		return (status);
+		pcopy = MsgGet(pdrvPvt);
+		memcpy(pcopy->message, frame, pmsg->sendlen);
 	}
-
-	switch (pasynUser->reason)
+	
+	epicsMutexMustLock(pdrvPvt->mutex);
+	
+	epicsTimeGetCurrent(&sent);
+	status = pasynOctetSyncIO->writeRead(pdrvPvt->pasynUser, (char *) frame, pmsg->sendlen, (char *) frame, pmsg->recvlen, slice, sentlen, recdlen, eomReason);
+	
+	while (1)
 	{
-		case FINS_DM_READ_32:
-		case FINS_AR_READ_32:
+		if ((status == asynSuccess) && (*recdlen >= MIN_RESP_LEN) && (frame[SID] != pmsg->sid))
 		{
-			break;
+			double left;
+			
+			pdrvPvt->ndiscarded++;
+			asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, SID %u sent, dropped a reply with SID %u.\n", __func__, pdrvPvt->portName, (epicsUInt8) pmsg->sid, frame[SID]);
+			
+			epicsTimeGetCurrent(&now);
+			left = slice - epicsTimeDiffInSeconds(&now, &sent);
+			
+			status = (left > 0.0) ? pasynOctetSyncIO->read(pdrvPvt->pasynUser, (char *) frame, pmsg->recvlen, left, recdlen, eomReason) : asynTimeout;
 		}
-		
-	/* this gets called at initialisation by write methods */
-	
-		case FINS_DM_WRITE_32:
-		case FINS_AR_WRITE_32:
+		else if ((status == asynTimeout) && (tries < pdrvPvt->retransmits))
 		{
-			break;
-		}
+			tries++;
+			pdrvPvt->nretransmits++;
+			asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, no reply to SID %u, sending it again.\n", __func__, pdrvPvt->portName, (epicsUInt8) pmsg->sid);
+			
+/* not writeRead, whose flush would throw away a late reply to the first send */
 
-		case FINS_DM_WRITE_NOREAD:
-		case FINS_AR_WRITE_NOREAD:
-		case FINS_DM_WRITE_32_NOREAD:
-		case FINS_AR_WRITE_32_NOREAD:
-		{
-			asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, WRITE_NOREAD\n", __func__, pdrvPvt->portName, addr);
-			return (asynError);
+			memcpy(frame, pcopy->message, pmsg->sendlen);
+			
+			epicsTimeGetCurrent(&sent);
+			
+			if ((status = pasynOctetSyncIO->write(pdrvPvt->pasynUser, (char *) frame, pmsg->sendlen, slice, sentlen)) == asynSuccess)
+			{
+				status = pasynOctetSyncIO->read(pdrvPvt->pasynUser, (char *) frame, pmsg->recvlen, slice, recdlen, eomReason);
+			}
 		}
-
-		default:
+		else
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, no such command %d.\n", __func__, pdrvPvt->portName, addr, pasynUser->reason);
-			return (asynError);
+			break;
 		}
 	}
-
-	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
-
-/* send FINS request */
-
-	if (finsRead(pdrvPvt, pasynUser, (void *) &val, ONE_ELEMENT, addr, NULL, sizeof(epicsUInt32)) < 0)
+	
+	epicsMutexUnlock(pdrvPvt->mutex);
+	
+	if (pcopy)
 	{
-		return (asynError);
+		MsgPut(pdrvPvt, pcopy);
 	}
-
-	*value = (epicsFloat64) val;
 	
-	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, read 1 word.\n", __func__, pdrvPvt->portName, addr);
-
-	return (asynSuccess);
+	return (status);
 }
 
-static asynStatus WriteFloat64(void *pvt, asynUser *pasynUser, epicsFloat64 value)
+static asynStatus finsTransferStart(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg)
 {
-	drvPvt * const pdrvPvt = (drvPvt *) pvt;
-	int addr;
-	asynStatus status;
-	epicsFloat32 val = (epicsFloat32) value;
+	epicsTimeGetCurrent(&pmsg->ets);
 	
-	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+	pmsg->sentlen = 0;
+	
+	if (BreakerOpen(pdrvPvt, pasynUser))
 	{
-		return (status);
+		pmsg->status = asynDisconnected;
 	}
-
-	switch (pasynUser->reason)
+	else
 	{
-		case FINS_DM_WRITE_32:
-		case FINS_DM_WRITE_32_NOREAD:
-		case FINS_AR_WRITE_32:
-		case FINS_AR_WRITE_32_NOREAD:
-		{
-			break;
-		}
-
-		default:
-		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
-			return (asynError);
-		}
+		pmsg->status = pdrvPvt->link ? LinkStart(pdrvPvt, pasynUser, pmsg, &pmsg->sentlen) : asynSuccess;
 	}
-
-	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
 	
-/* form FINS message and send data */
+	return (pmsg->status);
+}
 
-	if (finsWrite(pdrvPvt, pasynUser, (void *) &val, ONE_ELEMENT, addr, sizeof(epicsUInt32)) < 0)
+static asynStatus finsTransferWait(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg, size_t *sentlen, size_t *recdlen, int *eomReason)
+{
+	asynStatus status;
+	
+	if (pmsg->status != asynSuccess)
 	{
-		return (asynError);
+		status = pmsg->status;
 	}
-
-	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, wrote 1 word.\n", __func__, pdrvPvt->portName, addr);
-
-	return (asynSuccess);
+	else if (pdrvPvt->link)
+	{
+		*sentlen = pmsg->sentlen;
+		
+		status = LinkWait(pdrvPvt, pasynUser, pmsg, asynSuccess, recdlen);
+	}
+	else if (pdrvPvt->type == FINS_UDP_type)
+	{
+		status = UDPWriteRead(pdrvPvt, pasynUser, pmsg, sentlen, recdlen, eomReason);
+	}
+	else
+	{
+		epicsMutexMustLock(pdrvPvt->mutex);
+		status = pasynOctetSyncIO->writeRead(pdrvPvt->pasynUser, (char *) MsgFrame(pdrvPvt, pmsg), pmsg->sendlen, (char *) MsgFrame(pdrvPvt, pmsg), pmsg->recvlen, pasynUser->timeout, sentlen, recdlen, eomReason);
+		epicsMutexUnlock(pdrvPvt->mutex);
+	}
+	
+	BreakerResult(pdrvPvt, pasynUser, status);
+	
+	return (status);
 }
 
-/*** asynInt16Array *******************************************************************************/
+/* send a request that has the no response bit set */
 
-static asynStatus ReadInt16Array(void *pvt, asynUser *pasynUser, epicsInt16 *value, size_t nelements, size_t *nIn)
+static asynStatus finsSend(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg, size_t *sentlen)
 {
-	drvPvt * const pdrvPvt = (drvPvt *) pvt;
-	int addr;
 	asynStatus status;
 	
-	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+	if (BreakerOpen(pdrvPvt, pasynUser))
 	{
-		return (status);
+		return (asynDisconnected);
 	}
-
-	switch (pasynUser->reason)
+	
+	if (pdrvPvt->link)
 	{
-		case FINS_DM_READ:
-		case FINS_AR_READ:
-		case FINS_IO_READ:
-		case FINS_WR_READ:
-		case FINS_HR_READ:
-		case FINS_EM0_READ ... FINS_EMF_READ:
-		{
-			if (((pdrvPvt->type == FINS_UDP_type) && (nelements > FINS_MAX_UDP_WORDS)) || ((pdrvPvt->type == FINS_TCP_type) && (nelements > FINS_MAX_TCP_WORDS)) || ((pdrvPvt->type == HOSTLINK_type) && (nelements > FINS_MAX_HOST_WORDS)))
-			{
-				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, request too big for %s.\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
-				return (asynError);
-			}
-			
-			break;
-		}
-		
-		case FINS_CLOCK_READ:
-		{
-			if (nelements != FINS_CLOCK_READ_LEN)
-			{
-				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, FINS_CLOCK_READ size != %d.\n", __func__, pdrvPvt->portName, addr, FINS_CLOCK_READ_LEN);
-				return (asynError);
-			}
-			
-			break;
-		}
-		
-		case FINS_MM_READ:
-		{
-			if (nelements > FINS_MM_MAX_ADDRS)
-			{
-				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, FINS_MM_READ size > %d.\n", __func__, pdrvPvt->portName, addr, FINS_MM_MAX_ADDRS);
-				return (asynError);
-			}
-			
-			if (addr >= ellCount(&mmList))
-			{
-				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, FINS_MM_READ invalid entry.\n", __func__, pdrvPvt->portName, addr);
-				return (asynError);
-			}
-			
-			break;
-		}
-		
-		default:
-		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
-			return (asynError);
-		}
+		return (LinkSendOnly(pdrvPvt, pasynUser, pmsg, sentlen));
 	}
+	
+	epicsMutexMustLock(pdrvPvt->mutex);
+	status = pasynOctetSyncIO->write(pdrvPvt->pasynUser, (char *) MsgFrame(pdrvPvt, pmsg), pmsg->sendlen, pasynUser->timeout, sentlen);
+	epicsMutexUnlock(pdrvPvt->mutex);
+	
+	return (status);
+}
 
-	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+static asynStatus finsTransfer(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg, size_t *sentlen, size_t *recdlen, int *eomReason)
+{
+	finsTransferStart(pdrvPvt, pasynUser, pmsg);
 	
-/* send FINS request */
+	return (finsTransferWait(pdrvPvt, pasynUser, pmsg, sentlen, recdlen, eomReason));
+}
 
-	if (finsRead(pdrvPvt, pasynUser, (void *) value, nelements, addr, nIn, sizeof(epicsUInt16)) < 0)
-	{
-		*nIn = 0;
-		return (asynError);
-	}
+/**************************************************************************************************/
+/*
+	Command descriptors, indexed by reason
+*/
 
-	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, read %lu 16-bit word(s).\n", __func__, pdrvPvt->portName, addr, (unsigned long) *nIn);
+#define R	FINS_CMD_READ
+#define W	FINS_CMD_WRITE
+#define D	FINS_CMD_DRVINFO
 
-	return (asynSuccess);
+static const finsCommand finsCommands[] =
+{
+	[FINS_NULL]			= { 0,  0, 0 },
+	[FINS_DM_READ]			= { DM, 1, R | D },
+	[FINS_DM_WRITE]			= { DM, 1, R | W | D },
+	[FINS_DM_WRITE_NOREAD]		= { DM, 1, W | D },
+	[FINS_IO_READ]			= { IO, 1, R | D },
+	[FINS_IO_WRITE]			= { IO, 1, R | W | D },
+	[FINS_IO_WRITE_NOREAD]		= { IO, 1, W | D },
+	[FINS_AR_READ]			= { AR, 1, R | D },
+	[FINS_AR_WRITE]			= { AR, 1, R | W | D },
+	[FINS_AR_WRITE_NOREAD]		= { AR, 1, W | D },
+	[FINS_CT_READ]			= { 0,  0, D },
+	[FINS_CT_WRITE]			= { 0,  0, D },
+	[FINS_CT_WRITE_NOREAD]		= { 0,  0, 0 },
+	[FINS_WR_READ]			= { WR, 1, R | D },
+	[FINS_HR_READ]			= { HR, 1, R | D },
+	[FINS_DM_READ_32]		= { DM, 2, R | D },
+	[FINS_DM_WRITE_32]		= { DM, 2, R | W | D },
+	[FINS_DM_WRITE_32_NOREAD]	= { DM, 2, W | D },
+	[FINS_IO_READ_32]		= { IO, 2, R | D },
+	[FINS_IO_WRITE_32]		= { IO, 2, R | W | D },
+	[FINS_IO_WRITE_32_NOREAD]	= { IO, 2, W | D },
+	[FINS_AR_READ_32]		= { AR, 2, R | D },
+	[FINS_AR_WRITE_32]		= { AR, 2, R | W | D },
+	[FINS_AR_WRITE_32_NOREAD]	= { AR, 2, W | D },
+	[FINS_CT_READ_32]		= { 0,  0, 0 },
+	[FINS_CT_WRITE_32]		= { 0,  0, 0 },
+	[FINS_CT_WRITE_32_NOREAD]	= { 0,  0, 0 },
+	[FINS_EM0_READ]			= { E0, 1, R | D },
+	[FINS_EM1_READ]			= { E1, 1, R | D },
+	[FINS_EM2_READ]			= { E2, 1, R | D },
+	[FINS_EM3_READ]			= { E3, 1, R | D },
+	[FINS_EM4_READ]			= { E4, 1, R | D },
+	[FINS_EM5_READ]			= { E5, 1, R | D },
+	[FINS_EM6_READ]			= { E6, 1, R | D },
+	[FINS_EM7_READ]			= { E7, 1, R | D },
+	[FINS_EM8_READ]			= { E8, 1, R | D },
+	[FINS_EM9_READ]			= { E9, 1, R | D },
+	[FINS_EMA_READ]			= { EA, 1, R | D },
+	[FINS_EMB_READ]			= { EB, 1, R | D },
+	[FINS_EMC_READ]			= { EC, 1, R | D },
+	[FINS_EMD_READ]			= { ED, 1, R | D },
+	[FINS_EME_READ]			= { EE, 1, R | D },
+	[FINS_EMF_READ]			= { EF, 1, R | D },
+	[FINS_READ_MULTI]		= { 0,  0, 0 },
+	[FINS_WRITE_MULTI]		= { 0,  0, 0 },
+	[FINS_SET_MULTI_TYPE]		= { 0,  0, 0 },
+	[FINS_SET_MULTI_ADDR]		= { 0,  0, 0 },
+	[FINS_CLR_MULTI]		= { 0,  0, 0 },
+	[FINS_MODEL]			= { 0,  0, R | D },
+	[FINS_CPU_STATUS]		= { 0,  0, R | D },
+	[FINS_CPU_MODE]			= { 0,  0, R | D },
+	[FINS_CPU_FATAL]		= { 0,  0, R | D },
+	[FINS_CPU_NONFATAL]		= { 0,  0, R | D },
+	[FINS_CYCLE_TIME_RESET]		= { 0,  0, W | D },
+	[FINS_CYCLE_TIME]		= { 0,  0, R | D },
+	[FINS_CYCLE_TIME_MEAN]		= { 0,  0, R | D },
+	[FINS_CYCLE_TIME_MAX]		= { 0,  0, R | D },
+	[FINS_CYCLE_TIME_MIN]		= { 0,  0, R | D },
+	[FINS_MONITOR]			= { 0,  0, D },
+	[FINS_CLOCK_READ]		= { 0,  0, R | D },
+	[FINS_SET_RESET_CANCEL]		= { 0,  0, W | D },
+	[FINS_MM_READ]			= { 0,  0, R | D },
+	[FINS_EXPLICIT]			= { 0,  0, D },
+	[FINS_ECHO_TEST]		= { 0,  0, R | D },
+	[FINS_LATENCY_P50]		= { 0,  0, D },
+	[FINS_LATENCY_P90]		= { 0,  0, D },
+	[FINS_LATENCY_P99]		= { 0,  0, D },
+	[FINS_LATENCY_P999]		= { 0,  0, D },
+	[FINS_LATENCY_MAX]		= { 0,  0, D },
+	[FINS_LATENCY_COUNT]		= { 0,  0, D },
+	[FINS_WRITE_COMMIT]		= { 0,  0, W | D }
+};
+
+#undef R
+#undef W
+#undef D
+
+#define FINS_NCOMMANDS	(sizeof(finsCommands) / sizeof(finsCommands[0]))
+
+static const finsCommand *Command(const int reason)
+{
+	return (((reason > FINS_NULL) && (reason < FINS_NCOMMANDS)) ? &finsCommands[reason] : &finsCommands[FINS_NULL]);
 }
 
-static asynStatus WriteInt16Array(void *pvt, asynUser *pasynUser, epicsInt16 *value, size_t nelements)
+/* the finsUser drvUserCreate made for a record, NULL for the asynUser of the parent port */
+
+static finsUser *RequestUser(const drvPvt * const pdrvPvt, asynUser *pasynUser)
 {
-	drvPvt * const pdrvPvt = (drvPvt *) pvt;
-	int addr;
-	asynStatus status;
+	return ((pasynUser == pdrvPvt->pasynUser) ? NULL : (finsUser *) pasynUser->drvUser);
+}
 
-	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+/* the descriptor of a request, resolved once by drvUserCreate for records and looked up for the driver's own asynUsers */
+
+static const finsCommand *RequestCommand(const drvPvt * const pdrvPvt, asynUser *pasynUser)
+{
+	const finsUser * const puser = RequestUser(pdrvPvt, pasynUser);
+	
+	return ((puser && puser->pcmd) ? puser->pcmd : Command(pasynUser->reason));
+}
+
+/******************************************************************************/
+/*
+
+Standard FINS header. DA1 must be the target node address: the last byte of the IP address
+
+*/
+/******************************************************************************/
+
+static void InitHeader(const drvPvt * const pdrvPvt, finsMsg * const pmsg)
+{
+	pmsg->message[ICF] = 0x80;
+	pmsg->message[RSV] = 0x00;
+	pmsg->message[GCT] = FINS_GATEWAY;
+
+	pmsg->message[DNA] = 0x00;
+	pmsg->message[DA1] = pdrvPvt->dnode;
+	pmsg->message[DA2] = 0x00;
+
+	pmsg->message[SNA] = 0x00;
+	pmsg->message[SA1] = pdrvPvt->snode;
+	pmsg->message[SA2] = 0x00;
+}
+
+/**************************************************************************************************/
+/*
+	We only support word addresses, no bit addressing so COM+3 is zero
+	
+	address:	16-bit address
+	nelements:	number of 16-bit words to transfer
+*/
+/**************************************************************************************************/
+
+static void InitAddrSize(finsMsg * const pmsg, const epicsUInt16 address, const epicsUInt16  nelements, const size_t asynSize)
+{
+	pmsg->message[COM+1] = address >> 8;
+	pmsg->message[COM+2] = address & 0xff;
+	pmsg->message[COM+3] = 0x00;
+
+	pmsg->message[COM+4] = (nelements * asynSize / sizeof(epicsUInt16)) >> 8;
+	pmsg->message[COM+5] = (nelements * asynSize / sizeof(epicsUInt16)) & 0xff;
+}
+
+/**************************************************************************************************/
+/*
+	Multiple Memory Area Read tables.
+	
+	The port's own table once it has one, otherwise the finsMultiMemoryAreaInit table. Returned locked.
+*/
+
+static finsMMTable *MMLock(drvPvt * const pdrvPvt)
+{
+	epicsMutexMustLock(pdrvPvt->mm.lock);
+	
+	if ((pdrvPvt->mm.n > 0) || (mmDefault.lock == NULL))
 	{
-		return (status);
+		return (&pdrvPvt->mm);
 	}
+	
+	epicsMutexUnlock(pdrvPvt->mm.lock);
+	epicsMutexMustLock(mmDefault.lock);
+	
+	return (&mmDefault);
+}
 
-/* check reason */
+/* the port's own table, starting as a copy of the finsMultiMemoryAreaInit table. Returned locked. */
 
-	switch (pasynUser->reason)
+static finsMMTable *MMOwn(drvPvt * const pdrvPvt)
+{
+	finsMMTable * const ptable = &pdrvPvt->mm;
+	
+	epicsMutexMustLock(ptable->lock);
+	
+	if ((ptable->n == 0) && mmDefault.lock)
 	{
-		case FINS_DM_WRITE:
-		case FINS_AR_WRITE:
-		case FINS_IO_WRITE:
+		epicsMutexMustLock(mmDefault.lock);
+		
+		if (mmDefault.n > ptable->max)
 		{
-			if (((pdrvPvt->type == FINS_UDP_type) && (nelements > FINS_MAX_UDP_WORDS)) || ((pdrvPvt->type == FINS_TCP_type) && (nelements > FINS_MAX_TCP_WORDS)) || ((pdrvPvt->type == HOSTLINK_type) && (nelements > FINS_MAX_HOST_WORDS)))
+			if ((ptable->entry = (finsMMEntry *) realloc(ptable->entry, mmDefault.n * sizeof(finsMMEntry))) == NULL)
 			{
-				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, request too big for %s.\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
-				return (asynError);
+				cantProceed("%s: port %s, out of memory\n", __func__, pdrvPvt->portName);
 			}
 			
-			break;
+			ptable->max = mmDefault.n;
 		}
 		
-		default:
+		if (mmDefault.n > 0)
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
-			return (asynError);
+			memcpy(ptable->entry, mmDefault.entry, mmDefault.n * sizeof(finsMMEntry));
+			ptable->n = mmDefault.n;
 		}
+		
+		epicsMutexUnlock(mmDefault.lock);
 	}
-
-	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
-
-/* form FINS message and send data */
-
-	if (finsWrite(pdrvPvt, pasynUser, (void *) value, nelements, addr, sizeof(epicsUInt16)) < 0)
-	{
-		return (asynError);
-	}
-
-	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, wrote %lu 16-bit word(s).\n", __func__, pdrvPvt->portName, addr, (unsigned long) nelements);
-
-	return (asynSuccess);
+	
+	return (ptable);
 }
 
-/*** asynInt32Array *******************************************************************************/
+/* entry index of a locked table, created if needed. NULL if there is no such entry. */
 
-static asynStatus ReadInt32Array(void *pvt, asynUser *pasynUser, epicsInt32 *value, size_t nelements, size_t *nIn)
+static finsMMEntry *MMEntry(finsMMTable * const ptable, const int index, const int create)
 {
-	drvPvt * const pdrvPvt = (drvPvt *) pvt;
-	int addr;
-	asynStatus status;
-	
-	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+	if ((index < 0) || (index >= FINS_MM_MAX_ENTRIES))
 	{
-		return (status);
+		return (NULL);
 	}
-
-	switch (pasynUser->reason)
+	
+	if (index >= ptable->n)
 	{
-		case FINS_DM_READ_32:
-		case FINS_AR_READ_32:
-		case FINS_IO_READ_32:
+		if (create == 0)
 		{
-			if (((pdrvPvt->type == FINS_UDP_type) && ((nelements * 2) > FINS_MAX_UDP_WORDS)) || ((pdrvPvt->type == FINS_TCP_type) && ((nelements * 2) > FINS_MAX_TCP_WORDS)) || ((pdrvPvt->type == HOSTLINK_type) && ((nelements * 2) > FINS_MAX_HOST_WORDS)))
+			return (NULL);
+		}
+		
+		if (index >= ptable->max)
+		{
+			const int max = (index < 16) ? 16 : (index + 1) * 2;
+			finsMMEntry * const pentry = (finsMMEntry *) realloc(ptable->entry, max * sizeof(finsMMEntry));
+			
+			if (pentry == NULL)
 			{
-				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, request too big for %s.\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
-				return (asynError);
+				return (NULL);
 			}
 			
-			break;
+			ptable->entry = pentry;
+			ptable->max = max;
 		}
+		
+		memset(&ptable->entry[ptable->n], 0, (index + 1 - ptable->n) * sizeof(finsMMEntry));
+		ptable->n = index + 1;
+	}
+	
+	return (&ptable->entry[index]);
+}
 
-		case FINS_CYCLE_TIME:
+/*
+	Parse "area address[.bit|:32], ..." into an entry, eg. "0x82 100, 0x82 200:32, 0x30 10.5".
+	Returns the number of items or -1.
+*/
+
+static int MMParse(const char *s, finsMMEntry * const pentry)
+{
+	int n = 0;
+	
+	memset(pentry, 0, sizeof(finsMMEntry));
+	
+	while (s && *s)
+	{
+		unsigned short area, address;
+		int num = 0;
+		finsMMItem * const pitem = &pentry->item[n];
+		
+		if (sscanf(s, " %hi %hi%n", &area, &address, &num) != 2)
 		{
-			if (nelements != FINS_CYCLE_TIME_LEN)
+			break;
+		}
+		
+		if (n == FINS_MM_MAX_ADDRS)
+		{
+			printf("%s: more than %d items\n", __func__, FINS_MM_MAX_ADDRS);
+			return (-1);
+		}
+		
+		s += num;
+		
+		pitem->area = (epicsUInt8) area;
+		pitem->address = address;
+		pitem->width = (area & 0x80) ? FINS_MM_WORD : FINS_MM_BIT;
+		
+		if (*s == '.')
+		{
+			unsigned int bit;
+			
+			if ((pitem->width != FINS_MM_BIT) || (sscanf(s, ".%u%n", &bit, &num) != 1) || (bit > 15))
 			{
-				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, FINS_CYCLE_TIME size != %d.\n", __func__, pdrvPvt->portName, addr, FINS_CYCLE_TIME_LEN);
-				return (asynError);
+				printf("%s: bad bit number at \"%s\"\n", __func__, s);
+				return (-1);
 			}
 			
-			break;
+			pitem->bit = bit;
+			s += num;
 		}
-
-		default:
+		else if (strncmp(s, ":32", 3) == 0)
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
-			return (asynError);
+			if (pitem->width != FINS_MM_WORD)
+			{
+				printf("%s: 0x%02x is not a word area\n", __func__, area);
+				return (-1);
+			}
+			
+			pitem->width = FINS_MM_WORD_32;
+			s += 3;
 		}
+		
+		n++;
+		
+		while (*s == ' ') s++;
+		
+		if (*s == ',') s++;
 	}
 	
-	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+	if (s && *s)
+	{
+		printf("%s: can't parse \"%s\"\n", __func__, s);
+		return (-1);
+	}
+	
+	pentry->nitems = n;
+	
+	return (n);
+}
 
-/* send FINS request */
+/* the 0104 request for an entry. 32-bit items are sent as two word items. */
 
-	if (finsRead(pdrvPvt, pasynUser, (void *) value, nelements, addr, nIn, sizeof(epicsUInt32)) < 0)
+static void MMBuild(finsMsg * const pmsg, const finsMMEntry * const pentry)
+{
+	epicsUInt8 *p = &pmsg->message[COM];
+	size_t recvlen = RESP;
+	int i, j;
+	
+	for (i = 0; i < pentry->nitems; i++)
 	{
-		*nIn = 0;
-		return (asynError);
+		const finsMMItem * const pitem = &pentry->item[i];
+		
+		for (j = 0; j < ((pitem->width == FINS_MM_WORD_32) ? 2 : 1); j++)
+		{
+			*p++ = pitem->area;
+			*p++ = (pitem->address + j) >> 8;
+			*p++ = (pitem->address + j) & 0xff;
+			*p++ = pitem->bit;
+			
+			recvlen += (pitem->width == FINS_MM_BIT) ? 2 : 3;
+		}
 	}
-
-	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, read %lu 32-bit word(s).\n", __func__, pdrvPvt->portName, addr, (unsigned long) *nIn);
 	
-	return (asynSuccess);
+	pmsg->sendlen = p - pmsg->message;
+	pmsg->recvlen = recvlen;
+	pmsg->edits = pentry->edits;
 }
 
-static asynStatus WriteInt32Array(void *pvt, asynUser *pasynUser, epicsInt32 *value, size_t nelements)
+/*
+	Unpack a 0104 reply into 16-bit or 32-bit elements. A 32-bit item takes two 16-bit elements or one
+	32-bit element. Returns the number of elements, or -1 if the entry has changed since the request.
+*/
+
+static int MMExtract(const finsMsg * const pmsg, const finsMMEntry * const pentry, void *data, const size_t nelements, const size_t asynSize)
 {
-	drvPvt * const pdrvPvt = (drvPvt *) pvt;
-	int addr;
-	asynStatus status;
+	const epicsUInt8 *p = &pmsg->message[RESP];
+	epicsUInt32 word[2];
+	size_t n = 0;
+	int i, j;
 	
-	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+	if (pentry->edits != pmsg->edits)
 	{
-		return (status);
+		return (-1);
 	}
-
-	switch (pasynUser->reason)
+	
+	for (i = 0; (i < pentry->nitems) && (n < nelements); i++)
 	{
-		case FINS_DM_WRITE_32:
-		case FINS_AR_WRITE_32:
-		case FINS_IO_WRITE_32:
+		const finsMMItem * const pitem = &pentry->item[i];
+		const int nwords = (pitem->width == FINS_MM_WORD_32) ? 2 : 1;
+		
+		for (j = 0; j < nwords; j++)
 		{
-			if (((pdrvPvt->type == FINS_UDP_type) && ((nelements * 2) > FINS_MAX_UDP_WORDS)) || ((pdrvPvt->type == FINS_TCP_type) && ((nelements * 2) > FINS_MAX_TCP_WORDS)) || ((pdrvPvt->type == HOSTLINK_type) && ((nelements * 2) > FINS_MAX_HOST_WORDS)))
+			if ((p + ((pitem->width == FINS_MM_BIT) ? 2 : 3) > pmsg->message + pmsg->recvlen) || (*p != pitem->area))
 			{
-				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, request too big for %s.\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
-				return (asynError);
+				return (-1);
 			}
 			
-			break;
+			if (pitem->width == FINS_MM_BIT)
+			{
+				word[j] = p[1] & 0x01;
+				p += 2;
+			}
+			else
+			{
+				word[j] = (p[1] << 8) | p[2];
+				p += 3;
+			}
 		}
 		
-		default:
+		if (asynSize == sizeof(epicsUInt32))
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
-			return (asynError);
+			((epicsUInt32 *) data)[n++] = (nwords == 2) ? ((word[1] << 16) | word[0]) : word[0];
+		}
+		else
+		{
+			for (j = 0; (j < nwords) && (n < nelements); j++)
+			{
+				((epicsUInt16 *) data)[n++] = (epicsUInt16) word[j];
+			}
 		}
 	}
 	
-	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
-	
-/* form FINS message and send data */
-
-	if (finsWrite(pdrvPvt, pasynUser, (void *) value, nelements, addr, sizeof(epicsUInt32)) < 0)
-	{
-		return (asynError);
-	}
-
-	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, wrote %lu 32-bit word(s).\n", __func__, pdrvPvt->portName, addr, (unsigned long) nelements);
-
-	return (asynSuccess);
+	return (n);
 }
 
-/*** asynFloat32Array *****************************************************************************/
-
+/**************************************************************************************************/
 /*
-	Read 32 bit values from the PLC which are encoded as IEEE floats
+
+	Populate the FINS message based on pasynUser->reason
+	Called by finsRead
+
+	address	PLC source/destination address for memory/counter/timer commands
+	nelements	number of 16/32 words to read for memory/counter/timer commands
+	sendlen	calculated size of message
+	recvlen	expected size of reply
 */
+/**************************************************************************************************/
 
-static asynStatus ReadFloat32Array(void *pvt, asynUser *pasynUser, epicsFloat32 *value, size_t nelements, size_t *nIn)
+static int BuildReadCommand(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg, const size_t address, const size_t nelements)
 {
-	drvPvt * const pdrvPvt = (drvPvt *) pvt;
-	int addr;
-	asynStatus status;
-	
-	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
-	{
-		return (status);
-	}
+	InitHeader(pdrvPvt, pmsg);
 
 	switch (pasynUser->reason)
 	{
+	
+	/* Memory read */
+	
+		case FINS_DM_READ:
+		case FINS_AR_READ:
+		case FINS_IO_READ:
+		case FINS_WR_READ:
+		case FINS_HR_READ:
+		case FINS_EM0_READ ... FINS_EMF_READ:
+		case FINS_DM_WRITE:
+		case FINS_AR_WRITE:
+		case FINS_IO_WRITE:
+		{
+			pmsg->mrc = 0x01;
+			pmsg->src = 0x01;
+
+		/* memory type */
+
+			pmsg->message[COM] = RequestCommand(pdrvPvt, pasynUser)->area;
+			
+			InitAddrSize(pmsg, address, nelements, sizeof(epicsUInt16));
+
+		/* send header + memory type + address + size, receiver header + data */
+				
+			pmsg->sendlen = COM + COMMAND_DATA_OFFSET;
+			pmsg->recvlen = RESP + sizeof(epicsUInt16) * nelements;
+			
+			break;
+		}
+
 		case FINS_DM_READ_32:
 		case FINS_AR_READ_32:
+		case FINS_IO_READ_32:
+		case FINS_DM_WRITE_32:
+		case FINS_AR_WRITE_32:
+		case FINS_IO_WRITE_32:
+		{
+			pmsg->mrc = 0x01;
+			pmsg->src = 0x01;
+
+		/* memory type */
+
+			pmsg->message[COM] = RequestCommand(pdrvPvt, pasynUser)->area;
+
+			InitAddrSize(pmsg, address, nelements, sizeof(epicsUInt32));
+			
+			pmsg->sendlen = COM + COMMAND_DATA_OFFSET;
+			pmsg->recvlen = RESP + sizeof(epicsUInt32) * nelements;
+			
+			break;
+		}
+
+		case FINS_MODEL:
+		{
+			pmsg->mrc = 0x05;
+			pmsg->src = 0x02;
+
+		/* address is unit number */
+		
+			pmsg->message[COM + 0] = address & 0xff;
+			pmsg->message[COM + 1] = 1;
+			
+			pmsg->sendlen = COM + 2;
+			pmsg->recvlen = RESP + 2 + FINS_MODEL_LEN;
+			
+			break;
+		}
+		
+		case FINS_CPU_STATUS:
+		case FINS_CPU_MODE:
+		case FINS_CPU_FATAL:
+		case FINS_CPU_NONFATAL:
+		{
+			pmsg->mrc = 0x06;
+			pmsg->src = 0x01;
+			
+			pmsg->sendlen = COM;
+			pmsg->recvlen = RESP + FINS_CPU_STATE_LEN;
+
+			break;
+		}
+	
+		case FINS_CYCLE_TIME:
+		case FINS_CYCLE_TIME_MEAN:
+		case FINS_CYCLE_TIME_MAX:
+		case FINS_CYCLE_TIME_MIN:
+		{
+			pmsg->mrc = 0x06;
+			pmsg->src = 0x20;
+
+			pmsg->message[COM] = 0x01;
+			
+			pmsg->sendlen = COM + 1;
+			pmsg->recvlen = RESP + FINS_CYCLE_TIME_LEN * sizeof(epicsUInt32);
+			
+			break;
+		}
+
+		case FINS_CLOCK_READ:
+		{
+			pmsg->mrc = 0x07;
+			pmsg->src = 0x01;
+			
+			pmsg->sendlen = COM;
+			pmsg->recvlen = RESP + FINS_CLOCK_READ_LEN * sizeof(epicsUInt8);
+		
+			break;
+		}
+
+		case FINS_ECHO_TEST:
+		{
+			pmsg->mrc = 0x08;
+			pmsg->src = 0x01;
+			
+			pmsg->message[COM + 0] = pdrvPvt->snode;
+			pmsg->message[COM + 1] = pdrvPvt->snode;
+			pmsg->message[COM + 2] = pdrvPvt->snode;
+			pmsg->message[COM + 3] = pdrvPvt->snode;
+			
+			pmsg->sendlen = COM + 4;
+			pmsg->recvlen = RESP + sizeof(epicsUInt32);
+		
+			break;
+		}	
+		
+		case FINS_MM_READ:
 		{
-			if (((pdrvPvt->type == FINS_UDP_type) && ((nelements * 2) > FINS_MAX_UDP_WORDS)) || ((pdrvPvt->type == FINS_TCP_type) && ((nelements * 2) > FINS_MAX_TCP_WORDS)) || ((pdrvPvt->type == HOSTLINK_type) && ((nelements * 2) > FINS_MAX_HOST_WORDS)))
+			finsMMTable * const ptable = MMLock(pdrvPvt);
+			const finsMMEntry * const pentry = MMEntry(ptable, address, 0);
+			
+			if ((pentry == NULL) || (pentry->nitems == 0))
 			{
-				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, request too big for %s.\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
-				return (asynError);
+				epicsMutexUnlock(ptable->lock);
+				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no Multiple Memory Area entry %d.\n", __func__, pdrvPvt->portName, (int) address);
+				return (-1);
 			}
 			
+			pmsg->mrc = 0x01;
+			pmsg->src = 0x04;
+			
+			MMBuild(pmsg, pentry);
+			
+			epicsMutexUnlock(ptable->lock);
+
 			break;
 		}
 		
 		default:
 		{
 			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
-			return (asynError);
+			return (-1);
 		}
 	}
-	
-	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
-	
-/* send FINS request */
-
-	if (finsRead(pdrvPvt, pasynUser, (void *) value, nelements, addr, nIn, sizeof(epicsInt32)) < 0)
-	{
-		*nIn = 0;
-		return (asynError);
-	}
 
-	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, read %lu float(s).\n", __func__, pdrvPvt->portName, addr, (unsigned long) *nIn);
-	
-	return (asynSuccess);
+	return (0);
 }
 
-static asynStatus WriteFloat32Array(void *pvt, asynUser *pasynUser, epicsFloat32 *value, size_t nelements)
-{
-	drvPvt * const pdrvPvt = (drvPvt *) pvt;
-	int addr;
-	asynStatus status;
+/*
+	The header and command bytes of a record's read only change with its address and size, so
+	they are kept in its finsUser and copied from there while they still apply. A poller's asynUser
+	can be used by more than one poller thread, for example for a record inside two blocks, so the
+	template is only touched under the port's tmplLock.
+*/
 
-	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+static int BuildReadMessage(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg, const size_t address, const size_t nelements)
+{
+	finsUser * const puser = RequestUser(pdrvPvt, pasynUser);
+	finsTemplate * const ptmpl = puser ? &puser->request : NULL;
+	int found = 0;
+	
+	if (ptmpl)
 	{
-		return (status);
+		epicsMutexMustLock(pdrvPvt->tmplLock);
+		
+		if ((ptmpl->reason == pasynUser->reason) && (ptmpl->address == address) && (ptmpl->nelements == nelements) && (ptmpl->dnode == pdrvPvt->dnode) && (ptmpl->snode == pdrvPvt->snode))
+		{
+			memcpy(pmsg->message, ptmpl->message, ptmpl->sendlen);
+			
+			pmsg->mrc = ptmpl->mrc;
+			pmsg->src = ptmpl->src;
+			pmsg->sendlen = ptmpl->sendlen;
+			pmsg->recvlen = ptmpl->recvlen;
+			found = 1;
+		}
+		
+		epicsMutexUnlock(pdrvPvt->tmplLock);
 	}
-
-	switch (pasynUser->reason)
+	
+	if (found == 0)
 	{
-		case FINS_DM_WRITE_32:
-		case FINS_AR_WRITE_32:
+		if (BuildReadCommand(pdrvPvt, pasynUser, pmsg, address, nelements) < 0)
 		{
-			if (((pdrvPvt->type == FINS_UDP_type) && ((nelements * 2) > FINS_MAX_UDP_WORDS)) || ((pdrvPvt->type == FINS_TCP_type) && ((nelements * 2) > FINS_MAX_TCP_WORDS)) || ((pdrvPvt->type == HOSTLINK_type) && ((nelements * 2) > FINS_MAX_HOST_WORDS)))
-			{
-				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, request too big for %s.\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
-				return (asynError);
-			}
-			
-			break;
+			return (-1);
 		}
 		
-		default:
+	/* the Multiple Memory Area Read table can be redefined, so build those every time */
+	
+		if (ptmpl)
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
-			return (asynError);
+			epicsMutexMustLock(pdrvPvt->tmplLock);
+			
+			if ((pasynUser->reason != FINS_MM_READ) && (pmsg->sendlen <= FINS_TEMPLATE_LEN))
+			{
+				ptmpl->reason = pasynUser->reason;
+				ptmpl->address = address;
+				ptmpl->nelements = nelements;
+				ptmpl->dnode = pdrvPvt->dnode;
+				ptmpl->snode = pdrvPvt->snode;
+				ptmpl->mrc = pmsg->mrc;
+				ptmpl->src = pmsg->src;
+				ptmpl->sendlen = pmsg->sendlen;
+				ptmpl->recvlen = pmsg->recvlen;
+				
+				memcpy(ptmpl->message, pmsg->message, pmsg->sendlen);
+			}
+			else
+			{
+				ptmpl->reason = FINS_NULL;
+			}
+			
+			epicsMutexUnlock(pdrvPvt->tmplLock);
 		}
 	}
 	
-	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+	pmsg->message[MRC] = pmsg->mrc;
+	pmsg->message[SRC] = pmsg->src;
+	pmsg->message[SID] = pmsg->sid = NextSid(pdrvPvt);
+
+/* add the FINS TCP command */
+
+	if (pdrvPvt->type == FINS_TCP_type)
+	{
 	
-/* form FINS message and send data */
+	/* the FINS Frame Send Command goes in the headroom in front of the message */
+	
+		AddCommand(pmsg->buffer, pmsg->sendlen, FINS_FRAME_SEND_COMMAND);
+			
+		pmsg->sendlen += FINS_SEND_FRAME_SIZE;
+		pmsg->recvlen += FINS_SEND_FRAME_SIZE;
+	}
 
-	if (finsWrite(pdrvPvt, pasynUser, (void *) value, nelements, addr, sizeof(epicsInt32)) < 0)
+	return (0);
+}
+
+/**************************************************************************************************/
+
+/*
+	check the response codes MRES & SRES, the SID, message codes and addresses
+*/
+
+static int CheckData(const drvPvt * const pdrvPvt, asynUser *pasynUser, const finsMsg * const pmsg)
+{
+	
+/* check response code */
+
+	if (pmsg->message[MRES] != 0x00)
 	{
-		return (asynError);
+		FINSerror(pdrvPvt, pasynUser, __func__, pmsg->message[MRES], pmsg->message[SRES]);
+		return (-1);
+	}
+	
+/* SID check - probably received a UDP packet out of order */
+	
+	if (pmsg->sid != pmsg->message[SID])
+	{
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, SID %u sent, wrong SID %u received.\n", __func__, pdrvPvt->portName, (epicsUInt8) pmsg->sid, (epicsUInt8) pmsg->message[SID]);
+		return (-1);
 	}
+	
+/* command check */
 
-	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, wrote %lu float(s).\n", __func__, pdrvPvt->portName, addr, (unsigned long) nelements);
+	if ((pmsg->message[MRC] != pmsg->mrc) || (pmsg->message[SRC] != pmsg->src))
+	{
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, wrong MRC/SRC received.\n", __func__, pdrvPvt->portName);
+		return (-1);
+	}
+	
+/* source address check */
+	
+	if ((pmsg->message[DA1] != pdrvPvt->snode) || (pmsg->message[SA1] != pdrvPvt->dnode))
+	{
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, illegal source address received. %d = %d, %d = %d\n", __func__, pdrvPvt->portName, pmsg->message[DA1], pdrvPvt->snode, pmsg->message[SA1], pdrvPvt->dnode);
+		return (-1);
+	}
 
-	return (asynSuccess);
+	return (0);
 }
 
-/*** asynDrvUser **********************************************************************************/
+/**************************************************************************************************/
 
-static asynStatus drvUserDestroy(void *drvPvt, asynUser *pasynUser)
+static int HistBucket(const unsigned int us)
 {
-	return (asynSuccess);
+	int msb = 0, bucket;
+	
+	if (us < 4)
+	{
+		return (us);
+	}
+	
+	while (us >> (msb + 1))
+	{
+		msb++;
+	}
+	
+/* four buckets per power of two, selected by the two bits below the most significant one */
+
+	bucket = 4 * (msb - 1) + ((us >> (msb - 2)) & 3);
+	
+	return ((bucket < FINS_HIST_BUCKETS) ? bucket : FINS_HIST_BUCKETS - 1);
 }
 
-static asynStatus drvUserGetType(void *drvPvt, asynUser *pasynUser, const char **pptypeName, size_t *psize)
+/* lowest time in a bucket in seconds */
+
+static double HistBound(const int bucket)
 {
-	*psize = 0;
-	return (asynSuccess);
+	if (bucket < 4)
+	{
+		return (bucket * 1e-6);
+	}
+	
+	return ((double) ((4 + (bucket & 3)) << (bucket / 4 - 1)) * 1e-6);
 }
 
-static asynStatus drvUserCreate(void *pvt, asynUser *pasynUser, const char *drvInfo, const char **pptypeName, size_t *psize)
+/* the port thread, pollers and finsBench clients all add to a histogram, so each has a lock */
+
+static void HistInit(finsHist * const phist)
 {
-	drvPvt * const pdrvPvt = (drvPvt *) pvt;
+	phist->lock = epicsMutexMustCreate();
+}
 
-	if (drvInfo)
+static void HistFree(finsHist * const phist)
+{
+	epicsMutexDestroy(phist->lock);
+}
+
+static void HistAdd(finsHist * const phist, const double seconds)
+{
+	const int us = (seconds < 2000.0) ? (int) (seconds * 1e6) : 2000000000;
+	
+	epicsMutexMustLock(phist->lock);
+	
+	phist->count[HistBucket(us)]++;
+	phist->n++;
+	phist->last = us;
+	
+	if (us > phist->max)
 	{
-		if (strcmp("FINS_DM_READ", drvInfo) == 0)
-		{
-			pasynUser->reason = FINS_DM_READ;
-		}
-		else
-		if (strcmp("FINS_DM_READ_32", drvInfo) == 0)
+		phist->max = us;
+	}
+	
+	epicsMutexUnlock(phist->lock);
+}
+
+static size_t HistCount(const finsHist * const phist)
+{
+	size_t n;
+	
+	epicsMutexMustLock(phist->lock);
+	n = phist->n;
+	epicsMutexUnlock(phist->lock);
+	
+	return (n);
+}
+
+static double HistMax(const finsHist * const phist)
+{
+	int max;
+	
+	epicsMutexMustLock(phist->lock);
+	max = phist->max;
+	epicsMutexUnlock(phist->lock);
+	
+	return (max * 1e-6);
+}
+
+/*
+	The response time in seconds that q of the responses were faster than, taken as the upper edge
+	of the bucket it falls in. Zero if there haven't been any.
+*/
+
+static double HistPercentile(const finsHist * const phist, const double q)
+{
+	double bound;
+	size_t sum = 0;
+	int i;
+	
+	epicsMutexMustLock(phist->lock);
+	
+	if (phist->n == 0)
+	{
+		epicsMutexUnlock(phist->lock);
+		return (0.0);
+	}
+	
+	for (i = 0; i < FINS_HIST_BUCKETS - 1; i++)
+	{
+		sum += phist->count[i];
+		
+		if (sum >= q * phist->n)
 		{
-			pasynUser->reason = FINS_DM_READ_32;
+			break;
 		}
-		else
-		if (strcmp("FINS_DM_WRITE", drvInfo) == 0)
+	}
+	
+	bound = (i < FINS_HIST_BUCKETS - 1) ? HistBound(i + 1) : phist->max * 1e-6;
+	
+	epicsMutexUnlock(phist->lock);
+	
+	return (bound);
+}
+
+static void HistClear(finsHist * const phist)
+{
+	epicsMutexMustLock(phist->lock);
+	
+	memset(phist->count, 0, sizeof(phist->count));
+	phist->n = 0;
+	phist->max = 0;
+	phist->last = 0;
+	
+	epicsMutexUnlock(phist->lock);
+}
+
+static void HistReport(const finsHist * const phist, FILE *fp, const char *name, const int details)
+{
+	finsHist copy;
+	
+	epicsMutexMustLock(phist->lock);
+	copy = *phist;
+	epicsMutexUnlock(phist->lock);
+	
+	fprintf(fp, "    %-6s n %lu  p50 %.6fs  p90 %.6fs  p99 %.6fs  p99.9 %.6fs  max %.6fs  last %.6fs\n", name, (unsigned long) copy.n,
+		HistPercentile(phist, 0.5), HistPercentile(phist, 0.9), HistPercentile(phist, 0.99), HistPercentile(phist, 0.999),
+		copy.max * 1e-6, copy.last * 1e-6);
+	
+	if (details > 1)
+	{
+		int i;
+		
+		for (i = 0; i < FINS_HIST_BUCKETS; i++)
 		{
-			pasynUser->reason = FINS_DM_WRITE;
+			if (copy.count[i])
+			{
+				fprintf(fp, "        >= %.6fs  %lu\n", HistBound(i), (unsigned long) copy.count[i]);
+			}
 		}
-		else
-		if (strcmp("FINS_DM_WRITE_NOREAD", drvInfo) == 0)
+	}
+}
+
+static void UpdateTimes(drvPvt * const pdrvPvt, const int class, epicsTimeStamp *ets, epicsTimeStamp *ete)
+{
+	epicsTimeGetCurrent(ete);
+	
+	HistAdd(&pdrvPvt->latency[class], epicsTimeDiffInSeconds(ete, ets));
+}
+
+/**************************************************************************************************/
+/*
+	Return the PLC memory area code of a memory read/write command, or zero if the command doesn't
+	address PLC memory. width is set to the number of 16-bit PLC words per element.
+*/
+
+static epicsUInt8 MemoryArea(const int reason, int *width)
+{
+	const finsCommand * const pcmd = Command(reason);
+	
+	*width = pcmd->width;
+	
+	return (pcmd->area);
+}
+
+static epicsUInt8 RequestArea(const drvPvt * const pdrvPvt, asynUser *pasynUser, int *width)
+{
+	const finsCommand * const pcmd = RequestCommand(pdrvPvt, pasynUser);
+	
+	*width = pcmd->width;
+	
+	return (pcmd->area);
+}
+
+/* the most words of PLC memory that one frame of the transport can carry */
+
+static size_t TransportWords(const drvPvt * const pdrvPvt)
+{
+	switch (pdrvPvt->type)
+	{
+		case FINS_UDP_type:
 		{
-			pasynUser->reason = FINS_DM_WRITE_NOREAD;
+			return (FINS_MAX_UDP_WORDS);
 		}
-		else
-		if (strcmp("FINS_DM_WRITE_32", drvInfo) == 0)
+		
+		case FINS_TCP_type:
 		{
-			pasynUser->reason = FINS_DM_WRITE_32;
+			return (FINS_MAX_TCP_WORDS);
 		}
-		else
-		if (strcmp("FINS_DM_WRITE_32_NOREAD", drvInfo) == 0)
+		
+		default:
 		{
-			pasynUser->reason = FINS_DM_WRITE_32_NOREAD;
+			return (FINS_MAX_HOST_WORDS);
 		}
-		else
-		if (strcmp("FINS_IO_READ", drvInfo) == 0)
+	}
+}
+
+/* and that the port puts in one frame, see finsFrameSize */
+
+static size_t MaxWords(const drvPvt * const pdrvPvt)
+{
+	return ((pdrvPvt->maxwords) ? pdrvPvt->maxwords : TransportWords(pdrvPvt));
+}
+
+/**************************************************************************************************/
+/*
+	Convert between PLC words in host byte order, as kept by the block and read caches, and asyn
+	elements. 32-bit values are low word first.
+*/
+
+static void ImageCopy(const epicsUInt16 *ptrs, void *data, const size_t nelements, const int width, const size_t asynSize)
+{
+	size_t i;
+	
+	if (width == 2)
+	{
+		epicsUInt32 *ptrd = (epicsUInt32 *) data;
+		
+		for (i = 0; i < nelements; i++)
 		{
-			pasynUser->reason = FINS_IO_READ;
+			ptrd[i] = ((epicsUInt32) ptrs[2 * i + 1] << 16) | ptrs[2 * i];
 		}
-		else
-		if (strcmp("FINS_IO_READ_32", drvInfo) == 0)
+	}
+	else if (asynSize == sizeof(epicsUInt16))
+	{
+		memcpy(data, ptrs, nelements * sizeof(epicsUInt16));
+	}
+	else
+	{
+		epicsUInt32 *ptrd = (epicsUInt32 *) data;
+		
+		for (i = 0; i < nelements; i++)
 		{
-			pasynUser->reason = FINS_IO_READ_32;
+			ptrd[i] = ptrs[i];
 		}
-		else
-		if (strcmp("FINS_IO_WRITE", drvInfo) == 0)
+	}
+}
+
+/* PLC word i of the asyn elements */
+
+static epicsUInt16 ImageWord(const void *data, const size_t i, const int width, const size_t asynSize)
+{
+	if (width == 2)
+	{
+		const epicsUInt32 value32 = ((const epicsUInt32 *) data)[i / 2];
+		
+		return ((i & 1) ? (value32 >> 16) : (value32 & 0xffff));
+	}
+	
+	if (asynSize == sizeof(epicsUInt16))
+	{
+		return (((const epicsUInt16 *) data)[i]);
+	}
+	
+	return ((epicsUInt16) ((const epicsUInt32 *) data)[i]);
+}
+
+/**************************************************************************************************/
+/*
+	Find the block that contains nwords of the area from address. Call with blockLock held.
+*/
+
+static finsBlock *BlockFind(drvPvt * const pdrvPvt, const epicsUInt8 area, const size_t address, const size_t nwords)
+{
+	finsBlock *pblock;
+	
+	for (pblock = (finsBlock *) ellFirst(&pdrvPvt->blockList); pblock; pblock = (finsBlock *) ellNext(&pblock->node))
+	{
+		if ((pblock->area == area) && (address >= pblock->start) && (address + nwords <= pblock->start + pblock->nwords))
 		{
-			pasynUser->reason = FINS_IO_WRITE;
+			return (pblock);
 		}
-		else
-		if (strcmp("FINS_IO_WRITE_NOREAD", drvInfo) == 0)
+	}
+	
+	return (NULL);
+}
+
+/**************************************************************************************************/
+/*
+	Serve a memory read from a block cache image if a valid block contains the whole request.
+	Returns 0 if the data was copied, -1 if the request has to go to the PLC.
+	
+	The image holds host order words, so 32-bit values are the low word followed by the high word.
+*/
+
+static int BlockRead(drvPvt * const pdrvPvt, asynUser *pasynUser, void *data, const size_t nelements, const epicsUInt16 address, size_t *transferred, const size_t asynSize)
+{
+	int width;
+	const epicsUInt8 area = RequestArea(pdrvPvt, pasynUser, &width);
+	finsBlock *pblock;
+	
+	if ((area == 0) || (ellCount(&pdrvPvt->blockList) == 0))
+	{
+		return (-1);
+	}
+	
+	epicsMutexMustLock(pdrvPvt->blockLock);
+	
+	pblock = BlockFind(pdrvPvt, area, address, nelements * width);
+	
+	if ((pblock == NULL) || (pblock->valid == 0))
+	{
+		epicsMutexUnlock(pdrvPvt->blockLock);
+		return (-1);
+	}
+	
+	ImageCopy(pblock->image + (address - pblock->start), data, nelements, width, asynSize);
+	
+	pblock->nhits++;
+	
+	epicsMutexUnlock(pdrvPvt->blockLock);
+	
+	asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s: port %s, %lu element(s) from the block cache.\n", __func__, pdrvPvt->portName, (unsigned long) nelements);
+	
+	if (transferred) *transferred = nelements;
+	
+	return (0);
+}
+
+/**************************************************************************************************/
+/*
+	After a successful memory write update any block images that overlap the written words so that
+	cached reads see the new values before the next poll.
+*/
+
+static void BlockWrite(drvPvt * const pdrvPvt, const int reason, const void *data, const size_t nelements, const epicsUInt16 address, const size_t asynSize)
+{
+	int width;
+	const epicsUInt8 area = MemoryArea(reason, &width);
+	finsBlock *pblock;
+	
+	if ((area == 0) || (ellCount(&pdrvPvt->blockList) == 0))
+	{
+		return;
+	}
+	
+	epicsMutexMustLock(pdrvPvt->blockLock);
+	
+	for (pblock = (finsBlock *) ellFirst(&pdrvPvt->blockList); pblock; pblock = (finsBlock *) ellNext(&pblock->node))
+	{
+		size_t i;
+		
+		if (pblock->area != area)
 		{
-			pasynUser->reason = FINS_IO_WRITE_NOREAD;
+			continue;
 		}
-		else
-		if (strcmp("FINS_IO_WRITE_32", drvInfo) == 0)
+		
+		for (i = 0; i < nelements * width; i++)
 		{
-			pasynUser->reason = FINS_IO_WRITE_32;
+			const size_t word = address + i;
+			
+			if ((word < pblock->start) || (word >= pblock->start + pblock->nwords))
+			{
+				continue;
+			}
+			
+			pblock->image[word - pblock->start] = ImageWord(data, i, width, asynSize);
 		}
-		else
-		if (strcmp("FINS_IO_WRITE_32_NOREAD", drvInfo) == 0)
+	}
+	
+	epicsMutexUnlock(pdrvPvt->blockLock);
+}
+
+/**************************************************************************************************/
+/*
+	Form a FINS read message, send request, wait for the reply and check for errors
+	
+	This function knows about various message types an forms the correct message
+	and processes the reply based on pasynUser->reason.
+	
+	data		epicsInt16, epicsInt32 or epicsFloat32
+	nelements	number of items to read
+	address	PLC memory address
+	transferred	normally the same as nelements
+	asynSize	sizeof(epicsInt16) for asynInt16Array or sizeof(epicsInt32) for asynInt32, asynInt32Array, asynFloat32Array, asynFloat64
+			defines the type of data to be returned to asyn
+*/
+/**************************************************************************************************/
+/*
+	Decode a field of a CPU Unit Status Read or Cycle Time Read response, resp being the data after
+	the end code.
+*/
+
+static int StatusFrame(const int reason)
+{
+	switch (reason)
+	{
+		case FINS_CPU_STATUS:
+		case FINS_CPU_MODE:
+		case FINS_CPU_FATAL:
+		case FINS_CPU_NONFATAL:
 		{
-			pasynUser->reason = FINS_IO_WRITE_32_NOREAD;
+			return (FINS_STATUS_CPU);
 		}
-		else
-		if (strcmp("FINS_AR_READ", drvInfo) == 0)
+		
+		case FINS_CYCLE_TIME:
+		case FINS_CYCLE_TIME_MEAN:
+		case FINS_CYCLE_TIME_MAX:
+		case FINS_CYCLE_TIME_MIN:
 		{
-			pasynUser->reason = FINS_AR_READ;
+			return (FINS_STATUS_CYCLE);
 		}
-		else
-		if (strcmp("FINS_AR_READ_32", drvInfo) == 0)
+		
+		default:
 		{
-			pasynUser->reason = FINS_AR_READ_32;
+			return (-1);
 		}
-		else
-		if (strcmp("FINS_AR_WRITE", drvInfo) == 0)
+	}
+}
+
+static void StatusDecode(const int reason, const epicsUInt8 *resp, void *data, const size_t nelements)
+{
+	epicsInt32 * const ptrd = (epicsInt32 *) data;
+	
+	switch (reason)
+	{
+		case FINS_CPU_STATUS:
 		{
-			pasynUser->reason = FINS_AR_WRITE;
+			*ptrd = resp[0];
+			break;
 		}
-		else
-		if (strcmp("FINS_AR_WRITE_NOREAD", drvInfo) == 0)
+		
+		case FINS_CPU_MODE:
 		{
-			pasynUser->reason = FINS_AR_WRITE_NOREAD;
+			*ptrd = resp[1];
+			break;
 		}
-		else
-		if (strcmp("FINS_AR_WRITE_32", drvInfo) == 0)
+		
+		case FINS_CPU_FATAL:
 		{
-			pasynUser->reason = FINS_AR_WRITE_32;
+			const epicsUInt16 word = BSWAP16(*(epicsUInt16 *) &resp[2]);
+			
+			*ptrd = word;
+			break;
 		}
-		else
-		if (strcmp("FINS_AR_WRITE_32_NOREAD", drvInfo) == 0)
+		
+		case FINS_CPU_NONFATAL:
 		{
-			pasynUser->reason = FINS_AR_WRITE_32_NOREAD;
+			const epicsUInt16 word = BSWAP16(*(epicsUInt16 *) &resp[4]);
+			
+			*ptrd = word;
+			break;
 		}
-		else
-		if (strcmp("FINS_WR_READ", drvInfo) == 0)
+
+	/* mean, max and min */
+	
+		case FINS_CYCLE_TIME:
 		{
-			pasynUser->reason = FINS_WR_READ;
-		}
-		else
-		if (strcmp("FINS_HR_READ", drvInfo) == 0)
+			const epicsInt32 *rep = (const epicsInt32 *) resp;
+			int i;
+			
+			for (i = 0; (i < nelements) && (i < FINS_CYCLE_TIME_LEN); i++)
+			{
+				ptrd[i] = BSWAP32(rep[i]);
+			}
+			
+			break;
+		}
+		
+		case FINS_CYCLE_TIME_MEAN:
+		case FINS_CYCLE_TIME_MAX:
+		case FINS_CYCLE_TIME_MIN:
+		{
+			const epicsInt32 *rep = (const epicsInt32 *) resp + (reason - FINS_CYCLE_TIME_MEAN);
+			
+			*ptrd = BSWAP32(*rep);
+			break;
+		}
+	}
+}
+
+/**************************************************************************************************/
+
+/* build and send a read request. Unless it fails the reply must be collected with ReadFinish */
+
+static int ReadStart(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg, const size_t nelements, const epicsUInt16 address)
+{
+	if (NodeReady(pdrvPvt, pasynUser) < 0)
+	{
+		return (-1);
+	}
+	
+/* return the size of the message to write and the expected size of the message to read */
+
+	if (BuildReadMessage(pdrvPvt, pasynUser, pmsg, address, nelements) < 0)
+	{
+		return (-1);
+	}
+
+/* using %lu and casting to unsigned long instead of using %zu because of our old PPC/vxWorks gcc compiler */
+
+	asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, (char *) MsgFrame(pdrvPvt, pmsg), pmsg->sendlen, "%s: port %s, sending %lu bytes, expecting %lu bytes.\n", __func__, pdrvPvt->portName, (unsigned long) pmsg->sendlen, (unsigned long) pmsg->recvlen);
+	
+	if (pasynUser->timeout <= 0.0)
+	{
+		 pasynUser->timeout = FINS_TIMEOUT;
+	}
+	
+	finsTransferStart(pdrvPvt, pasynUser, pmsg);
+	
+	return (0);
+}
+
+static int ReadFinish(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg, void *data, const size_t nelements, const epicsUInt16 address, size_t *transferred, size_t asynSize)
+{
+	size_t sentlen = 0, recdlen = 0;
+	int eomReason = 0;
+	asynStatus status;
+	epicsTimeStamp ete;
+	
+	status = finsTransferWait(pdrvPvt, pasynUser, pmsg, &sentlen, &recdlen, &eomReason);
+
+	UpdateTimes(pdrvPvt, RequestCommand(pdrvPvt, pasynUser)->area ? FINS_CLASS_READ : FINS_CLASS_STATUS, &pmsg->ets, &ete);
+	
+	switch (status)
+	{
+		case asynSuccess:
+		{
+			break;
+		}
+		
+		case asynTimeout:
+		case asynOverflow:
+		case asynError:
+		case asynDisconnected:
+		case asynDisabled:
+		{
+		
+		/* the circuit breaker has said why when it opened */
+		
+			asynPrint(pasynUser, FailTrace(pdrvPvt, status), "%s: port %s, writeRead() failed with %s.\n", __func__, pdrvPvt->portName, asynStatusMessages[status]);
+			return (-1);
+		}
+		
+		default:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, unknown asyn return code %d.\n", __func__, pdrvPvt->portName, status);
+			return (-1);
+		}
+	}
+
+	asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, (char *) MsgFrame(pdrvPvt, pmsg), recdlen, "%s: port %s, received %lu bytes.\n", __func__, pdrvPvt->portName, (unsigned long) recdlen);
+
+	if (sentlen != pmsg->sendlen)
+	{
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, writeRead() write failed. %lu != %lu\n", __func__, pdrvPvt->portName, (unsigned long) sentlen, (unsigned long) pmsg->sendlen);
+		return (-1);
+	}
+	
+	if (recdlen != pmsg->recvlen)
+	{
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, writeRead() read failed.\n", __func__, pdrvPvt->portName);
+		return (-1);
+	}
+
+/* check the TCP FINS header */
+
+	if (pdrvPvt->type == FINS_TCP_type)
+	{
+		const unsigned int ferror = BSWAP32(((unsigned int *) pmsg->buffer)[FINS_MODE_ERROR]);
+		 
+		if (ferror != FINS_ERROR_NORMAL) 
+		{
+			TCPDisconnect(pdrvPvt);
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, FINS Frame Send error 0x%x.\n", __func__, pdrvPvt->portName, ferror);
+			
+			return (-1);
+		}
+	}
+	
+	if (CheckData(pdrvPvt, pasynUser, pmsg) < 0)
+	{
+		return (-1);
+	}
+
+/* extract data */
+
+	switch (pasynUser->reason)
+	{
+		case FINS_DM_READ:
+		case FINS_AR_READ:
+		case FINS_IO_READ:
+		case FINS_WR_READ:
+		case FINS_HR_READ:
+		case FINS_EM0_READ ... FINS_EMF_READ:
+		case FINS_DM_WRITE:
+		case FINS_AR_WRITE:
+		case FINS_IO_WRITE:
+		{
+			int i;
+			epicsUInt16 *ptrs = (epicsUInt16 *) &pmsg->message[RESP];
+			
+		/* asynInt16Array */
+		
+			if (asynSize == sizeof(epicsUInt16))
+			{
+				epicsUInt16 *ptrd = (epicsUInt16 *) data;
+
+				for (i = 0; i < nelements; i++)
+				{
+					ptrd[i] = (epicsUInt16) BSWAP16(ptrs[i]);
+				}
+			}
+			else
+			
+		/* asynInt32 * 1 */
+		
+			{			
+				epicsUInt32 *ptrd = (epicsUInt32 *) data;
+
+				for (i = 0; i < nelements; i++)
+				{
+					ptrd[i] = (epicsUInt32) BSWAP16(ptrs[i]);
+				}
+			}
+
+			asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s: port %s, %s %lu 16-bit word(s).\n", __func__, pdrvPvt->portName, SWAPT, (unsigned long) nelements);
+			
+			break;
+		}
+
+		case FINS_DM_READ_32:
+		case FINS_AR_READ_32:
+		case FINS_IO_READ_32:
+		case FINS_DM_WRITE_32:
+		case FINS_AR_WRITE_32:
+		case FINS_IO_WRITE_32:
+		{		
+			int i;
+			epicsUInt32 *ptrs = (epicsUInt32 *) &pmsg->message[RESP];
+			epicsUInt32 *ptrd = (epicsUInt32 *) data;
+
+			for (i = 0; i < nelements; i++)
+			{
+				ptrd[i] = WSWAP32(ptrs[i]);
+			}
+				
+			asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s: port %s, swapping %lu 32-bit word(s).\n", __func__, pdrvPvt->portName, (unsigned long) nelements);
+			
+			break;
+		}
+		
+/* return a string of 20 chars, packed as two characters per word */
+
+		case FINS_MODEL:
+		{
+			memcpy(data, &pmsg->message[RESP + 2], nelements);
+			
+			break;
+		}
+
+/* CPU status and cycle time - epicsInt32 */
+
+		case FINS_CPU_STATUS:
+		case FINS_CPU_MODE:
+		case FINS_CPU_FATAL:
+		case FINS_CPU_NONFATAL:
+		case FINS_CYCLE_TIME:
+		case FINS_CYCLE_TIME_MEAN:
+		case FINS_CYCLE_TIME_MAX:
+		case FINS_CYCLE_TIME_MIN:
+		{
+			StatusDecode(pasynUser->reason, &pmsg->message[RESP], data, nelements);
+			
+			break;
+		}
+
+/* asynInt16array */
+
+		case FINS_CLOCK_READ:	/* convert from BCD to dec */
+		{
+			epicsInt8  *rep = (epicsInt8 *)  &pmsg->message[RESP + 0];
+			epicsInt16 *dat = (epicsInt16 *) data;
+			int i;
+			
+			for (i = 0; i < nelements; i++)
+			{
+				*dat++ = *rep++;
+			}
+
+			break;
+		}
+
+		case FINS_ECHO_TEST:
+		{
+			const epicsInt32 *rep = (epicsInt32 *) &pmsg->message[RESP + 0];
+
+			*(epicsInt32 *)(data) = BSWAP32(*rep);
+			
+			break;
+		}
+				
+		case FINS_MM_READ:
+		{
+			finsMMTable * const ptable = MMLock(pdrvPvt);
+			const finsMMEntry * const pentry = MMEntry(ptable, address, 0);
+			const int n = pentry ? MMExtract(pmsg, pentry, data, nelements, asynSize) : -1;
+			
+			epicsMutexUnlock(ptable->lock);
+			
+			if (n < 0)
+			{
+				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, Multiple Memory Area entry %d changed during the read.\n", __func__, pdrvPvt->portName, (int) address);
+				return (-1);
+			}
+			
+			if (transferred) *transferred = n;
+			
+			return (0);
+		}
+		
+		default:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
+			return (-1);
+		}
+	}
+	
+	if (transferred) *transferred = nelements;
+
+	return (0);	
+}
+
+static int finsReadPLC(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg, void *data, const size_t nelements, const epicsUInt16 address, size_t *transferred, size_t asynSize)
+{
+	if (nelements < 1)
+	{
+		return (0);
+	}
+	
+	if (ReadStart(pdrvPvt, pasynUser, pmsg, nelements, address) < 0)
+	{
+		return (-1);
+	}
+	
+	return (ReadFinish(pdrvPvt, pasynUser, pmsg, data, nelements, address, transferred, asynSize));
+}
+
+/**************************************************************************************************/
+/*
+	Read from the PLC in as many frames as it takes.
+*/
+
+static int finsChunked(drvPvt * const pdrvPvt, asynUser *pasynUser, const int write, void *data, const size_t nelements, const epicsUInt16 address, size_t *transferred, size_t asynSize, const int width);
+static void WriteFlushOverlap(drvPvt * const pdrvPvt, const epicsUInt8 area, const size_t address, const size_t nwords);
+
+static int ReadPLC(drvPvt * const pdrvPvt, asynUser *pasynUser, void *data, const size_t nelements, const epicsUInt16 address, size_t *transferred, size_t asynSize)
+{
+	finsMsg *pmsg;
+	int status, width;
+	
+	if (RequestArea(pdrvPvt, pasynUser, &width) && (nelements * width > MaxWords(pdrvPvt)))
+	{
+		return (finsChunked(pdrvPvt, pasynUser, 0, data, nelements, address, transferred, asynSize, width));
+	}
+	
+	pmsg = MsgGet(pdrvPvt);
+	status = finsReadPLC(pdrvPvt, pasynUser, pmsg, data, nelements, address, transferred, asynSize);
+	MsgPut(pdrvPvt, pmsg);
+	
+	return (status);
+}
+
+/**************************************************************************************************/
+/*
+	Read cache, see finsCacheInit. Each entry has a mutex that the thread reading it from the PLC
+	holds until the words are in the image, so a read of the same words waits on the mutex and
+	then takes the result. The cache lock is never held while waiting for the PLC.
+	
+	Records' reads are queued to the asyn port thread one at a time, so two of them are never in
+	flight together. The wait only joins a read by the port thread with one made directly by a
+	poller thread, see finsPollInit and finsBlockDefine, or between two poller threads.
+*/
+
+static finsCacheEntry *CacheFind(finsCache * const pcache, const epicsUInt8 area, const epicsUInt16 address, const size_t nwords)
+{
+	ELLLIST * const pbucket = &pcache->bucket[(area * 31 + address) % FINS_CACHE_BUCKETS];
+	finsCacheEntry *pentry;
+	
+	for (pentry = (finsCacheEntry *) ellFirst(pbucket); pentry; pentry = (finsCacheEntry *) ellNext(&pentry->node))
+	{
+		if ((pentry->area == area) && (pentry->address == address) && (pentry->nwords == nwords))
+		{
+			return (pentry);
+		}
+	}
+	
+/* the entries are never freed, so stop adding them at some point */
+
+	if (pcache->nentries >= FINS_CACHE_MAX_ENTRIES)
+	{
+		pcache->nfull++;
+		return (NULL);
+	}
+	
+	pentry = (finsCacheEntry *) callocMustSucceed(1, sizeof(finsCacheEntry), __func__);
+	pentry->area = area;
+	pentry->address = address;
+	pentry->nwords = nwords;
+	pentry->flight = epicsMutexMustCreate();
+	pentry->image = (epicsUInt16 *) callocMustSucceed(nwords, sizeof(epicsUInt16), __func__);
+	
+	ellAdd(pbucket, &pentry->node);
+	pcache->nentries++;
+	
+	return (pentry);
+}
+
+static int CacheRead(drvPvt * const pdrvPvt, asynUser *pasynUser, void *data, const size_t nelements, const epicsUInt16 address, size_t *transferred, size_t asynSize)
+{
+	finsCache * const pcache = pdrvPvt->cache;
+	finsCacheEntry *pentry;
+	epicsTimeStamp now;
+	size_t i;
+	int width, status;
+	const epicsUInt8 area = RequestArea(pdrvPvt, pasynUser, &width);
+	
+	epicsMutexMustLock(pcache->lock);
+	
+	if ((pentry = CacheFind(pcache, area, address, nelements * width)) == NULL)
+	{
+		epicsMutexUnlock(pcache->lock);
+		return (ReadPLC(pdrvPvt, pasynUser, data, nelements, address, transferred, asynSize));
+	}
+	
+	epicsTimeGetCurrent(&now);
+	
+	if (pentry->valid && (epicsTimeDiffInSeconds(&now, &pentry->fetched) < pcache->ttl))
+	{
+		ImageCopy(pentry->image, data, nelements, width, asynSize);
+		pcache->nhits++;
+		epicsMutexUnlock(pcache->lock);
+		
+		asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s: port %s, %lu element(s) from the read cache.\n", __func__, pdrvPvt->portName, (unsigned long) nelements);
+		
+		if (transferred) *transferred = nelements;
+		
+		return (0);
+	}
+	
+/* the same words are on their way, wait for them */
+
+	if (pentry->busy)
+	{
+		epicsMutexUnlock(pcache->lock);
+		
+		epicsMutexMustLock(pentry->flight);
+		epicsMutexUnlock(pentry->flight);
+		
+		epicsMutexMustLock(pcache->lock);
+		
+		pcache->nshared++;
+		status = pentry->ok ? 0 : -1;
+		
+		if (status == 0)
+		{
+			ImageCopy(pentry->image, data, nelements, width, asynSize);
+		}
+		
+		epicsMutexUnlock(pcache->lock);
+		
+		if (status < 0)
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, the shared read of %lu word(s) from %u failed.\n", __func__, pdrvPvt->portName, (unsigned long) pentry->nwords, address);
+		}
+		else if (transferred)
+		{
+			*transferred = nelements;
+		}
+		
+		return (status);
+	}
+	
+/* otherwise we read them */
+
+	pentry->busy = 1;
+	pentry->dirty = 0;
+	pcache->nreads++;
+	
+	epicsMutexMustLock(pentry->flight);
+	epicsMutexUnlock(pcache->lock);
+	
+	status = ReadPLC(pdrvPvt, pasynUser, data, nelements, address, transferred, asynSize);
+	
+	epicsMutexMustLock(pcache->lock);
+	
+	if (status == 0)
+	{
+		for (i = 0; i < pentry->nwords; i++)
+		{
+			pentry->image[i] = ImageWord(data, i, width, asynSize);
+		}
+	}
+	
+/* a write while we were reading leaves the result good for the waiters but not for later */
+
+	pentry->ok = (status == 0);
+	pentry->valid = pentry->ok && (pentry->dirty == 0);
+	pentry->fetched = now;
+	pentry->busy = 0;
+	
+	epicsMutexUnlock(pentry->flight);
+	epicsMutexUnlock(pcache->lock);
+	
+	return (status);
+}
+
+/* keep the cached words a write overlaps up to date, or drop them if it failed */
+
+static void CacheWrite(drvPvt * const pdrvPvt, const int reason, const void *data, const size_t nelements, const epicsUInt16 address, const size_t asynSize, const int ok)
+{
+	finsCache * const pcache = pdrvPvt->cache;
+	int width, i;
+	const epicsUInt8 area = MemoryArea(reason, &width);
+	const size_t end = address + nelements * width;
+	
+	if ((pcache == NULL) || (area == 0))
+	{
+		return;
+	}
+	
+	epicsMutexMustLock(pcache->lock);
+	
+	for (i = 0; i < FINS_CACHE_BUCKETS; i++)
+	{
+		finsCacheEntry *pentry;
+		
+		for (pentry = (finsCacheEntry *) ellFirst(&pcache->bucket[i]); pentry; pentry = (finsCacheEntry *) ellNext(&pentry->node))
+		{
+			size_t word;
+			
+			if ((pentry->area != area) || (pentry->address >= end) || (pentry->address + pentry->nwords <= address))
+			{
+				continue;
+			}
+			
+			if (pentry->busy)
+			{
+				pentry->dirty = 1;
+			}
+			
+			if (ok == 0)
+			{
+				pentry->valid = 0;
+				continue;
+			}
+			
+			for (word = (address > pentry->address) ? address : pentry->address; (word < end) && (word < pentry->address + pentry->nwords); word++)
+			{
+				pentry->image[word - pentry->address] = ImageWord(data, word - address, width, asynSize);
+			}
+		}
+	}
+	
+	epicsMutexUnlock(pcache->lock);
+}
+
+/**************************************************************************************************/
+/*
+	Shared CPU status and cycle time, see finsStatusInit. A frame is read from the PLC by whoever
+	finds it stale while holding its flight mutex, so those asking meanwhile wait for that reply.
+*/
+
+static const size_t StatusLen[FINS_STATUS_FRAMES] =
+{
+	[FINS_STATUS_CPU]	= FINS_CPU_STATE_LEN,
+	[FINS_STATUS_CYCLE]	= FINS_CYCLE_TIME_LEN * sizeof(epicsUInt32)
+};
+
+/* called with the frame's flight mutex held */
+
+static int StatusFetch(drvPvt * const pdrvPvt, asynUser *pasynUser, finsStatusFrame * const pframe, void *data, const size_t nelements)
+{
+	finsMsg * const pmsg = MsgGet(pdrvPvt);
+	const int n = StatusFrame(pasynUser->reason);
+	int status;
+	
+	status = finsReadPLC(pdrvPvt, pasynUser, pmsg, data, nelements, 0, NULL, sizeof(epicsInt32));
+	
+	pframe->nreads++;
+	
+	if (status == 0)
+	{
+		memcpy(pframe->reply, &pmsg->message[RESP], StatusLen[n]);
+		pframe->fetched = pmsg->ets;
+		pframe->valid = 1;
+	}
+	else
+	{
+		pframe->valid = 0;
+		pframe->nerrors++;
+	}
+	
+	MsgPut(pdrvPvt, pmsg);
+	
+	return (status);
+}
+
+static int StatusRead(drvPvt * const pdrvPvt, asynUser *pasynUser, void *data, const size_t nelements, size_t *transferred)
+{
+	finsStatus * const pstatus = pdrvPvt->status;
+	finsStatusFrame * const pframe = &pstatus->frame[StatusFrame(pasynUser->reason)];
+	epicsTimeStamp now;
+	int status = 0;
+	
+	epicsMutexMustLock(pframe->flight);
+	epicsTimeGetCurrent(&now);
+	
+	if (pframe->valid && (epicsTimeDiffInSeconds(&now, &pframe->fetched) < pstatus->period))
+	{
+		StatusDecode(pasynUser->reason, pframe->reply, data, nelements);
+		pframe->nshared++;
+		
+		asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s: port %s, %s from the shared status reply.\n", __func__, pdrvPvt->portName, FINS_names[pasynUser->reason]);
+	}
+	else
+	{
+		status = StatusFetch(pdrvPvt, pasynUser, pframe, data, nelements);
+	}
+	
+	epicsMutexUnlock(pframe->flight);
+	
+	if ((status == 0) && transferred)
+	{
+		*transferred = nelements;
+	}
+	
+	return (status);
+}
+
+/**************************************************************************************************/
+/*
+	Serve the read from the block cache if we can, then the read cache if there is one, otherwise
+	from the PLC.
+*/
+
+static int finsRead(drvPvt * const pdrvPvt, asynUser *pasynUser, void *data, const size_t nelements, const epicsUInt16 address, size_t *transferred, size_t asynSize)
+{
+	int width;
+	
+/* the block images only get queued writes once they are in the PLC */
+
+	if (pdrvPvt->wq && RequestArea(pdrvPvt, pasynUser, &width))
+	{
+		WriteFlushOverlap(pdrvPvt, RequestArea(pdrvPvt, pasynUser, &width), address, nelements * width);
+	}
+	
+	if (BlockRead(pdrvPvt, pasynUser, data, nelements, address, transferred, asynSize) == 0)
+	{
+		return (0);
+	}
+	
+	if (pdrvPvt->status && (StatusFrame(pasynUser->reason) >= 0))
+	{
+		return (StatusRead(pdrvPvt, pasynUser, data, nelements, transferred));
+	}
+	
+	if (pdrvPvt->cache && (pdrvPvt->cache->ttl >= 0.0) && RequestArea(pdrvPvt, pasynUser, &width))
+	{
+		return (CacheRead(pdrvPvt, pasynUser, data, nelements, address, transferred, asynSize));
+	}
+	
+	return (ReadPLC(pdrvPvt, pasynUser, data, nelements, address, transferred, asynSize));
+}
+
+/**************************************************************************************************/
+
+/* the header and command bytes of a write, without its data */
+
+static int BuildWriteCommand(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg, const epicsUInt16 address, const size_t nelements)
+{
+	InitHeader(pdrvPvt, pmsg);
+	
+	switch (pasynUser->reason)
+	{
+	
+	/* Memory write */
+	
+		case FINS_DM_WRITE:
+		case FINS_DM_WRITE_NOREAD:
+		case FINS_AR_WRITE:
+		case FINS_AR_WRITE_NOREAD:
+		case FINS_IO_WRITE:
+		case FINS_IO_WRITE_NOREAD:
+		{
+			pmsg->mrc = 0x01;
+			pmsg->src = 0x02;
+				
+			pmsg->message[COM] = RequestCommand(pdrvPvt, pasynUser)->area;
+			
+			InitAddrSize(pmsg, address, nelements, sizeof(epicsUInt16));
+			
+			pmsg->sendlen = COM + COMMAND_DATA_OFFSET;
+			pmsg->recvlen = RESP + 0;
+						
+			break;
+		}
+
+		case FINS_DM_WRITE_32:
+		case FINS_DM_WRITE_32_NOREAD:
+		case FINS_AR_WRITE_32:
+		case FINS_AR_WRITE_32_NOREAD:
+		case FINS_IO_WRITE_32:
+		case FINS_IO_WRITE_32_NOREAD:
+		{
+			pmsg->mrc = 0x01;
+			pmsg->src = 0x02;
+				
+		/* memory type */
+
+			pmsg->message[COM] = RequestCommand(pdrvPvt, pasynUser)->area;
+			
+			InitAddrSize(pmsg, address, nelements, sizeof(epicsUInt32));
+			
+			pmsg->sendlen = COM + COMMAND_DATA_OFFSET;
+			pmsg->recvlen = RESP + 0;
+			
+			break;
+		}
+
+	/* cycle time reset */
+	
+		case FINS_CYCLE_TIME_RESET:
+		{
+			pmsg->mrc = 0x06;
+			pmsg->src = 0x20;
+			pmsg->message[COM] = 0x00;
+			
+			pmsg->sendlen = COM + 1;
+			pmsg->recvlen = RESP + 0;
+			
+			break;
+		}
+	
+	/* clear all bits that have been forced on or off */
+	
+		case FINS_SET_RESET_CANCEL:
+		{
+			pmsg->mrc = 0x23;
+			pmsg->src = 0x02;
+			
+			pmsg->sendlen = COM + 0;
+			pmsg->recvlen = RESP + 0;
+			
+			break;
+		}
+		
+		default:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, command %s not supported.\n", __func__, pdrvPvt->portName, FINS_names[pasynUser->reason]);
+			return (-1);
+		}
+	}
+	
+	return (0);
+}
+
+/* convert a memory write's data to PLC words at dest, returns the number of bytes */
+
+static size_t BuildWriteData(drvPvt * const pdrvPvt, asynUser *pasynUser, epicsUInt8 *dest, const size_t nelements, const size_t asynSize, const void *data)
+{
+	const finsCommand * const pcmd = RequestCommand(pdrvPvt, pasynUser);
+	
+	if (pcmd->area == 0)
+	{
+		return (0);
+	}
+	
+	if (pcmd->width == 2)
+	{
+		int i;
+		epicsUInt32 *ptrd = (epicsUInt32 *) dest;
+		epicsUInt32 *ptrs = (epicsUInt32 *) data;
+		
+		for (i = 0; i < nelements; i++)
+		{
+			ptrd[i] = WSWAP32(ptrs[i]);
+		}
+		
+		asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s: port %s, swapping %lu 32-bit word(s).\n", __func__, pdrvPvt->portName, (unsigned long) nelements);
+		
+		return (nelements * sizeof(epicsUInt32));
+	}
+	
+/* asynInt16Array */
+
+	if (asynSize == sizeof(epicsUInt16))
+	{
+		int i;
+		epicsUInt16 *ptrd = (epicsUInt16 *) dest;
+		epicsUInt16 *ptrs = (epicsUInt16 *) data;
+
+		for (i = 0; i < nelements; i++)
+		{
+			ptrd[i] = BSWAP16(ptrs[i]);
+		}
+	}
+	else
+	
+/* asynInt32 * 1 */
+
+	{
+		int i;
+		epicsUInt16 *ptrd = (epicsUInt16 *) dest;
+		epicsUInt32 *ptrs = (epicsUInt32 *) data;
+
+		for (i = 0; i < nelements; i++)
+		{
+			ptrd[i] = BSWAP16((epicsUInt16) ptrs[i]);
+		}
+	}
+	
+	asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s: port %s, %s %lu 16-bit word(s).\n", __func__, pdrvPvt->portName, SWAPT, (unsigned long) nelements);
+	
+	return (nelements * sizeof(epicsUInt16));
+}
+
+/*
+	As for reads, the header and command bytes of a record's last write are kept in its finsUser
+	and reused while the reason, address, size and nodes are the same. Only the SID and the data
+	change from one write to the next.
+*/
+
+static int BuildWriteMessage(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg, const epicsUInt16 address, const size_t nelements, const size_t asynSize, const void *data)
+{
+	finsUser * const puser = RequestUser(pdrvPvt, pasynUser);
+	finsTemplate * const ptmpl = puser ? &puser->write : NULL;
+	int found = 0;
+	
+	if (ptmpl)
+	{
+		epicsMutexMustLock(pdrvPvt->tmplLock);
+		
+		if ((ptmpl->reason == pasynUser->reason) && (ptmpl->address == address) && (ptmpl->nelements == nelements) && (ptmpl->dnode == pdrvPvt->dnode) && (ptmpl->snode == pdrvPvt->snode))
+		{
+			memcpy(pmsg->message, ptmpl->message, ptmpl->sendlen);
+			
+			pmsg->mrc = ptmpl->mrc;
+			pmsg->src = ptmpl->src;
+			pmsg->sendlen = ptmpl->sendlen;
+			pmsg->recvlen = ptmpl->recvlen;
+			found = 1;
+		}
+		
+		epicsMutexUnlock(pdrvPvt->tmplLock);
+	}
+	
+	if (found == 0)
+	{
+		if (BuildWriteCommand(pdrvPvt, pasynUser, pmsg, address, nelements) < 0)
+		{
+			return (-1);
+		}
+		
+		if (ptmpl)
+		{
+			epicsMutexMustLock(pdrvPvt->tmplLock);
+			
+			ptmpl->reason = pasynUser->reason;
+			ptmpl->address = address;
+			ptmpl->nelements = nelements;
+			ptmpl->dnode = pdrvPvt->dnode;
+			ptmpl->snode = pdrvPvt->snode;
+			ptmpl->mrc = pmsg->mrc;
+			ptmpl->src = pmsg->src;
+			ptmpl->sendlen = pmsg->sendlen;
+			ptmpl->recvlen = pmsg->recvlen;
+			
+			memcpy(ptmpl->message, pmsg->message, pmsg->sendlen);
+			
+			epicsMutexUnlock(pdrvPvt->tmplLock);
+		}
+	}
+	
+	pmsg->sendlen += BuildWriteData(pdrvPvt, pasynUser, &pmsg->message[COM + COMMAND_DATA_OFFSET], nelements, asynSize, data);
+	
+	pmsg->message[MRC] = pmsg->mrc;
+	pmsg->message[SRC] = pmsg->src;
+	pmsg->message[SID] = pmsg->sid = NextSid(pdrvPvt);
+
+/* add the FINS TCP command */
+
+	if (pdrvPvt->type == FINS_TCP_type)
+	{
+	
+	/* the FINS Frame Send Command goes in the headroom in front of the message */
+	
+		AddCommand(pmsg->buffer, pmsg->sendlen, FINS_FRAME_SEND_COMMAND);
+			
+		pmsg->sendlen += FINS_SEND_FRAME_SIZE;
+		pmsg->recvlen += FINS_SEND_FRAME_SIZE;
+	}
+		
+	return (0);
+}
+
+/**************************************************************************************************/
+/*
+	asynSize is either sizeof(epicsInt16) for asynInt16Array or sizeof(epicsInt32) for asynInt16Array and asynInt32Array.
+*/
+/**************************************************************************************************/
+	
+/* build and send a write request. Unless it fails the reply must be collected with WriteFinish */
+
+static int WriteStart(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg, const void *data, const size_t nelements, const epicsUInt16 address, const size_t asynSize)
+{
+	if (NodeReady(pdrvPvt, pasynUser) < 0)
+	{
+		return (-1);
+	}
+	
+	BuildWriteMessage(pdrvPvt, pasynUser, pmsg, address, nelements, asynSize, data);
+	
+	asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, (char *) MsgFrame(pdrvPvt, pmsg), pmsg->sendlen, "%s: port %s, sending %lu bytes.\n", __func__, pdrvPvt->portName, (unsigned long) pmsg->sendlen);
+	
+/* set the time out of writes to the asynOctet port to be the time out specified in the record */
+
+	if (pasynUser->timeout <= 0.0)
+	{
+		pasynUser->timeout = 1.0;
+	}
+	
+	finsTransferStart(pdrvPvt, pasynUser, pmsg);
+	
+	return (0);
+}
+
+static int WriteFinish(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg)
+{
+	size_t sentlen = 0, recdlen = 0;
+	int eomReason = 0;
+	asynStatus status;
+	epicsTimeStamp ete;
+	
+	status = finsTransferWait(pdrvPvt, pasynUser, pmsg, &sentlen, &recdlen, &eomReason);
+
+	UpdateTimes(pdrvPvt, FINS_CLASS_WRITE, &pmsg->ets, &ete);
+	
+	switch (status)
+	{
+		case asynSuccess:
+		{
+			break;
+		}
+		
+		case asynTimeout:
+		case asynOverflow:
+		case asynError:
+		case asynDisconnected:
+		case asynDisabled:
+		{
+		
+		/* the circuit breaker has said why when it opened */
+		
+			asynPrint(pasynUser, FailTrace(pdrvPvt, status), "%s: port %s, writeRead() failed with %s.\n", __func__, pdrvPvt->portName, asynStatusMessages[status]);
+			return (-1);
+		}
+		
+		default:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, unknown asyn return code %d.\n", __func__, pdrvPvt->portName, status);
+			return (-1);
+		}
+	}
+
+	asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, (char *) MsgFrame(pdrvPvt, pmsg), recdlen, "%s: port %s, received %lu bytes.\n", __func__, pdrvPvt->portName, (unsigned long) recdlen);
+
+	if (sentlen != pmsg->sendlen)
+	{
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, writeRead() write failed. %lu != %lu\n", __func__, pdrvPvt->portName, (unsigned long) sentlen, (unsigned long) pmsg->sendlen);
+		return (-1);
+	}
+	
+	if (recdlen != pmsg->recvlen)
+	{
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, writeRead() read failed.\n", __func__, pdrvPvt->portName);
+		return (-1);
+	}
+	
+/* check the TCP FINS header */
+
+	if (pdrvPvt->type == FINS_TCP_type)
+	{
+		const unsigned int ferror = BSWAP32(((unsigned int *) pmsg->buffer)[FINS_MODE_ERROR]);
+		 
+		if (ferror != FINS_ERROR_NORMAL) 
+		{
+			TCPDisconnect(pdrvPvt);
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, FINS Frame Send error 0x%x.\n", __func__, pdrvPvt->portName, ferror);
+			
+			return (-1);
+		}
+	}	
+
+	if (CheckData(pdrvPvt, pasynUser, pmsg) < 0)
+	{
+		return (-1);
+	}
+
+	return (0);
+}
+
+static int finsWritePLC(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg, const void *data, const size_t nelements, const epicsUInt16 address, const size_t asynSize)
+{
+	if (WriteStart(pdrvPvt, pasynUser, pmsg, data, nelements, address, asynSize) < 0)
+	{
+		return (-1);
+	}
+	
+	return (WriteFinish(pdrvPvt, pasynUser, pmsg));
+}
+
+/**************************************************************************************************/
+/*
+	An array too big for one frame is split into frames of as many elements as fit, read or written
+	in address order. On a pipelined link up to FINS_MAX_CHUNKS frames are in flight at once,
+	otherwise they go back to back. The transfer fails if any frame does, so a failed write may
+	have been partly done.
+*/
+
+static int finsChunked(drvPvt * const pdrvPvt, asynUser *pasynUser, const int write, void *data, const size_t nelements, const epicsUInt16 address, size_t *transferred, size_t asynSize, const int width)
+{
+	const size_t chunk = MaxWords(pdrvPvt) / width;
+	const size_t nchunks = (nelements + chunk - 1) / chunk;
+	finsMsg *pmsg[FINS_MAX_CHUNKS];
+	size_t depth = 1, started = 0, finished = 0;
+	int status = 0;
+	
+	if (address + nelements * width > 0x10000)
+	{
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %lu elements from %u run past the end of the memory area.\n", __func__, pdrvPvt->portName, (unsigned long) nelements, address);
+		return (-1);
+	}
+	
+/* a window smaller than ours would have us waiting for room that only we can make */
+
+	if (pdrvPvt->link)
+	{
+		depth = (pdrvPvt->link->window < FINS_MAX_CHUNKS) ? pdrvPvt->link->window : FINS_MAX_CHUNKS;
+	}
+	
+	if (transferred)
+	{
+		*transferred = 0;
+	}
+	
+	while (finished < nchunks)
+	{
+		while ((status == 0) && (started < nchunks) && (started - finished < depth))
+		{
+			const size_t first = started * chunk;
+			const size_t count = (nelements - first < chunk) ? nelements - first : chunk;
+			void * const pdata = (char *) data + first * asynSize;
+			finsMsg * const pnext = MsgGet(pdrvPvt);
+			
+			if ((write ? WriteStart(pdrvPvt, pasynUser, pnext, pdata, count, address + first * width, asynSize) : ReadStart(pdrvPvt, pasynUser, pnext, count, address + first * width)) < 0)
+			{
+				MsgPut(pdrvPvt, pnext);
+				status = -1;
+				break;
+			}
+			
+			pmsg[started++ % FINS_MAX_CHUNKS] = pnext;
+		}
+		
+		if (finished == started)
+		{
+			break;
+		}
+		
+	/* collect the oldest frame, even after a failure, so that its SID is released */
+	
+		{
+			const size_t first = finished * chunk;
+			const size_t count = (nelements - first < chunk) ? nelements - first : chunk;
+			finsMsg * const pdone = pmsg[finished++ % FINS_MAX_CHUNKS];
+			size_t n = 0;
+			
+			if (write)
+			{
+				if (WriteFinish(pdrvPvt, pasynUser, pdone) < 0)
+				{
+					status = -1;
+				}
+			}
+			else if (ReadFinish(pdrvPvt, pasynUser, pdone, (char *) data + first * asynSize, count, address + first * width, &n, asynSize) < 0)
+			{
+				status = -1;
+			}
+			else if (transferred)
+			{
+				*transferred += n;
+			}
+			
+			MsgPut(pdrvPvt, pdone);
+		}
+	}
+	
+	return (status);
+}
+
+/**************************************************************************************************/
+/*
+	Write to the PLC and keep any block and read cache images up to date.
+*/
+
+/*
+	Write with the no response bit set. Once per verify period the write asks for a response
+	instead, so that a PLC that isn't taking them shows up as a failed write.
+*/
+
+static int WriteNoResponse(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg, const void *data, const size_t nelements, const epicsUInt16 address, const size_t asynSize)
+{
+	finsUser * const puser = (finsUser *) pasynUser->drvUser;
+	size_t sentlen = 0;
+	epicsTimeStamp now;
+	asynStatus status;
+	
+	epicsTimeGetCurrent(&now);
+	
+	if ((pdrvPvt->verify > 0.0) && (epicsTimeDiffInSeconds(&now, &puser->acked) >= pdrvPvt->verify))
+	{
+		pdrvPvt->nverified++;
+		
+		if (finsWritePLC(pdrvPvt, pasynUser, pmsg, data, nelements, address, asynSize) < 0)
+		{
+			return (-1);
+		}
+		
+		puser->acked = now;
+		
+		return (0);
+	}
+	
+	if (NodeReady(pdrvPvt, pasynUser) < 0)
+	{
+		return (-1);
+	}
+	
+	BuildWriteMessage(pdrvPvt, pasynUser, pmsg, address, nelements, asynSize, data);
+	
+	pmsg->message[ICF] |= FINS_ICF_NO_RESPONSE;
+	
+	asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, (char *) MsgFrame(pdrvPvt, pmsg), pmsg->sendlen, "%s: port %s, sending %lu bytes, no response.\n", __func__, pdrvPvt->portName, (unsigned long) pmsg->sendlen);
+	
+	if (pasynUser->timeout <= 0.0)
+	{
+		pasynUser->timeout = 1.0;
+	}
+	
+	if ((status = finsSend(pdrvPvt, pasynUser, pmsg, &sentlen)) != asynSuccess)
+	{
+		asynPrint(pasynUser, FailTrace(pdrvPvt, status), "%s: port %s, write failed with %s.\n", __func__, pdrvPvt->portName, asynStatusMessages[status]);
+		return (-1);
+	}
+	
+	if (sentlen != pmsg->sendlen)
+	{
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, write failed. %lu != %lu\n", __func__, pdrvPvt->portName, (unsigned long) sentlen, (unsigned long) pmsg->sendlen);
+		return (-1);
+	}
+	
+	pdrvPvt->nnoresp++;
+	
+	return (0);
+}
+
+/**************************************************************************************************/
+/*
+	Write combining, see finsWriteCombineInit. WriteQueue puts the words a memory write would send
+	in its area's image and returns. WriteFlush sends every queued word in as few frames as it can,
+	taking the runs out of the image one at a time, so that words written while it waits for the
+	PLC are left for the next flush. A run that fails goes back into the image, except for words
+	written again since, and the flusher tries again after FINS_WQ_RETRY or the deadline, whichever
+	is longer.
+*/
+
+static finsWriteArea *WriteArea(finsWriteQueue * const pqueue, const epicsUInt8 area)
+{
+	finsWriteArea *parea;
+	int i, reason;
+	
+	for (i = 0; i < pqueue->nareas; i++)
+	{
+		if (pqueue->areas[i].area == area)
+		{
+			return (&pqueue->areas[i]);
+		}
+	}
+	
+/* the runs are sent as 16-bit writes of the area */
+
+	for (reason = FINS_NULL + 1; reason < (int) FINS_NCOMMANDS; reason++)
+	{
+		if ((finsCommands[reason].area == area) && (finsCommands[reason].width == 1) && (finsCommands[reason].flags & FINS_CMD_WRITE))
+		{
+			break;
+		}
+	}
+	
+	if ((pqueue->nareas == FINS_WQ_AREAS) || (reason == (int) FINS_NCOMMANDS))
+	{
+		return (NULL);
+	}
+	
+	parea = &pqueue->areas[pqueue->nareas++];
+	
+	parea->area = area;
+	parea->reason = reason;
+	parea->lo = FINS_WQ_WORDS;
+	parea->hi = 0;
+	parea->image = (epicsUInt16 *) callocMustSucceed(FINS_WQ_WORDS, sizeof(epicsUInt16), __func__);
+	parea->queued = (epicsUInt8 *) callocMustSucceed(FINS_WQ_WORDS / 8, sizeof(epicsUInt8), __func__);
+	
+	return (parea);
+}
+
+/* returns 1 if the write was queued, 0 if it has to be sent as it is */
+
+static int WriteQueue(drvPvt * const pdrvPvt, asynUser *pasynUser, const void *data, const size_t nelements, const epicsUInt16 address, const size_t asynSize)
+{
+	finsWriteQueue * const pqueue = pdrvPvt->wq;
+	finsWriteArea *parea;
+	epicsUInt16 buffer[FINS_MAX_UDP_WORDS];
+	const epicsUInt8 * const ptrs = (epicsUInt8 *) buffer;
+	size_t i, nwords;
+	int width;
+	const epicsUInt8 area = RequestArea(pdrvPvt, pasynUser, &width);
+	
+	nwords = nelements * width;
+	
+	if ((area == 0) || (nwords == 0) || (nwords > MaxWords(pdrvPvt)) || (nwords > FINS_MAX_UDP_WORDS) || (address + nwords > FINS_WQ_WORDS))
+	{
+		return (0);
+	}
+	
+/* the words as they would be sent, in PLC byte order */
+
+	BuildWriteData(pdrvPvt, pasynUser, (epicsUInt8 *) buffer, nelements, asynSize, data);
+	
+	epicsMutexMustLock(pqueue->lock);
+	
+	if ((parea = WriteArea(pqueue, area)) == NULL)
+	{
+		epicsMutexUnlock(pqueue->lock);
+		
+		return (0);
+	}
+	
+	if (pqueue->nqueued == 0)
+	{
+		epicsTimeGetCurrent(&pqueue->first);
+	}
+	
+	for (i = 0; i < nwords; i++)
+	{
+		const size_t word = address + i;
+		const epicsUInt8 bit = 1 << (word & 7);
+		
+		parea->image[word] = (ptrs[2 * i] << 8) | ptrs[2 * i + 1];
+		
+		if (parea->queued[word >> 3] & bit)
+		{
+			pqueue->nsuperseded++;
+		}
+		else
+		{
+			parea->queued[word >> 3] |= bit;
+			pqueue->nqueued++;
+		}
+	}
+	
+	if (address < parea->lo)
+	{
+		parea->lo = address;
+	}
+	
+	if (address + nwords > parea->hi)
+	{
+		parea->hi = address + nwords;
+	}
+	
+	pqueue->nwrites++;
+	
+	epicsMutexUnlock(pqueue->lock);
+	epicsEventSignal(pqueue->wakeup);
+	
+	asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s: port %s, %lu word(s) at %u queued.\n", __func__, pdrvPvt->portName, (unsigned long) nwords, address);
+	
+	return (1);
+}
+
+/* take the next run of queued words out of the image, returns its length or zero if there are none */
+
+static size_t WriteRun(finsWriteQueue * const pqueue, const size_t maxwords, epicsUInt16 *words, size_t *start, int *reason)
+{
+	int i;
+	
+	for (i = 0; i < pqueue->nareas; i++)
+	{
+		finsWriteArea * const parea = &pqueue->areas[i];
+		size_t word, n = 0;
+		
+		for (word = parea->lo; word < parea->hi; word++)
+		{
+			const epicsUInt8 bit = 1 << (word & 7);
+			
+			if ((parea->queued[word >> 3] & bit) == 0)
+			{
+				if (n)
+				{
+					break;
+				}
+				
+				continue;
+			}
+			
+			if (n == 0)
+			{
+				*start = word;
+			}
+			
+			words[n++] = parea->image[word];
+			parea->queued[word >> 3] &= ~bit;
+			
+			if (n == maxwords)
+			{
+				word++;
+				break;
+			}
+		}
+		
+		parea->lo = word;
+		
+		if (parea->lo >= parea->hi)
+		{
+			parea->lo = FINS_WQ_WORDS;
+			parea->hi = 0;
+		}
+		
+		if (n)
+		{
+			pqueue->nqueued -= n;
+			*reason = parea->reason;
+			
+			return (n);
+		}
+	}
+	
+	return (0);
+}
+
+/* put a run that failed back into the image, called with the queue locked */
+
+static void WriteRequeue(finsWriteQueue * const pqueue, const int reason, const epicsUInt16 *words, const size_t n, const size_t start)
+{
+	finsWriteArea *parea = NULL;
+	size_t i;
+	int a;
+	
+	for (a = 0; a < pqueue->nareas; a++)
+	{
+		if (pqueue->areas[a].reason == reason)
+		{
+			parea = &pqueue->areas[a];
+		}
+	}
+	
+	if (parea == NULL)
+	{
+		return;
+	}
+	
+	for (i = 0; i < n; i++)
+	{
+		const size_t word = start + i;
+		const epicsUInt8 bit = 1 << (word & 7);
+		
+	/* a word that has been queued again has a newer value */
+	
+		if ((parea->queued[word >> 3] & bit) == 0)
+		{
+			parea->image[word] = words[i];
+			parea->queued[word >> 3] |= bit;
+			pqueue->nqueued++;
+		}
+	}
+	
+	if (start < parea->lo)
+	{
+		parea->lo = start;
+	}
+	
+	if (start + n > parea->hi)
+	{
+		parea->hi = start + n;
+	}
+}
+
+/* drop queued words that a write sent as it is replaces, called with the flush lock held so that a failed run can't bring them back */
+
+static void WriteDrop(finsWriteQueue * const pqueue, const epicsUInt8 area, const size_t address, const size_t nwords)
+{
+	int i;
+	
+	epicsMutexMustLock(pqueue->lock);
+	
+	for (i = 0; i < pqueue->nareas; i++)
+	{
+		finsWriteArea * const parea = &pqueue->areas[i];
+		size_t word;
+		
+		if (parea->area != area)
+		{
+			continue;
+		}
+		
+		for (word = address; (word < address + nwords) && (word < FINS_WQ_WORDS); word++)
+		{
+			const epicsUInt8 bit = 1 << (word & 7);
+			
+			if (parea->queued[word >> 3] & bit)
+			{
+				parea->queued[word >> 3] &= ~bit;
+				pqueue->nqueued--;
+				pqueue->nsuperseded++;
+			}
+		}
+	}
+	
+	epicsMutexUnlock(pqueue->lock);
+}
+
+static int WriteFlush(drvPvt * const pdrvPvt)
+{
+	finsWriteQueue * const pqueue = pdrvPvt->wq;
+	asynUser * const pasynUser = pqueue->pasynUser;
+	epicsUInt16 words[FINS_MAX_UDP_WORDS];
+	const size_t maxwords = (MaxWords(pdrvPvt) < FINS_MAX_UDP_WORDS) ? MaxWords(pdrvPvt) : FINS_MAX_UDP_WORDS;
+	size_t n, start;
+	int status = 0;
+	
+	epicsMutexMustLock(pqueue->flushLock);
+	
+	while (1)
+	{
+		finsMsg *pmsg;
+		int ok;
+		
+		epicsMutexMustLock(pqueue->lock);
+		n = WriteRun(pqueue, maxwords, words, &start, &pasynUser->reason);
+		epicsMutexUnlock(pqueue->lock);
+		
+		if (n == 0)
+		{
+			break;
+		}
+		
+		pmsg = MsgGet(pdrvPvt);
+		ok = (finsWritePLC(pdrvPvt, pasynUser, pmsg, words, n, start, sizeof(epicsUInt16)) == 0);
+		MsgPut(pdrvPvt, pmsg);
+		
+		epicsMutexMustLock(pqueue->lock);
+		
+		if (ok)
+		{
+			pqueue->nframes++;
+		}
+		else
+		{
+			pqueue->nerrors++;
+			WriteRequeue(pqueue, pasynUser->reason, words, n, start);
+		}
+		
+		epicsMutexUnlock(pqueue->lock);
+		
+		if (ok)
+		{
+			BlockWrite(pdrvPvt, pasynUser->reason, words, n, start, sizeof(epicsUInt16));
+			continue;
+		}
+		
+	/* the cache was given these words when they were queued. The rest of the queue waits for the next try. */
+	
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %lu queued word(s) at %lu not written, queued again.\n", __func__, pdrvPvt->portName, (unsigned long) n, (unsigned long) start);
+		CacheWrite(pdrvPvt, pasynUser->reason, words, n, start, sizeof(epicsUInt16), 0);
+		status = -1;
+		
+		break;
+	}
+	
+	epicsMutexUnlock(pqueue->flushLock);
+	
+	return (status);
+}
+
+/* a read of words that are still queued waits for them to be written */
+
+static void WriteFlushOverlap(drvPvt * const pdrvPvt, const epicsUInt8 area, const size_t address, const size_t nwords)
+{
+	finsWriteQueue * const pqueue = pdrvPvt->wq;
+	int i, overlap = 0;
+	
+	epicsMutexMustLock(pqueue->lock);
+	
+	for (i = 0; i < pqueue->nareas; i++)
+	{
+		if ((pqueue->areas[i].area == area) && (address < pqueue->areas[i].hi) && (address + nwords > pqueue->areas[i].lo))
+		{
+			overlap = 1;
+		}
+	}
+	
+	epicsMutexUnlock(pqueue->lock);
+	
+	if (overlap)
+	{
+		WriteFlush(pdrvPvt);
+	}
+}
+
+static void finsWriteFlusher(void *pvt)
+{
+	drvPvt * const pdrvPvt = (drvPvt *) pvt;
+	finsWriteQueue * const pqueue = pdrvPvt->wq;
+	
+	while (1)
+	{
+		epicsTimeStamp now;
+		double delay = 0.0;
+		int queued;
+		
+		epicsMutexMustLock(pqueue->lock);
+		
+		if ((queued = (pqueue->nqueued > 0)))
+		{
+			epicsTimeGetCurrent(&now);
+			delay = pqueue->deadline - epicsTimeDiffInSeconds(&now, &pqueue->first);
+		}
+		
+		epicsMutexUnlock(pqueue->lock);
+		
+		if (!queued)
+		{
+			epicsEventMustWait(pqueue->wakeup);
+		}
+		else if (delay > 0.0)
+		{
+			epicsThreadSleep(delay);
+		}
+		else if (WriteFlush(pdrvPvt) < 0)
+		{
+			epicsThreadSleep((pqueue->deadline > FINS_WQ_RETRY) ? pqueue->deadline : FINS_WQ_RETRY);
+		}
+	}
+}
+
+static int finsWrite(drvPvt * const pdrvPvt, asynUser *pasynUser, const void *data, const size_t nelements, const epicsUInt16 address, const size_t asynSize)
+{
+	const finsUser * const puser = (pasynUser == pdrvPvt->pasynUser) ? NULL : (finsUser *) pasynUser->drvUser;
+	finsMsg *pmsg;
+	int status, width;
+	
+	if (pasynUser->reason == FINS_WRITE_COMMIT)
+	{
+		return (pdrvPvt->wq ? WriteFlush(pdrvPvt) : 0);
+	}
+	
+	if (pdrvPvt->wq)
+	{
+		if (((puser == NULL) || (puser->noresp == 0)) && WriteQueue(pdrvPvt, pasynUser, data, nelements, address, asynSize))
+		{
+		/* the block images get the words when the flush has written them */
+		
+			CacheWrite(pdrvPvt, pasynUser->reason, data, nelements, address, asynSize, 1);
+			
+			return (0);
+		}
+		
+	/* anything sent as it is goes after the writes queued before it, and replaces any of them that failed */
+	
+		epicsMutexMustLock(pdrvPvt->wq->flushLock);
+		WriteFlush(pdrvPvt);
+		
+		if (RequestArea(pdrvPvt, pasynUser, &width))
+		{
+			WriteDrop(pdrvPvt->wq, RequestArea(pdrvPvt, pasynUser, &width), address, nelements * width);
+		}
+	}
+	
+	if (RequestArea(pdrvPvt, pasynUser, &width) && (nelements * width > MaxWords(pdrvPvt)))
+	{
+		status = finsChunked(pdrvPvt, pasynUser, 1, (void *) data, nelements, address, NULL, asynSize, width);
+	}
+	else
+	{
+		pmsg = MsgGet(pdrvPvt);
+		
+		if (puser && puser->noresp)
+		{
+			status = WriteNoResponse(pdrvPvt, pasynUser, pmsg, data, nelements, address, asynSize);
+		}
+		else
+		{
+			status = finsWritePLC(pdrvPvt, pasynUser, pmsg, data, nelements, address, asynSize);
+		}
+		
+		MsgPut(pdrvPvt, pmsg);
+	}
+	
+	if (pdrvPvt->wq)
+	{
+		epicsMutexUnlock(pdrvPvt->wq->flushLock);
+	}
+	
+	CacheWrite(pdrvPvt, pasynUser->reason, data, nelements, address, asynSize, status == 0);
+	
+	if (status == 0)
+	{
+		BlockWrite(pdrvPvt, pasynUser->reason, data, nelements, address, asynSize);
+	}
+	
+	return (status);
+}
+
+/*** asynOctet ************************************************************************************/
+
+static asynStatus octetRead(void *pvt, asynUser *pasynUser, char *data, size_t maxchars, size_t *nbytesTransferred, int *eomReason)
+{
+	drvPvt * const pdrvPvt = (drvPvt *) pvt;
+	int addr;
+	asynStatus status;
+	
+	*eomReason = 0;
+	*nbytesTransferred = 0;
+	
+	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+	{
+		return (status);
+	}
+	
+	switch (pasynUser->reason)
+	{
+		case FINS_MODEL:
+		{
+			if (maxchars < FINS_MODEL_LEN)
+			{
+				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, length is not >= %d for FINS_MODEL\n", __func__, pdrvPvt->portName, addr, FINS_MODEL_LEN);
+				return (asynError);
+			}
+			
+			break;
+		}
+		
+	/* no more reasons for asynOctetRead */
+	
+		default:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
+			return (asynError);
+		}
+	}
+
+	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+
+/* send FINS request */
+
+	if (finsRead(pdrvPvt, pasynUser, (void *) data, maxchars, addr, nbytesTransferred, 0) < 0)
+	{
+		return (FailStatus(pdrvPvt));
+	}
+	
+	if (eomReason)
+	{
+		*eomReason |= ASYN_EOM_END;
+	}
+
+	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, read %lu bytes.\n", __func__, pdrvPvt->portName, addr, (unsigned long) *nbytesTransferred);
+
+   	return (asynSuccess);
+}
+
+/* Form a FINS write message, send request, wait for the reply and check for errors */
+
+static asynStatus octetWrite(void *pvt, asynUser *pasynUser, const char *data, size_t numchars, size_t *nbytesTransferred)
+{
+	drvPvt * const pdrvPvt = (drvPvt *) pvt;
+	int addr;
+	asynStatus status;
+	
+	*nbytesTransferred = 0;
+
+	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+	{
+		return (status);
+	}
+	
+	switch (pasynUser->reason)
+	{
+		case FINS_CYCLE_TIME_RESET:
+		{
+			break;
+		}
+
+		default:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
+			return (asynError);
+		}
+	}
+
+	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+	
+/* form FINS message and send data */
+	
+	if (finsWrite(pdrvPvt, pasynUser, (void *) data, numchars, addr, 0) < 0)
+	{
+		return (FailStatus(pdrvPvt));
+	}
+
+/* assume for now that we can always write the full request */
+
+	*nbytesTransferred = numchars;
+
+	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, wrote %lu bytes.\n", __func__, pdrvPvt->portName, addr, (unsigned long) numchars);
+
+   	return (asynSuccess);
+}
+
+/*** asynInt32 ************************************************************************************/
+
+/*
+	FINS_SET_MULTI_TYPE sets the area code, plus FINS_MM_TYPE_32 for a 32-bit item, of the next item.
+	FINS_SET_MULTI_ADDR appends the item at the word address value, or (address << 8 | bit) for a bit
+	area. FINS_CLR_MULTI empties the entry.
+*/
+
+static asynStatus MMEdit(drvPvt * const pdrvPvt, asynUser *pasynUser, const int addr, const epicsInt32 value)
+{
+	finsMMTable * const ptable = MMOwn(pdrvPvt);
+	finsMMEntry * const pentry = MMEntry(ptable, addr, pasynUser->reason != FINS_CLR_MULTI);
+	asynStatus status = asynSuccess;
+	
+	if (pentry == NULL)
+	{
+		epicsMutexUnlock(ptable->lock);
+		
+		if (pasynUser->reason == FINS_CLR_MULTI)
+		{
+			return (asynSuccess);
+		}
+		
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, no such Multiple Memory Area entry.\n", __func__, pdrvPvt->portName, addr);
+		return (asynError);
+	}
+	
+	switch (pasynUser->reason)
+	{
+		case FINS_SET_MULTI_TYPE:
+		{
+			const epicsUInt8 area = value & 0xff;
+			
+			if ((value & ~(0xff | FINS_MM_TYPE_32)) || ((value & FINS_MM_TYPE_32) && ((area & 0x80) == 0)))
+			{
+				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, bad type 0x%x.\n", __func__, pdrvPvt->portName, addr, value);
+				status = asynError;
+				break;
+			}
+			
+			pentry->type = value;
+			
+			break;
+		}
+		
+		case FINS_SET_MULTI_ADDR:
+		{
+			finsMMItem * const pitem = &pentry->item[pentry->nitems];
+			const epicsUInt8 area = pentry->type & 0xff;
+			
+			if ((area == 0) || (pentry->nitems == FINS_MM_MAX_ADDRS))
+			{
+				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, %s.\n", __func__, pdrvPvt->portName, addr, (area ? "entry is full" : "no FINS_SET_MULTI_TYPE"));
+				status = asynError;
+				break;
+			}
+			
+			pitem->area = area;
+			
+			if (area & 0x80)
+			{
+				pitem->address = value;
+				pitem->bit = 0;
+				pitem->width = (pentry->type & FINS_MM_TYPE_32) ? FINS_MM_WORD_32 : FINS_MM_WORD;
+			}
+			else
+			{
+				pitem->address = value >> 8;
+				pitem->bit = value & 0x0f;
+				pitem->width = FINS_MM_BIT;
+			}
+			
+			pentry->nitems++;
+			pentry->edits++;
+			
+			break;
+		}
+		
+		default:
+		{
+			pentry->nitems = 0;
+			pentry->type = 0;
+			pentry->edits++;
+			
+			break;
+		}
+	}
+	
+	epicsMutexUnlock(ptable->lock);
+	
+	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s 0x%x\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason], value);
+	
+	return (status);
+}
+
+static asynStatus ReadInt32(void *pvt, asynUser *pasynUser, epicsInt32 *value)
+{
+	drvPvt * const pdrvPvt = (drvPvt *) pvt;
+	int addr;
+	asynStatus status;
+
+	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+	{
+		return (status);
+	}
+
+	switch (pasynUser->reason)
+	{
+		case FINS_DM_READ:
+		case FINS_AR_READ:
+		case FINS_IO_READ:
+		case FINS_WR_READ:
+		case FINS_HR_READ:
+		case FINS_DM_READ_32:
+		case FINS_AR_READ_32:
+		case FINS_IO_READ_32:
+		case FINS_CYCLE_TIME_MEAN:
+		case FINS_CYCLE_TIME_MAX:
+		case FINS_CYCLE_TIME_MIN:
+		case FINS_CPU_STATUS:
+		case FINS_CPU_MODE:
+		case FINS_CPU_FATAL:
+		case FINS_CPU_NONFATAL:
+		case FINS_ECHO_TEST:
+		{
+			break;
+		}
+		
+	/* number of responses timed for the command class given by addr */
+	
+		case FINS_LATENCY_COUNT:
+		{
+			if ((addr < 0) || (addr >= FINS_CLASSES))
+			{
+				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, no such command class.\n", __func__, pdrvPvt->portName, addr);
+				return (asynError);
+			}
+			
+			*value = (epicsInt32) HistCount(&pdrvPvt->latency[addr]);
+			
+			return (asynSuccess);
+		}
+
+	/* these get called at initialisation by write methods */
+	
+		case FINS_DM_WRITE:
+		case FINS_IO_WRITE:
+		case FINS_AR_WRITE:
+		case FINS_CT_WRITE:
+		case FINS_DM_WRITE_32:
+		case FINS_IO_WRITE_32:
+		case FINS_AR_WRITE_32:
+		case FINS_CT_WRITE_32:
+		{
+			break;
+		}
+
+	/* user selects these when they don't want to initialise the record by performing a read first */
+	
+		case FINS_DM_WRITE_NOREAD:
+		case FINS_IO_WRITE_NOREAD:
+		case FINS_AR_WRITE_NOREAD:
+		case FINS_DM_WRITE_32_NOREAD:
+		case FINS_IO_WRITE_32_NOREAD:
+		case FINS_AR_WRITE_32_NOREAD:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, WRITE_NOREAD\n", __func__, pdrvPvt->portName, addr);
+			return (asynError);
+		}
+
+	/* don't try and perform a read to initialise the PV */
+	
+		case FINS_SET_RESET_CANCEL:
+		case FINS_SET_MULTI_TYPE:
+		case FINS_SET_MULTI_ADDR:
+		case FINS_CLR_MULTI:
+		{
+			return (asynError);
+		}
+		
+		default:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, no such command %d.\n", __func__, pdrvPvt->portName, addr, pasynUser->reason);
+			return (asynError);
+		}
+	}
+
+	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+	
+/* send FINS request */
+
+	if (finsRead(pdrvPvt, pasynUser, (void *) value, ONE_ELEMENT, addr, NULL, sizeof(epicsUInt32)) < 0)
+	{
+		return (FailStatus(pdrvPvt));
+	}
+
+	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, read 1 value.\n", __func__, pdrvPvt->portName, addr);
+
+	return (asynSuccess);
+}
+
+static asynStatus WriteInt32(void *pvt, asynUser *pasynUser, epicsInt32 value)
+{
+	drvPvt * const pdrvPvt = (drvPvt *) pvt;
+	int addr;
+	asynStatus status;
+	
+	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+	{
+		return (status);
+	}
+	
+	switch (pasynUser->reason)
+	{
+		case FINS_DM_WRITE:
+		case FINS_DM_WRITE_NOREAD:
+		case FINS_AR_WRITE:
+		case FINS_AR_WRITE_NOREAD:
+		case FINS_IO_WRITE:
+		case FINS_IO_WRITE_NOREAD:
+		case FINS_CYCLE_TIME_RESET:
+		case FINS_DM_WRITE_32:
+		case FINS_DM_WRITE_32_NOREAD:
+		case FINS_AR_WRITE_32:
+		case FINS_AR_WRITE_32_NOREAD:
+		case FINS_IO_WRITE_32:
+		case FINS_IO_WRITE_32_NOREAD:
+		case FINS_SET_RESET_CANCEL:
+		case FINS_WRITE_COMMIT:
+		{
+			break;
+		}
+		
+	/* edit the port's Multiple Memory Area Read entry addr */
+	
+		case FINS_SET_MULTI_TYPE:
+		case FINS_SET_MULTI_ADDR:
+		case FINS_CLR_MULTI:
+		{
+			return (MMEdit(pdrvPvt, pasynUser, addr, value));
+		}
+		
+		default:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, command %s not supported.\n", __func__, pdrvPvt->portName, FINS_names[pasynUser->reason]);
+			return (asynError);
+		}
+	}
+
+	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+
+/* form FINS message and send data */
+
+	if (finsWrite(pdrvPvt, pasynUser, (void *) &value, ONE_ELEMENT, addr, sizeof(epicsUInt32)) < 0)
+	{
+		return (FailStatus(pdrvPvt));
+	}
+	
+	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, wrote 1 value.\n", __func__, pdrvPvt->portName, addr);
+
+	return (asynSuccess);
+}
+
+/*** asynFloat64 **********************************************************************************/
+
+static asynStatus ReadFloat64(void *pvt, asynUser *pasynUser, epicsFloat64 *value)
+{
+	drvPvt * const pdrvPvt = (drvPvt *) pvt;
+	int addr;
+	asynStatus status;
+	epicsFloat32 val;
+	
+	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+	{
+		return (status);
+	}
+
+	switch (pasynUser->reason)
+	{
+		case FINS_DM_READ_32:
+		case FINS_AR_READ_32:
+		{
+			break;
+		}
+		
+	/* response times of the port, addr is the command class */
+	
+		case FINS_LATENCY_P50:
+		case FINS_LATENCY_P90:
+		case FINS_LATENCY_P99:
+		case FINS_LATENCY_P999:
+		case FINS_LATENCY_MAX:
+		{
+			static const double q[] = { 0.5, 0.9, 0.99, 0.999 };
+			
+			if ((addr < 0) || (addr >= FINS_CLASSES))
+			{
+				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, no such command class.\n", __func__, pdrvPvt->portName, addr);
+				return (asynError);
+			}
+			
+			if (pasynUser->reason == FINS_LATENCY_MAX)
+			{
+				*value = HistMax(&pdrvPvt->latency[addr]);
+			}
+			else
+			{
+				*value = HistPercentile(&pdrvPvt->latency[addr], q[pasynUser->reason - FINS_LATENCY_P50]);
+			}
+			
+			return (asynSuccess);
+		}
+		
+	/* this gets called at initialisation by write methods */
+	
+		case FINS_DM_WRITE_32:
+		case FINS_AR_WRITE_32:
+		{
+			break;
+		}
+
+		case FINS_DM_WRITE_NOREAD:
+		case FINS_AR_WRITE_NOREAD:
+		case FINS_DM_WRITE_32_NOREAD:
+		case FINS_AR_WRITE_32_NOREAD:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, WRITE_NOREAD\n", __func__, pdrvPvt->portName, addr);
+			return (asynError);
+		}
+
+		default:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, no such command %d.\n", __func__, pdrvPvt->portName, addr, pasynUser->reason);
+			return (asynError);
+		}
+	}
+
+	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+
+/* send FINS request */
+
+	if (finsRead(pdrvPvt, pasynUser, (void *) &val, ONE_ELEMENT, addr, NULL, sizeof(epicsUInt32)) < 0)
+	{
+		return (FailStatus(pdrvPvt));
+	}
+
+	*value = (epicsFloat64) val;
+	
+	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, read 1 word.\n", __func__, pdrvPvt->portName, addr);
+
+	return (asynSuccess);
+}
+
+static asynStatus WriteFloat64(void *pvt, asynUser *pasynUser, epicsFloat64 value)
+{
+	drvPvt * const pdrvPvt = (drvPvt *) pvt;
+	int addr;
+	asynStatus status;
+	epicsFloat32 val = (epicsFloat32) value;
+	
+	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+	{
+		return (status);
+	}
+
+	switch (pasynUser->reason)
+	{
+		case FINS_DM_WRITE_32:
+		case FINS_DM_WRITE_32_NOREAD:
+		case FINS_AR_WRITE_32:
+		case FINS_AR_WRITE_32_NOREAD:
+		{
+			break;
+		}
+
+		default:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
+			return (asynError);
+		}
+	}
+
+	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+	
+/* form FINS message and send data */
+
+	if (finsWrite(pdrvPvt, pasynUser, (void *) &val, ONE_ELEMENT, addr, sizeof(epicsUInt32)) < 0)
+	{
+		return (FailStatus(pdrvPvt));
+	}
+
+	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, wrote 1 word.\n", __func__, pdrvPvt->portName, addr);
+
+	return (asynSuccess);
+}
+
+/*** asynInt16Array *******************************************************************************/
+
+static asynStatus ReadInt16Array(void *pvt, asynUser *pasynUser, epicsInt16 *value, size_t nelements, size_t *nIn)
+{
+	drvPvt * const pdrvPvt = (drvPvt *) pvt;
+	int addr;
+	asynStatus status;
+	
+	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+	{
+		return (status);
+	}
+
+	switch (pasynUser->reason)
+	{
+		case FINS_DM_READ:
+		case FINS_AR_READ:
+		case FINS_IO_READ:
+		case FINS_WR_READ:
+		case FINS_HR_READ:
+		case FINS_EM0_READ ... FINS_EMF_READ:
+		{
+			if (nelements > FINS_MAX_ARRAY_WORDS)
+			{
+				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, request too big for %s.\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+				return (asynError);
+			}
+			
+			break;
+		}
+		
+		case FINS_CLOCK_READ:
+		{
+			if (nelements != FINS_CLOCK_READ_LEN)
+			{
+				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, FINS_CLOCK_READ size != %d.\n", __func__, pdrvPvt->portName, addr, FINS_CLOCK_READ_LEN);
+				return (asynError);
+			}
+			
+			break;
+		}
+		
+	/* the entry is checked when the request is built */
+	
+		case FINS_MM_READ:
+		{
+			break;
+		}
+		
+		default:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
+			return (asynError);
+		}
+	}
+
+	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+	
+/* remember the size for polling I/O Intr records */
+
+	if (pasynUser->drvUser)
+	{
+		((finsUser *) pasynUser->drvUser)->nelements = nelements;
+	}
+	
+/* send FINS request */
+
+	if (finsRead(pdrvPvt, pasynUser, (void *) value, nelements, addr, nIn, sizeof(epicsUInt16)) < 0)
+	{
+		*nIn = 0;
+		return (FailStatus(pdrvPvt));
+	}
+
+	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, read %lu 16-bit word(s).\n", __func__, pdrvPvt->portName, addr, (unsigned long) *nIn);
+
+	return (asynSuccess);
+}
+
+static asynStatus WriteInt16Array(void *pvt, asynUser *pasynUser, epicsInt16 *value, size_t nelements)
+{
+	drvPvt * const pdrvPvt = (drvPvt *) pvt;
+	int addr;
+	asynStatus status;
+
+	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+	{
+		return (status);
+	}
+
+/* check reason */
+
+	switch (pasynUser->reason)
+	{
+		case FINS_DM_WRITE:
+		case FINS_AR_WRITE:
+		case FINS_IO_WRITE:
+		{
+			if (nelements > FINS_MAX_ARRAY_WORDS)
+			{
+				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, request too big for %s.\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+				return (asynError);
+			}
+			
+			break;
+		}
+		
+		default:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
+			return (asynError);
+		}
+	}
+
+	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+
+/* form FINS message and send data */
+
+	if (finsWrite(pdrvPvt, pasynUser, (void *) value, nelements, addr, sizeof(epicsUInt16)) < 0)
+	{
+		return (FailStatus(pdrvPvt));
+	}
+
+	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, wrote %lu 16-bit word(s).\n", __func__, pdrvPvt->portName, addr, (unsigned long) nelements);
+
+	return (asynSuccess);
+}
+
+/*** asynInt32Array *******************************************************************************/
+
+static asynStatus ReadInt32Array(void *pvt, asynUser *pasynUser, epicsInt32 *value, size_t nelements, size_t *nIn)
+{
+	drvPvt * const pdrvPvt = (drvPvt *) pvt;
+	int addr;
+	asynStatus status;
+	
+	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+	{
+		return (status);
+	}
+
+	switch (pasynUser->reason)
+	{
+		case FINS_DM_READ_32:
+		case FINS_AR_READ_32:
+		case FINS_IO_READ_32:
+		{
+			if ((nelements * 2) > FINS_MAX_ARRAY_WORDS)
+			{
+				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, request too big for %s.\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+				return (asynError);
+			}
+			
+			break;
+		}
+
+		case FINS_CYCLE_TIME:
+		{
+			if (nelements != FINS_CYCLE_TIME_LEN)
+			{
+				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, FINS_CYCLE_TIME size != %d.\n", __func__, pdrvPvt->portName, addr, FINS_CYCLE_TIME_LEN);
+				return (asynError);
+			}
+			
+			break;
+		}
+
+		case FINS_MM_READ:
+		{
+			break;
+		}
+
+		default:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
+			return (asynError);
+		}
+	}
+	
+	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+
+/* remember the size for polling I/O Intr records */
+
+	if (pasynUser->drvUser)
+	{
+		((finsUser *) pasynUser->drvUser)->nelements = nelements;
+	}
+	
+/* send FINS request */
+
+	if (finsRead(pdrvPvt, pasynUser, (void *) value, nelements, addr, nIn, sizeof(epicsUInt32)) < 0)
+	{
+		*nIn = 0;
+		return (FailStatus(pdrvPvt));
+	}
+
+	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, read %lu 32-bit word(s).\n", __func__, pdrvPvt->portName, addr, (unsigned long) *nIn);
+	
+	return (asynSuccess);
+}
+
+static asynStatus WriteInt32Array(void *pvt, asynUser *pasynUser, epicsInt32 *value, size_t nelements)
+{
+	drvPvt * const pdrvPvt = (drvPvt *) pvt;
+	int addr;
+	asynStatus status;
+	
+	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+	{
+		return (status);
+	}
+
+	switch (pasynUser->reason)
+	{
+		case FINS_DM_WRITE_32:
+		case FINS_AR_WRITE_32:
+		case FINS_IO_WRITE_32:
+		{
+			if ((nelements * 2) > FINS_MAX_ARRAY_WORDS)
+			{
+				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, request too big for %s.\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+				return (asynError);
+			}
+			
+			break;
+		}
+		
+		default:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
+			return (asynError);
+		}
+	}
+	
+	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+	
+/* form FINS message and send data */
+
+	if (finsWrite(pdrvPvt, pasynUser, (void *) value, nelements, addr, sizeof(epicsUInt32)) < 0)
+	{
+		return (FailStatus(pdrvPvt));
+	}
+
+	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, wrote %lu 32-bit word(s).\n", __func__, pdrvPvt->portName, addr, (unsigned long) nelements);
+
+	return (asynSuccess);
+}
+
+/*** asynFloat32Array *****************************************************************************/
+
+/*
+	Read 32 bit values from the PLC which are encoded as IEEE floats
+*/
+
+static asynStatus ReadFloat32Array(void *pvt, asynUser *pasynUser, epicsFloat32 *value, size_t nelements, size_t *nIn)
+{
+	drvPvt * const pdrvPvt = (drvPvt *) pvt;
+	int addr;
+	asynStatus status;
+	
+	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+	{
+		return (status);
+	}
+
+	switch (pasynUser->reason)
+	{
+		case FINS_DM_READ_32:
+		case FINS_AR_READ_32:
+		{
+			if ((nelements * 2) > FINS_MAX_ARRAY_WORDS)
+			{
+				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, request too big for %s.\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+				return (asynError);
+			}
+			
+			break;
+		}
+		
+		default:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
+			return (asynError);
+		}
+	}
+	
+	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+	
+/* remember the size for polling I/O Intr records */
+
+	if (pasynUser->drvUser)
+	{
+		((finsUser *) pasynUser->drvUser)->nelements = nelements;
+	}
+	
+/* send FINS request */
+
+	if (finsRead(pdrvPvt, pasynUser, (void *) value, nelements, addr, nIn, sizeof(epicsInt32)) < 0)
+	{
+		*nIn = 0;
+		return (FailStatus(pdrvPvt));
+	}
+
+	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, read %lu float(s).\n", __func__, pdrvPvt->portName, addr, (unsigned long) *nIn);
+	
+	return (asynSuccess);
+}
+
+static asynStatus WriteFloat32Array(void *pvt, asynUser *pasynUser, epicsFloat32 *value, size_t nelements)
+{
+	drvPvt * const pdrvPvt = (drvPvt *) pvt;
+	int addr;
+	asynStatus status;
+
+	if ((status = pasynManager->getAddr(pasynUser, &addr)) != asynSuccess)
+	{
+		return (status);
+	}
+
+	switch (pasynUser->reason)
+	{
+		case FINS_DM_WRITE_32:
+		case FINS_AR_WRITE_32:
+		{
+			if ((nelements * 2) > FINS_MAX_ARRAY_WORDS)
+			{
+				asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, request too big for %s.\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+				return (asynError);
+			}
+			
+			break;
+		}
+		
+		default:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, no such command %d.\n", __func__, pdrvPvt->portName, pasynUser->reason);
+			return (asynError);
+		}
+	}
+	
+	asynPrint(pasynUser, ASYN_TRACE_FLOW, "%s: port %s, addr %d, %s\n", __func__, pdrvPvt->portName, addr, FINS_names[pasynUser->reason]);
+	
+/* form FINS message and send data */
+
+	if (finsWrite(pdrvPvt, pasynUser, (void *) value, nelements, addr, sizeof(epicsInt32)) < 0)
+	{
+		return (FailStatus(pdrvPvt));
+	}
+
+	asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "%s: port %s, addr %d, wrote %lu float(s).\n", __func__, pdrvPvt->portName, addr, (unsigned long) nelements);
+
+	return (asynSuccess);
+}
+
+/*** asynDrvUser **********************************************************************************/
+
+static asynStatus drvUserDestroy(void *drvPvt, asynUser *pasynUser)
+{
+	finsUser *puser = (finsUser *) pasynUser->drvUser;
+	
+	if (puser)
+	{
+		free(puser->last);
+		free(puser);
+		
+		pasynUser->drvUser = NULL;
+	}
+	
+	return (asynSuccess);
+}
+
+static asynStatus drvUserGetType(void *drvPvt, asynUser *pasynUser, const char **pptypeName, size_t *psize)
+{
+	*psize = 0;
+	return (asynSuccess);
+}
+
+/*
+	drvInfo strings are looked up in a hash table of the command names, built the first time it's needed.
+*/
+
+static struct gphPvt *commandHash;
+static epicsThreadOnceId commandOnce = EPICS_THREAD_ONCE_INIT;
+
+static void CommandHashInit(void *arg)
+{
+	int reason;
+	
+	gphInitPvt(&commandHash, 256);
+	
+	for (reason = FINS_NULL + 1; reason < FINS_NCOMMANDS; reason++)
+	{
+		if (finsCommands[reason].flags & FINS_CMD_DRVINFO)
+		{
+			GPHENTRY * const pentry = gphAdd(commandHash, FINS_names[reason], NULL);
+			
+			if (pentry)
+			{
+				pentry->userPvt = (void *) &finsCommands[reason];
+			}
+		}
+	}
+}
+
+static asynStatus drvUserCreate(void *pvt, asynUser *pasynUser, const char *drvInfo, const char **pptypeName, size_t *psize)
+{
+	drvPvt * const pdrvPvt = (drvPvt *) pvt;
+
+	if (drvInfo)
+	{
+		GPHENTRY *pentry;
+		const size_t len = strlen(drvInfo), slen = strlen(FINS_NORESP_SUFFIX);
+		char name[64];
+		int noresp = 0;
+		
+		epicsThreadOnce(&commandOnce, CommandHashInit, NULL);
+		
+	/* a write command followed by _NORESP is sent without waiting for the PLC to acknowledge it */
+	
+		if ((len > slen) && (len - slen < sizeof(name)) && (strcmp(drvInfo + len - slen, FINS_NORESP_SUFFIX) == 0))
+		{
+			memcpy(name, drvInfo, len - slen);
+			name[len - slen] = '\0';
+			
+			drvInfo = name;
+			noresp = 1;
+		}
+		
+		if ((pentry = gphFind(commandHash, drvInfo, NULL)) != NULL)
+		{
+			pasynUser->reason = (const finsCommand *) pentry->userPvt - finsCommands;
+		}
+		else
+		{
+			pasynUser->reason = FINS_NULL;
+		}
+		
+		if (noresp && (((Command(pasynUser->reason)->flags & FINS_CMD_WRITE) == 0) || (pdrvPvt->type == HOSTLINK_type)))
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "drvUserCreate: port %s, %s%s isn't a FINS/UDP or FINS/TCP write.\n", pdrvPvt->portName, drvInfo, FINS_NORESP_SUFFIX);
+			return (asynError);
+		}
+
+		if (pasynUser->drvUser == NULL)
+		{
+			pasynUser->drvUser = callocMustSucceed(1, sizeof(finsUser), __func__);
+		}
+		
+		((finsUser *) pasynUser->drvUser)->pcmd = Command(pasynUser->reason);
+		((finsUser *) pasynUser->drvUser)->noresp = noresp;
+		
+		asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "drvUserCreate: port %s, %s = %d\n", pdrvPvt->portName, drvInfo, pasynUser->reason);
+
+		return (asynSuccess);
+	}
+
+	return (asynError);
+}
+
+static const char * const error01 = "Local node error";
+static const char * const error02 = "Destination node error";
+static const char * const error03 = "Communications controller error";
+static const char * const error04 = "Not executable";
+static const char * const error05 = "Routing error";
+static const char * const error10 = "Command format error";
+static const char * const error11 = "Parameter error";
+static const char * const error20 = "Read not possible";
+static const char * const error21 = "Write not possible";
+static const char * const error22 = "Not executable in current mode";
+static const char * const error23 = "No unit";
+static const char * const error24 = "Start/Stop not possible";
+static const char * const error25 = "Unit error";
+static const char * const error26 = "Command error";
+static const char * const error30 = "Access rights error";
+static const char * const error40 = "Abort error";
+
+static void FINSerror(const drvPvt * const pdrvPvt, asynUser *pasynUser, const char *name, const unsigned char mres, const unsigned char sres)
+{
+	if (mres & 0x80)
+	{
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, Relay Error Flag\n", __func__, pdrvPvt->portName);
+		
+		FINSerror(pdrvPvt, pasynUser, name, mres ^ 0x80, sres);
+	}
+	
+	switch (mres)
+	{
+		case 0x01:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error01, sres);
+			break;
+		}
+		
+		case 0x02:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error02, sres);
+			break;
+		}
+		
+		case 0x03:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error03, sres);
+			break;
+		}
+		
+		case 0x04:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error04, sres);
+			break;
+		}
+		
+		case 0x05:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error05, sres);
+			break;
+		}
+		
+		case 0x10:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error10, sres);
+			break;
+		}
+		
+		case 0x11:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error11, sres);
+			break;
+		}
+		
+		case 0x20:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error20, sres);
+			break;
+		}
+		
+		case 0x21:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error21, sres);
+			break;
+		}
+		
+		case 0x22:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error22, sres);
+			break;
+		}
+		
+		case 0x23:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error23, sres);
+			break;
+		}
+		
+		case 0x24:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %se 0x%02x\n", name, pdrvPvt->portName, error24, sres);
+			break;
+		}
+		
+		case 0x25:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error25, sres);
+			break;
+		}
+		
+		case 0x26:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error26, sres);
+			break;
+		}
+		
+		case 0x30:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error30, sres);
+			break;
+		}
+		
+		case 0x40:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error40, sres);
+			break;
+		}
+		
+		default:
+		{
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, Error 0x%02x/0x%02x\n", name, pdrvPvt->portName, mres, sres);
+			break;
+		}
+	}
+}
+
+/*** ioc shell ************************************************************************************/
+
+static const iocshArg finsNETInitArg0 = { "port name", iocshArgString };
+static const iocshArg finsNETInitArg1 = { "network device", iocshArgString };
+static const iocshArg finsNETInitArg2 = { "local node address", iocshArgInt };
+
+static const iocshArg *finsNETInitArgs[] = { &finsNETInitArg0, &finsNETInitArg1, &finsNETInitArg2};
+static const iocshFuncDef finsNETInitFuncDef = { "finsNETInit", 3, finsNETInitArgs};
+
+static void finsNETInitCallFunc(const iocshArgBuf *args)
+{
+	finsNETInit(args[0].sval, args[1].sval, args[2].ival);
+}
+
+static void finsNETRegister(void)
+{
+	static int firstTime = 1;
+	
+	if (firstTime)
+	{
+		firstTime = 0;
+		iocshRegister(&finsNETInitFuncDef, finsNETInitCallFunc);
+	}
+}
+
+epicsExportRegistrar(finsNETRegister);
+
+/*------------------------------------------------------------------------------------------------*/
+
+static const iocshArg finsDEVInitArg0 = { "port name", iocshArgString };
+static const iocshArg finsDEVInitArg1 = { "serial device", iocshArgString };
+
+static const iocshArg *finsDEVInitArgs[] = { &finsDEVInitArg0, &finsDEVInitArg1};
+static const iocshFuncDef finsDEVInitFuncDef = { "finsDEVInit", 2, finsDEVInitArgs};
+
+static void finsDEVInitCallFunc(const iocshArgBuf *args)
+{
+	finsDEVInit(args[0].sval, args[1].sval);
+}
+
+static void finsDEVRegister(void)
+{
+	static int firstTime = 1;
+	
+	if (firstTime)
+	{
+		firstTime = 0;
+		iocshRegister(&finsDEVInitFuncDef, finsDEVInitCallFunc);
+	}
+}
+
+epicsExportRegistrar(finsDEVRegister);
+
+/*------------------------------------------------------------------------------------------------*/
+
+static const iocshArg finsUDPInitArg0 = { "port name", iocshArgString };
+static const iocshArg finsUDPInitArg1 = { "IP address", iocshArgString };
+static const iocshArg finsUDPInitArg2 = { "Host node number", iocshArgInt };
+static const iocshArg finsUDPInitArg3 = { "requests in flight", iocshArgInt };
+
+static const iocshArg *finsUDPInitArgs[] = { &finsUDPInitArg0, &finsUDPInitArg1, &finsUDPInitArg2, &finsUDPInitArg3};
+static const iocshFuncDef finsUDPInitFuncDef = { "finsUDPInit", 4, finsUDPInitArgs};
+
+static void finsUDPInitCallFunc(const iocshArgBuf *args)
+{
+	finsUDPInit(args[0].sval, args[1].sval, args[2].ival, args[3].ival);
+}
+
+static void finsUDPRegister(void)
+{
+	static int firstTime = 1;
+	
+	if (firstTime)
+	{
+		firstTime = 0;
+		iocshRegister(&finsUDPInitFuncDef, finsUDPInitCallFunc);
+	}
+}
+
+epicsExportRegistrar(finsUDPRegister);
+
+/*------------------------------------------------------------------------------------------------*/
+
+static const iocshArg finsUDPSharedInitArg0 = { "port name", iocshArgString };
+static const iocshArg finsUDPSharedInitArg1 = { "IP address", iocshArgString };
+static const iocshArg finsUDPSharedInitArg2 = { "Host node number", iocshArgInt };
+static const iocshArg finsUDPSharedInitArg3 = { "requests in flight", iocshArgInt };
+
+static const iocshArg *finsUDPSharedInitArgs[] = { &finsUDPSharedInitArg0, &finsUDPSharedInitArg1, &finsUDPSharedInitArg2, &finsUDPSharedInitArg3};
+static const iocshFuncDef finsUDPSharedInitFuncDef = { "finsUDPSharedInit", 4, finsUDPSharedInitArgs};
+
+static void finsUDPSharedInitCallFunc(const iocshArgBuf *args)
+{
+	finsUDPSharedInit(args[0].sval, args[1].sval, args[2].ival, args[3].ival);
+}
+
+static const iocshArg finsDispatcherInitArg0 = { "sockets", iocshArgInt };
+static const iocshArg finsDispatcherInitArg1 = { "batch", iocshArgInt };
+
+static const iocshArg *finsDispatcherInitArgs[] = { &finsDispatcherInitArg0, &finsDispatcherInitArg1};
+static const iocshFuncDef finsDispatcherInitFuncDef = { "finsDispatcherInit", 2, finsDispatcherInitArgs};
+
+static void finsDispatcherInitCallFunc(const iocshArgBuf *args)
+{
+	finsDispatcherInit(args[0].ival, args[1].ival);
+}
+
+static void finsUDPSharedRegister(void)
+{
+	static int firstTime = 1;
+	
+	if (firstTime)
+	{
+		firstTime = 0;
+		iocshRegister(&finsUDPSharedInitFuncDef, finsUDPSharedInitCallFunc);
+		iocshRegister(&finsDispatcherInitFuncDef, finsDispatcherInitCallFunc);
+	}
+}
+
+epicsExportRegistrar(finsUDPSharedRegister);
+
+/*------------------------------------------------------------------------------------------------*/
+
+static const iocshArg finsTCPSharedInitArg0 = { "port name", iocshArgString };
+static const iocshArg finsTCPSharedInitArg1 = { "IP address", iocshArgString };
+static const iocshArg finsTCPSharedInitArg2 = { "requests in flight", iocshArgInt };
+
+static const iocshArg *finsTCPSharedInitArgs[] = { &finsTCPSharedInitArg0, &finsTCPSharedInitArg1, &finsTCPSharedInitArg2};
+static const iocshFuncDef finsTCPSharedInitFuncDef = { "finsTCPSharedInit", 3, finsTCPSharedInitArgs};
+
+static void finsTCPSharedInitCallFunc(const iocshArgBuf *args)
+{
+	finsTCPSharedInit(args[0].sval, args[1].sval, args[2].ival);
+}
+
+static void finsTCPSharedRegister(void)
+{
+	static int firstTime = 1;
+	
+	if (firstTime)
+	{
+		firstTime = 0;
+		iocshRegister(&finsTCPSharedInitFuncDef, finsTCPSharedInitCallFunc);
+	}
+}
+
+epicsExportRegistrar(finsTCPSharedRegister);
+
+/*------------------------------------------------------------------------------------------------*/
+
+static const iocshArg finsTCPInitArg0 = { "port name", iocshArgString };
+static const iocshArg finsTCPInitArg1 = { "IP address", iocshArgString };
+
+static const iocshArg *finsTCPInitArgs[] = { &finsTCPInitArg0, &finsTCPInitArg1};
+static const iocshFuncDef finsTCPInitFuncDef = { "finsTCPInit", 2, finsTCPInitArgs};
+
+static void finsTCPInitCallFunc(const iocshArgBuf *args)
+{
+	finsTCPInit(args[0].sval, args[1].sval);
+}
+
+static void finsTCPRegister(void)
+{
+	static int firstTime = 1;
+	
+	if (firstTime)
+	{
+		firstTime = 0;
+		iocshRegister(&finsTCPInitFuncDef, finsTCPInitCallFunc);
+	}
+}
+
+epicsExportRegistrar(finsTCPRegister);
+
+/**************************************************************************************************/
+
+/*
+	This is a test function to send a FINS data memory read request for two words from
+	address 100 to the specified IP address. It will print the data received as hex, or
+	a helpful error message if something fails.
+*/
+
+int finsTest(char *address)
+{
+	int fd;
+	struct sockaddr_in addr;
+	const int addrlen = sizeof(struct sockaddr_in);
+	uint8_t node;
+	unsigned char *message;
+	int recvlen, sendlen = 0;
+	
+	message = (unsigned char *) callocMustSucceed(1, FINS_MAX_MSG, "finsTest");
+	
+/* open a datagram socket */
+
+	fd = socket(PF_INET, SOCK_DGRAM, 0);
+	
+	if (fd < 0)
+	{
+		perror("finsTest: socket");
+		return (-1);
+	}
+	
+	bzero((char *) &(addr), addrlen);
+
+/* ask for a free port for incoming UDP packets */
+
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(0);
+
+/* bind socket to address */
+
+	if (bind(fd, (struct sockaddr *) &addr, addrlen) < 0)
+	{
+		perror("finsTest: bind failed");
+		
+		close(fd);
+		return (-1);
+	}
+
+/* find our port number */
+	
+	{
+		struct sockaddr_in name;
+#ifdef vxWorks
+		int namelen;
+#else
+		socklen_t namelen;
+#endif			
+		getsockname(fd, (struct sockaddr *) &name, &namelen);
+
+		printf("finsTest: port %d bound\n", name.sin_port);
+	}
+	
+/* destination port address used later in sendto() */
+
+	bzero((char *) &addr, addrlen);
+
+/*
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(FINS_UDP_PORT);
+*/
+
+/* convert IP address */
+
+	if (aToIPAddr(address, FINS_NET_PORT, &addr) < 0)
+	{
+		close(fd);
+		printf("finsTest: Bad IP address %s\n", address);
+		return (-1);
+	}
+
+/* node address is last byte of IP address */
+		
+	node = ntohl(addr.sin_addr.s_addr) & 0xff;
+		
+	printf("PLC node %d\n", node);
+
+/* send a simple FINS command */
+
+	message[ICF] = 0x80;
+	message[RSV] = 0x00;
+	message[GCT] = 0x02;
+
+	message[DNA] = 0x00;
+	message[DA1] = node;		/* destination node */
+	message[DA2] = 0x00;
+
+	message[SNA] = 0x00;
+	message[SA1] = 0x01;		/* source node */
+	message[SA2] = 0x00;
+
+	message[MRC] = 0x01;
+	message[SRC] = 0x01;
+	message[COM] = DM;		/* data memory read */
+
+	message[COM+1] = 100 >> 8;
+	message[COM+2] = 100 & 0xff;
+	message[COM+3] = 0x00;		/* start address */
+
+	message[COM+4] = 2 >> 8;
+	message[COM+5] = 2 & 0xff;	/* length */
+
+	sendlen = COM + 6;
+
+/* send request */
+
+	if (sendto(fd, message, sendlen, 0, (struct sockaddr *) &addr, addrlen) != sendlen)
+	{
+		perror("finsTest: sendto");
+		close(fd);
+		return (-1);
+	}
+
+/* receive reply with time out */
+
+	{
+		fd_set rfds;
+		struct timeval tv;
+		
+		FD_ZERO(&rfds);
+		FD_SET(fd, &rfds);
+		
+	/* time out */
+
+		tv.tv_sec = FINS_TIMEOUT;
+		tv.tv_usec = 0;
+
+		switch (select(fd + 1, &rfds, NULL, NULL, &tv))
+		{
+			case -1:
+			{
+				perror("finsTest: select");
+	
+				return (-1);
+				break;
+			}
+			
+			case 0:
+			{
+				perror("finsTest: select");
+
+				return (-1);
+				break;
+			}
+
+			default:
+			{
+				break;
+			}
+		}
+	}
+
+	{
+		struct sockaddr from_addr;
+#ifdef vxWorks
+		int iFromLen = 0;
+#else
+		socklen_t iFromLen = 0;
+#endif
+		if ((recvlen = recvfrom(fd, message, FINS_MAX_MSG, 0, &from_addr, &iFromLen)) < 0)
+		{
+			perror("finsTest: recvfrom");
+			close(fd);
+			return (-1);
+		}
+	}
+
+	{
+		int i;
+		
+		for (i = 0; i < recvlen; i++)
+		{
+			printf("0x%02x ", message[i]);
+		}
+	
+		puts("");
+	}
+
+/* Illegal response length check */
+	
+	if (recvlen < MIN_RESP_LEN)
+	{
+		puts("finsTest: receive length too small.");
+	}
+
+/* check response code */
+
+	if ((message[MRES] != 0x00) || (message[SRES] != 0x00))
+	{
+		if (message[MRES] & 0x80)
+		{
+			puts("finsTest: Relay Error Flag set");
+			
+			message[MRES] ^= 0x80;
+		}
+		
+		switch (message[MRES])
+		{
+			case 0x01:
+			{
+				printf("%s 0x%02x\n", error01, message[SRES]);
+				break;
+			}
+		
+			case 0x02:
+			{
+				printf("%s 0x%02x\n", error02, message[SRES]);
+				break;
+			}
+		
+			case 0x03:
+			{
+				printf("%s 0x%02x\n", error03, message[SRES]);
+				break;
+			}
+		
+			case 0x04:
+			{
+				printf("%s 0x%02x\n", error04, message[SRES]);
+				break;
+			}
+		
+			case 0x05:
+			{
+				printf("%s 0x%02x\n", error05, message[SRES]);
+				break;
+			}
+		
+			case 0x10:
+			{
+				printf("%s 0x%02x\n", error10, message[SRES]);
+				break;
+			}
+		
+			case 0x11:
+			{
+				printf("%s 0x%02x\n", error11, message[SRES]);
+				break;
+			}
+		
+			case 0x20:
+			{
+				printf("%s 0x%02x\n", error20, message[SRES]);
+				break;
+			}
+		
+			case 0x21:
+			{
+				printf("%s 0x%02x\n", error21, message[SRES]);
+				break;
+			}
+		
+			case 0x22:
+			{
+				printf("%s 0x%02x\n", error22, message[SRES]);
+				break;
+			}
+		
+			case 0x23:
+			{
+				printf("%s 0x%02x\n", error23, message[SRES]);
+				break;
+			}
+		
+			case 0x24:
+			{
+				printf("%s 0x%02x\n", error24, message[SRES]);
+				break;
+			}
+		
+			case 0x25:
+			{
+				printf("%s 0x%02x\n", error25, message[SRES]);
+				break;
+			}
+		
+			case 0x26:
+			{
+				printf("%s 0x%02x\n", error26, message[SRES]);
+				break;
+			}
+		
+			case 0x30:
+			{
+				printf("%s 0x%02x\n", error30, message[SRES]);
+				break;
+			}
+		
+			case 0x40:
+			{
+				printf("%s 0x%02x\n", error40, message[SRES]);
+				break;
+			}
+		
+			default:
+			{
+				printf("Error 0x%02x/0x%02x\n", message[MRES], message[SRES]);
+				break;
+			}
+		}
+	}
+		
+	close(fd);
+	
+	return (0);
+}
+
+static const iocshArg finsTestArg0 = { "IP address", iocshArgString };
+
+static const iocshArg *finsTestArgs[] = { &finsTestArg0};
+static const iocshFuncDef finsTestFuncDef = { "finsTest", 1, finsTestArgs};
+
+static void finsTestCallFunc(const iocshArgBuf *args)
+{
+	finsTest(args[0].sval);
+}
+
+static void finsTestRegister(void)
+{
+	static int firstTime = 1;
+	
+	if (firstTime)
+	{
+		firstTime = 0;
+		iocshRegister(&finsTestFuncDef, finsTestCallFunc);
+	}
+}
+
+epicsExportRegistrar(finsTestRegister);
+
+/**************************************************************************************************/
+
+/*
+	Define the 'memory area' & 'address' items read by the Multiple Memory Area Read command with
+	FINS_MM_READ. finsMultiMemoryAreaDefine sets entry index of one port's table, the asyn address of
+	the FINS_MM_READ record. finsMultiMemoryAreaInit appends an entry to the table used by ports
+	without one of their own.
+	
+	finsMultiMemoryAreaDefine("PLC1", 0, "0x82 100, 0x82 200:32, 0x30 10.5")
+*/
+
+static drvPvt *finsFindPort(const char *portName);
+
+int finsMultiMemoryAreaInit(char *s)
+{
+	finsMMEntry entry;
+	
+	if (MMParse(s, &entry) < 0)
+	{
+		return (-1);
+	}
+	
+	if (mmDefault.lock == NULL)
+	{
+		mmDefault.lock = epicsMutexMustCreate();
+	}
+	
+	epicsMutexMustLock(mmDefault.lock);
+	
+	{
+		finsMMEntry * const pentry = MMEntry(&mmDefault, mmDefault.n, 1);
+		
+		if (pentry)
+		{
+			*pentry = entry;
+		}
+		
+		epicsMutexUnlock(mmDefault.lock);
+		
+		if (pentry == NULL)
+		{
+			printf("%s: too many entries\n", __func__);
+			return (-1);
+		}
+	}
+	
+	return (0);
+}
+
+int finsMultiMemoryAreaDefine(const char *portName, const int index, const char *s)
+{
+	drvPvt * const pdrvPvt = finsFindPort(portName);
+	finsMMTable *ptable;
+	finsMMEntry entry, *pentry;
+	
+	if (pdrvPvt == NULL)
+	{
+		printf("%s: no FINS port %s\n", __func__, portName ? portName : "");
+		return (-1);
+	}
+	
+	if (MMParse(s, &entry) < 0)
+	{
+		return (-1);
+	}
+	
+	ptable = MMOwn(pdrvPvt);
+	
+	if ((pentry = MMEntry(ptable, index, 1)))
+	{
+		entry.edits = pentry->edits + 1;
+		*pentry = entry;
+	}
+	
+	epicsMutexUnlock(ptable->lock);
+	
+	if (pentry == NULL)
+	{
+		printf("%s: port %s, bad index %d\n", __func__, portName, index);
+		return (-1);
+	}
+	
+	return (0);
+}
+
+static int MMDump(finsMMTable * const ptable)
+{
+	int i, j;
+	
+	epicsMutexMustLock(ptable->lock);
+	
+	for (i = 0; i < ptable->n; i++)
+	{
+		const finsMMEntry * const pentry = &ptable->entry[i];
+		
+		if (pentry->nitems == 0) continue;
+		
+		printf("%2d: ", i);
+		
+		for (j = 0; j < pentry->nitems; j++)
+		{
+			const finsMMItem * const pitem = &pentry->item[j];
+			
+			printf("%s0x%02x 0x%04x", (j > 0) ? ", " : "", pitem->area, pitem->address);
+			
+			if (pitem->width == FINS_MM_BIT)
+			{
+				printf(".%u", pitem->bit);
+			}
+			else if (pitem->width == FINS_MM_WORD_32)
+			{
+				printf(":32");
+			}
+		}
+		
+		puts("");
+	}
+	
+	epicsMutexUnlock(ptable->lock);
+	
+	return (0);
+}
+
+/* the table used by portName, or the finsMultiMemoryAreaInit table */
+
+int finsMultiMemoryAreaDump(const char *portName)
+{
+	if (portName && *portName)
+	{
+		drvPvt * const pdrvPvt = finsFindPort(portName);
+		finsMMTable *ptable;
+		
+		if (pdrvPvt == NULL)
+		{
+			printf("%s: no FINS port %s\n", __func__, portName);
+			return (-1);
+		}
+		
+		ptable = MMLock(pdrvPvt);
+		epicsMutexUnlock(ptable->lock);
+		
+		return (MMDump(ptable));
+	}
+	
+	return (mmDefault.lock ? MMDump(&mmDefault) : 0);
+}
+
+static const iocshArg finsMultiMemoryAreaInitArg0 = { "area/address", iocshArgString };
+
+static const iocshArg *finsMultiMemoryAreaInitArgs[] = { &finsMultiMemoryAreaInitArg0};
+static const iocshFuncDef finsMultiMemoryAreaInitFuncDef = { "finsMultiMemoryAreaInit", 1, finsMultiMemoryAreaInitArgs};
+
+static void finsMultiMemoryAreaInitCallFunc(const iocshArgBuf *args)
+{
+	finsMultiMemoryAreaInit(args[0].sval);
+}
+
+static void finsMultiMemoryAreaInitRegister(void)
+{
+	static int firstTime = 1;
+	
+	if (firstTime)
+	{
+		firstTime = 0;
+		iocshRegister(&finsMultiMemoryAreaInitFuncDef, finsMultiMemoryAreaInitCallFunc);
+	}
+}
+
+epicsExportRegistrar(finsMultiMemoryAreaInitRegister);
+
+static const iocshArg finsMultiMemoryAreaDefineArg0 = { "portName", iocshArgString };
+static const iocshArg finsMultiMemoryAreaDefineArg1 = { "index", iocshArgInt };
+static const iocshArg finsMultiMemoryAreaDefineArg2 = { "area/address", iocshArgString };
+
+static const iocshArg *finsMultiMemoryAreaDefineArgs[] = { &finsMultiMemoryAreaDefineArg0, &finsMultiMemoryAreaDefineArg1, &finsMultiMemoryAreaDefineArg2};
+static const iocshFuncDef finsMultiMemoryAreaDefineFuncDef = { "finsMultiMemoryAreaDefine", 3, finsMultiMemoryAreaDefineArgs};
+
+static void finsMultiMemoryAreaDefineCallFunc(const iocshArgBuf *args)
+{
+	finsMultiMemoryAreaDefine(args[0].sval, args[1].ival, args[2].sval);
+}
+
+static const iocshArg finsMultiMemoryAreaDumpArg0 = { "portName", iocshArgString };
+
+static const iocshArg *finsMultiMemoryAreaDumpArgs[] = { &finsMultiMemoryAreaDumpArg0};
+static const iocshFuncDef finsMultiMemoryAreaDumpFuncDef = { "finsMultiMemoryAreaDump", 1, finsMultiMemoryAreaDumpArgs};
+
+static void finsMultiMemoryAreaDumpCallFunc(const iocshArgBuf *args)
+{
+	finsMultiMemoryAreaDump(args[0].sval);
+}
+
+static void finsMultiMemoryAreaDefineRegister(void)
+{
+	static int firstTime = 1;
+	
+	if (firstTime)
+	{
+		firstTime = 0;
+		iocshRegister(&finsMultiMemoryAreaDefineFuncDef, finsMultiMemoryAreaDefineCallFunc);
+		iocshRegister(&finsMultiMemoryAreaDumpFuncDef, finsMultiMemoryAreaDumpCallFunc);
+	}
+}
+
+epicsExportRegistrar(finsMultiMemoryAreaDefineRegister);
+
+/**************************************************************************************************/
+
+/*
+	I/O Intr support
+	
+	The driver reads the values for records with SCAN="I/O Intr" and passes them to the records
+	through the asyn interrupt callbacks. Records inside a block (see finsBlockDefine) are updated
+	by the block poller after each read of the block. All other records are updated by the port
+	poller created by finsPollInit, which also selects change-only publication.
+	
+	finsPollInit("PLC1", 1.0, 1)
+	
+	The driver doesn't know the NELM of an I/O Intr waveform until the record has been read, so
+	array records should also set PINI="YES". Fixed size reads (clock, cycle time) don't need it.
+*/
+
+/* find the private data of a FINS port created by finsInit() */
+
+static drvPvt *finsFindPort(const char *portName)
+{
+	asynUser *pasynUser = pasynManager->createAsynUser(0, 0);
+	drvPvt *pdrvPvt = NULL;
+	
+	if (portName && (pasynManager->connectDevice(pasynUser, portName, 0) == asynSuccess))
+	{
+		asynInterface *pasynInterface = pasynManager->findInterface(pasynUser, asynCommonType, 0);
+		
+		if (pasynInterface && (pasynInterface->pinterface == (void *) &ifacecommon))
+		{
+			pdrvPvt = (drvPvt *) pasynInterface->drvPvt;
+		}
+		
+		pasynManager->disconnect(pasynUser);
+	}
+	
+	pasynManager->freeAsynUser(pasynUser);
+	
+	return (pdrvPvt);
+}
+
+/* reasons that can't be read and so are never polled */
+
+static int IntrReadable(const int reason)
+{
+	switch (reason)
+	{
+		case FINS_NULL:
+		case FINS_DM_WRITE_NOREAD:
+		case FINS_IO_WRITE_NOREAD:
+		case FINS_AR_WRITE_NOREAD:
+		case FINS_CT_READ ... FINS_CT_WRITE_NOREAD:
+		case FINS_DM_WRITE_32_NOREAD:
+		case FINS_IO_WRITE_32_NOREAD:
+		case FINS_AR_WRITE_32_NOREAD:
+		case FINS_CT_READ_32 ... FINS_CT_WRITE_32_NOREAD:
+		case FINS_WRITE_MULTI:
+		case FINS_SET_MULTI_TYPE:
+		case FINS_SET_MULTI_ADDR:
+		case FINS_CLR_MULTI:
+		case FINS_CYCLE_TIME_RESET:
+		case FINS_MONITOR:
+		case FINS_SET_RESET_CANCEL:
+		case FINS_EXPLICIT:
+		case FINS_WRITE_COMMIT:
+		{
+			return (0);
+		}
+		
+		default:
+		{
+			return (1);
+		}
+	}
+}
+
+/*
+	Decide whether a poll updates a record. A block poll (pblock != NULL) updates the records inside
+	the block, the port poll (pblock == NULL) updates those which aren't inside any block.
+	nelements is the number of asyn elements read.
+*/
+
+static int IntrSelected(drvPvt * const pdrvPvt, const finsBlock * const pblock, const int reason, const int addr, const size_t nelements)
+{
+	int width, selected;
+	const epicsUInt8 area = MemoryArea(reason, &width);
+	
+	if ((nelements == 0) || (IntrReadable(reason) == 0))
+	{
+		return (0);
+	}
+	
+/* the status poller passes these on */
+
+	if (pdrvPvt->status && (StatusFrame(reason) >= 0))
+	{
+		return (0);
+	}
+	
+	if (pblock)
+	{
+		return ((area == pblock->area) && (addr >= pblock->start) && (addr + nelements * width <= pblock->start + pblock->nwords));
+	}
+	
+	if ((area == 0) || (ellCount(&pdrvPvt->blockList) == 0))
+	{
+		return (1);
+	}
+	
+	epicsMutexMustLock(pdrvPvt->blockLock);
+	selected = (BlockFind(pdrvPvt, area, addr, nelements * width) == NULL);
+	epicsMutexUnlock(pdrvPvt->blockLock);
+	
+	return (selected);
+}
+
+/*
+	With change-only publication only pass on a value if it, or the read status, differs from the
+	last one passed to the record. Returns non-zero if the callback should be made.
+*/
+
+static int IntrChanged(const drvPvt * const pdrvPvt, asynUser *pasynUser, const asynStatus status, const void *data, const size_t nbytes)
+{
+	finsUser * const puser = (finsUser *) pasynUser->drvUser;
+	
+	if (puser == NULL)
+	{
+		return (1);
+	}
+	
+	if (pdrvPvt->onChange && puser->published && (status == puser->status))
+	{
+		if ((status != asynSuccess) || ((nbytes == puser->nbytes) && (memcmp(data, puser->last, nbytes) == 0)))
+		{
+			return (0);
+		}
+	}
+	
+	if (nbytes > puser->size)
+	{
+		free(puser->last);
+		
+		puser->last = callocMustSucceed(1, nbytes, __func__);
+		puser->size = nbytes;
+	}
+	
+	if (status == asynSuccess)
+	{
+		memcpy(puser->last, data, nbytes);
+	}
+	
+	puser->nbytes = nbytes;
+	puser->status = status;
+	puser->published = 1;
+	
+	return (1);
+}
+
+/* the number of elements to read for an I/O Intr array record */
+
+static size_t IntrArraySize(asynUser *pasynUser)
+{
+	const finsUser * const puser = (finsUser *) pasynUser->drvUser;
+	
+	switch (pasynUser->reason)
+	{
+		case FINS_CLOCK_READ:
+		{
+			return (FINS_CLOCK_READ_LEN);
+		}
+		
+		case FINS_CYCLE_TIME:
+		{
+			return (FINS_CYCLE_TIME_LEN);
+		}
+		
+		default:
+		{
+			return (puser ? puser->nelements : 0);
+		}
+	}
+}
+
+/*
+	Scalar memory reads that the port poller coalesces into Multiple Memory Area Reads. These are
+	the reasons ReadInt32 (float64 == 0) and ReadFloat64 (float64 == 1) read from PLC memory.
+*/
+
+static int MultiCoalesced(const drvPvt * const pdrvPvt, const int float64, const int reason)
+{
+	if ((pdrvPvt->multi == NULL) || pdrvPvt->multi->disabled)
+	{
+		return (0);
+	}
+	
+	switch (reason)
+	{
+		case FINS_DM_READ:
+		case FINS_AR_READ:
+		case FINS_IO_READ:
+		case FINS_WR_READ:
+		case FINS_HR_READ:
+		case FINS_IO_READ_32:
+		case FINS_DM_WRITE:
+		case FINS_IO_WRITE:
+		case FINS_AR_WRITE:
+		case FINS_IO_WRITE_32:
+		{
+			return (float64 == 0);
+		}
+		
+		case FINS_DM_READ_32:
+		case FINS_AR_READ_32:
+		case FINS_DM_WRITE_32:
+		case FINS_AR_WRITE_32:
+		{
+			return (1);
+		}
+		
+		default:
+		{
+			return (0);
+		}
+	}
+}
+
+/*
+	The poller's own asynUser for an I/O Intr record, connected to the same address, so that reading
+	the record doesn't touch the asynUser and finsUser the port thread may be using for it.
+*/
+
+static asynUser *IntrShadow(drvPvt * const pdrvPvt, asynUser *pasynUser, const int addr)
+{
+	finsUser * const puser = (finsUser *) pasynUser->drvUser;
+	finsUser *pshadow;
+	asynUser *shadow;
+	
+	if (puser && puser->poll)
+	{
+		puser->poll->timeout = pasynUser->timeout;
+		return (puser->poll);
+	}
+	
+	shadow = pasynManager->createAsynUser(0, 0);
+	shadow->reason = pasynUser->reason;
+	shadow->timeout = pasynUser->timeout;
+	
+	if (pasynManager->connectDevice(shadow, pdrvPvt->portName, addr) != asynSuccess)
+	{
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, addr %d, connectDevice failed: %s\n", __func__, pdrvPvt->portName, addr, shadow->errorMessage);
+		pasynManager->freeAsynUser(shadow);
+		
+		return (NULL);
+	}
+	
+	pshadow = (finsUser *) callocMustSucceed(1, sizeof(finsUser), __func__);
+	
+	if (puser)
+	{
+		pshadow->pcmd = puser->pcmd;
+		pshadow->noresp = puser->noresp;
+		pshadow->nelements = puser->nelements;
+		
+		puser->poll = shadow;
+	}
+	
+	shadow->drvUser = pshadow;
+	
+	return (shadow);
+}
+
+/* add a client to read, with room for nelements of size bytes. Called with the interrupt lock held. */
+
+static finsIntrRead *IntrAdd(drvPvt * const pdrvPvt, finsIntrPoll * const ppoll, void *pinterrupt, asynUser *pasynUser, const int addr, const size_t nelements, const size_t size)
+{
+	const size_t nbytes = (nelements * size + 7) & ~(size_t) 7;
+	finsIntrRead *pread;
+	asynUser *shadow;
+	
+	if ((shadow = IntrShadow(pdrvPvt, pasynUser, addr)) == NULL)
+	{
+		return (NULL);
+	}
+	
+	if (ppoll->nreads == ppoll->maxreads)
+	{
+		ppoll->maxreads = ppoll->maxreads ? 2 * ppoll->maxreads : 32;
+		
+		if ((ppoll->reads = (finsIntrRead *) realloc(ppoll->reads, ppoll->maxreads * sizeof(finsIntrRead))) == NULL)
+		{
+			cantProceed("%s: port %s, out of memory\n", __func__, pdrvPvt->portName);
+		}
+	}
+	
+	if (ppoll->ndata + nbytes > ppoll->maxdata)
+	{
+		ppoll->maxdata = 2 * (ppoll->ndata + nbytes);
+		
+		if ((ppoll->data = (char *) realloc(ppoll->data, ppoll->maxdata)) == NULL)
+		{
+			cantProceed("%s: port %s, out of memory\n", __func__, pdrvPvt->portName);
+		}
+	}
+	
+	pread = &ppoll->reads[ppoll->nreads++];
+	pread->pinterrupt = pinterrupt;
+	pread->shadow = shadow;
+	pread->nelements = nelements;
+	pread->nread = 0;
+	pread->offset = ppoll->ndata;
+	pread->eomReason = 0;
+	pread->status = asynError;
+	
+	memset(ppoll->data + pread->offset, 0, nbytes);
+	ppoll->ndata += nbytes;
+	
+	return (pread);
+}
+
+/*
+	The read of a client, looked up when the interrupt lock is taken again to pass the values on.
+	Clients are only ever appended, so the reads are found in order from *next and those that went
+	away meanwhile are skipped. Returns NULL for a client that registered since.
+*/
+
+static finsIntrRead *IntrFind(finsIntrPoll * const ppoll, size_t *next, const void *pinterrupt)
+{
+	size_t i;
+	
+	for (i = *next; i < ppoll->nreads; i++)
+	{
+		if (ppoll->reads[i].pinterrupt == pinterrupt)
+		{
+			*next = i + 1;
+			return (&ppoll->reads[i]);
+		}
+	}
+	
+	return (NULL);
+}
+
+static void IntrPollOctet(drvPvt * const pdrvPvt, const finsBlock * const pblock, finsIntrPoll * const ppoll)
+{
+	ELLLIST *pclientList;
+	interruptNode *pnode;
+	size_t i, next = 0;
+	
+	ppoll->nreads = ppoll->ndata = 0;
+	
+	pasynManager->interruptStart(pdrvPvt->asynStdInterfaces.octetInterruptPvt, &pclientList);
+	
+	for (pnode = (interruptNode *) ellFirst(pclientList); pnode; pnode = (interruptNode *) ellNext(&pnode->node))
+	{
+		asynOctetInterrupt *pinterrupt = (asynOctetInterrupt *) pnode->drvPvt;
+		
+		if (IntrSelected(pdrvPvt, pblock, pinterrupt->pasynUser->reason, pinterrupt->addr, 1))
+		{
+			IntrAdd(pdrvPvt, ppoll, pinterrupt, pinterrupt->pasynUser, pinterrupt->addr, FINS_MODEL_LEN + 1, 1);
+		}
+	}
+	
+	pasynManager->interruptEnd(pdrvPvt->asynStdInterfaces.octetInterruptPvt);
+	
+	for (i = 0; i < ppoll->nreads; i++)
+	{
+		finsIntrRead * const pread = &ppoll->reads[i];
+		
+		pread->status = octetRead(pdrvPvt, pread->shadow, ppoll->data + pread->offset, FINS_MODEL_LEN, &pread->nread, &pread->eomReason);
+	}
+	
+	pasynManager->interruptStart(pdrvPvt->asynStdInterfaces.octetInterruptPvt, &pclientList);
+	
+	for (pnode = (interruptNode *) ellFirst(pclientList); pnode; pnode = (interruptNode *) ellNext(&pnode->node))
+	{
+		asynOctetInterrupt *pinterrupt = (asynOctetInterrupt *) pnode->drvPvt;
+		asynUser *pasynUser = pinterrupt->pasynUser;
+		const finsIntrRead * const pread = IntrFind(ppoll, &next, pinterrupt);
+		char *value;
+		
+		if (pread == NULL)
+		{
+			continue;
+		}
+		
+		value = ppoll->data + pread->offset;
+		
+		if (IntrChanged(pdrvPvt, pasynUser, pread->status, value, pread->nread))
+		{
+			pasynUser->auxStatus = pread->status;
+			pinterrupt->callback(pinterrupt->userPvt, pasynUser, value, pread->nread, pread->eomReason);
+		}
+	}
+	
+	pasynManager->interruptEnd(pdrvPvt->asynStdInterfaces.octetInterruptPvt);
+}
+
+static void IntrPollInt32(drvPvt * const pdrvPvt, const finsBlock * const pblock, finsIntrPoll * const ppoll)
+{
+	ELLLIST *pclientList;
+	interruptNode *pnode;
+	size_t i, next = 0;
+	
+	ppoll->nreads = ppoll->ndata = 0;
+	
+	pasynManager->interruptStart(pdrvPvt->asynStdInterfaces.int32InterruptPvt, &pclientList);
+	
+	for (pnode = (interruptNode *) ellFirst(pclientList); pnode; pnode = (interruptNode *) ellNext(&pnode->node))
+	{
+		asynInt32Interrupt *pinterrupt = (asynInt32Interrupt *) pnode->drvPvt;
+		const int reason = pinterrupt->pasynUser->reason;
+		
+		if (IntrSelected(pdrvPvt, pblock, reason, pinterrupt->addr, ONE_ELEMENT) && ((pblock != NULL) || (MultiCoalesced(pdrvPvt, 0, reason) == 0)))
+		{
+			IntrAdd(pdrvPvt, ppoll, pinterrupt, pinterrupt->pasynUser, pinterrupt->addr, ONE_ELEMENT, sizeof(epicsInt32));
+		}
+	}
+	
+	pasynManager->interruptEnd(pdrvPvt->asynStdInterfaces.int32InterruptPvt);
+	
+	for (i = 0; i < ppoll->nreads; i++)
+	{
+		finsIntrRead * const pread = &ppoll->reads[i];
+		
+		pread->status = ReadInt32(pdrvPvt, pread->shadow, (epicsInt32 *) (ppoll->data + pread->offset));
+	}
+	
+	pasynManager->interruptStart(pdrvPvt->asynStdInterfaces.int32InterruptPvt, &pclientList);
+	
+	for (pnode = (interruptNode *) ellFirst(pclientList); pnode; pnode = (interruptNode *) ellNext(&pnode->node))
+	{
+		asynInt32Interrupt *pinterrupt = (asynInt32Interrupt *) pnode->drvPvt;
+		asynUser *pasynUser = pinterrupt->pasynUser;
+		const finsIntrRead * const pread = IntrFind(ppoll, &next, pinterrupt);
+		epicsInt32 value;
+		
+		if (pread == NULL)
+		{
+			continue;
+		}
+		
+		value = *(epicsInt32 *) (ppoll->data + pread->offset);
+		
+		if (IntrChanged(pdrvPvt, pasynUser, pread->status, &value, sizeof(value)))
+		{
+			pasynUser->auxStatus = pread->status;
+			pinterrupt->callback(pinterrupt->userPvt, pasynUser, value);
+		}
+	}
+	
+	pasynManager->interruptEnd(pdrvPvt->asynStdInterfaces.int32InterruptPvt);
+}
+
+static void IntrPollFloat64(drvPvt * const pdrvPvt, const finsBlock * const pblock, finsIntrPoll * const ppoll)
+{
+	ELLLIST *pclientList;
+	interruptNode *pnode;
+	size_t i, next = 0;
+	
+	ppoll->nreads = ppoll->ndata = 0;
+	
+	pasynManager->interruptStart(pdrvPvt->asynStdInterfaces.float64InterruptPvt, &pclientList);
+	
+	for (pnode = (interruptNode *) ellFirst(pclientList); pnode; pnode = (interruptNode *) ellNext(&pnode->node))
+	{
+		asynFloat64Interrupt *pinterrupt = (asynFloat64Interrupt *) pnode->drvPvt;
+		const int reason = pinterrupt->pasynUser->reason;
+		
+		if (IntrSelected(pdrvPvt, pblock, reason, pinterrupt->addr, ONE_ELEMENT) && ((pblock != NULL) || (MultiCoalesced(pdrvPvt, 1, reason) == 0)))
+		{
+			IntrAdd(pdrvPvt, ppoll, pinterrupt, pinterrupt->pasynUser, pinterrupt->addr, ONE_ELEMENT, sizeof(epicsFloat64));
+		}
+	}
+	
+	pasynManager->interruptEnd(pdrvPvt->asynStdInterfaces.float64InterruptPvt);
+	
+	for (i = 0; i < ppoll->nreads; i++)
+	{
+		finsIntrRead * const pread = &ppoll->reads[i];
+		
+		pread->status = ReadFloat64(pdrvPvt, pread->shadow, (epicsFloat64 *) (ppoll->data + pread->offset));
+	}
+	
+	pasynManager->interruptStart(pdrvPvt->asynStdInterfaces.float64InterruptPvt, &pclientList);
+	
+	for (pnode = (interruptNode *) ellFirst(pclientList); pnode; pnode = (interruptNode *) ellNext(&pnode->node))
+	{
+		asynFloat64Interrupt *pinterrupt = (asynFloat64Interrupt *) pnode->drvPvt;
+		asynUser *pasynUser = pinterrupt->pasynUser;
+		const finsIntrRead * const pread = IntrFind(ppoll, &next, pinterrupt);
+		epicsFloat64 value;
+		
+		if (pread == NULL)
+		{
+			continue;
+		}
+		
+		value = *(epicsFloat64 *) (ppoll->data + pread->offset);
+		
+		if (IntrChanged(pdrvPvt, pasynUser, pread->status, &value, sizeof(value)))
+		{
+			pasynUser->auxStatus = pread->status;
+			pinterrupt->callback(pinterrupt->userPvt, pasynUser, value);
+		}
+	}
+	
+	pasynManager->interruptEnd(pdrvPvt->asynStdInterfaces.float64InterruptPvt);
+}
+
+static void IntrPollInt16Array(drvPvt * const pdrvPvt, const finsBlock * const pblock, finsIntrPoll * const ppoll)
+{
+	ELLLIST *pclientList;
+	interruptNode *pnode;
+	size_t i, next = 0;
+	
+	ppoll->nreads = ppoll->ndata = 0;
+	
+	pasynManager->interruptStart(pdrvPvt->asynStdInterfaces.int16ArrayInterruptPvt, &pclientList);
+	
+	for (pnode = (interruptNode *) ellFirst(pclientList); pnode; pnode = (interruptNode *) ellNext(&pnode->node))
+	{
+		asynInt16ArrayInterrupt *pinterrupt = (asynInt16ArrayInterrupt *) pnode->drvPvt;
+		const size_t nelements = IntrArraySize(pinterrupt->pasynUser);
+		
+		if ((nelements <= FINS_MAX_MSG / sizeof(epicsInt16)) && IntrSelected(pdrvPvt, pblock, pinterrupt->pasynUser->reason, pinterrupt->addr, nelements))
+		{
+			IntrAdd(pdrvPvt, ppoll, pinterrupt, pinterrupt->pasynUser, pinterrupt->addr, nelements, sizeof(epicsInt16));
+		}
+	}
+	
+	pasynManager->interruptEnd(pdrvPvt->asynStdInterfaces.int16ArrayInterruptPvt);
+	
+	for (i = 0; i < ppoll->nreads; i++)
+	{
+		finsIntrRead * const pread = &ppoll->reads[i];
+		
+		pread->status = ReadInt16Array(pdrvPvt, pread->shadow, (epicsInt16 *) (ppoll->data + pread->offset), pread->nelements, &pread->nread);
+	}
+	
+	pasynManager->interruptStart(pdrvPvt->asynStdInterfaces.int16ArrayInterruptPvt, &pclientList);
+	
+	for (pnode = (interruptNode *) ellFirst(pclientList); pnode; pnode = (interruptNode *) ellNext(&pnode->node))
+	{
+		asynInt16ArrayInterrupt *pinterrupt = (asynInt16ArrayInterrupt *) pnode->drvPvt;
+		asynUser *pasynUser = pinterrupt->pasynUser;
+		const finsIntrRead * const pread = IntrFind(ppoll, &next, pinterrupt);
+		epicsInt16 *value;
+		
+		if (pread == NULL)
 		{
-			pasynUser->reason = FINS_HR_READ;
+			continue;
 		}
-		else
-		if (strcmp("FINS_CT_READ", drvInfo) == 0)
+		
+		value = (epicsInt16 *) (ppoll->data + pread->offset);
+		
+		if (IntrChanged(pdrvPvt, pasynUser, pread->status, value, pread->nread * sizeof(value[0])))
 		{
-			pasynUser->reason = FINS_CT_READ;
+			pasynUser->auxStatus = pread->status;
+			pinterrupt->callback(pinterrupt->userPvt, pasynUser, value, pread->nread);
 		}
-		else
-		if (strcmp("FINS_CT_WRITE", drvInfo) == 0)
+	}
+	
+	pasynManager->interruptEnd(pdrvPvt->asynStdInterfaces.int16ArrayInterruptPvt);
+}
+
+static void IntrPollInt32Array(drvPvt * const pdrvPvt, const finsBlock * const pblock, finsIntrPoll * const ppoll)
+{
+	ELLLIST *pclientList;
+	interruptNode *pnode;
+	size_t i, next = 0;
+	
+	ppoll->nreads = ppoll->ndata = 0;
+	
+	pasynManager->interruptStart(pdrvPvt->asynStdInterfaces.int32ArrayInterruptPvt, &pclientList);
+	
+	for (pnode = (interruptNode *) ellFirst(pclientList); pnode; pnode = (interruptNode *) ellNext(&pnode->node))
+	{
+		asynInt32ArrayInterrupt *pinterrupt = (asynInt32ArrayInterrupt *) pnode->drvPvt;
+		const size_t nelements = IntrArraySize(pinterrupt->pasynUser);
+		
+		if ((nelements <= FINS_MAX_MSG / sizeof(epicsInt32)) && IntrSelected(pdrvPvt, pblock, pinterrupt->pasynUser->reason, pinterrupt->addr, nelements))
 		{
-			pasynUser->reason = FINS_CT_WRITE;
+			IntrAdd(pdrvPvt, ppoll, pinterrupt, pinterrupt->pasynUser, pinterrupt->addr, nelements, sizeof(epicsInt32));
 		}
-		else
-		if (strcmp("FINS_CPU_STATUS", drvInfo) == 0)
+	}
+	
+	pasynManager->interruptEnd(pdrvPvt->asynStdInterfaces.int32ArrayInterruptPvt);
+	
+	for (i = 0; i < ppoll->nreads; i++)
+	{
+		finsIntrRead * const pread = &ppoll->reads[i];
+		
+		pread->status = ReadInt32Array(pdrvPvt, pread->shadow, (epicsInt32 *) (ppoll->data + pread->offset), pread->nelements, &pread->nread);
+	}
+	
+	pasynManager->interruptStart(pdrvPvt->asynStdInterfaces.int32ArrayInterruptPvt, &pclientList);
+	
+	for (pnode = (interruptNode *) ellFirst(pclientList); pnode; pnode = (interruptNode *) ellNext(&pnode->node))
+	{
+		asynInt32ArrayInterrupt *pinterrupt = (asynInt32ArrayInterrupt *) pnode->drvPvt;
+		asynUser *pasynUser = pinterrupt->pasynUser;
+		const finsIntrRead * const pread = IntrFind(ppoll, &next, pinterrupt);
+		epicsInt32 *value;
+		
+		if (pread == NULL)
 		{
-			pasynUser->reason = FINS_CPU_STATUS;
+			continue;
 		}
-		else
-		if (strcmp("FINS_CPU_MODE", drvInfo) == 0)
+		
+		value = (epicsInt32 *) (ppoll->data + pread->offset);
+		
+		if (IntrChanged(pdrvPvt, pasynUser, pread->status, value, pread->nread * sizeof(value[0])))
 		{
-			pasynUser->reason = FINS_CPU_MODE;
+			pasynUser->auxStatus = pread->status;
+			pinterrupt->callback(pinterrupt->userPvt, pasynUser, value, pread->nread);
 		}
-		else
-		if (strcmp("FINS_CPU_FATAL", drvInfo) == 0)
+	}
+	
+	pasynManager->interruptEnd(pdrvPvt->asynStdInterfaces.int32ArrayInterruptPvt);
+}
+
+static void IntrPollFloat32Array(drvPvt * const pdrvPvt, const finsBlock * const pblock, finsIntrPoll * const ppoll)
+{
+	ELLLIST *pclientList;
+	interruptNode *pnode;
+	size_t i, next = 0;
+	
+	ppoll->nreads = ppoll->ndata = 0;
+	
+	pasynManager->interruptStart(pdrvPvt->asynStdInterfaces.float32ArrayInterruptPvt, &pclientList);
+	
+	for (pnode = (interruptNode *) ellFirst(pclientList); pnode; pnode = (interruptNode *) ellNext(&pnode->node))
+	{
+		asynFloat32ArrayInterrupt *pinterrupt = (asynFloat32ArrayInterrupt *) pnode->drvPvt;
+		const size_t nelements = IntrArraySize(pinterrupt->pasynUser);
+		
+		if ((nelements <= FINS_MAX_MSG / sizeof(epicsFloat32)) && IntrSelected(pdrvPvt, pblock, pinterrupt->pasynUser->reason, pinterrupt->addr, nelements))
 		{
-			pasynUser->reason = FINS_CPU_FATAL;
+			IntrAdd(pdrvPvt, ppoll, pinterrupt, pinterrupt->pasynUser, pinterrupt->addr, nelements, sizeof(epicsFloat32));
 		}
-		else
-		if (strcmp("FINS_CPU_NONFATAL", drvInfo) == 0)
+	}
+	
+	pasynManager->interruptEnd(pdrvPvt->asynStdInterfaces.float32ArrayInterruptPvt);
+	
+	for (i = 0; i < ppoll->nreads; i++)
+	{
+		finsIntrRead * const pread = &ppoll->reads[i];
+		
+		pread->status = ReadFloat32Array(pdrvPvt, pread->shadow, (epicsFloat32 *) (ppoll->data + pread->offset), pread->nelements, &pread->nread);
+	}
+	
+	pasynManager->interruptStart(pdrvPvt->asynStdInterfaces.float32ArrayInterruptPvt, &pclientList);
+	
+	for (pnode = (interruptNode *) ellFirst(pclientList); pnode; pnode = (interruptNode *) ellNext(&pnode->node))
+	{
+		asynFloat32ArrayInterrupt *pinterrupt = (asynFloat32ArrayInterrupt *) pnode->drvPvt;
+		asynUser *pasynUser = pinterrupt->pasynUser;
+		const finsIntrRead * const pread = IntrFind(ppoll, &next, pinterrupt);
+		epicsFloat32 *value;
+		
+		if (pread == NULL)
 		{
-			pasynUser->reason = FINS_CPU_NONFATAL;
+			continue;
 		}
-		else
-		if (strcmp("FINS_MODEL", drvInfo) == 0)
+		
+		value = (epicsFloat32 *) (ppoll->data + pread->offset);
+		
+		if (IntrChanged(pdrvPvt, pasynUser, pread->status, value, pread->nread * sizeof(value[0])))
 		{
-			pasynUser->reason = FINS_MODEL;
+			pasynUser->auxStatus = pread->status;
+			pinterrupt->callback(pinterrupt->userPvt, pasynUser, value, pread->nread);
 		}
-		else
-		if (strcmp("FINS_CYCLE_TIME_RESET", drvInfo) == 0)
+	}
+	
+	pasynManager->interruptEnd(pdrvPvt->asynStdInterfaces.float32ArrayInterruptPvt);
+}
+
+/*
+	Each poller thread passes its own finsIntrPoll, whose buffers are kept from one poll to the next.
+*/
+
+static void IntrPoll(drvPvt * const pdrvPvt, const finsBlock * const pblock, finsIntrPoll * const ppoll)
+{
+	if (pblock == NULL)
+	{
+		IntrPollOctet(pdrvPvt, pblock, ppoll);
+	}
+	
+	IntrPollInt32(pdrvPvt, pblock, ppoll);
+	IntrPollFloat64(pdrvPvt, pblock, ppoll);
+	IntrPollInt16Array(pdrvPvt, pblock, ppoll);
+	IntrPollInt32Array(pdrvPvt, pblock, ppoll);
+	IntrPollFloat32Array(pdrvPvt, pblock, ppoll);
+}
+
+/**************************************************************************************************/
+/*
+	Read a list of single words with one Multiple Memory Area Read. Returns 0 on success, -2 if
+	the PLC refused the command, so that the caller can fall back to reading the records one at a
+	time, and -1 on any other error.
+*/
+
+static int MultiReadPLC(drvPvt * const pdrvPvt, asynUser *pasynUser, finsMsg * const pmsg, finsMultiWord * const words, const size_t nwords)
+{
+	const size_t frame = (pdrvPvt->type == FINS_TCP_type) ? FINS_SEND_FRAME_SIZE : 0;
+	size_t i, sentlen = 0, recdlen = 0;
+	int eomReason = 0;
+	asynStatus status;
+	epicsTimeStamp ets, ete;
+	
+	if (NodeReady(pdrvPvt, pasynUser) < 0)
+	{
+		return (-1);
+	}
+	
+	InitHeader(pdrvPvt, pmsg);
+	
+	pmsg->mrc = 0x01;
+	pmsg->src = 0x04;
+	
+	for (i = 0; i < nwords; i++)
+	{
+		pmsg->message[COM + 4 * i + 0] = words[i].area;
+		pmsg->message[COM + 4 * i + 1] = words[i].address >> 8;
+		pmsg->message[COM + 4 * i + 2] = words[i].address & 0xff;
+		pmsg->message[COM + 4 * i + 3] = 0x00;
+	}
+	
+	pmsg->sendlen = COM + 4 * nwords;
+	pmsg->recvlen = RESP + 3 * nwords;
+	
+	pmsg->message[MRC] = pmsg->mrc;
+	pmsg->message[SRC] = pmsg->src;
+	pmsg->message[SID] = pmsg->sid = NextSid(pdrvPvt);
+	
+	if (pdrvPvt->type == FINS_TCP_type)
+	{
+		AddCommand(pmsg->buffer, pmsg->sendlen, FINS_FRAME_SEND_COMMAND);
+		
+		pmsg->sendlen += FINS_SEND_FRAME_SIZE;
+		pmsg->recvlen += FINS_SEND_FRAME_SIZE;
+	}
+	
+	asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, (char *) MsgFrame(pdrvPvt, pmsg), pmsg->sendlen, "%s: port %s, sending %lu bytes, expecting %lu bytes.\n", __func__, pdrvPvt->portName, (unsigned long) pmsg->sendlen, (unsigned long) pmsg->recvlen);
+	
+	epicsTimeGetCurrent(&ets);
+	
+	status = finsTransfer(pdrvPvt, pasynUser, pmsg, &sentlen, &recdlen, &eomReason);
+	
+	UpdateTimes(pdrvPvt, FINS_CLASS_READ, &ets, &ete);
+	
+	if (status != asynSuccess)
+	{
+		asynPrint(pasynUser, FailTrace(pdrvPvt, status), "%s: port %s, writeRead() failed with %s.\n", __func__, pdrvPvt->portName, asynStatusMessages[status]);
+		return (-1);
+	}
+	
+	asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, (char *) MsgFrame(pdrvPvt, pmsg), recdlen, "%s: port %s, received %lu bytes.\n", __func__, pdrvPvt->portName, (unsigned long) recdlen);
+	
+	if (pdrvPvt->type == FINS_TCP_type)
+	{
+		const unsigned int ferror = BSWAP32(((unsigned int *) pmsg->buffer)[FINS_MODE_ERROR]);
+		
+		if (ferror != FINS_ERROR_NORMAL)
 		{
-			pasynUser->reason = FINS_CYCLE_TIME_RESET;
+			TCPDisconnect(pdrvPvt);
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, FINS Frame Send error 0x%x.\n", __func__, pdrvPvt->portName, ferror);
+			
+			return (-1);
 		}
-		else
-		if (strcmp("FINS_CYCLE_TIME", drvInfo) == 0)
+	}
+	
+/* an error reply is short, so check the response code before the length */
+
+	if ((recdlen >= frame + RESP) && (pmsg->message[SID] == pmsg->sid) && (pmsg->message[MRES] != 0x00))
+	{
+		FINSerror(pdrvPvt, pasynUser, __func__, pmsg->message[MRES], pmsg->message[SRES]);
+		return (-2);
+	}
+	
+	if ((sentlen != pmsg->sendlen) || (recdlen != pmsg->recvlen))
+	{
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, writeRead() failed, sent %lu of %lu, received %lu of %lu bytes.\n", __func__, pdrvPvt->portName, (unsigned long) sentlen, (unsigned long) pmsg->sendlen, (unsigned long) recdlen, (unsigned long) pmsg->recvlen);
+		return (-1);
+	}
+	
+	if (CheckData(pdrvPvt, pasynUser, pmsg) < 0)
+	{
+		return (-1);
+	}
+	
+/* each item is the area code and a big endian word */
+
+	for (i = 0; i < nwords; i++)
+	{
+		const epicsUInt8 * const item = &pmsg->message[RESP + 3 * i];
+		
+		if (item[0] != words[i].area)
 		{
-			pasynUser->reason = FINS_CYCLE_TIME;
+			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, item %lu is area 0x%02x, expected 0x%02x.\n", __func__, pdrvPvt->portName, (unsigned long) i, item[0], words[i].area);
+			return (-1);
 		}
-		else
-		if (strcmp("FINS_CYCLE_TIME_MEAN", drvInfo) == 0)
+		
+		words[i].value = (item[1] << 8) | item[2];
+	}
+	
+	return (0);
+}
+
+static int MultiWordCompare(const void *a, const void *b)
+{
+	const finsMultiWord * const pa = (const finsMultiWord *) a;
+	const finsMultiWord * const pb = (const finsMultiWord *) b;
+	
+	return ((pa->area != pb->area) ? (pa->area - pb->area) : (pa->address - pb->address));
+}
+
+static finsMultiWord *MultiWordFind(const finsMulti * const pmulti, const size_t nwords, const epicsUInt8 area, const epicsUInt16 address)
+{
+	finsMultiWord key;
+	
+	key.area = area;
+	key.address = address;
+	
+	return ((finsMultiWord *) bsearch(&key, pmulti->words, nwords, sizeof(finsMultiWord), MultiWordCompare));
+}
+
+/*
+	Poll the scalar I/O Intr memory records that aren't inside a block. The records are collected
+	from the Int32 and Float64 interrupt lists, their words read in as few frames as possible, and
+	the values passed to the records. A record whose frame the PLC refused, perhaps because of a bad
+	address, is read on its own so that it gets the same error as it would without coalescing.
+*/
+
+static void IntrPollMulti(drvPvt * const pdrvPvt)
+{
+	finsMulti * const pmulti = pdrvPvt->multi;
+	const size_t maxitems = (pdrvPvt->type == HOSTLINK_type) ? FINS_MM_MAX_HOST_ITEMS : FINS_MM_MAX_ITEMS;
+	ELLLIST *pint32List, *pfloat64List;
+	interruptNode *pnode;
+	size_t i, next, nint32, nreads = 0, nwords = 0;
+	int refused = 0;
+	finsMsg *pmsg;
+	
+	if ((pmulti == NULL) || pmulti->disabled)
+	{
+		return;
+	}
+	
+	pasynManager->interruptStart(pdrvPvt->asynStdInterfaces.int32InterruptPvt, &pint32List);
+	pasynManager->interruptStart(pdrvPvt->asynStdInterfaces.float64InterruptPvt, &pfloat64List);
+	
+/* make sure there is room for every record */
+
+	if (ellCount(pint32List) + ellCount(pfloat64List) > pmulti->maxreads)
+	{
+		pmulti->maxreads = ellCount(pint32List) + ellCount(pfloat64List);
+		pmulti->reads = (finsMultiRead *) realloc(pmulti->reads, pmulti->maxreads * sizeof(finsMultiRead));
+		pmulti->words = (finsMultiWord *) realloc(pmulti->words, 2 * pmulti->maxreads * sizeof(finsMultiWord));
+		
+		if ((pmulti->reads == NULL) || (pmulti->words == NULL))
 		{
-			pasynUser->reason = FINS_CYCLE_TIME_MEAN;
+			cantProceed("%s: port %s, out of memory\n", __func__, pdrvPvt->portName);
 		}
-		else
-		if (strcmp("FINS_CYCLE_TIME_MAX", drvInfo) == 0)
+	}
+	
+	for (pnode = (interruptNode *) ellFirst(pint32List); pnode; pnode = (interruptNode *) ellNext(&pnode->node))
+	{
+		asynInt32Interrupt *pinterrupt = (asynInt32Interrupt *) pnode->drvPvt;
+		finsMultiRead * const pread = &pmulti->reads[nreads];
+		
+		if (MultiCoalesced(pdrvPvt, 0, pinterrupt->pasynUser->reason) && IntrSelected(pdrvPvt, NULL, pinterrupt->pasynUser->reason, pinterrupt->addr, ONE_ELEMENT) && ((pread->shadow = IntrShadow(pdrvPvt, pinterrupt->pasynUser, pinterrupt->addr)) != NULL))
 		{
-			pasynUser->reason = FINS_CYCLE_TIME_MAX;
+			pread->pasynUser = pinterrupt->pasynUser;
+			pread->pinterrupt = pinterrupt;
+			pread->float64 = 0;
+			pread->area = MemoryArea(pinterrupt->pasynUser->reason, &pread->width);
+			pread->address = pinterrupt->addr;
+			nreads++;
 		}
-		else
-		if (strcmp("FINS_CYCLE_TIME_MIN", drvInfo) == 0)
+	}
+	
+	nint32 = nreads;
+	
+	for (pnode = (interruptNode *) ellFirst(pfloat64List); pnode; pnode = (interruptNode *) ellNext(&pnode->node))
+	{
+		asynFloat64Interrupt *pinterrupt = (asynFloat64Interrupt *) pnode->drvPvt;
+		finsMultiRead * const pread = &pmulti->reads[nreads];
+		
+		if (MultiCoalesced(pdrvPvt, 1, pinterrupt->pasynUser->reason) && IntrSelected(pdrvPvt, NULL, pinterrupt->pasynUser->reason, pinterrupt->addr, ONE_ELEMENT) && ((pread->shadow = IntrShadow(pdrvPvt, pinterrupt->pasynUser, pinterrupt->addr)) != NULL))
 		{
-			pasynUser->reason = FINS_CYCLE_TIME_MIN;
+			pread->pasynUser = pinterrupt->pasynUser;
+			pread->pinterrupt = pinterrupt;
+			pread->float64 = 1;
+			pread->area = MemoryArea(pinterrupt->pasynUser->reason, &pread->width);
+			pread->address = pinterrupt->addr;
+			nreads++;
 		}
-		else
-		if (strcmp("FINS_MONITOR", drvInfo) == 0)
+	}
+	
+/* read without holding up callback registration, the PLC may take a time out to answer */
+
+	pasynManager->interruptEnd(pdrvPvt->asynStdInterfaces.float64InterruptPvt);
+	pasynManager->interruptEnd(pdrvPvt->asynStdInterfaces.int32InterruptPvt);
+	
+/* the words to read, sorted and without duplicates */
+
+	for (i = 0; i < nreads; i++)
+	{
+		int j;
+		
+		for (j = 0; j < pmulti->reads[i].width; j++)
 		{
-			pasynUser->reason = FINS_MONITOR;
+			pmulti->words[nwords].area = pmulti->reads[i].area;
+			pmulti->words[nwords].address = pmulti->reads[i].address + j;
+			pmulti->words[nwords].status = -1;
+			nwords++;
 		}
-		else
-		if (strcmp("FINS_CLOCK_READ", drvInfo) == 0)
+	}
+	
+	if (nwords)
+	{
+		size_t n = 1;
+		
+		qsort(pmulti->words, nwords, sizeof(finsMultiWord), MultiWordCompare);
+		
+		for (i = 1; i < nwords; i++)
 		{
-			pasynUser->reason = FINS_CLOCK_READ;
+			if (MultiWordCompare(&pmulti->words[i], &pmulti->words[n - 1]))
+			{
+				pmulti->words[n++] = pmulti->words[i];
+			}
 		}
-		else
-		if (strcmp("FINS_SET_RESET_CANCEL", drvInfo) == 0)
+		
+		nwords = n;
+	}
+	
+/* read them */
+
+	pmsg = MsgGet(pdrvPvt);
+	
+	for (i = 0; i < nwords; i += maxitems)
+	{
+		const size_t n = (nwords - i < maxitems) ? nwords - i : maxitems;
+		const int status = MultiReadPLC(pdrvPvt, pmulti->pasynUser, pmsg, &pmulti->words[i], n);
+		size_t j;
+		
+		for (j = 0; j < n; j++)
 		{
-			pasynUser->reason = FINS_SET_RESET_CANCEL;
+			pmulti->words[i + j].status = status;
 		}
-		else
-		if (strcmp("FINS_MM_READ", drvInfo) == 0)
+		
+		pmulti->nframes++;
+		pmulti->nwords += n;
+		
+	/* a PLC which doesn't support the command refuses it with "Not executable" */
+	
+		if ((status == -2) && ((pmsg->message[MRES] & 0x7f) == 0x04))
 		{
-			pasynUser->reason = FINS_MM_READ;
+			refused = 1;
 		}
-		else
-		if (strcmp("FINS_EXPLICIT", drvInfo) == 0)
+	}
+	
+	MsgPut(pdrvPvt, pmsg);
+	
+	pmulti->npolls++;
+	
+/* the values, reading the records one at a time if the PLC refused the frame */
+
+	for (i = 0; i < nreads; i++)
+	{
+		finsMultiRead * const pread = &pmulti->reads[i];
+		const finsMultiWord * const plow = MultiWordFind(pmulti, nwords, pread->area, pread->address);
+		const finsMultiWord * const phigh = (pread->width == 2) ? MultiWordFind(pmulti, nwords, pread->area, pread->address + 1) : plow;
+		epicsUInt32 raw = 0;
+		
+		pread->status = asynError;
+		pread->ivalue = 0;
+		pread->fvalue = 0.0;
+		
+		if ((plow->status == 0) && (phigh->status == 0))
 		{
-			pasynUser->reason = FINS_EXPLICIT;
+			raw = (pread->width == 2) ? (((epicsUInt32) phigh->value << 16) | plow->value) : plow->value;
+			pread->status = asynSuccess;
 		}
-		else
-		if (strcmp("FINS_ECHO_TEST", drvInfo) == 0)
+		
+		if ((plow->status == -2) || (phigh->status == -2))
 		{
-			pasynUser->reason = FINS_ECHO_TEST;
+			pmulti->nfallbacks++;
+			pread->status = pread->float64 ? ReadFloat64(pdrvPvt, pread->shadow, &pread->fvalue) : ReadInt32(pdrvPvt, pread->shadow, &pread->ivalue);
 		}
-		else
-		if (strcmp("FINS_EM0_READ", drvInfo) == 0)
+		else if (pread->float64)
 		{
-			pasynUser->reason = FINS_EM0_READ;
+			union { epicsUInt32 raw; epicsFloat32 value; } u;
+			
+			u.raw = raw;
+			pread->fvalue = u.value;
 		}
 		else
-		if (strcmp("FINS_EM1_READ", drvInfo) == 0)
 		{
-			pasynUser->reason = FINS_EM1_READ;
+			pread->ivalue = (epicsInt32) raw;
 		}
-		else
-		if (strcmp("FINS_EM2_READ", drvInfo) == 0)
+	}
+	
+/* pass them to the records still registered, finding each in the order they were collected */
+
+	pasynManager->interruptStart(pdrvPvt->asynStdInterfaces.int32InterruptPvt, &pint32List);
+	pasynManager->interruptStart(pdrvPvt->asynStdInterfaces.float64InterruptPvt, &pfloat64List);
+	
+	for (pnode = (interruptNode *) ellFirst(pint32List), next = 0; pnode; pnode = (interruptNode *) ellNext(&pnode->node))
+	{
+		asynInt32Interrupt *pinterrupt = (asynInt32Interrupt *) pnode->drvPvt;
+		asynUser *pasynUser = pinterrupt->pasynUser;
+		
+		for (i = next; (i < nint32) && (pmulti->reads[i].pinterrupt != pinterrupt); i++)
 		{
-			pasynUser->reason = FINS_EM2_READ;
 		}
-		else
-		if (strcmp("FINS_EM3_READ", drvInfo) == 0)
+		
+		if (i == nint32)
 		{
-			pasynUser->reason = FINS_EM3_READ;
+			continue;
 		}
-		else
-		if (strcmp("FINS_EM4_READ", drvInfo) == 0)
+		
+		next = i + 1;
+		
+		if (IntrChanged(pdrvPvt, pasynUser, pmulti->reads[i].status, &pmulti->reads[i].ivalue, sizeof(epicsInt32)))
+		{
+			pasynUser->auxStatus = pmulti->reads[i].status;
+			pinterrupt->callback(pinterrupt->userPvt, pasynUser, pmulti->reads[i].ivalue);
+		}
+	}
+	
+	for (pnode = (interruptNode *) ellFirst(pfloat64List), next = nint32; pnode; pnode = (interruptNode *) ellNext(&pnode->node))
+	{
+		asynFloat64Interrupt *pinterrupt = (asynFloat64Interrupt *) pnode->drvPvt;
+		asynUser *pasynUser = pinterrupt->pasynUser;
+		
+		for (i = next; (i < nreads) && (pmulti->reads[i].pinterrupt != pinterrupt); i++)
+		{
+		}
+		
+		if (i == nreads)
+		{
+			continue;
+		}
+		
+		next = i + 1;
+		
+		if (IntrChanged(pdrvPvt, pasynUser, pmulti->reads[i].status, &pmulti->reads[i].fvalue, sizeof(epicsFloat64)))
+		{
+			pasynUser->auxStatus = pmulti->reads[i].status;
+			pinterrupt->callback(pinterrupt->userPvt, pasynUser, pmulti->reads[i].fvalue);
+		}
+	}
+	
+	pasynManager->interruptEnd(pdrvPvt->asynStdInterfaces.float64InterruptPvt);
+	pasynManager->interruptEnd(pdrvPvt->asynStdInterfaces.int32InterruptPvt);
+	
+/* from the next poll these records are read one at a time by IntrPollInt32 and IntrPollFloat64 */
+
+	if (refused)
+	{
+		asynPrint(pmulti->pasynUser, ASYN_TRACE_ERROR, "%s: port %s, Multiple Memory Area Read not supported, reading records one at a time.\n", __func__, pdrvPvt->portName);
+		pmulti->disabled = 1;
+	}
+}
+
+static void finsPoller(void *pvt)
+{
+	drvPvt * const pdrvPvt = (drvPvt *) pvt;
+	finsIntrPoll intr;
+	
+	memset(&intr, 0, sizeof(intr));
+	
+	while (1)
+	{
+		epicsTimeStamp ets, ete;
+		
+		epicsTimeGetCurrent(&ets);
+		
+		IntrPollMulti(pdrvPvt);
+		IntrPoll(pdrvPvt, NULL, &intr);
+		
+		epicsTimeGetCurrent(&ete);
+		
 		{
-			pasynUser->reason = FINS_EM4_READ;
+			const double delay = pdrvPvt->pollPeriod - epicsTimeDiffInSeconds(&ete, &ets);
+			
+			epicsThreadSleep((delay > 0.0) ? delay : 0.0);
 		}
-		else
-		if (strcmp("FINS_EM5_READ", drvInfo) == 0)
+	}
+}
+
+/* a period of zero doesn't start a poller, but still sets change-only publication for the blocks */
+
+int finsPollInit(const char *portName, const double period, const int onChange)
+{
+	drvPvt *pdrvPvt;
+	char name[64];
+	
+	if ((pdrvPvt = finsFindPort(portName)) == NULL)
+	{
+		printf("%s: %s is not a FINS port\n", __func__, portName ? portName : "");
+		return (-1);
+	}
+	
+	if (pdrvPvt->pollPeriod > 0.0)
+	{
+		printf("%s: port %s already has a poller\n", __func__, portName);
+		return (-1);
+	}
+	
+	pdrvPvt->onChange = (onChange != 0);
+	
+	if (period <= 0.0)
+	{
+		return (0);
+	}
+	
+	pdrvPvt->pollPeriod = period;
+	
+/* coalesce the scalar memory reads */
+
+	{
+		finsMulti * const pmulti = (finsMulti *) callocMustSucceed(1, sizeof(finsMulti), __func__);
+		
+		pmulti->pasynUser = pasynManager->createAsynUser(0, 0);
+		pmulti->pasynUser->reason = FINS_MM_READ;
+		pmulti->pasynUser->timeout = FINS_TIMEOUT;
+		
+		if (pasynManager->connectDevice(pmulti->pasynUser, portName, 0) != asynSuccess)
 		{
-			pasynUser->reason = FINS_EM5_READ;
+			printf("%s: port %s, connectDevice failed: %s\n", __func__, portName, pmulti->pasynUser->errorMessage);
+			pdrvPvt->pollPeriod = 0.0;
+			
+			return (-1);
 		}
-		else
-		if (strcmp("FINS_EM6_READ", drvInfo) == 0)
+		
+		pdrvPvt->multi = pmulti;
+	}
+	
+	epicsSnprintf(name, sizeof(name), "%s_P", portName);
+	
+	if (epicsThreadCreate(name, epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackMedium), finsPoller, pdrvPvt) == NULL)
+	{
+		printf("%s: port %s, can't create poller thread\n", __func__, portName);
+		pdrvPvt->pollPeriod = 0.0;
+		
+		return (-1);
+	}
+	
+	return (0);
+}
+
+static const iocshArg finsPollInitArg0 = { "port name", iocshArgString };
+static const iocshArg finsPollInitArg1 = { "period (s)", iocshArgDouble };
+static const iocshArg finsPollInitArg2 = { "only changes", iocshArgInt };
+
+static const iocshArg *finsPollInitArgs[] = { &finsPollInitArg0, &finsPollInitArg1, &finsPollInitArg2};
+static const iocshFuncDef finsPollInitFuncDef = { "finsPollInit", 3, finsPollInitArgs};
+
+static void finsPollInitCallFunc(const iocshArgBuf *args)
+{
+	finsPollInit(args[0].sval, args[1].dval, args[2].ival);
+}
+
+static void finsPollRegister(void)
+{
+	static int firstTime = 1;
+	
+	if (firstTime)
+	{
+		firstTime = 0;
+		iocshRegister(&finsPollInitFuncDef, finsPollInitCallFunc);
+	}
+}
+
+epicsExportRegistrar(finsPollRegister);
+
+/**************************************************************************************************/
+
+/*
+	Block cache
+	
+	A poller thread reads nwords of a memory area, starting at start, in one FINS request every period
+	seconds. Memory reads that fall inside the range are then served from the cached image and don't
+	cause any PLC traffic. Writes inside the range go to the PLC and update the image.
+	
+	finsBlockDefine("PLC1", "DM", 1000, 400, 1.0)
+*/
+
+static const struct
+{
+	const char *name;
+	int reason;
+	
+} blockAreas[] =
+{
+	{ "DM", FINS_DM_READ }, { "IO", FINS_IO_READ }, { "AR", FINS_AR_READ }, { "WR", FINS_WR_READ }, { "HR", FINS_HR_READ },
+	{ "EM0", FINS_EM0_READ }, { "EM1", FINS_EM1_READ }, { "EM2", FINS_EM2_READ }, { "EM3", FINS_EM3_READ },
+	{ "EM4", FINS_EM4_READ }, { "EM5", FINS_EM5_READ }, { "EM6", FINS_EM6_READ }, { "EM7", FINS_EM7_READ },
+	{ "EM8", FINS_EM8_READ }, { "EM9", FINS_EM9_READ }, { "EMA", FINS_EMA_READ }, { "EMB", FINS_EMB_READ },
+	{ "EMC", FINS_EMC_READ }, { "EMD", FINS_EMD_READ }, { "EME", FINS_EME_READ }, { "EMF", FINS_EMF_READ }
+};
+
+static void finsBlockPoller(void *pvt)
+{
+	finsBlock * const pblock = (finsBlock *) pvt;
+	drvPvt * const pdrvPvt = pblock->pdrvPvt;
+	epicsUInt16 *buffer = (epicsUInt16 *) callocMustSucceed(pblock->nwords, sizeof(epicsUInt16), __func__);
+	finsMsg * const pmsg = MsgGet(pdrvPvt);
+	finsIntrPoll intr;
+	
+	memset(&intr, 0, sizeof(intr));
+	
+	while (1)
+	{
+		epicsTimeStamp ets, ete;
+		int status;
+		
+		epicsTimeGetCurrent(&ets);
+		
+	/* the block is read straight from the PLC, so send any queued writes to it first */
+	
+		if (pdrvPvt->wq)
 		{
-			pasynUser->reason = FINS_EM6_READ;
+			WriteFlushOverlap(pdrvPvt, pblock->area, pblock->start, pblock->nwords);
 		}
-		else
-		if (strcmp("FINS_EM7_READ", drvInfo) == 0)
+		
+		if (pblock->nwords > MaxWords(pdrvPvt))
 		{
-			pasynUser->reason = FINS_EM7_READ;
+			status = finsChunked(pdrvPvt, pblock->pasynUser, 0, buffer, pblock->nwords, pblock->start, NULL, sizeof(epicsUInt16), 1);
 		}
 		else
-		if (strcmp("FINS_EM8_READ", drvInfo) == 0)
 		{
-			pasynUser->reason = FINS_EM8_READ;
+			status = finsReadPLC(pdrvPvt, pblock->pasynUser, pmsg, buffer, pblock->nwords, pblock->start, NULL, sizeof(epicsUInt16));
 		}
-		else
-		if (strcmp("FINS_EM9_READ", drvInfo) == 0)
+		
+		epicsMutexMustLock(pdrvPvt->blockLock);
+		
+		pblock->npolls++;
+		
+		if (status == 0)
 		{
-			pasynUser->reason = FINS_EM9_READ;
+			memcpy(pblock->image, buffer, pblock->nwords * sizeof(epicsUInt16));
+			pblock->updated = ets;
+			pblock->valid = 1;
 		}
 		else
-		if (strcmp("FINS_EMA_READ", drvInfo) == 0)
 		{
-			pasynUser->reason = FINS_EMA_READ;
+			pblock->nerrors++;
+			pblock->valid = 0;
 		}
-		else
-		if (strcmp("FINS_EMB_READ", drvInfo) == 0)
+		
+		epicsMutexUnlock(pdrvPvt->blockLock);
+		
+	/* pass the new values to the I/O Intr records inside the block */
+	
+		IntrPoll(pdrvPvt, pblock, &intr);
+		
+		epicsTimeGetCurrent(&ete);
+		
 		{
-			pasynUser->reason = FINS_EMB_READ;
+			const double delay = pblock->period - epicsTimeDiffInSeconds(&ete, &ets);
+			
+			epicsThreadSleep((delay > 0.0) ? delay : 0.0);
 		}
-		else
-		if (strcmp("FINS_EMC_READ", drvInfo) == 0)
+	}
+}
+
+int finsBlockDefine(const char *portName, const char *area, const int start, const int nwords, const double period)
+{
+	drvPvt *pdrvPvt;
+	finsBlock *pblock;
+	int i, width, reason = FINS_NULL;
+	char name[64];
+	
+	if ((pdrvPvt = finsFindPort(portName)) == NULL)
+	{
+		printf("%s: %s is not a FINS port\n", __func__, portName ? portName : "");
+		return (-1);
+	}
+	
+	for (i = 0; area && (i < sizeof(blockAreas) / sizeof(blockAreas[0])); i++)
+	{
+		if (strcmp(area, blockAreas[i].name) == 0)
 		{
-			pasynUser->reason = FINS_EMC_READ;
+			reason = blockAreas[i].reason;
+			break;
 		}
-		else
-		if (strcmp("FINS_EMD_READ", drvInfo) == 0)
+	}
+	
+	if (reason == FINS_NULL)
+	{
+		printf("%s: unknown memory area %s\n", __func__, area ? area : "");
+		return (-1);
+	}
+	
+	if ((start < 0) || (nwords < 1) || (nwords > FINS_MAX_ARRAY_WORDS) || (start + nwords > 0x10000))
+	{
+		printf("%s: port %s, bad range %d + %d words, at most %d words per block\n", __func__, portName, start, nwords, FINS_MAX_ARRAY_WORDS);
+		return (-1);
+	}
+	
+	if (period <= 0.0)
+	{
+		printf("%s: port %s, period must be > 0\n", __func__, portName);
+		return (-1);
+	}
+	
+	pblock = (finsBlock *) callocMustSucceed(1, sizeof(finsBlock), __func__);
+	pblock->pdrvPvt = pdrvPvt;
+	pblock->reason = reason;
+	pblock->area = MemoryArea(reason, &width);
+	pblock->start = start;
+	pblock->nwords = nwords;
+	pblock->period = period;
+	pblock->image = (epicsUInt16 *) callocMustSucceed(nwords, sizeof(epicsUInt16), __func__);
+	
+	pblock->pasynUser = pasynManager->createAsynUser(0, 0);
+	pblock->pasynUser->reason = reason;
+	pblock->pasynUser->timeout = FINS_TIMEOUT;
+	
+	if (pasynManager->connectDevice(pblock->pasynUser, portName, 0) != asynSuccess)
+	{
+		printf("%s: port %s, connectDevice failed: %s\n", __func__, portName, pblock->pasynUser->errorMessage);
+		return (-1);
+	}
+	
+	epicsMutexMustLock(pdrvPvt->blockLock);
+	ellAdd(&pdrvPvt->blockList, &pblock->node);
+	epicsSnprintf(name, sizeof(name), "%s_B%d", portName, ellCount(&pdrvPvt->blockList));
+	epicsMutexUnlock(pdrvPvt->blockLock);
+	
+	if (epicsThreadCreate(name, epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackMedium), finsBlockPoller, pblock) == NULL)
+	{
+		printf("%s: port %s, can't create poller thread\n", __func__, portName);
+		return (-1);
+	}
+	
+	return (0);
+}
+
+static const iocshArg finsBlockDefineArg0 = { "port name", iocshArgString };
+static const iocshArg finsBlockDefineArg1 = { "memory area", iocshArgString };
+static const iocshArg finsBlockDefineArg2 = { "start address", iocshArgInt };
+static const iocshArg finsBlockDefineArg3 = { "number of words", iocshArgInt };
+static const iocshArg finsBlockDefineArg4 = { "period (s)", iocshArgDouble };
+
+static const iocshArg *finsBlockDefineArgs[] = { &finsBlockDefineArg0, &finsBlockDefineArg1, &finsBlockDefineArg2, &finsBlockDefineArg3, &finsBlockDefineArg4};
+static const iocshFuncDef finsBlockDefineFuncDef = { "finsBlockDefine", 5, finsBlockDefineArgs};
+
+static void finsBlockDefineCallFunc(const iocshArgBuf *args)
+{
+	finsBlockDefine(args[0].sval, args[1].sval, args[2].ival, args[3].ival, args[4].dval);
+}
+
+static void finsBlockRegister(void)
+{
+	static int firstTime = 1;
+	
+	if (firstTime)
+	{
+		firstTime = 0;
+		iocshRegister(&finsBlockDefineFuncDef, finsBlockDefineCallFunc);
+	}
+}
+
+epicsExportRegistrar(finsBlockRegister);
+
+/**************************************************************************************************/
+/*
+	Frame size
+	
+	A FINS/UDP datagram bigger than the path MTU is fragmented by IP. Losing any fragment loses the
+	whole datagram, which costs the caller a timeout. finsFrameSize limits the words a port puts in
+	one Memory Area Read or Write to what fits in one unfragmented datagram and, if given, what the
+	PLC accepts. Bigger array transfers and blocks are split into frames of that size.
+	
+	finsFrameSize("PLC1", 0, 0)		find the path MTU
+	finsFrameSize("PLC1", 1500, 500)	a PLC or network that takes at most 500 words
+	
+	FINS/TCP and Hostlink ports only use the words.
+*/
+
+/* a connected socket knows the route's MTU, including anything path MTU discovery has learnt */
+
+static int FrameMTU(const drvPvt * const pdrvPvt)
+{
+	int mtu = 0;
+	
+#ifdef IP_MTU
+	osiSocklen_t len = sizeof(mtu);
+	SOCKET fd;
+	
+	if ((fd = epicsSocketCreate(AF_INET, SOCK_DGRAM, 0)) != INVALID_SOCKET)
+	{
+		if ((connect(fd, (struct sockaddr *) &pdrvPvt->addr, sizeof(pdrvPvt->addr)) < 0) || (getsockopt(fd, IPPROTO_IP, IP_MTU, (char *) &mtu, &len) < 0))
 		{
-			pasynUser->reason = FINS_EMD_READ;
+			mtu = 0;
 		}
-		else
-		if (strcmp("FINS_EME_READ", drvInfo) == 0)
+		
+		epicsSocketDestroy(fd);
+	}
+#endif
+
+	return ((mtu > 0) ? mtu : FINS_MTU);
+}
+
+int finsFrameSize(const char *portName, const int mtu, const int plcwords)
+{
+	drvPvt *pdrvPvt;
+	size_t maxwords;
+	int path = 0;
+	
+	if ((pdrvPvt = finsFindPort(portName)) == NULL)
+	{
+		printf("%s: %s is not a FINS port\n", __func__, portName ? portName : "");
+		return (-1);
+	}
+	
+	maxwords = TransportWords(pdrvPvt);
+	
+	if ((plcwords > 0) && ((size_t) plcwords < maxwords))
+	{
+		maxwords = plcwords;
+	}
+	
+/* a Memory Area Write request has the largest header, the reply to a read is four bytes less */
+
+	if (pdrvPvt->type == FINS_UDP_type)
+	{
+		size_t udpwords;
+		
+		path = (mtu > 0) ? mtu : FrameMTU(pdrvPvt);
+		
+		if (path < FINS_UDP_OVERHEAD + COM + 6 + 2)
 		{
-			pasynUser->reason = FINS_EME_READ;
+			printf("%s: port %s, MTU %d is too small\n", __func__, portName, path);
+			return (-1);
 		}
-		else
-		if (strcmp("FINS_EMF_READ", drvInfo) == 0)
-		{
-			pasynUser->reason = FINS_EMF_READ;
-		}		
-		else
+		
+		udpwords = (path - FINS_UDP_OVERHEAD - (COM + 6)) / 2;
+		
+		if (udpwords < maxwords)
 		{
-			pasynUser->reason = FINS_NULL;
+			maxwords = udpwords;
 		}
+	}
+	
+	pdrvPvt->mtu = path;
+	pdrvPvt->maxwords = maxwords;
+	
+	printf("%s: port %s, %lu words per frame\n", __func__, portName, (unsigned long) maxwords);
+	
+	return (0);
+}
 
-		asynPrint(pasynUser, ASYN_TRACEIO_DEVICE, "drvUserCreate: port %s, %s = %d\n", pdrvPvt->portName, drvInfo, pasynUser->reason);
+static const iocshArg finsFrameSizeArg0 = { "port name", iocshArgString };
+static const iocshArg finsFrameSizeArg1 = { "MTU", iocshArgInt };
+static const iocshArg finsFrameSizeArg2 = { "PLC words", iocshArgInt };
 
-		return (asynSuccess);
+static const iocshArg *finsFrameSizeArgs[] = { &finsFrameSizeArg0, &finsFrameSizeArg1, &finsFrameSizeArg2};
+static const iocshFuncDef finsFrameSizeFuncDef = { "finsFrameSize", 3, finsFrameSizeArgs};
+
+static void finsFrameSizeCallFunc(const iocshArgBuf *args)
+{
+	finsFrameSize(args[0].sval, args[1].ival, args[2].ival);
+}
+
+static void finsFrameSizeRegister(void)
+{
+	static int firstTime = 1;
+	
+	if (firstTime)
+	{
+		firstTime = 0;
+		iocshRegister(&finsFrameSizeFuncDef, finsFrameSizeCallFunc);
 	}
+}
 
-	return (asynError);
+epicsExportRegistrar(finsFrameSizeRegister);
+
+/**************************************************************************************************/
+/*
+	Read cache
+	
+	finsCacheInit("PLC1", 0.1)	serve memory reads of the same words from the cache for 0.1 s
+	finsCacheInit("PLC1", 0)	only share a read with those of the same words made while it is in flight
+	finsCacheInit("PLC1", -1)	turn the cache off
+*/
+
+int finsCacheInit(const char *portName, const double ttl)
+{
+	drvPvt *pdrvPvt;
+	finsCache *pcache;
+	int i;
+	
+	if ((pdrvPvt = finsFindPort(portName)) == NULL)
+	{
+		printf("%s: %s is not a FINS port\n", __func__, portName ? portName : "");
+		return (-1);
+	}
+	
+	if (pdrvPvt->cache)
+	{
+		epicsMutexMustLock(pdrvPvt->cache->lock);
+		pdrvPvt->cache->ttl = ttl;
+		epicsMutexUnlock(pdrvPvt->cache->lock);
+		
+		return (0);
+	}
+	
+	if (ttl < 0.0)
+	{
+		return (0);
+	}
+	
+	pcache = (finsCache *) callocMustSucceed(1, sizeof(finsCache), __func__);
+	pcache->lock = epicsMutexMustCreate();
+	pcache->ttl = ttl;
+	
+	for (i = 0; i < FINS_CACHE_BUCKETS; i++)
+	{
+		ellInit(&pcache->bucket[i]);
+	}
+	
+	pdrvPvt->cache = pcache;
+	
+	return (0);
 }
 
-static const char * const error01 = "Local node error";
-static const char * const error02 = "Destination node error";
-static const char * const error03 = "Communications controller error";
-static const char * const error04 = "Not executable";
-static const char * const error05 = "Routing error";
-static const char * const error10 = "Command format error";
-static const char * const error11 = "Parameter error";
-static const char * const error20 = "Read not possible";
-static const char * const error21 = "Write not possible";
-static const char * const error22 = "Not executable in current mode";
-static const char * const error23 = "No unit";
-static const char * const error24 = "Start/Stop not possible";
-static const char * const error25 = "Unit error";
-static const char * const error26 = "Command error";
-static const char * const error30 = "Access rights error";
-static const char * const error40 = "Abort error";
+static const iocshArg finsCacheInitArg0 = { "port name", iocshArgString };
+static const iocshArg finsCacheInitArg1 = { "time to live (s)", iocshArgDouble };
 
-static void FINSerror(const drvPvt * const pdrvPvt, asynUser *pasynUser, const char *name, const unsigned char mres, const unsigned char sres)
+static const iocshArg *finsCacheInitArgs[] = { &finsCacheInitArg0, &finsCacheInitArg1};
+static const iocshFuncDef finsCacheInitFuncDef = { "finsCacheInit", 2, finsCacheInitArgs};
+
+static void finsCacheInitCallFunc(const iocshArgBuf *args)
 {
-	if (mres & 0x80)
+	finsCacheInit(args[0].sval, args[1].dval);
+}
+
+static void finsCacheRegister(void)
+{
+	static int firstTime = 1;
+	
+	if (firstTime)
 	{
-		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, Relay Error Flag\n", __func__, pdrvPvt->portName);
-		
-		FINSerror(pdrvPvt, pasynUser, name, mres ^ 0x80, sres);
+		firstTime = 0;
+		iocshRegister(&finsCacheInitFuncDef, finsCacheInitCallFunc);
 	}
+}
+
+epicsExportRegistrar(finsCacheRegister);
+
+/**************************************************************************************************/
+/*
+	Shared CPU status and cycle time
 	
-	switch (mres)
+	finsStatusInit("PLC1", 1.0)	read 0601 and 0620 once a second and pass every field to its I/O Intr records
+	
+	Periodically scanned records of these fields share the same replies.
+*/
+
+static void StatusCallbacks(drvPvt * const pdrvPvt, const int n, const epicsUInt8 *reply, const asynStatus status)
+{
+	ELLLIST *pclientList;
+	interruptNode *pnode;
+	
+	pasynManager->interruptStart(pdrvPvt->asynStdInterfaces.int32InterruptPvt, &pclientList);
+	
+	for (pnode = (interruptNode *) ellFirst(pclientList); pnode; pnode = (interruptNode *) ellNext(&pnode->node))
 	{
-		case 0x01:
-		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error01, sres);
-			break;
-		}
+		asynInt32Interrupt *pinterrupt = (asynInt32Interrupt *) pnode->drvPvt;
+		asynUser *pasynUser = pinterrupt->pasynUser;
+		epicsInt32 value = 0;
 		
-		case 0x02:
+		if ((StatusFrame(pasynUser->reason) != n) || (pasynUser->reason == FINS_CYCLE_TIME))
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error02, sres);
-			break;
+			continue;
 		}
 		
-		case 0x03:
+		if (status == asynSuccess)
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error03, sres);
-			break;
+			StatusDecode(pasynUser->reason, reply, &value, ONE_ELEMENT);
 		}
 		
-		case 0x04:
+		if (IntrChanged(pdrvPvt, pasynUser, status, &value, sizeof(value)))
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error04, sres);
-			break;
+			pasynUser->auxStatus = status;
+			pinterrupt->callback(pinterrupt->userPvt, pasynUser, value);
 		}
+	}
+	
+	pasynManager->interruptEnd(pdrvPvt->asynStdInterfaces.int32InterruptPvt);
+	
+	if (n != FINS_STATUS_CYCLE)
+	{
+		return;
+	}
+	
+	pasynManager->interruptStart(pdrvPvt->asynStdInterfaces.int32ArrayInterruptPvt, &pclientList);
+	
+	for (pnode = (interruptNode *) ellFirst(pclientList); pnode; pnode = (interruptNode *) ellNext(&pnode->node))
+	{
+		asynInt32ArrayInterrupt *pinterrupt = (asynInt32ArrayInterrupt *) pnode->drvPvt;
+		asynUser *pasynUser = pinterrupt->pasynUser;
+		epicsInt32 value[FINS_CYCLE_TIME_LEN] = { 0 };
+		size_t nread = 0;
 		
-		case 0x05:
+		if ((pasynUser->reason != FINS_CYCLE_TIME) || (IntrArraySize(pasynUser) != FINS_CYCLE_TIME_LEN))
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error05, sres);
-			break;
+			continue;
 		}
 		
-		case 0x10:
+		if (status == asynSuccess)
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error10, sres);
-			break;
+			StatusDecode(pasynUser->reason, reply, value, FINS_CYCLE_TIME_LEN);
+			nread = FINS_CYCLE_TIME_LEN;
 		}
 		
-		case 0x11:
+		if (IntrChanged(pdrvPvt, pasynUser, status, value, nread * sizeof(value[0])))
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error11, sres);
-			break;
+			pasynUser->auxStatus = status;
+			pinterrupt->callback(pinterrupt->userPvt, pasynUser, value, nread);
 		}
+	}
+	
+	pasynManager->interruptEnd(pdrvPvt->asynStdInterfaces.int32ArrayInterruptPvt);
+}
+
+static void finsStatusPoller(void *pvt)
+{
+	drvPvt * const pdrvPvt = (drvPvt *) pvt;
+	finsStatus * const pstatus = pdrvPvt->status;
+	
+/* a request for each frame, the reason picks which */
+
+	static const int reasons[FINS_STATUS_FRAMES] =
+	{
+		[FINS_STATUS_CPU]	= FINS_CPU_STATUS,
+		[FINS_STATUS_CYCLE]	= FINS_CYCLE_TIME
+	};
+	
+	while (1)
+	{
+		epicsTimeStamp ets, ete;
+		int n;
 		
-		case 0x20:
-		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error20, sres);
-			break;
-		}
+		epicsTimeGetCurrent(&ets);
 		
-		case 0x21:
+		for (n = 0; n < FINS_STATUS_FRAMES; n++)
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error21, sres);
-			break;
+			finsStatusFrame * const pframe = &pstatus->frame[n];
+			epicsUInt8 reply[FINS_CPU_STATE_LEN];
+			epicsInt32 value[FINS_CYCLE_TIME_LEN];
+			int status;
+			
+			pstatus->pasynUser->reason = reasons[n];
+			
+			epicsMutexMustLock(pframe->flight);
+			
+			if ((status = StatusFetch(pdrvPvt, pstatus->pasynUser, pframe, value, (n == FINS_STATUS_CYCLE) ? FINS_CYCLE_TIME_LEN : ONE_ELEMENT)) == 0)
+			{
+				memcpy(reply, pframe->reply, sizeof(reply));
+			}
+			
+			epicsMutexUnlock(pframe->flight);
+			
+			StatusCallbacks(pdrvPvt, n, reply, (status == 0) ? asynSuccess : asynError);
 		}
 		
-		case 0x22:
-		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error22, sres);
-			break;
-		}
+		epicsTimeGetCurrent(&ete);
 		
-		case 0x23:
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error23, sres);
-			break;
+			const double delay = pstatus->period - epicsTimeDiffInSeconds(&ete, &ets);
+			
+			epicsThreadSleep((delay > 0.0) ? delay : 0.0);
 		}
+	}
+}
+
+int finsStatusInit(const char *portName, const double period)
+{
+	drvPvt *pdrvPvt;
+	finsStatus *pstatus;
+	char name[64];
+	int i;
+	
+	if ((pdrvPvt = finsFindPort(portName)) == NULL)
+	{
+		printf("%s: %s is not a FINS port\n", __func__, portName ? portName : "");
+		return (-1);
+	}
+	
+	if (pdrvPvt->status)
+	{
+		printf("%s: port %s already has a status poller\n", __func__, portName);
+		return (-1);
+	}
+	
+	if (period <= 0.0)
+	{
+		printf("%s: port %s, the period must be positive\n", __func__, portName);
+		return (-1);
+	}
+	
+	pstatus = (finsStatus *) callocMustSucceed(1, sizeof(finsStatus), __func__);
+	pstatus->period = period;
+	
+	for (i = 0; i < FINS_STATUS_FRAMES; i++)
+	{
+		pstatus->frame[i].flight = epicsMutexMustCreate();
+	}
+	
+	pstatus->pasynUser = pasynManager->createAsynUser(0, 0);
+	pstatus->pasynUser->timeout = FINS_TIMEOUT;
+	
+	if (pasynManager->connectDevice(pstatus->pasynUser, portName, 0) != asynSuccess)
+	{
+		printf("%s: port %s, connectDevice failed: %s\n", __func__, portName, pstatus->pasynUser->errorMessage);
+		return (-1);
+	}
+	
+/* from here on the port poller leaves these records alone */
+
+	pdrvPvt->status = pstatus;
+	
+	epicsSnprintf(name, sizeof(name), "%s_C", portName);
+	
+	if (epicsThreadCreate(name, epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackMedium), finsStatusPoller, pdrvPvt) == NULL)
+	{
+		printf("%s: port %s, can't create status poller thread\n", __func__, portName);
+		return (-1);
+	}
+	
+	return (0);
+}
+
+static const iocshArg finsStatusInitArg0 = { "port name", iocshArgString };
+static const iocshArg finsStatusInitArg1 = { "period (s)", iocshArgDouble };
+
+static const iocshArg *finsStatusInitArgs[] = { &finsStatusInitArg0, &finsStatusInitArg1};
+static const iocshFuncDef finsStatusInitFuncDef = { "finsStatusInit", 2, finsStatusInitArgs};
+
+static void finsStatusInitCallFunc(const iocshArgBuf *args)
+{
+	finsStatusInit(args[0].sval, args[1].dval);
+}
+
+static void finsStatusRegister(void)
+{
+	static int firstTime = 1;
+	
+	if (firstTime)
+	{
+		firstTime = 0;
+		iocshRegister(&finsStatusInitFuncDef, finsStatusInitCallFunc);
+	}
+}
+
+epicsExportRegistrar(finsStatusRegister);
+
+/**************************************************************************************************/
+/*
+	Writes without a response
+	
+	finsNoResponseInit("PLC1", 1.0)	acknowledge one _NORESP write of each record per second
+	finsNoResponseInit("PLC1", 0)	never
+*/
+
+int finsNoResponseInit(const char *portName, const double verify)
+{
+	drvPvt *pdrvPvt;
+	
+	if ((pdrvPvt = finsFindPort(portName)) == NULL)
+	{
+		printf("%s: %s is not a FINS port\n", __func__, portName ? portName : "");
+		return (-1);
+	}
+	
+	pdrvPvt->verify = (verify > 0.0) ? verify : 0.0;
+	
+	return (0);
+}
+
+static const iocshArg finsNoResponseInitArg0 = { "port name", iocshArgString };
+static const iocshArg finsNoResponseInitArg1 = { "verify period (s)", iocshArgDouble };
+
+static const iocshArg *finsNoResponseInitArgs[] = { &finsNoResponseInitArg0, &finsNoResponseInitArg1};
+static const iocshFuncDef finsNoResponseInitFuncDef = { "finsNoResponseInit", 2, finsNoResponseInitArgs};
+
+static void finsNoResponseInitCallFunc(const iocshArgBuf *args)
+{
+	finsNoResponseInit(args[0].sval, args[1].dval);
+}
+
+static void finsNoResponseRegister(void)
+{
+	static int firstTime = 1;
+	
+	if (firstTime)
+	{
+		firstTime = 0;
+		iocshRegister(&finsNoResponseInitFuncDef, finsNoResponseInitCallFunc);
+	}
+}
+
+epicsExportRegistrar(finsNoResponseRegister);
+
+/**************************************************************************************************/
+/*
+	Write combining
+	
+	finsWriteCombineInit("PLC1", 0.01)	queue memory writes for up to 10 ms and send them merged
+	finsWriteCombineInit("PLC1", 0)		send them as soon as the last flush is done
+*/
+
+int finsWriteCombineInit(const char *portName, const double deadline)
+{
+	drvPvt *pdrvPvt;
+	finsWriteQueue *pqueue;
+	char name[64];
+	
+	if ((pdrvPvt = finsFindPort(portName)) == NULL)
+	{
+		printf("%s: %s is not a FINS port\n", __func__, portName ? portName : "");
+		return (-1);
+	}
+	
+	if (deadline < 0.0)
+	{
+		printf("%s: port %s, the deadline can't be negative\n", __func__, portName);
+		return (-1);
+	}
+	
+	if (pdrvPvt->wq)
+	{
+		epicsMutexMustLock(pdrvPvt->wq->lock);
+		pdrvPvt->wq->deadline = deadline;
+		epicsMutexUnlock(pdrvPvt->wq->lock);
 		
-		case 0x24:
-		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %se 0x%02x\n", name, pdrvPvt->portName, error24, sres);
-			break;
-		}
+		return (0);
+	}
+	
+	pqueue = (finsWriteQueue *) callocMustSucceed(1, sizeof(finsWriteQueue), __func__);
+	pqueue->lock = epicsMutexMustCreate();
+	pqueue->flushLock = epicsMutexMustCreate();
+	pqueue->wakeup = epicsEventMustCreate(epicsEventEmpty);
+	pqueue->deadline = deadline;
+	
+	pqueue->pasynUser = pasynManager->createAsynUser(0, 0);
+	pqueue->pasynUser->timeout = FINS_TIMEOUT;
+	
+	if (pasynManager->connectDevice(pqueue->pasynUser, portName, 0) != asynSuccess)
+	{
+		printf("%s: port %s, connectDevice failed: %s\n", __func__, portName, pqueue->pasynUser->errorMessage);
 		
-		case 0x25:
+		pasynManager->freeAsynUser(pqueue->pasynUser);
+		epicsEventDestroy(pqueue->wakeup);
+		epicsMutexDestroy(pqueue->flushLock);
+		epicsMutexDestroy(pqueue->lock);
+		free(pqueue);
+		
+		return (-1);
+	}
+	
+	pdrvPvt->wq = pqueue;
+	
+	epicsSnprintf(name, sizeof(name), "%s_W", portName);
+	
+	if (epicsThreadCreate(name, epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackMedium), finsWriteFlusher, pdrvPvt) == NULL)
+	{
+		printf("%s: port %s, can't create write flusher thread\n", __func__, portName);
+		pdrvPvt->wq = NULL;
+		
+		return (-1);
+	}
+	
+	return (0);
+}
+
+static const iocshArg finsWriteCombineInitArg0 = { "port name", iocshArgString };
+static const iocshArg finsWriteCombineInitArg1 = { "deadline (s)", iocshArgDouble };
+
+static const iocshArg *finsWriteCombineInitArgs[] = { &finsWriteCombineInitArg0, &finsWriteCombineInitArg1};
+static const iocshFuncDef finsWriteCombineInitFuncDef = { "finsWriteCombineInit", 2, finsWriteCombineInitArgs};
+
+static void finsWriteCombineInitCallFunc(const iocshArgBuf *args)
+{
+	finsWriteCombineInit(args[0].sval, args[1].dval);
+}
+
+static void finsWriteCombineRegister(void)
+{
+	static int firstTime = 1;
+	
+	if (firstTime)
+	{
+		firstTime = 0;
+		iocshRegister(&finsWriteCombineInitFuncDef, finsWriteCombineInitCallFunc);
+	}
+}
+
+epicsExportRegistrar(finsWriteCombineRegister);
+
+/**************************************************************************************************/
+/*
+	Circuit breaker
+	
+	finsBreakerInit("PLC1", 3, 2.0)	after 3 time outs in a row fail requests at once, probing the PLC every 2 s
+	finsBreakerInit("PLC1", 0, 0)	never open the breaker
+*/
+
+static void finsBreakerProbe(void *pvt)
+{
+	drvPvt * const pdrvPvt = (drvPvt *) pvt;
+	finsBreaker * const pbreaker = pdrvPvt->breaker;
+	
+	while (1)
+	{
+		epicsUInt16 word;
+		int open;
+		
+		epicsMutexMustLock(pbreaker->lock);
+		open = pbreaker->open;
+		epicsMutexUnlock(pbreaker->lock);
+		
+		if (!open)
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error25, sres);
-			break;
+			epicsEventMustWait(pbreaker->wakeup);
+			continue;
 		}
 		
-		case 0x26:
+		epicsThreadSleep(pbreaker->interval);
+		
+	/* one word of DM, which every CPU unit has */
+	
+		if (ReadPLC(pdrvPvt, pbreaker->pasynUser, &word, ONE_ELEMENT, 0, NULL, sizeof(word)) == 0)
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error26, sres);
-			break;
+			epicsMutexMustLock(pbreaker->lock);
+			pbreaker->open = 0;
+			pbreaker->timeouts = 0;
+			pbreaker->nprobes++;
+			epicsMutexUnlock(pbreaker->lock);
+			
+			asynPrint(pbreaker->pasynUser, ASYN_TRACE_ERROR, "%s: port %s, PLC answering again.\n", __func__, pdrvPvt->portName);
 		}
-		
-		case 0x30:
+		else
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error30, sres);
-			break;
+			epicsMutexMustLock(pbreaker->lock);
+			pbreaker->nprobes++;
+			epicsMutexUnlock(pbreaker->lock);
 		}
+	}
+}
+
+int finsBreakerInit(const char *portName, const int threshold, const double interval)
+{
+	drvPvt *pdrvPvt;
+	finsBreaker *pbreaker;
+	char name[64];
+	
+	if ((pdrvPvt = finsFindPort(portName)) == NULL)
+	{
+		printf("%s: %s is not a FINS port\n", __func__, portName ? portName : "");
+		return (-1);
+	}
+	
+	if (pdrvPvt->breaker)
+	{
+		epicsMutexMustLock(pdrvPvt->breaker->lock);
 		
-		case 0x40:
+		pdrvPvt->breaker->threshold = (threshold > 0) ? threshold : 0;
+		
+		if (interval > 0.0)
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, %s 0x%02x\n", name, pdrvPvt->portName, error40, sres);
-			break;
+			pdrvPvt->breaker->interval = interval;
 		}
 		
-		default:
+		if (pdrvPvt->breaker->threshold == 0)
 		{
-			asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, Error 0x%02x/0x%02x\n", name, pdrvPvt->portName, mres, sres);
-			break;
+			pdrvPvt->breaker->open = 0;
 		}
+		
+		epicsMutexUnlock(pdrvPvt->breaker->lock);
+		
+		return (0);
+	}
+	
+	if (threshold <= 0)
+	{
+		return (0);
+	}
+	
+	pbreaker = (finsBreaker *) callocMustSucceed(1, sizeof(finsBreaker), __func__);
+	pbreaker->lock = epicsMutexMustCreate();
+	pbreaker->wakeup = epicsEventMustCreate(epicsEventEmpty);
+	pbreaker->threshold = threshold;
+	pbreaker->interval = (interval > 0.0) ? interval : FINS_TIMEOUT;
+	
+	pbreaker->pasynUser = pasynManager->createAsynUser(0, 0);
+	pbreaker->pasynUser->reason = FINS_DM_READ;
+	pbreaker->pasynUser->timeout = FINS_TIMEOUT;
+	
+	if (pasynManager->connectDevice(pbreaker->pasynUser, portName, 0) != asynSuccess)
+	{
+		printf("%s: port %s, connectDevice failed: %s\n", __func__, portName, pbreaker->pasynUser->errorMessage);
+		return (-1);
+	}
+	
+	pdrvPvt->breaker = pbreaker;
+	
+	epicsSnprintf(name, sizeof(name), "%s_B", portName);
+	
+	if (epicsThreadCreate(name, epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackMedium), finsBreakerProbe, pdrvPvt) == NULL)
+	{
+		printf("%s: port %s, can't create probe thread\n", __func__, portName);
+		pdrvPvt->breaker = NULL;
+		
+		return (-1);
 	}
+	
+	return (0);
 }
 
-/*** ioc shell ************************************************************************************/
-
-static const iocshArg finsNETInitArg0 = { "port name", iocshArgString };
-static const iocshArg finsNETInitArg1 = { "network device", iocshArgString };
-static const iocshArg finsNETInitArg2 = { "local node address", iocshArgInt };
+static const iocshArg finsBreakerInitArg0 = { "port name", iocshArgString };
+static const iocshArg finsBreakerInitArg1 = { "time outs in a row", iocshArgInt };
+static const iocshArg finsBreakerInitArg2 = { "probe interval (s)", iocshArgDouble };
 
-static const iocshArg *finsNETInitArgs[] = { &finsNETInitArg0, &finsNETInitArg1, &finsNETInitArg2};
-static const iocshFuncDef finsNETInitFuncDef = { "finsNETInit", 3, finsNETInitArgs};
+static const iocshArg *finsBreakerInitArgs[] = { &finsBreakerInitArg0, &finsBreakerInitArg1, &finsBreakerInitArg2};
+static const iocshFuncDef finsBreakerInitFuncDef = { "finsBreakerInit", 3, finsBreakerInitArgs};
 
-static void finsNETInitCallFunc(const iocshArgBuf *args)
+static void finsBreakerInitCallFunc(const iocshArgBuf *args)
 {
-	finsNETInit(args[0].sval, args[1].sval, args[2].ival);
+	finsBreakerInit(args[0].sval, args[1].ival, args[2].dval);
 }
 
-static void finsNETRegister(void)
+static void finsBreakerRegister(void)
 {
 	static int firstTime = 1;
 	
 	if (firstTime)
 	{
 		firstTime = 0;
-		iocshRegister(&finsNETInitFuncDef, finsNETInitCallFunc);
+		iocshRegister(&finsBreakerInitFuncDef, finsBreakerInitCallFunc);
 	}
 }
 
-epicsExportRegistrar(finsNETRegister);
+epicsExportRegistrar(finsBreakerRegister);
 
-/*------------------------------------------------------------------------------------------------*/
+/**************************************************************************************************/
+/*
+	Background reconnection of FINS/TCP ports, before finsNETInit, finsTCPInit or finsTCPSharedInit
+	
+	finsReconnectInit(0.5, 30.0)	connect in the background, retrying after 0.5 s, 1 s, 2 s ... up to 30 s
+	finsReconnectInit(0, 0)		connect when finsInit runs and when a request finds the port disconnected
+*/
 
-static const iocshArg finsDEVInitArg0 = { "port name", iocshArgString };
-static const iocshArg finsDEVInitArg1 = { "serial device", iocshArgString };
+int finsReconnectInit(const double minDelay, const double maxDelay)
+{
+	if (maxDelay <= 0.0)
+	{
+		reconnectMin = reconnectMax = 0.0;
+		return (0);
+	}
+	
+	reconnectMin = (minDelay > 0.0) ? minDelay : 0.1;
+	reconnectMax = (maxDelay > reconnectMin) ? maxDelay : reconnectMin;
+	
+	return (0);
+}
 
-static const iocshArg *finsDEVInitArgs[] = { &finsDEVInitArg0, &finsDEVInitArg1};
-static const iocshFuncDef finsDEVInitFuncDef = { "finsDEVInit", 2, finsDEVInitArgs};
+static const iocshArg finsReconnectInitArg0 = { "shortest delay (s)", iocshArgDouble };
+static const iocshArg finsReconnectInitArg1 = { "longest delay (s)", iocshArgDouble };
 
-static void finsDEVInitCallFunc(const iocshArgBuf *args)
+static const iocshArg *finsReconnectInitArgs[] = { &finsReconnectInitArg0, &finsReconnectInitArg1};
+static const iocshFuncDef finsReconnectInitFuncDef = { "finsReconnectInit", 2, finsReconnectInitArgs};
+
+static void finsReconnectInitCallFunc(const iocshArgBuf *args)
 {
-	finsDEVInit(args[0].sval, args[1].sval);
+	finsReconnectInit(args[0].dval, args[1].dval);
 }
 
-static void finsDEVRegister(void)
+static void finsReconnectRegister(void)
 {
 	static int firstTime = 1;
 	
 	if (firstTime)
 	{
 		firstTime = 0;
-		iocshRegister(&finsDEVInitFuncDef, finsDEVInitCallFunc);
+		iocshRegister(&finsReconnectInitFuncDef, finsReconnectInitCallFunc);
 	}
 }
 
-epicsExportRegistrar(finsDEVRegister);
-
-/*------------------------------------------------------------------------------------------------*/
-
-static const iocshArg finsUDPInitArg0 = { "port name", iocshArgString };
-static const iocshArg finsUDPInitArg1 = { "IP address", iocshArgString };
-static const iocshArg finsUDPInitArg2 = { "Host node number", iocshArgInt };
-
-static const iocshArg *finsUDPInitArgs[] = { &finsUDPInitArg0, &finsUDPInitArg1, &finsUDPInitArg2};
-static const iocshFuncDef finsUDPInitFuncDef = { "finsUDPInit", 3, finsUDPInitArgs};
+epicsExportRegistrar(finsReconnectRegister);
 
-static void finsUDPInitCallFunc(const iocshArgBuf *args)
-{
-	finsUDPInit(args[0].sval, args[1].sval, args[2].ival);
-}
+/**************************************************************************************************/
+/*
+	Retransmission of FINS/UDP requests
+	
+	finsRetransmitInit("PLC1", 2)	send a request up to twice more, each after a third of the time out without a reply
+	finsRetransmitInit("PLC1", 0)	send each request once
+*/
 
-static void finsUDPRegister(void)
+int finsRetransmitInit(const char *portName, const int retransmits)
 {
-	static int firstTime = 1;
+	drvPvt *pdrvPvt;
 	
-	if (firstTime)
+	if ((pdrvPvt = finsFindPort(portName)) == NULL)
 	{
-		firstTime = 0;
-		iocshRegister(&finsUDPInitFuncDef, finsUDPInitCallFunc);
+		printf("%s: %s is not a FINS port\n", __func__, portName ? portName : "");
+		return (-1);
+	}
+	
+	if (pdrvPvt->type != FINS_UDP_type)
+	{
+		printf("%s: port %s, only FINS/UDP requests are sent again\n", __func__, portName);
+		return (-1);
 	}
+	
+	pdrvPvt->retransmits = (retransmits < 0) ? 0 : (retransmits > FINS_MAX_RETRANSMITS) ? FINS_MAX_RETRANSMITS : retransmits;
+	
+	return (0);
 }
 
-epicsExportRegistrar(finsUDPRegister);
-
-/*------------------------------------------------------------------------------------------------*/
-
-static const iocshArg finsTCPInitArg0 = { "port name", iocshArgString };
-static const iocshArg finsTCPInitArg1 = { "IP address", iocshArgString };
+static const iocshArg finsRetransmitInitArg0 = { "port name", iocshArgString };
+static const iocshArg finsRetransmitInitArg1 = { "retransmits", iocshArgInt };
 
-static const iocshArg *finsTCPInitArgs[] = { &finsTCPInitArg0, &finsTCPInitArg1};
-static const iocshFuncDef finsTCPInitFuncDef = { "finsTCPInit", 2, finsTCPInitArgs};
+static const iocshArg *finsRetransmitInitArgs[] = { &finsRetransmitInitArg0, &finsRetransmitInitArg1};
+static const iocshFuncDef finsRetransmitInitFuncDef = { "finsRetransmitInit", 2, finsRetransmitInitArgs};
 
-static void finsTCPInitCallFunc(const iocshArgBuf *args)
+static void finsRetransmitInitCallFunc(const iocshArgBuf *args)
 {
-	finsTCPInit(args[0].sval, args[1].sval);
+	finsRetransmitInit(args[0].sval, args[1].ival);
 }
 
-static void finsTCPRegister(void)
+static void finsRetransmitRegister(void)
 {
 	static int firstTime = 1;
 	
 	if (firstTime)
 	{
 		firstTime = 0;
-		iocshRegister(&finsTCPInitFuncDef, finsTCPInitCallFunc);
+		iocshRegister(&finsRetransmitInitFuncDef, finsRetransmitInitCallFunc);
 	}
 }
 
-epicsExportRegistrar(finsTCPRegister);
+epicsExportRegistrar(finsRetransmitRegister);
 
 /**************************************************************************************************/
 
+/**************************************************************************************************/
 /*
-	This is a test function to send a FINS data memory read request for two words from
-	address 100 to the specified IP address. It will print the data received as hex, or
-	a helpful error message if something fails.
+	Print the response time percentiles of a port, and optionally clear them.
+	
+	finsStats("PLC1", 0)
 */
 
-int finsTest(char *address)
+int finsStats(const char *portName, const int reset)
 {
-	int fd;
-	struct sockaddr_in addr;
-	const int addrlen = sizeof(struct sockaddr_in);
-	uint8_t node;
-	unsigned char *message;
-	int recvlen, sendlen = 0;
-	
-	message = (unsigned char *) callocMustSucceed(1, FINS_MAX_MSG, "finsTest");
-	
-/* open a datagram socket */
-
-	fd = socket(PF_INET, SOCK_DGRAM, 0);
+	drvPvt *pdrvPvt;
+	int i;
 	
-	if (fd < 0)
+	if ((pdrvPvt = finsFindPort(portName)) == NULL)
 	{
-		perror("finsTest: socket");
+		printf("%s: port %s not found\n", __func__, portName);
 		return (-1);
 	}
 	
-	bzero((char *) &(addr), addrlen);
-
-/* ask for a free port for incoming UDP packets */
-
-	addr.sin_addr.s_addr = htonl(INADDR_ANY);
-	addr.sin_family = AF_INET;
-	addr.sin_port = htons(0);
-
-/* bind socket to address */
-
-	if (bind(fd, (struct sockaddr *) &addr, addrlen) < 0)
-	{
-		perror("finsTest: bind failed");
-		
-		close(fd);
-		return (-1);
-	}
-
-/* find our port number */
+	printf("%s:\n", pdrvPvt->portName);
 	
+	for (i = 0; i < FINS_CLASSES; i++)
 	{
-		struct sockaddr_in name;
-#ifdef vxWorks
-		int namelen;
-#else
-		socklen_t namelen;
-#endif			
-		getsockname(fd, (struct sockaddr *) &name, &namelen);
-
-		printf("finsTest: port %d bound\n", name.sin_port);
+		HistReport(&pdrvPvt->latency[i], stdout, FINS_classes[i], 2);
+		
+		if (reset)
+		{
+			HistClear(&pdrvPvt->latency[i]);
+		}
 	}
 	
-/* destination port address used later in sendto() */
-
-	bzero((char *) &addr, addrlen);
-
-/*
-	addr.sin_family = AF_INET;
-	addr.sin_port = htons(FINS_UDP_PORT);
-*/
-
-/* convert IP address */
-
-	if (aToIPAddr(address, FINS_NET_PORT, &addr) < 0)
-	{
-		close(fd);
-		printf("finsTest: Bad IP address %s\n", address);
-		return (-1);
-	}
-
-/* node address is last byte of IP address */
-		
-	node = ntohl(addr.sin_addr.s_addr) & 0xff;
-		
-	printf("PLC node %d\n", node);
-
-/* send a simple FINS command */
-
-	message[ICF] = 0x80;
-	message[RSV] = 0x00;
-	message[GCT] = 0x02;
-
-	message[DNA] = 0x00;
-	message[DA1] = node;		/* destination node */
-	message[DA2] = 0x00;
-
-	message[SNA] = 0x00;
-	message[SA1] = 0x01;		/* source node */
-	message[SA2] = 0x00;
-
-	message[MRC] = 0x01;
-	message[SRC] = 0x01;
-	message[COM] = DM;		/* data memory read */
-
-	message[COM+1] = 100 >> 8;
-	message[COM+2] = 100 & 0xff;
-	message[COM+3] = 0x00;		/* start address */
+	return (0);
+}
 
-	message[COM+4] = 2 >> 8;
-	message[COM+5] = 2 & 0xff;	/* length */
+static const iocshArg finsStatsArg0 = { "port name", iocshArgString };
+static const iocshArg finsStatsArg1 = { "reset", iocshArgInt };
 
-	sendlen = COM + 6;
+static const iocshArg *finsStatsArgs[] = { &finsStatsArg0, &finsStatsArg1};
+static const iocshFuncDef finsStatsFuncDef = { "finsStats", 2, finsStatsArgs};
 
-/* send request */
+static void finsStatsCallFunc(const iocshArgBuf *args)
+{
+	finsStats(args[0].sval, args[1].ival);
+}
 
-	if (sendto(fd, message, sendlen, 0, (struct sockaddr *) &addr, addrlen) != sendlen)
+static void finsStatsRegister(void)
+{
+	static int firstTime = 1;
+	
+	if (firstTime)
 	{
-		perror("finsTest: sendto");
-		close(fd);
-		return (-1);
+		firstTime = 0;
+		iocshRegister(&finsStatsFuncDef, finsStatsCallFunc);
 	}
+}
 
-/* receive reply with time out */
-
-	{
-		fd_set rfds;
-		struct timeval tv;
-		
-		FD_ZERO(&rfds);
-		FD_SET(fd, &rfds);
-		
-	/* time out */
-
-		tv.tv_sec = FINS_TIMEOUT;
-		tv.tv_usec = 0;
+epicsExportRegistrar(finsStatsRegister);
 
-		switch (select(fd + 1, &rfds, NULL, NULL, &tv))
-		{
-			case -1:
-			{
-				perror("finsTest: select");
+/**************************************************************************************************/
+/*
+	Benchmark a port through the same asyn interfaces that records use.
 	
-				return (-1);
-				break;
-			}
-			
-			case 0:
-			{
-				perror("finsTest: select");
-
-				return (-1);
-				break;
-			}
-
-			default:
-			{
-				break;
-			}
-		}
+	finsBench("PLC1", "read:1,read:950,write:10", 4, 10.0, 1000, "bench.json")
+	
+	mix		comma separated operations, each name[:elements], run in turn by every client
+	clients	number of threads, each with its own asynUsers
+	seconds	how long to run for
+	address	DM address to read and write
+	file		append the results as one JSON object per operation, "-" for stdout, "" for none
+	
+	Writes change PLC memory, so only use them against a test PLC or finsEmulator.
+*/
+
+static const finsBenchType finsBenchTypes[] =
+{
+	{ "echo",    "FINS_ECHO_TEST",       FINS_BENCH_INT32,        0, 0 },
+	{ "int",     "FINS_DM_READ",         FINS_BENCH_INT32,        0, sizeof(epicsUInt16) },
+	{ "intw",    "FINS_DM_WRITE_NOREAD", FINS_BENCH_INT32,        1, sizeof(epicsUInt16) },
+	{ "read",    "FINS_DM_READ",         FINS_BENCH_INT16ARRAY,   0, sizeof(epicsUInt16) },
+	{ "write",   "FINS_DM_WRITE",        FINS_BENCH_INT16ARRAY,   1, sizeof(epicsUInt16) },
+	{ "read32",  "FINS_DM_READ_32",      FINS_BENCH_INT32ARRAY,   0, sizeof(epicsUInt32) },
+	{ "write32", "FINS_DM_WRITE_32",     FINS_BENCH_INT32ARRAY,   1, sizeof(epicsUInt32) },
+	{ "float",   "FINS_DM_READ_32",      FINS_BENCH_FLOAT32ARRAY, 0, sizeof(epicsFloat32) },
+	{ "floatw",  "FINS_DM_WRITE_32",     FINS_BENCH_FLOAT32ARRAY, 1, sizeof(epicsFloat32) }
+};
+
+#define FINS_BENCH_TYPES	(sizeof(finsBenchTypes) / sizeof(finsBenchTypes[0]))
+
+static asynStatus BenchConnect(finsBenchClient * const pclient, const int op)
+{
+	const finsBenchRun * const pbench = pclient->pbench;
+	const finsBenchType * const ptype = pbench->ops[op].ptype;
+	asynUser **ppasynUser = &pclient->pasynUser[op];
+	
+	switch (ptype->iface)
+	{
+		case FINS_BENCH_INT32:		return pasynInt32SyncIO->connect(pbench->portName, pbench->address, ppasynUser, ptype->drvInfo);
+		case FINS_BENCH_INT16ARRAY:	return pasynInt16ArraySyncIO->connect(pbench->portName, pbench->address, ppasynUser, ptype->drvInfo);
+		case FINS_BENCH_INT32ARRAY:	return pasynInt32ArraySyncIO->connect(pbench->portName, pbench->address, ppasynUser, ptype->drvInfo);
+		default:				return pasynFloat32ArraySyncIO->connect(pbench->portName, pbench->address, ppasynUser, ptype->drvInfo);
 	}
+}
 
+static void BenchDisconnect(finsBenchClient * const pclient, const int op)
+{
+	asynUser *pasynUser = pclient->pasynUser[op];
+	
+	switch (pclient->pbench->ops[op].ptype->iface)
 	{
-		struct sockaddr from_addr;
-#ifdef vxWorks
-		int iFromLen = 0;
-#else
-		socklen_t iFromLen = 0;
-#endif
-		if ((recvlen = recvfrom(fd, message, FINS_MAX_MSG, 0, &from_addr, &iFromLen)) < 0)
-		{
-			perror("finsTest: recvfrom");
-			close(fd);
-			return (-1);
-		}
+		case FINS_BENCH_INT32:		pasynInt32SyncIO->disconnect(pasynUser);		break;
+		case FINS_BENCH_INT16ARRAY:	pasynInt16ArraySyncIO->disconnect(pasynUser);	break;
+		case FINS_BENCH_INT32ARRAY:	pasynInt32ArraySyncIO->disconnect(pasynUser);	break;
+		default:				pasynFloat32ArraySyncIO->disconnect(pasynUser);	break;
 	}
+}
 
+static asynStatus BenchTransfer(finsBenchClient * const pclient, const int op, void *data)
+{
+	const finsBenchOp * const pop = &pclient->pbench->ops[op];
+	asynUser *pasynUser = pclient->pasynUser[op];
+	size_t nIn;
+	
+	switch (pop->ptype->iface)
 	{
-		int i;
+		case FINS_BENCH_INT32:
+		{
+			return ((pop->ptype->write) ? pasynInt32SyncIO->write(pasynUser, pclient->id, FINS_TIMEOUT) : pasynInt32SyncIO->read(pasynUser, (epicsInt32 *) data, FINS_TIMEOUT));
+		}
 		
-		for (i = 0; i < recvlen; i++)
+		case FINS_BENCH_INT16ARRAY:
 		{
-			printf("0x%02x ", message[i]);
+			return ((pop->ptype->write) ? pasynInt16ArraySyncIO->write(pasynUser, (epicsInt16 *) data, pop->nelements, FINS_TIMEOUT) : pasynInt16ArraySyncIO->read(pasynUser, (epicsInt16 *) data, pop->nelements, &nIn, FINS_TIMEOUT));
+		}
+		
+		case FINS_BENCH_INT32ARRAY:
+		{
+			return ((pop->ptype->write) ? pasynInt32ArraySyncIO->write(pasynUser, (epicsInt32 *) data, pop->nelements, FINS_TIMEOUT) : pasynInt32ArraySyncIO->read(pasynUser, (epicsInt32 *) data, pop->nelements, &nIn, FINS_TIMEOUT));
+		}
+		
+		default:
+		{
+			return ((pop->ptype->write) ? pasynFloat32ArraySyncIO->write(pasynUser, (epicsFloat32 *) data, pop->nelements, FINS_TIMEOUT) : pasynFloat32ArraySyncIO->read(pasynUser, (epicsFloat32 *) data, pop->nelements, &nIn, FINS_TIMEOUT));
 		}
-	
-		puts("");
 	}
+}
 
-/* Illegal response length check */
+static void BenchClient(void *arg)
+{
+	finsBenchClient * const pclient = (finsBenchClient *) arg;
+	finsBenchRun * const pbench = pclient->pbench;
+	epicsInt32 *data = callocMustSucceed(FINS_MAX_ARRAY_WORDS, sizeof(epicsInt32), __func__);
+	epicsTimeStamp ets, ete;
+	int i, op = 0;
 	
-	if (recvlen < MIN_RESP_LEN)
+	for (i = 0; i < FINS_MAX_ARRAY_WORDS; i++)
 	{
-		puts("finsTest: receive length too small.");
+		data[i] = pclient->id + i;
 	}
-
-/* check response code */
-
-	if ((message[MRES] != 0x00) || (message[SRES] != 0x00))
+	
+	for (i = 0; i < pbench->nops; i++)
 	{
-		if (message[MRES] & 0x80)
+		if (BenchConnect(pclient, i) != asynSuccess)
 		{
-			puts("finsTest: Relay Error Flag set");
+			printf("finsBench: client %d can't connect %s to port %s\n", pclient->id, pbench->ops[i].ptype->drvInfo, pbench->portName);
+			pclient->errors[i]++;
 			
-			message[MRES] ^= 0x80;
-		}
-		
-		switch (message[MRES])
-		{
-			case 0x01:
-			{
-				printf("%s 0x%02x\n", error01, message[SRES]);
-				break;
-			}
-		
-			case 0x02:
-			{
-				printf("%s 0x%02x\n", error02, message[SRES]);
-				break;
-			}
-		
-			case 0x03:
-			{
-				printf("%s 0x%02x\n", error03, message[SRES]);
-				break;
-			}
-		
-			case 0x04:
-			{
-				printf("%s 0x%02x\n", error04, message[SRES]);
-				break;
-			}
-		
-			case 0x05:
-			{
-				printf("%s 0x%02x\n", error05, message[SRES]);
-				break;
-			}
-		
-			case 0x10:
-			{
-				printf("%s 0x%02x\n", error10, message[SRES]);
-				break;
-			}
-		
-			case 0x11:
-			{
-				printf("%s 0x%02x\n", error11, message[SRES]);
-				break;
-			}
-		
-			case 0x20:
-			{
-				printf("%s 0x%02x\n", error20, message[SRES]);
-				break;
-			}
-		
-			case 0x21:
-			{
-				printf("%s 0x%02x\n", error21, message[SRES]);
-				break;
-			}
-		
-			case 0x22:
-			{
-				printf("%s 0x%02x\n", error22, message[SRES]);
-				break;
-			}
-		
-			case 0x23:
-			{
-				printf("%s 0x%02x\n", error23, message[SRES]);
-				break;
-			}
-		
-			case 0x24:
-			{
-				printf("%s 0x%02x\n", error24, message[SRES]);
-				break;
-			}
-		
-			case 0x25:
-			{
-				printf("%s 0x%02x\n", error25, message[SRES]);
-				break;
-			}
-		
-			case 0x26:
+			while (i--)
 			{
-				printf("%s 0x%02x\n", error26, message[SRES]);
-				break;
-			}
-		
-			case 0x30:
-			{
-				printf("%s 0x%02x\n", error30, message[SRES]);
-				break;
+				BenchDisconnect(pclient, i);
 			}
+			
+			goto done;
+		}
+	}
+	
+	for (epicsTimeGetCurrent(&ets); epicsTimeDiffInSeconds(&pbench->end, &ets) > 0.0; ets = ete, op = (op + 1) % pbench->nops)
+	{
+		const asynStatus status = BenchTransfer(pclient, op, data);
 		
-			case 0x40:
-			{
-				printf("%s 0x%02x\n", error40, message[SRES]);
-				break;
-			}
+		epicsTimeGetCurrent(&ete);
 		
-			default:
-			{
-				printf("Error 0x%02x/0x%02x\n", message[MRES], message[SRES]);
-				break;
-			}
+		if (status == asynSuccess)
+		{
+			HistAdd(&pbench->ops[op].latency, epicsTimeDiffInSeconds(&ete, &ets));
+		}
+		else
+		{
+			pclient->errors[op]++;
 		}
 	}
-		
-	close(fd);
 	
-	return (0);
-}
-
-static const iocshArg finsTestArg0 = { "IP address", iocshArgString };
+	for (i = 0; i < pbench->nops; i++)
+	{
+		BenchDisconnect(pclient, i);
+	}
 
-static const iocshArg *finsTestArgs[] = { &finsTestArg0};
-static const iocshFuncDef finsTestFuncDef = { "finsTest", 1, finsTestArgs};
+done:
+	free(data);
+	epicsEventSignal(pclient->done);
+}
 
-static void finsTestCallFunc(const iocshArgBuf *args)
+static void BenchResults(const finsBenchRun * const pbench, FILE *fp, const int clients, const double seconds)
 {
-	finsTest(args[0].sval);
+	const drvPvt * const pdrvPvt = finsFindPort(pbench->portName);
+	char when[40];
+	epicsTimeStamp now;
+	int i;
+	
+	epicsTimeGetCurrent(&now);
+	epicsTimeToStrftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%S", &now);
+	
+	for (i = 0; i < pbench->nops; i++)
+	{
+		const finsBenchOp * const pop = &pbench->ops[i];
+		const size_t n = HistCount(&pop->latency);
+		
+		fprintf(fp, "{\"time\": \"%s\", \"port\": \"%s\", \"op\": \"%s\", \"elements\": %lu, \"clients\": %d, \"seconds\": %g, "
+			"\"frame_words\": %lu, \"transactions\": %lu, \"errors\": %d, \"tps\": %.1f, \"bytes_per_s\": %.0f, "
+			"\"p50\": %.6f, \"p90\": %.6f, \"p99\": %.6f, \"p999\": %.6f, \"max\": %.6f}\n",
+			when, pbench->portName, pop->ptype->name, (unsigned long) pop->nelements, clients, seconds,
+			(unsigned long) MaxWords(pdrvPvt), (unsigned long) n, pop->errors, n / seconds, n * pop->nelements * pop->ptype->size / seconds,
+			HistPercentile(&pop->latency, 0.5), HistPercentile(&pop->latency, 0.9), HistPercentile(&pop->latency, 0.99), HistPercentile(&pop->latency, 0.999),
+			HistMax(&pop->latency));
+	}
 }
 
-static void finsTestRegister(void)
+static void BenchFree(finsBenchRun * const pbench)
 {
-	static int firstTime = 1;
+	int i;
 	
-	if (firstTime)
+	for (i = 0; i < pbench->nops; i++)
 	{
-		firstTime = 0;
-		iocshRegister(&finsTestFuncDef, finsTestCallFunc);
+		HistFree(&pbench->ops[i].latency);
 	}
+	
+	free(pbench);
 }
 
-epicsExportRegistrar(finsTestRegister);
-
-/**************************************************************************************************/
-
-/* Create a list of 'memory area' & 'address' pairs for the Read Multiple Memory Area command */
-
-static int initlist = 1;
-
-int finsMultiMemoryAreaInit(char *s)
+int finsBench(const char *portName, const char *mix, const int clients, const double seconds, const int address, const char *file)
 {
-	MultiMemArea *MM;
-
-/* initialise the linked list */
+	finsBenchRun *pbench;
+	finsBenchClient *pclients;
+	char *list, *item, *save;
+	int i, op;
+	
+	if (finsFindPort(portName) == NULL)
+	{
+		printf("%s: port %s not found\n", __func__, portName);
+		return (-1);
+	}
+	
+	if ((clients < 1) || (clients > FINS_BENCH_MAX_CLIENTS) || (seconds <= 0.0))
+	{
+		printf("%s: need 1 to %d clients and a positive time\n", __func__, FINS_BENCH_MAX_CLIENTS);
+		return (-1);
+	}
+	
+	pbench = callocMustSucceed(1, sizeof(finsBenchRun), __func__);
+	pbench->portName = portName;
+	pbench->address = address;
+	
+/* parse the mix */
 
-	if (initlist)
+	list = epicsStrDup((mix && *mix) ? mix : "read:1");
+	
+	for (item = epicsStrtok_r(list, ",", &save); item; item = epicsStrtok_r(NULL, ",", &save))
 	{
-		initlist = 0;
+		char *count = strchr(item, ':');
+		
+		if (count)
+		{
+			*count++ = '\0';
+		}
+		
+		for (i = 0; (i < FINS_BENCH_TYPES) && strcmp(item, finsBenchTypes[i].name); i++);
+		
+		if ((i == FINS_BENCH_TYPES) || (pbench->nops == FINS_BENCH_MAX_OPS))
+		{
+			printf("%s: unknown operation %s, or more than %d operations\n", __func__, item, FINS_BENCH_MAX_OPS);
+			goto error;
+		}
+		
+		pbench->ops[pbench->nops].ptype = &finsBenchTypes[i];
+		pbench->ops[pbench->nops].nelements = (count && (finsBenchTypes[i].iface != FINS_BENCH_INT32)) ? atoi(count) : 1;
+		
+		if ((pbench->ops[pbench->nops].nelements < 1) || (pbench->ops[pbench->nops].nelements * finsBenchTypes[i].size > FINS_MAX_ARRAY_WORDS * sizeof(epicsUInt16)))
+		{
+			printf("%s: %s:%s is too many elements\n", __func__, item, count);
+			goto error;
+		}
 		
-		ellInit(&mmList);
+		HistInit(&pbench->ops[pbench->nops].latency);
+		pbench->nops++;
 	}
+	
+/* run */
 
-/* allocate space to 10 memory type / memory address pairs */
+	pclients = callocMustSucceed(clients, sizeof(finsBenchClient), __func__);
 	
-	MM = (MultiMemArea *) callocMustSucceed(1, sizeof(MultiMemArea), "finsMultiMemoryAreaInit");
+	epicsTimeGetCurrent(&pbench->end);
+	epicsTimeAddSeconds(&pbench->end, seconds);
+	
+	for (i = 0; i < clients; i++)
+	{
+		char name[20];
 		
-/* and add to our list */
-
-	ellAdd(&mmList, &(MM->node));
+		pclients[i].pbench = pbench;
+		pclients[i].id = i;
+		pclients[i].done = epicsEventMustCreate(epicsEventEmpty);
+		
+		epicsSnprintf(name, sizeof(name), "finsBench%d", i);
+		epicsThreadMustCreate(name, epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackMedium), BenchClient, &pclients[i]);
+	}
 	
-/* scan for memory type / memory address pairs */
-
+	for (i = 0; i < clients; i++)
 	{
-		int num = 0, i, p = 0;
-
-		do
+		epicsEventMustWait(pclients[i].done);
+		epicsEventDestroy(pclients[i].done);
+		
+		for (op = 0; op < pbench->nops; op++)
 		{
-			i = sscanf(s += num, "%hi%hi,%n", &(MM->area[p]), &(MM->address[p]), &num);
-			p++;
+			pbench->ops[op].errors += pclients[i].errors[op];
 		}
-		while ((i == 2) && (p < FINS_MM_MAX_ADDRS));
 	}
 	
-	return (0);
-}
+	free(pclients);
 
-int finsMultiMemoryAreaDump(void)
-{
-	int i, j;
-	MultiMemArea *MM;
+/* report */
+
+	printf("%s: port %s, %d client(s), %g seconds\n", __func__, portName, clients, seconds);
 	
-	for (i = 0, MM = (MultiMemArea *) ellFirst(&mmList); MM; i++, MM = (MultiMemArea *) ellNext(&(MM->node)))
+	for (op = 0; op < pbench->nops; op++)
 	{
-		printf("%2d: ", i);
+		const finsBenchOp * const pop = &pbench->ops[op];
+		const size_t n = HistCount(&pop->latency);
+		char name[40];
 		
-		for (j = 0; j < FINS_MM_MAX_ADDRS; j++)
+		epicsSnprintf(name, sizeof(name), "%s:%lu", pop->ptype->name, (unsigned long) pop->nelements);
+		
+		printf("    %-12s %10.1f/s %12.0f bytes/s  errors %d\n", name, n / seconds, n * pop->nelements * pop->ptype->size / seconds, pop->errors);
+		HistReport(&pop->latency, stdout, "", 1);
+	}
+	
+	if (file && *file)
+	{
+		FILE *fp = (strcmp(file, "-") == 0) ? stdout : fopen(file, "a");
+		
+		if (fp == NULL)
+		{
+			printf("%s: can't open %s: %s\n", __func__, file, strerror(errno));
+		}
+		else
 		{
-			if (MM->area[j] == 0x00) break;
+			BenchResults(pbench, fp, clients, seconds);
 			
-			printf("%s0x%02x 0x%04x", (j > 0) ? ", " : "", MM->area[j], MM->address[j]);
+			if (fp != stdout)
+			{
+				fclose(fp);
+			}
 		}
-		
-		puts("");
 	}
 	
+	free(list);
+	BenchFree(pbench);
 	return (0);
+
+error:
+	free(list);
+	BenchFree(pbench);
+	return (-1);
 }
 
-static const iocshArg finsMultiMemoryAreaInitArg0 = { "area/address", iocshArgString };
+static const iocshArg finsBenchArg0 = { "port name", iocshArgString };
+static const iocshArg finsBenchArg1 = { "mix", iocshArgString };
+static const iocshArg finsBenchArg2 = { "clients", iocshArgInt };
+static const iocshArg finsBenchArg3 = { "seconds", iocshArgDouble };
+static const iocshArg finsBenchArg4 = { "DM address", iocshArgInt };
+static const iocshArg finsBenchArg5 = { "results file", iocshArgString };
 
-static const iocshArg *finsMultiMemoryAreaInitArgs[] = { &finsMultiMemoryAreaInitArg0};
-static const iocshFuncDef finsMultiMemoryAreaInitFuncDef = { "finsMultiMemoryAreaInit", 1, finsMultiMemoryAreaInitArgs};
+static const iocshArg *finsBenchArgs[] = { &finsBenchArg0, &finsBenchArg1, &finsBenchArg2, &finsBenchArg3, &finsBenchArg4, &finsBenchArg5};
+static const iocshFuncDef finsBenchFuncDef = { "finsBench", 6, finsBenchArgs};
 
-static void finsMultiMemoryAreaInitCallFunc(const iocshArgBuf *args)
+static void finsBenchCallFunc(const iocshArgBuf *args)
 {
-	finsMultiMemoryAreaInit(args[0].sval);
+	finsBench(args[0].sval, args[1].sval, args[2].ival, args[3].dval, args[4].ival, args[5].sval);
 }
 
-static void finsMultiMemoryAreaInitRegister(void)
+static void finsBenchRegister(void)
 {
 	static int firstTime = 1;
 	
 	if (firstTime)
 	{
 		firstTime = 0;
-		iocshRegister(&finsMultiMemoryAreaInitFuncDef, finsMultiMemoryAreaInitCallFunc);
+		iocshRegister(&finsBenchFuncDef, finsBenchCallFunc);
 	}
 }
 
-epicsExportRegistrar(finsMultiMemoryAreaInitRegister);
-
-/**************************************************************************************************/
+epicsExportRegistrar(finsBenchRegister);
@@ -1,3 +1,8 @@
+/* types used by the driver structures below */
+
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+
 /* PLC memory  types */
 
 #define DM	0x82
@@ -61,9 +66,17 @@
 #define FINS_MAX_TCP_WORDS	FINS_MAX_UDP_WORDS
 #define FINS_MAX_HOST_WORDS	268
 #define FINS_MAX_MSG		((FINS_MAX_UDP_WORDS) * 2 + 100)
+#define FINS_MAX_ARRAY_WORDS	32768					/* a whole DM or EM bank, split into frames */
+#define FINS_MAX_CHUNKS		16					/* frames of one split transfer in flight */
 #define FINS_TIMEOUT		1					/* asyn default timeout */
+#define FINS_CONNECT_TIMEOUT	2.0					/* seconds for a shared FINS/TCP connection to be made */
+#define FINS_MTU		1500					/* Ethernet, if the path MTU can't be found */
+#define FINS_UDP_OVERHEAD	28					/* IPv4 and UDP headers */
+#define FINS_MAX_RETRANSMITS	4					/* resends of a UDP request, see finsRetransmitInit */
 #define FINS_SOURCE_ADDR	(0xFE)				/* default node address 254 */
 #define FINS_GATEWAY		0x02
+#define FINS_ICF_NO_RESPONSE	0x01					/* ICF bit 0, the PLC doesn't reply */
+#define FINS_NORESP_SUFFIX	"_NORESP"				/* drvInfo suffix of writes sent with it set */
 
 #define FINS_MODEL_LEN		20
 #define FINS_CYCLE_TIME_LEN	3
@@ -71,6 +84,8 @@
 #define FINS_CPU_STATE_LEN	26
 
 #define FINS_MM_MAX_ADDRS	10
+#define FINS_MM_MAX_ITEMS	167					/* Multiple Memory Area Read items in one FINS/UDP or FINS/TCP frame */
+#define FINS_MM_MAX_HOST_ITEMS	((FINS_MAX_HOST_WORDS) * 2 / 4)	/* and in one Hostlink frame, four bytes per item */
 
 #define ONE_ELEMENT	(1)
 
@@ -107,6 +122,10 @@
 
 enum { FINS_UDP_type, FINS_TCP_type, HOSTLINK_type };
 
+/* how a network port reaches the PLC: through its parent asyn port or a shared transport */
+
+enum { FINS_PARENT_PORT, FINS_SHARED_UDP, FINS_SHARED_TCP };
+
 static const char * const asynStatusMessages[] = { "asynSuccess", "asynTimeout", "asynOverflow", "asynError", "asynDisconnected", "asynDisabled"};
 static const char * const asynEomMessages[] = { "Request count reached", "End of String detected", "End indicator detected"};
 
@@ -147,7 +166,14 @@ enum FINS_COMMANDS
 	FINS_SET_RESET_CANCEL,
 	FINS_MM_READ,
 	FINS_EXPLICIT,
-	FINS_ECHO_TEST
+	FINS_ECHO_TEST,
+	FINS_LATENCY_P50,
+	FINS_LATENCY_P90,
+	FINS_LATENCY_P99,
+	FINS_LATENCY_P999,
+	FINS_LATENCY_MAX,
+	FINS_LATENCY_COUNT,
+	FINS_WRITE_COMMIT
 };
 
 static const char * const FINS_names[] = {
@@ -186,7 +212,14 @@ static const char * const FINS_names[] = {
 	"FINS_SET_RESET_CANCEL",
 	"FINS_MM_READ",
 	"FINS_EXPLICIT",
-	"FINS_ECHO_TEST"
+	"FINS_ECHO_TEST",
+	"FINS_LATENCY_P50",
+	"FINS_LATENCY_P90",
+	"FINS_LATENCY_P99",
+	"FINS_LATENCY_P999",
+	"FINS_LATENCY_MAX",
+	"FINS_LATENCY_COUNT",
+	"FINS_WRITE_COMMIT"
 };
 
 /* from asyn/drvAsynSerial/drvAsynIPPort.c */
@@ -225,6 +258,66 @@ typedef struct MultiMemAreaPair
 	
 } MultiMemAreaPair;
 
+/*
+	Multiple Memory Area Read definitions. Each port has a table of entries indexed by asyn address.
+	An item is a word, a 32-bit value in two consecutive words (low word first) or a bit. Bit areas
+	are those with the top bit of the area code clear.
+*/
+
+#define FINS_MM_MAX_ENTRIES	4096
+
+#define FINS_MM_BIT		0
+#define FINS_MM_WORD		1
+#define FINS_MM_WORD_32		2
+
+#define FINS_MM_TYPE_32		0x100	/* FINS_SET_MULTI_TYPE flag for a 32-bit item */
+
+typedef struct finsMMItem
+{
+	epicsUInt8 area;
+	epicsUInt8 bit;
+	epicsUInt8 width;			/* FINS_MM_BIT, FINS_MM_WORD or FINS_MM_WORD_32 */
+	epicsUInt16 address;
+	
+} finsMMItem;
+
+typedef struct finsMMEntry
+{
+	int nitems;
+	int type;				/* set by FINS_SET_MULTI_TYPE for the next FINS_SET_MULTI_ADDR */
+	unsigned int edits;			/* changes to the items, so that a reply to an older request is refused */
+	finsMMItem item[FINS_MM_MAX_ADDRS];
+	
+} finsMMEntry;
+
+typedef struct finsMMTable
+{
+	epicsMutexId lock;
+	int n, max;				/* entries in use and allocated */
+	finsMMEntry *entry;
+	
+} finsMMTable;
+
+/*
+	Response time histogram. Bucket boundaries are spaced four to an octave from 1us, so each bucket
+	is within 19% of its neighbours. A short lock per histogram, as EPICS 3.14 has no epicsAtomic.
+*/
+
+#define FINS_HIST_BUCKETS	100
+
+enum { FINS_CLASS_READ, FINS_CLASS_WRITE, FINS_CLASS_STATUS, FINS_CLASSES };
+
+static const char * const FINS_classes[] = { "read", "write", "status" };
+
+typedef struct finsHist
+{
+	epicsMutexId lock;		/* protects everything below */
+	size_t count[FINS_HIST_BUCKETS];	/* size_t so that they don't wrap after a few weeks at 1 kHz */
+	size_t n;
+	int max, last;			/* microseconds */
+	
+} finsHist;
+
 typedef struct drvPvt
 {
 	int connected;
@@ -241,12 +334,35 @@ typedef struct drvPvt
 
 	epicsUInt8 dnode, snode;		/* source and destination node addresses */
 	epicsUInt8 sid;				/* session id - incremented for each message */
-	epicsUInt8 mrc, src;
-	epicsFloat32 tMax, tMin, tLast;	/* Max and Min and last response time of PLC */
-	epicsUInt8 message[FINS_MAX_MSG];
+	finsHist latency[FINS_CLASSES];	/* response times of memory reads, writes and other commands */
 	
 	struct sockaddr_in addr;
 
+	epicsMutexId mutex;			/* serialises writeRead() on the parent port between the port thread and pollers */
+	epicsMutexId msgLock;		/* protects msgFree and sid */
+	epicsMutexId tmplLock;		/* protects the request template of each finsUser */
+	ELLLIST msgFree;			/* finsMsg buffers not in use */
+	struct finsLink *link;		/* pipelined UDP transport, NULL if requests go through the parent port */
+	epicsMutexId blockLock;		/* protects blockList and the block images */
+	ELLLIST blockList;			/* finsBlock cache entries */
+	
+	double pollPeriod;			/* I/O Intr poller period, zero if there is no poller */
+	int onChange;				/* only pass changed values to I/O Intr callbacks */
+	struct finsMulti *multi;		/* the poller's coalesced single value reads */
+	struct finsCache *cache;		/* see finsCacheInit, NULL if there isn't one */
+	struct finsStatus *status;		/* see finsStatusInit, NULL if there isn't one */
+	double verify;				/* request a response to a _NORESP write once per this many seconds, zero for never */
+	int nnoresp, nverified;			/* _NORESP writes sent without and with a response */
+	struct finsWriteQueue *wq;		/* see finsWriteCombineInit, NULL if writes go straight out */
+	struct finsBreaker *breaker;		/* see finsBreakerInit, NULL if there isn't one */
+	struct finsReconnect *reconnect;	/* see finsReconnectInit, NULL if FINS/TCP connects on demand */
+	int retransmits;			/* see finsRetransmitInit, times a UDP request is sent again before it times out */
+	unsigned long nretransmits, ndiscarded;	/* UDP requests sent again, replies with the wrong SID dropped */
+	finsMMTable mm;				/* Multiple Memory Area Read definitions */
+	
+	size_t maxwords;			/* words per frame set by finsFrameSize, zero for the transport's maximum */
+	int mtu;
+
 } drvPvt;
 
 /* FINS TCP */
@@ -263,6 +379,464 @@ typedef struct drvPvt
 #define FINS_MODE_SEND_SIZE	20
 #define FINS_MODE_RECV_SIZE	24
 
+/*
+	A request and its reply. Each transfer has its own buffer so that several can be in flight
+	on one port. For FINS/TCP the frame header is written into the headroom in front of message
+	so that the request and reply are never shifted.
+*/
+
+typedef struct finsMsg
+{
+	ELLNODE node;
+	
+	epicsUInt8 mrc, src;		/* expected in the reply */
+	epicsUInt8 sid;
+	unsigned int edits;		/* of the Multiple Memory Area entry a FINS_MM_READ was built from */
+	size_t sendlen, recvlen;	/* including the FINS/TCP header */
+	size_t sentlen;			/* set by finsTransferStart for finsTransferWait */
+	asynStatus status;
+	epicsTimeStamp ets;
+	epicsUInt8 *message;		/* the FINS header and data, FINS_SEND_FRAME_SIZE bytes into buffer[] */
+	epicsUInt8 buffer[FINS_SEND_FRAME_SIZE + FINS_MAX_MSG];
+	
+} finsMsg;
+
+/*
+	Pipelined FINS/UDP. Up to window requests are sent without waiting for the replies, which
+	a receive thread matches to the requests by SID.
+*/
+
+typedef struct finsPending
+{
+	finsMsg *pmsg;			/* waiting for a reply, NULL if the SID is free */
+	size_t recdlen;			/* 0 if the request failed without a reply, see SessionReceive */
+	epicsEventId done;
+	epicsTimeStamp quiet;		/* a SID which timed out isn't used again before this, see LinkSid */
+	
+} finsPending;
+
+typedef struct finsLink
+{
+	SOCKET fd;
+	struct sockaddr_in peer;	/* the PLC, for a link on a shared socket */
+	int shared;			/* fd belongs to a shared transport: a dispatcher socket or a session */
+	struct finsBatch *batch;	/* the shared socket's sendmmsg() queue, NULL if not batching */
+	struct finsSession *session;	/* the shared FINS/TCP connection, NULL for UDP */
+	int window;			/* maximum number of requests in flight */
+	int inflight;
+	
+	epicsMutexId lock;		/* protects everything below */
+	epicsEventId space;		/* signalled when a request completes */
+	finsPending pending[256];	/* indexed by SID */
+	
+	unsigned long nsent, nreplies, nstale, ntimeouts;
+	
+} finsLink;
+
+/*
+	Shared FINS/UDP. The links of ports created by finsUDPSharedInit send on a small pool of sockets
+	and one dispatcher thread passes each reply to the link of the PLC it came from.
+*/
+
+#define FINS_DISPATCH_MAX_SOCKETS	16
+
+typedef struct finsDispatchPeer
+{
+	epicsUInt32 ip;			/* network byte order, as are port and the sockaddr_in */
+	epicsUInt16 port;
+	finsLink *plink;
+	
+} finsDispatchPeer;
+
+typedef struct finsDispatchSocket
+{
+	SOCKET fd;
+	int npeers, maxpeers;
+	finsDispatchPeer *peers;	/* sorted by ip and port */
+	unsigned long nunknown;		/* datagrams from addresses without a port */
+	struct finsBatch *batch;	/* requests waiting for sendmmsg(), NULL if not batching */
+	
+} finsDispatchSocket;
+
+typedef struct finsDispatcher
+{
+	epicsMutexId lock;		/* protects the peer tables and counters */
+	int epfd;			/* the sockets' epoll instance, Linux only */
+	int nsockets;
+	finsDispatchSocket socket[FINS_DISPATCH_MAX_SOCKETS];
+	struct finsRing *ring;		/* recvmmsg() buffers, NULL if not batching */
+	
+} finsDispatcher;
+
+/*
+	Shared FINS/TCP. Ports created by finsTCPSharedInit for the same address share one connection and
+	its node address. Their requests go through the session's link, so several frames can be on the
+	stream at once and a receive thread matches the replies to them by SID.
+*/
+
+typedef struct finsSession
+{
+	ELLNODE node;
+	
+	char *address;
+	struct sockaddr_in peer;
+	finsLink *plink;		/* plink->fd is the connection, INVALID_SOCKET when there isn't one */
+	
+	epicsMutexId connectLock;	/* one connect and node address exchange at a time */
+	epicsMutexId sendLock;		/* keeps frames whole on the stream */
+	epicsEventId connected;		/* wakes the receive thread */
+	
+	epicsUInt8 snode, dnode;	/* from the node address exchange */
+	struct drvPvt **ports;
+	int nports;
+	
+	unsigned long nconnects, nclosed;
+	
+} finsSession;
+
+/*
+	What the driver needs to know about each command, indexed by reason. drvUserCreate resolves the
+	drvInfo string to one of these once, so reads and writes don't have to work it out every time.
+*/
+
+#define FINS_CMD_READ		0x01		/* built by BuildReadMessage */
+#define FINS_CMD_WRITE		0x02		/* built by BuildWriteMessage */
+#define FINS_CMD_DRVINFO	0x04		/* may be given as the drvInfo of a record */
+
+typedef struct finsCommand
+{
+	epicsUInt8 area;		/* PLC memory area code, zero if the command doesn't address PLC memory */
+	int width;			/* number of 16-bit PLC words per element */
+	int flags;
+	
+} finsCommand;
+
+/*
+	A record's last read or write request, header and command bytes without the write data or the
+	FINS/TCP header. It is sent again with a new SID for as long as the reason, address, size and
+	node addresses don't change.
+*/
+
+#define FINS_TEMPLATE_LEN	(COM + COMMAND_DATA_OFFSET)
+
+typedef struct finsTemplate
+{
+	int reason;			/* FINS_NULL if the template is empty */
+	size_t address, nelements;
+	epicsUInt8 dnode, snode;
+	
+	epicsUInt8 mrc, src;
+	size_t sendlen, recvlen;
+	epicsUInt8 message[FINS_TEMPLATE_LEN];
+	
+} finsTemplate;
+
+/* per asynUser data, created by drvUserCreate */
+
+typedef struct finsUser
+{
+	const finsCommand *pcmd;	/* resolved from drvInfo */
+	
+	size_t nelements;		/* array size of the last read, used when polling I/O Intr arrays */
+	finsTemplate request;		/* see BuildReadMessage */
+	finsTemplate write;		/* see BuildWriteMessage */
+	
+	asynUser *poll;			/* the poller's own asynUser for the record, see IntrShadow */
+	
+	int noresp;			/* writes are sent without waiting for a response, see drvUserCreate */
+	epicsTimeStamp acked;		/* when the PLC last acknowledged one of them */
+	
+	int published;			/* the fields below hold the last I/O Intr callback */
+	asynStatus status;
+	void *last;
+	size_t nbytes, size;
+	
+} finsUser;
+
+/*
+	A contiguous range of PLC memory read by a poller thread in a single Memory Area Read.
+	Reads of addresses inside the range are served from the image instead of the PLC.
+*/
+
+typedef struct finsBlock
+{
+	ELLNODE node;
+	
+	drvPvt *pdrvPvt;
+	asynUser *pasynUser;		/* used by the poller for its FINS requests */
+	
+	int reason;			/* FINS_xx_READ for the memory area */
+	epicsUInt8 area;
+	epicsUInt16 start;
+	epicsUInt16 nwords;
+	double period;
+	
+	int valid;			/* image holds the data from the last successful poll */
+	epicsTimeStamp updated;
+	epicsUInt16 *image;		/* PLC words in host byte order */
+	
+	unsigned long npolls, nerrors, nhits;
+	
+} finsBlock;
+
+/*
+	Read cache. The words of a memory read are kept for ttl seconds, keyed by the area and the
+	range of words, and a read of the same words while one is in flight waits for its result
+	instead of sending another request. Writes update the words they overlap.
+*/
+
+#define FINS_CACHE_BUCKETS	256
+#define FINS_CACHE_MAX_ENTRIES	4096
+
+typedef struct finsCacheEntry
+{
+	ELLNODE node;
+	
+	epicsUInt8 area;
+	epicsUInt16 address;
+	size_t nwords;
+	
+	int valid;			/* image can be served until it is ttl old */
+	int busy;			/* a read is in flight */
+	int dirty;			/* written while the read was in flight */
+	int ok;				/* the last read succeeded */
+	epicsTimeStamp fetched;		/* when the read that filled image was sent */
+	epicsMutexId flight;		/* held by the thread reading from the PLC */
+	epicsUInt16 *image;		/* PLC words in host byte order */
+	
+} finsCacheEntry;
+
+typedef struct finsCache
+{
+	epicsMutexId lock;
+	double ttl;			/* negative if the cache is off */
+	int nentries;
+	ELLLIST bucket[FINS_CACHE_BUCKETS];
+	
+	unsigned long nhits, nshared, nreads, nfull;
+	
+} finsCache;
+
+/*
+	CPU Unit Status Read (0601) and Cycle Time Read (0620) replies. Every field of FINS_CPU_* and
+	FINS_CYCLE_TIME* is decoded from the last reply of its frame while that is younger than the
+	period, so the records of a frame cost one request per period between them.
+*/
+
+#define FINS_STATUS_CPU		0
+#define FINS_STATUS_CYCLE	1
+#define FINS_STATUS_FRAMES	2
+
+typedef struct finsStatusFrame
+{
+	int valid;			/* reply holds a good response */
+	epicsTimeStamp fetched;		/* when the request for it was sent */
+	epicsMutexId flight;		/* held while the frame is read from the PLC and while reply is used */
+	epicsUInt8 reply[FINS_CPU_STATE_LEN];
+	
+	unsigned long nreads, nshared, nerrors;
+	
+} finsStatusFrame;
+
+typedef struct finsStatus
+{
+	double period;
+	asynUser *pasynUser;		/* the status poller's */
+	finsStatusFrame frame[FINS_STATUS_FRAMES];
+	
+} finsStatus;
+
+/*
+	Write combining, see finsWriteCombineInit. Memory writes are put in an image of their area and
+	sent by the flusher in runs of contiguous words, so neighbouring writes share a frame and only
+	the last value written to a word goes to the PLC.
+*/
+
+#define FINS_WQ_AREAS	8			/* memory areas written through one queue */
+#define FINS_WQ_WORDS	0x10000
+#define FINS_WQ_RETRY	1.0			/* seconds at least before a failed flush is tried again */
+
+typedef struct finsWriteArea
+{
+	epicsUInt8 area;
+	int reason;			/* a 16-bit write to the area, used to send its runs */
+	size_t lo, hi;			/* the queued words are in [lo, hi) */
+	epicsUInt16 *image;		/* FINS_WQ_WORDS words in host byte order */
+	epicsUInt8 *queued;		/* a bit per word */
+	
+} finsWriteArea;
+
+typedef struct finsWriteQueue
+{
+	epicsMutexId lock;		/* protects the areas and the counters */
+	epicsMutexId flushLock;		/* one flush at a time, so a word's values go out in order */
+	epicsEventId wakeup;
+	double deadline;		/* seconds a write may wait */
+	size_t nqueued;			/* words waiting */
+	epicsTimeStamp first;		/* when the oldest of them was written */
+	asynUser *pasynUser;		/* the flusher's */
+	int nareas;
+	finsWriteArea areas[FINS_WQ_AREAS];
+	
+	unsigned long nwrites, nsuperseded, nframes, nerrors;
+	
+} finsWriteQueue;
+
+/*
+	Circuit breaker, see finsBreakerInit. After threshold time outs in a row the breaker opens and
+	requests fail without being sent, until a probe read gets a reply.
+*/
+
+typedef struct finsBreaker
+{
+	epicsMutexId lock;
+	int threshold;			/* zero never opens it */
+	double interval;		/* seconds between probes while it is open */
+	int timeouts;			/* in a row */
+	int open;
+	epicsEventId wakeup;
+	asynUser *pasynUser;		/* the probe's */
+	
+	unsigned long ntrips, nrejected, nprobes;
+	
+} finsBreaker;
+
+/*
+	Background connection and node address exchange for FINS/TCP ports, see finsReconnectInit.
+	While a port has no node addresses its requests fail at once and its reconnect thread tries
+	again, waiting twice as long after each failure up to the longest delay.
+*/
+
+typedef struct finsReconnect
+{
+	epicsEventId wakeup;
+	double delay;			/* before the next attempt */
+	
+	unsigned long nattempts, nconnects;
+	
+} finsReconnect;
+
+/*
+	The I/O Intr clients of one interface that a poller reads. The interrupt lock is only held to
+	find the clients and to pass the values on, the reads go through the poller's own asynUser for
+	each record. A client's data is at offset in the poller's buffer.
+*/
+
+typedef struct finsIntrRead
+{
+	void *pinterrupt;		/* used to find the client again */
+	asynUser *shadow;
+	size_t nelements, nread, offset;
+	int eomReason;
+	asynStatus status;
+	
+} finsIntrRead;
+
+typedef struct finsIntrPoll
+{
+	finsIntrRead *reads;
+	size_t nreads, maxreads;
+	char *data;
+	size_t ndata, maxdata;
+	
+} finsIntrPoll;
+
+/*
+	The port poller reads the scalar memory values of its I/O Intr records together with Multiple
+	Memory Area Read, one word per item, instead of one request per record. 32-bit values take two
+	words. The words are sorted and duplicates removed before they are split into frames.
+*/
+
+typedef struct finsMultiWord
+{
+	epicsUInt8 area;
+	epicsUInt16 address;
+	epicsUInt16 value;
+	int status;			/* 0 read, -1 failed, -2 the frame was refused so read the records one at a time */
+	
+} finsMultiWord;
+
+typedef struct finsMultiRead
+{
+	asynUser *pasynUser;
+	asynUser *shadow;		/* the poller's asynUser for the record, see IntrShadow */
+	void *pinterrupt;		/* asynInt32Interrupt or asynFloat64Interrupt */
+	int float64;
+	epicsUInt8 area;
+	epicsUInt16 address;
+	int width;
+	
+	asynStatus status;		/* the value read, passed on once the interrupt lock is taken again */
+	epicsInt32 ivalue;
+	epicsFloat64 fvalue;
+	
+} finsMultiRead;
+
+typedef struct finsMulti
+{
+	asynUser *pasynUser;		/* used by the poller for its FINS requests */
+	int disabled;			/* the PLC doesn't support Multiple Memory Area Read */
+	
+	finsMultiRead *reads;
+	finsMultiWord *words;
+	size_t maxreads;		/* reads has room for maxreads, words for twice that */
+	
+	unsigned long npolls, nframes, nwords, nfallbacks;
+	
+} finsMulti;
+
+/*
+	finsBench. Each client thread runs the operations of the mix in turn through its own asynUsers,
+	as records would, until the time is up.
+*/
+
+#define FINS_BENCH_MAX_OPS		8
+#define FINS_BENCH_MAX_CLIENTS	64
+
+enum { FINS_BENCH_INT32, FINS_BENCH_INT16ARRAY, FINS_BENCH_INT32ARRAY, FINS_BENCH_FLOAT32ARRAY };
+
+typedef struct finsBenchType
+{
+	const char *name;
+	const char *drvInfo;
+	int iface;			/* FINS_BENCH_xx */
+	int write;
+	size_t size;			/* bytes of PLC memory per element */
+	
+} finsBenchType;
+
+typedef struct finsBenchOp
+{
+	const finsBenchType *ptype;
+	size_t nelements;
+	
+	finsHist latency;		/* successful transfers */
+	int errors;
+	
+} finsBenchOp;
+
+typedef struct finsBenchRun
+{
+	const char *portName;
+	int address;
+	int nops;
+	finsBenchOp ops[FINS_BENCH_MAX_OPS];
+	epicsTimeStamp end;
+	
+} finsBenchRun;
+
+typedef struct finsBenchClient
+{
+	finsBenchRun *pbench;
+	int id;
+	asynUser *pasynUser[FINS_BENCH_MAX_OPS];
+	int errors[FINS_BENCH_MAX_OPS];	/* added to the run's once the client is done */
+	epicsEventId done;
+	
+} finsBenchClient;
+
+/* FINS TCP commands and errors */
+
 #define FINS_NODE_CLIENT_COMMAND	0
 #define FINS_NODE_SERVER_COMMAND	1
 #define FINS_FRAME_SEND_COMMAND	2
@@ -0,0 +1,881 @@
+/*
+	FINS PLC emulator
+
+	A host program that answers FINS/UDP and FINS/TCP requests on a local port the way the CPU
+	unit of a PLC does, so that the whole driver - framing, the FINS/TCP node address handshake,
+	SID checks and byte swapping - can be run without a PLC.
+
+	Usage:	finsEmulator [-p port] [-n node] [-l latency] [-j jitter] [-m mtu] [-f loss] [-v]
+
+		-p	UDP and TCP port, default 9600
+		-n	our node address, default is to answer as whatever node the request is sent to
+		-l	response latency in milliseconds added to every reply
+		-j	random extra latency of up to this many milliseconds
+		-m	MTU that UDP datagrams are fragmented on, default 1500
+		-f	percentage of IP fragments lost. A datagram is lost with any of its fragments
+		-v	print every request and reply
+
+	Commands:
+
+		0101	Memory Area Read
+		0102	Memory Area Write
+		0104	Multiple Memory Area Read
+		0502	Connection Data Read
+		0601	CPU Unit Status Read
+		0620	Cycle Time Read
+		0701	Clock Read
+		0801	Echo Test
+		2302	Forced Set/Reset Cancel
+
+	Memory areas are word addressed and start at zero. Bit addressing is not supported, as in the
+	driver.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <cantProceed.h>
+#include <epicsStdio.h>
+#include <epicsTime.h>
+#include <epicsEndian.h>
+#include <epicsThread.h>
+#include <epicsMutex.h>
+#include <epicsEvent.h>
+#include <epicsGetopt.h>
+#include <ellLib.h>
+#include <osiSock.h>
+
+#include <asynDriver.h>
+#include <asynStandardInterfaces.h>
+
+#include "FINS.h"
+
+#define SIM_MAX_WORDS		999				/* largest Memory Area Read a CPU unit accepts */
+#define SIM_MAX_MSG		(RESP + SIM_MAX_WORDS * 2)
+#define SIM_MODEL		"FINS EMULATOR"
+
+/* FINS end codes */
+
+#define SIM_UNDEFINED_COMMAND	0x0401
+#define SIM_COMMAND_TOO_LONG	0x1001
+#define SIM_COMMAND_TOO_SHORT	0x1002
+#define SIM_NO_AREA_TYPE		0x1101
+#define SIM_ADDRESS_RANGE		0x1103
+
+/* PLC memory */
+
+typedef struct simArea
+{
+	epicsUInt8 code;
+	const char *name;
+	size_t nwords;
+	epicsUInt16 *words;		/* host byte order */
+
+} simArea;
+
+static simArea areas[] =
+{
+	{ IO, "CIO", 6144, NULL },
+	{ WR, "WR", 512, NULL },
+	{ HR, "HR", 1536, NULL },
+	{ AR, "AR", 960, NULL },
+	{ CT, "TC", 0x9000, NULL },		/* timers from 0, counters from 0x8000 */
+	{ DM, "DM", 32768, NULL },
+	{ E0, "E0", 32768, NULL }, { E1, "E1", 32768, NULL }, { E2, "E2", 32768, NULL }, { E3, "E3", 32768, NULL },
+	{ E4, "E4", 32768, NULL }, { E5, "E5", 32768, NULL }, { E6, "E6", 32768, NULL }, { E7, "E7", 32768, NULL },
+	{ E8, "E8", 32768, NULL }, { E9, "E9", 32768, NULL }, { EA, "EA", 32768, NULL }, { EB, "EB", 32768, NULL },
+	{ EC, "EC", 32768, NULL }, { ED, "ED", 32768, NULL }, { EE, "EE", 32768, NULL }, { EF, "EF", 32768, NULL }
+};
+
+#define SIM_AREAS	(sizeof(areas) / sizeof(areas[0]))
+
+static epicsMutexId memLock;		/* protects the memory areas and the TCP node allocation */
+
+/* options */
+
+static int verbose = 0;
+static int node = 0;
+static double latency = 0.0, jitter = 0.0;
+static int mtu = 1500;
+static double loss = 0.0;
+
+/* a reply waiting for its latency to expire before it is sent */
+
+typedef struct simReply
+{
+	ELLNODE node;
+
+	epicsTimeStamp due;
+	struct sockaddr_in to;
+	size_t len;
+	epicsUInt8 message[SIM_MAX_MSG];
+
+} simReply;
+
+static SOCKET udp;
+static epicsMutexId replyLock;		/* protects replyQueue and replyFree */
+static epicsEventId replyReady;
+static ELLLIST replyQueue;			/* in order of due time */
+static ELLLIST replyFree;
+
+/**************************************************************************************************/
+
+static simArea *FindArea(const epicsUInt8 code)
+{
+	int i;
+
+	for (i = 0; i < SIM_AREAS; i++)
+	{
+		if (areas[i].code == code)
+		{
+			return (&areas[i]);
+		}
+	}
+
+	return (NULL);
+}
+
+static double Latency(void)
+{
+	return (latency + jitter * rand() / RAND_MAX);
+}
+
+/* whether a UDP datagram is lost, one of its IP fragments at a time */
+
+static int Lost(const size_t len)
+{
+	const size_t payload = (mtu - 20) & ~7;
+	size_t fragments = (len + 8 + payload - 1) / payload;
+
+	while (fragments--)
+	{
+		if (rand() < loss * RAND_MAX)
+		{
+			return (1);
+		}
+	}
+
+	return (0);
+}
+
+static epicsUInt8 BCD(const int value)
+{
+	return (((value / 10) % 10) << 4) | (value % 10);
+}
+
+static void PutWord(epicsUInt8 * const p, const epicsUInt16 value)
+{
+	p[0] = value >> 8;
+	p[1] = value & 0xff;
+}
+
+static void PutLong(epicsUInt8 * const p, const epicsUInt32 value)
+{
+	p[0] = value >> 24;
+	p[1] = value >> 16;
+	p[2] = value >> 8;
+	p[3] = value & 0xff;
+}
+
+static epicsUInt16 GetWord(const epicsUInt8 * const p)
+{
+	return ((p[0] << 8) | p[1]);
+}
+
+/**************************************************************************************************/
+/*
+	Check the area, word address and word count of a memory command.
+*/
+
+static int CheckRange(const epicsUInt8 * const data, const size_t nwords, simArea **parea, size_t *paddress)
+{
+	const size_t address = GetWord(&data[1]);
+
+	if ((*parea = FindArea(data[0])) == NULL)
+	{
+		return (SIM_NO_AREA_TYPE);
+	}
+
+	if ((data[3] != 0) || (address + nwords > (*parea)->nwords))
+	{
+		return (SIM_ADDRESS_RANGE);
+	}
+
+	*paddress = address;
+
+	return (0);
+}
+
+/**************************************************************************************************/
+/*
+	Execute a FINS command and build the reply. len is the length of the request including the
+	FINS header. Returns the length of the reply, or zero if no reply is wanted.
+*/
+
+static size_t Execute(const epicsUInt8 * const request, const size_t len, epicsUInt8 * const reply)
+{
+	const epicsUInt8 * const data = &request[COM];
+	size_t ndata, rlen = RESP;
+	int code = 0;
+
+	if (len < COM)
+	{
+		return (0);
+	}
+	
+	ndata = len - COM;
+
+/* the reply goes back to the source of the request */
+
+	reply[ICF] = (request[ICF] & ~0x01) | 0x40;
+	reply[RSV] = 0x00;
+	reply[GCT] = FINS_GATEWAY;
+	reply[DNA] = request[SNA];
+	reply[DA1] = request[SA1];
+	reply[DA2] = request[SA2];
+	reply[SNA] = request[DNA];
+	reply[SA1] = (node) ? node : request[DA1];
+	reply[SA2] = request[DA2];
+	reply[SID] = request[SID];
+	reply[MRC] = request[MRC];
+	reply[SRC] = request[SRC];
+
+	switch ((request[MRC] << 8) | request[SRC])
+	{
+
+	/* Memory Area Read */
+
+		case 0x0101:
+		{
+			simArea *parea;
+			size_t address, nwords, i;
+
+			if (ndata != COMMAND_DATA_OFFSET)
+			{
+				code = (ndata < COMMAND_DATA_OFFSET) ? SIM_COMMAND_TOO_SHORT : SIM_COMMAND_TOO_LONG;
+				break;
+			}
+
+			if ((nwords = GetWord(&data[4])) > SIM_MAX_WORDS)
+			{
+				code = SIM_COMMAND_TOO_LONG;
+				break;
+			}
+
+			if ((code = CheckRange(data, nwords, &parea, &address)) != 0)
+			{
+				break;
+			}
+
+			epicsMutexMustLock(memLock);
+
+			for (i = 0; i < nwords; i++)
+			{
+				PutWord(&reply[RESP + 2 * i], parea->words[address + i]);
+			}
+
+			epicsMutexUnlock(memLock);
+
+			rlen = RESP + 2 * nwords;
+			break;
+		}
+
+	/* Memory Area Write */
+
+		case 0x0102:
+		{
+			simArea *parea;
+			size_t address, nwords, i;
+
+			if (ndata < COMMAND_DATA_OFFSET)
+			{
+				code = SIM_COMMAND_TOO_SHORT;
+				break;
+			}
+
+			nwords = GetWord(&data[4]);
+
+			if (ndata != COMMAND_DATA_OFFSET + 2 * nwords)
+			{
+				code = (ndata < COMMAND_DATA_OFFSET + 2 * nwords) ? SIM_COMMAND_TOO_SHORT : SIM_COMMAND_TOO_LONG;
+				break;
+			}
+
+			if ((code = CheckRange(data, nwords, &parea, &address)) != 0)
+			{
+				break;
+			}
+
+			epicsMutexMustLock(memLock);
+
+			for (i = 0; i < nwords; i++)
+			{
+				parea->words[address + i] = GetWord(&data[COMMAND_DATA_OFFSET + 2 * i]);
+			}
+
+			epicsMutexUnlock(memLock);
+
+			break;
+		}
+
+	/* Multiple Memory Area Read, one word from each address */
+
+		case 0x0104:
+		{
+			simArea *parea;
+			size_t address, i;
+
+			if ((ndata == 0) || (ndata % 4))
+			{
+				code = SIM_COMMAND_TOO_SHORT;
+				break;
+			}
+
+			epicsMutexMustLock(memLock);
+
+			for (i = 0; i < ndata / 4; i++)
+			{
+				if ((code = CheckRange(&data[4 * i], 1, &parea, &address)) != 0)
+				{
+					break;
+				}
+
+				reply[RESP + 3 * i] = parea->code;
+				PutWord(&reply[RESP + 3 * i + 1], parea->words[address]);
+			}
+
+			epicsMutexUnlock(memLock);
+
+			rlen = (code) ? RESP : RESP + 3 * i;
+			break;
+		}
+
+	/* Connection Data Read, the model of the first unit asked for */
+
+		case 0x0502:
+		{
+			if (ndata < 1)
+			{
+				code = SIM_COMMAND_TOO_SHORT;
+				break;
+			}
+
+			reply[RESP + 0] = 1;
+			reply[RESP + 1] = data[0];
+			memset(&reply[RESP + 2], ' ', FINS_MODEL_LEN);
+			memcpy(&reply[RESP + 2], SIM_MODEL, strlen(SIM_MODEL));
+
+			rlen = RESP + 2 + FINS_MODEL_LEN;
+			break;
+		}
+
+	/* CPU Unit Status Read, running in RUN mode with no errors */
+
+		case 0x0601:
+		{
+			memset(&reply[RESP], 0, FINS_CPU_STATE_LEN);
+			reply[RESP + 0] = 0x01;
+			reply[RESP + 1] = 0x04;
+
+			rlen = RESP + FINS_CPU_STATE_LEN;
+			break;
+		}
+
+	/* Cycle Time Read and reset, mean, max and min in units of 0.1ms */
+
+		case 0x0620:
+		{
+			if (ndata < 1)
+			{
+				code = SIM_COMMAND_TOO_SHORT;
+				break;
+			}
+
+			if (data[0] == 0x01)
+			{
+				PutLong(&reply[RESP + 0], 10);
+				PutLong(&reply[RESP + 4], 12);
+				PutLong(&reply[RESP + 8], 8);
+
+				rlen = RESP + FINS_CYCLE_TIME_LEN * sizeof(epicsUInt32);
+			}
+
+			break;
+		}
+
+	/* Clock Read, BCD */
+
+		case 0x0701:
+		{
+			epicsTimeStamp now;
+			unsigned long nsec;
+			struct tm tm;
+
+			epicsTimeGetCurrent(&now);
+			epicsTimeToTM(&tm, &nsec, &now);
+
+			reply[RESP + 0] = BCD(tm.tm_year);
+			reply[RESP + 1] = BCD(tm.tm_mon + 1);
+			reply[RESP + 2] = BCD(tm.tm_mday);
+			reply[RESP + 3] = BCD(tm.tm_hour);
+			reply[RESP + 4] = BCD(tm.tm_min);
+			reply[RESP + 5] = BCD(tm.tm_sec);
+			reply[RESP + 6] = BCD(tm.tm_wday);
+
+			rlen = RESP + FINS_CLOCK_READ_LEN;
+			break;
+		}
+
+	/* Echo Test */
+
+		case 0x0801:
+		{
+			if (ndata > SIM_MAX_MSG - RESP)
+			{
+				code = SIM_COMMAND_TOO_LONG;
+				break;
+			}
+
+			memcpy(&reply[RESP], data, ndata);
+
+			rlen = RESP + ndata;
+			break;
+		}
+
+	/* Forced Set/Reset Cancel, nothing is ever forced */
+
+		case 0x2302:
+		{
+			break;
+		}
+
+		default:
+		{
+			code = SIM_UNDEFINED_COMMAND;
+			break;
+		}
+	}
+
+	reply[MRES] = code >> 8;
+	reply[SRES] = code & 0xff;
+
+	if (verbose)
+	{
+		printf("SID %02x command %02x%02x from node %u, %lu bytes, end code %04x, %lu bytes\n", request[SID], request[MRC], request[SRC], request[SA1], (unsigned long) len, code, (unsigned long) ((code) ? RESP : rlen));
+	}
+
+/* ICF bit 0 set means the command is carried out without a response */
+
+	if (request[ICF] & 0x01)
+	{
+		return (0);
+	}
+
+	return ((code) ? RESP : rlen);
+}
+
+/**************************************************************************************************/
+/*
+	FINS/UDP
+
+	Replies are queued by the receive thread with the time they are due, and sent by the reply
+	thread, so requests keep being accepted while earlier ones wait out their latency.
+*/
+
+static simReply *ReplyGet(void)
+{
+	simReply *preply;
+
+	epicsMutexMustLock(replyLock);
+	preply = (simReply *) ellGet(&replyFree);
+	epicsMutexUnlock(replyLock);
+
+	return ((preply) ? preply : callocMustSucceed(1, sizeof(simReply), __func__));
+}
+
+static void ReplyQueue(simReply * const preply)
+{
+	simReply *pnext;
+
+	epicsMutexMustLock(replyLock);
+
+	for (pnext = (simReply *) ellFirst(&replyQueue); pnext; pnext = (simReply *) ellNext(&pnext->node))
+	{
+		if (epicsTimeDiffInSeconds(&pnext->due, &preply->due) > 0.0)
+		{
+			break;
+		}
+	}
+
+	ellInsert(&replyQueue, (pnext) ? ellPrevious(&pnext->node) : ellLast(&replyQueue), &preply->node);
+
+	epicsMutexUnlock(replyLock);
+
+	epicsEventSignal(replyReady);
+}
+
+static void UDPReply(void *arg)
+{
+	for (;;)
+	{
+		simReply *preply;
+		epicsTimeStamp now;
+		double wait;
+
+		epicsMutexMustLock(replyLock);
+
+		if ((preply = (simReply *) ellFirst(&replyQueue)) == NULL)
+		{
+			epicsMutexUnlock(replyLock);
+			epicsEventMustWait(replyReady);
+			continue;
+		}
+
+		epicsTimeGetCurrent(&now);
+
+		if ((wait = epicsTimeDiffInSeconds(&preply->due, &now)) > 0.0)
+		{
+			epicsMutexUnlock(replyLock);
+			epicsEventWaitWithTimeout(replyReady, wait);
+			continue;
+		}
+
+		ellDelete(&replyQueue, &preply->node);
+		epicsMutexUnlock(replyLock);
+
+		if (Lost(preply->len))
+		{
+			if (verbose)
+			{
+				printf("reply of %lu bytes lost\n", (unsigned long) preply->len);
+			}
+		}
+		else if (sendto(udp, (char *) preply->message, preply->len, 0, (struct sockaddr *) &preply->to, sizeof(preply->to)) < 0)
+		{
+			perror("finsEmulator: sendto");
+		}
+
+		epicsMutexMustLock(replyLock);
+		ellAdd(&replyFree, &preply->node);
+		epicsMutexUnlock(replyLock);
+	}
+}
+
+static void UDPServer(void *arg)
+{
+	epicsUInt8 request[SIM_MAX_MSG];
+
+	for (;;)
+	{
+		simReply *preply = ReplyGet();
+		osiSocklen_t addrlen = sizeof(preply->to);
+		int len;
+
+		if ((len = recvfrom(udp, (char *) request, sizeof(request), 0, (struct sockaddr *) &preply->to, &addrlen)) < 0)
+		{
+			perror("finsEmulator: recvfrom");
+			epicsThreadSleep(1.0);
+		}
+		else if (Lost(len))
+		{
+			if (verbose)
+			{
+				printf("request of %d bytes lost\n", len);
+			}
+		}
+		else if ((preply->len = Execute(request, len, preply->message)) > 0)
+		{
+			epicsTimeGetCurrent(&preply->due);
+			epicsTimeAddSeconds(&preply->due, Latency());
+
+			ReplyQueue(preply);
+			continue;
+		}
+
+		epicsMutexMustLock(replyLock);
+		ellAdd(&replyFree, &preply->node);
+		epicsMutexUnlock(replyLock);
+	}
+}
+
+/**************************************************************************************************/
+/*
+	FINS/TCP
+
+	Each client gets a thread of its own. The client must send the FINS Node Address Data Send
+	command first, and is given a node address if it asks for node 0.
+*/
+
+static int RecvAll(const SOCKET fd, void *buffer, const size_t len)
+{
+	size_t done = 0;
+
+	while (done < len)
+	{
+		const int n = recv(fd, (char *) buffer + done, len - done, 0);
+
+		if (n <= 0)
+		{
+			return (-1);
+		}
+
+		done += n;
+	}
+
+	return (0);
+}
+
+static int SendFrame(const SOCKET fd, const unsigned int command, const unsigned int error, const void *data, const size_t len)
+{
+	epicsUInt8 frame[FINS_SEND_FRAME_SIZE + SIM_MAX_MSG];
+
+	PutLong(&frame[0], FINS_TCP_HEADER);
+	PutLong(&frame[4], 8 + len);
+	PutLong(&frame[8], command);
+	PutLong(&frame[12], error);
+	memcpy(&frame[FINS_SEND_FRAME_SIZE], data, len);
+
+	return ((send(fd, (char *) frame, FINS_SEND_FRAME_SIZE + len, 0) == FINS_SEND_FRAME_SIZE + len) ? 0 : -1);
+}
+
+static void TCPClient(void *arg)
+{
+	static epicsUInt8 nextNode = 1;
+	const SOCKET fd = (SOCKET) (size_t) arg;
+	epicsUInt8 request[SIM_MAX_MSG], reply[SIM_MAX_MSG];
+	unsigned int client = 0;
+
+	for (;;)
+	{
+		epicsUInt8 header[FINS_SEND_FRAME_SIZE];
+		unsigned int magic, length, command;
+
+		if (RecvAll(fd, header, sizeof(header)) < 0)
+		{
+			break;
+		}
+
+		magic   = (header[0]  << 24) | (header[1]  << 16) | (header[2]  << 8) | header[3];
+		length  = (header[4]  << 24) | (header[5]  << 16) | (header[6]  << 8) | header[7];
+		command = (header[8]  << 24) | (header[9]  << 16) | (header[10] << 8) | header[11];
+
+		if (magic != FINS_TCP_HEADER)
+		{
+			SendFrame(fd, FINS_FRAME_SEND_ERROR, FINS_ERROR_HEADER, NULL, 0);
+			break;
+		}
+
+		if ((length < 8) || (length - 8 > sizeof(request)))
+		{
+			SendFrame(fd, FINS_FRAME_SEND_ERROR, FINS_ERROR_TOO_LONG, NULL, 0);
+			break;
+		}
+
+		if (RecvAll(fd, request, length - 8) < 0)
+		{
+			break;
+		}
+
+		if ((command == FINS_NODE_CLIENT_COMMAND) && (length == 12))
+		{
+			epicsUInt8 nodes[8];
+
+			client = (request[0] << 24) | (request[1] << 16) | (request[2] << 8) | request[3];
+
+		/* automatic allocation, skipping our own node */
+
+			if (client == 0)
+			{
+				epicsMutexMustLock(memLock);
+
+				do
+				{
+					client = nextNode;
+					nextNode = nextNode % 254 + 1;
+					
+				} while (client == ((node) ? node : 1));
+
+				epicsMutexUnlock(memLock);
+			}
+
+			PutLong(&nodes[0], client);
+			PutLong(&nodes[4], (node) ? node : 1);
+
+			if (verbose)
+			{
+				printf("TCP client is node %u\n", client);
+			}
+
+			if (SendFrame(fd, FINS_NODE_SERVER_COMMAND, FINS_ERROR_NORMAL, nodes, sizeof(nodes)) < 0)
+			{
+				break;
+			}
+		}
+		else if ((command == FINS_FRAME_SEND_COMMAND) && client)
+		{
+			const size_t rlen = Execute(request, length - 8, reply);
+
+			if (rlen == 0)
+			{
+				continue;
+			}
+
+			epicsThreadSleep(Latency());
+
+			if (SendFrame(fd, FINS_FRAME_SEND_COMMAND, FINS_ERROR_NORMAL, reply, rlen) < 0)
+			{
+				break;
+			}
+		}
+		else
+		{
+			SendFrame(fd, FINS_FRAME_SEND_ERROR, FINS_ERROR_NOT_SUPPORTED, NULL, 0);
+			break;
+		}
+	}
+
+	if (verbose)
+	{
+		printf("TCP client node %u disconnected\n", client);
+	}
+
+	epicsSocketDestroy(fd);
+}
+
+static void TCPServer(void *arg)
+{
+	const SOCKET listener = (SOCKET) (size_t) arg;
+
+	for (;;)
+	{
+		struct sockaddr_in addr;
+		osiSocklen_t addrlen = sizeof(addr);
+		SOCKET fd;
+
+		if ((fd = accept(listener, (struct sockaddr *) &addr, &addrlen)) == INVALID_SOCKET)
+		{
+			perror("finsEmulator: accept");
+			epicsThreadSleep(1.0);
+			continue;
+		}
+
+		epicsThreadMustCreate("finsEmuTCP", epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackMedium), TCPClient, (void *) (size_t) fd);
+	}
+}
+
+/**************************************************************************************************/
+
+static SOCKET OpenSocket(const int type, const unsigned short port)
+{
+	struct sockaddr_in addr;
+	SOCKET fd;
+
+	if ((fd = epicsSocketCreate(AF_INET, type, 0)) == INVALID_SOCKET)
+	{
+		perror("finsEmulator: socket");
+		return (INVALID_SOCKET);
+	}
+
+	if (type == SOCK_STREAM)
+	{
+		epicsSocketEnableAddressReuseDuringTimeWaitState(fd);
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_ANY);
+	addr.sin_port = htons(port);
+
+	if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0)
+	{
+		perror("finsEmulator: bind");
+		epicsSocketDestroy(fd);
+		return (INVALID_SOCKET);
+	}
+
+	if ((type == SOCK_STREAM) && (listen(fd, 10) < 0))
+	{
+		perror("finsEmulator: listen");
+		epicsSocketDestroy(fd);
+		return (INVALID_SOCKET);
+	}
+
+	return (fd);
+}
+
+static void Usage(void)
+{
+	fprintf(stderr, "usage: finsEmulator [-p port] [-n node] [-l latency ms] [-j jitter ms] [-m mtu] [-f loss %%] [-v]\n");
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned short port = FINS_NET_PORT;
+	SOCKET tcp;
+	int i, opt;
+
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	while ((opt = getopt(argc, argv, "p:n:l:j:m:f:v")) != -1)
+	{
+		switch (opt)
+		{
+			case 'p':	port = atoi(optarg);			break;
+			case 'n':	node = atoi(optarg);			break;
+			case 'l':	latency = atof(optarg) / 1000.0;	break;
+			case 'j':	jitter = atof(optarg) / 1000.0;	break;
+			case 'm':	mtu = atoi(optarg);			break;
+			case 'f':	loss = atof(optarg) / 100.0;		break;
+			case 'v':	verbose = 1;				break;
+
+			default:
+			{
+				Usage();
+				return (1);
+			}
+		}
+	}
+
+	if ((optind < argc) || (node < 0) || (node > 254) || (latency < 0.0) || (jitter < 0.0) || (mtu < 68) || (loss < 0.0) || (loss > 1.0))
+	{
+		Usage();
+		return (1);
+	}
+
+	for (i = 0; i < SIM_AREAS; i++)
+	{
+		areas[i].words = callocMustSucceed(areas[i].nwords, sizeof(epicsUInt16), __func__);
+	}
+
+	memLock = epicsMutexMustCreate();
+	replyLock = epicsMutexMustCreate();
+	replyReady = epicsEventMustCreate(epicsEventEmpty);
+	ellInit(&replyQueue);
+	ellInit(&replyFree);
+
+	if (osiSockAttach() == 0)
+	{
+		fprintf(stderr, "finsEmulator: can't initialise sockets\n");
+		return (1);
+	}
+
+	if (((udp = OpenSocket(SOCK_DGRAM, port)) == INVALID_SOCKET) || ((tcp = OpenSocket(SOCK_STREAM, port)) == INVALID_SOCKET))
+	{
+		return (1);
+	}
+
+	epicsThreadMustCreate("finsEmuReply", epicsThreadPriorityHigh, epicsThreadGetStackSize(epicsThreadStackMedium), UDPReply, NULL);
+	epicsThreadMustCreate("finsEmuUDP", epicsThreadPriorityHigh, epicsThreadGetStackSize(epicsThreadStackBig), UDPServer, NULL);
+	epicsThreadMustCreate("finsEmuTCP", epicsThreadPriorityMedium, epicsThreadGetStackSize(epicsThreadStackMedium), TCPServer, (void *) (size_t) tcp);
+
+	printf("finsEmulator: FINS/UDP and FINS/TCP on port %u, node %d, latency %g ms, jitter %g ms\n", port, node, latency * 1000.0, jitter * 1000.0);
+
+	for (;;)
+	{
+		epicsThreadSleep(60.0);
+	}
+
+	return (0);
+}
@@ -10,6 +10,8 @@
 #include <epicsStdio.h>
 #include <epicsString.h>
 #include <epicsTypes.h>
+#include <epicsTime.h>
+#include <epicsThread.h>
 #include <iocsh.h>
 #include <osiUnistd.h>
 #include <osiSock.h>
@@ -53,19 +55,103 @@ typedef struct interposePvt
 	char fins_header[FINS_HEADER_LEN];
 	size_t bufferSize;
 	
+	int cmode;			/* use C-mode commands where possible */
+	char command[2];		/* C-mode command of the last request, zero if it was sent as FINS */
+	epicsUInt8 mrc, src;		/* FINS command codes of the last request */
+	
 } interposePvt;
 
 /******************************************************************************/
+/*
+	Table driven hex conversion. The FCS, a simple xor of the characters, is calculated as the
+	characters are written or read instead of in a separate pass.
+*/
 
-/* a simple xor checksum */
+#define HOST_HEADER		"@00FA000000000"		/* short hostlink/fins header */
+#define HEX_INVALID		0xff
+
+static const char hexDigits[] = "0123456789ABCDEF";
+static epicsUInt8 hexValues[256];
+static unsigned char hostHeaderFcs;
+
+/* filled once, as refilling the table under a running port would fail its valid replies */
 
-static unsigned char checksum(const char *m)
+static epicsThreadOnceId hexOnce = EPICS_THREAD_ONCE_INIT;
+
+static void HexInit(void *arg)
 {
-	const int len = strlen(m);
 	int i;
-	unsigned char k = m[0];
 	
-	for (i = 1; i < len; i++)
+	memset(hexValues, HEX_INVALID, sizeof(hexValues));
+	
+	for (i = 0; i < 16; i++)
+	{
+		hexValues[(unsigned char) hexDigits[i]] = i;
+	}
+	
+	for (i = 10; i < 16; i++)
+	{
+		hexValues['a' + i - 10] = i;
+	}
+	
+	hostHeaderFcs = 0;
+	
+	for (i = 0; i < HOST_HEADER_LEN; i++)
+	{
+		hostHeaderFcs ^= HOST_HEADER[i];
+	}
+}
+
+/* write 2 * n hex characters to dst and return the FCS updated with them */
+
+static unsigned char HexEncode(char *dst, const epicsUInt8 *src, const size_t n, unsigned char fcs)
+{
+	size_t i;
+	
+	for (i = 0; i < n; i++)
+	{
+		const char hi = hexDigits[src[i] >> 4];
+		const char lo = hexDigits[src[i] & 0x0f];
+		
+		*dst++ = hi;
+		*dst++ = lo;
+		
+		fcs ^= hi ^ lo;
+	}
+	
+	return (fcs);
+}
+
+/* convert 2 * n hex characters to n bytes, return -1 if a character isn't a hex digit */
+
+static int HexDecode(epicsUInt8 *dst, const char *src, const size_t n)
+{
+	size_t i;
+	
+	for (i = 0; i < n; i++)
+	{
+		const epicsUInt8 hi = hexValues[(unsigned char) *src++];
+		const epicsUInt8 lo = hexValues[(unsigned char) *src++];
+		
+		if ((hi | lo) == HEX_INVALID)
+		{
+			return (-1);
+		}
+		
+		dst[i] = (hi << 4) | lo;
+	}
+	
+	return (0);
+}
+
+/* a simple xor checksum */
+
+static unsigned char checksum(const char *m, const size_t len)
+{
+	size_t i;
+	unsigned char k = 0;
+	
+	for (i = 0; i < len; i++)
 	{
 		k ^= m[i];
 	}
@@ -74,28 +160,19 @@ static unsigned char checksum(const char *m)
 }
 
 /******************************************************************************/
-/* vxWorks doesn't like %2hhx */
 
 static int extractAndCompareChecksum(interposePvt * const pdrvPvt, const size_t pos)
 {
-#ifdef vxWorks
-	unsigned short kcalc, krecv;
-#else
-	unsigned char kcalc, krecv;
-#endif
+	epicsUInt8 krecv;
 
 /* extract the received checksum */
 
-#ifdef vxWorks	
-	sscanf(&pdrvPvt->buffer[pos], "%2hx", &krecv);
-#else
-	sscanf(&pdrvPvt->buffer[pos], "%2hhx", &krecv);
-#endif
+	if (HexDecode(&krecv, &pdrvPvt->buffer[pos], 1) < 0)
+	{
+		return (-1);
+	}
 
-	pdrvPvt->buffer[pos] = 0;
-	kcalc = checksum(pdrvPvt->buffer);
-	
-	if (kcalc != krecv)
+	if (checksum(pdrvPvt->buffer, pos) != krecv)
 	{
 		return (-1);
 	}
@@ -104,8 +181,137 @@ static int extractAndCompareChecksum(interposePvt * const pdrvPvt, const size_t
 }
 
 /******************************************************************************/
+/*
+	Hostlink C-mode
+	
+	Word reads and writes of DM, CIO, HR and AR which fit in a single Hostlink frame are sent as
+	the native RD/WD, RR/WR, RH/WH and RJ/WJ commands instead of FINS commands. The reply is turned
+	back into the FINS response the driver expects.
+	
+	@00RD0100000255*		read 2 words from D100
+	@00RD000000000157*		reply, D100 = 0 and D101 = 1
+*/
+
+#define HOST_CMODE_HEADER_LEN		5		/* @00RD */
+#define HOST_CMODE_HEADER_LEN_RESP	7		/* @00RD00 */
+#define HOST_CMODE_MAX_WORDS		29		/* words that fit in a single frame */
+#define HOST_CMODE_MAX_ADDR		9999
+
+/* build the C-mode request in pPvt->buffer, return its length or zero if it can't be done in C-mode */
+
+static size_t CmodeRequest(interposePvt * const pPvt, const epicsUInt8 *fins, const size_t numchars)
+{
+	unsigned int address, nwords;
+	unsigned char fcs;
+	size_t len;
+	char area;
+	
+	if ((numchars < COM + COMMAND_DATA_OFFSET) || (fins[MRC] != 0x01) || (fins[COM + 3] != 0x00))
+	{
+		return (0);
+	}
+	
+	switch (fins[COM])
+	{
+		case DM:	area = 'D';	break;
+		case IO:	area = 'R';	break;
+		case HR:	area = 'H';	break;
+		case AR:	area = 'J';	break;
+		
+		default:
+		{
+			return (0);
+		}
+	}
+	
+	address = (fins[COM + 1] << 8) | fins[COM + 2];
+	nwords  = (fins[COM + 4] << 8) | fins[COM + 5];
+	
+	if ((nwords < 1) || (nwords > HOST_CMODE_MAX_WORDS) || (address + nwords - 1 > HOST_CMODE_MAX_ADDR))
+	{
+		return (0);
+	}
+	
+	switch (fins[SRC])
+	{
+		case 0x01:
+		{
+			pPvt->command[0] = 'R';
+			len = epicsSnprintf(pPvt->buffer, sizeof(pPvt->buffer), "@00R%c%04u%04u", area, address, nwords);
+			fcs = checksum(pPvt->buffer, len);
+			
+			break;
+		}
+		
+		case 0x02:
+		{
+			if (numchars != COM + COMMAND_DATA_OFFSET + 2 * nwords)
+			{
+				return (0);
+			}
+			
+			pPvt->command[0] = 'W';
+			len = epicsSnprintf(pPvt->buffer, sizeof(pPvt->buffer), "@00W%c%04u", area, address);
+			fcs = HexEncode(pPvt->buffer + len, fins + COM + COMMAND_DATA_OFFSET, 2 * nwords, checksum(pPvt->buffer, len));
+			len += 4 * nwords;
+			
+			break;
+		}
+		
+		default:
+		{
+			return (0);
+		}
+	}
+	
+	pPvt->command[1] = area;
+	
+	pPvt->buffer[len++] = hexDigits[fcs >> 4];
+	pPvt->buffer[len++] = hexDigits[fcs & 0x0f];
+	pPvt->buffer[len++] = '*';
+	pPvt->buffer[len++] = '\r';
+	
+	return (len);
+}
 
-epicsShareFunc int HostlinkInterposeInit(const char *portName)
+/* check the C-mode reply in pPvt->buffer and convert its data, return the number of bytes or -1 */
+
+static int CmodeResponse(interposePvt * const pPvt, asynUser *pasynUser, epicsUInt8 *data, const size_t maxbytes, const size_t bytesTransfered)
+{
+	epicsUInt8 endcode;
+	size_t nbytes;
+	
+	if ((pPvt->buffer[3] != pPvt->command[0]) || (pPvt->buffer[4] != pPvt->command[1]))
+	{
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, reply to the wrong command %.2s.\n", __func__, pPvt->portName, &pPvt->buffer[3]);
+		return (-1);
+	}
+	
+	if ((HexDecode(&endcode, &pPvt->buffer[HOST_CMODE_HEADER_LEN], 1) < 0) || (endcode != 0x00))
+	{
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, Hostlink end code %.2s.\n", __func__, pPvt->portName, &pPvt->buffer[HOST_CMODE_HEADER_LEN]);
+		return (-1);
+	}
+	
+	nbytes = (bytesTransfered - HOST_CMODE_HEADER_LEN_RESP - 3) / 2;
+	
+	if (nbytes > maxbytes)
+	{
+		nbytes = maxbytes;
+	}
+	
+	if (HexDecode(data, pPvt->buffer + HOST_CMODE_HEADER_LEN_RESP, nbytes) < 0)
+	{
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, illegal character in response.\n", __func__, pPvt->portName);
+		return (-1);
+	}
+	
+	return (nbytes);
+}
+
+/******************************************************************************/
+
+epicsShareFunc int HostlinkInterposeInit(const char *portName, const int cmode)
 {
 	interposePvt *pPvt;
 	asynInterface *poctetasynInterface;
@@ -113,8 +319,11 @@ epicsShareFunc int HostlinkInterposeInit(const char *portName)
 	asynUser *pasynUser;
 	int addr = 0;
 	
+	epicsThreadOnce(&hexOnce, HexInit, NULL);
+	
 	pPvt = callocMustSucceed(1, sizeof(*pPvt), __func__);
 	pPvt->portName = epicsStrDup(portName);
+	pPvt->cmode = cmode;
 	
 	pPvt->octet.interfaceType = asynOctetType;
 	pPvt->octet.pinterface = &octet;
@@ -183,26 +392,42 @@ static asynStatus interposeWrite(void *ppvt, asynUser *pasynUser, const char *da
 {
 	interposePvt * const pPvt = (interposePvt *) ppvt;
 	asynStatus status = asynSuccess;
-	size_t bytesTransfered;
-	int i;
+	size_t bytesTransfered, len;
+	unsigned char fcs;
+	
+	if ((numchars < FINS_HEADER_LEN) || (HOST_HEADER_LEN + 2 * (numchars - FINS_HEADER_LEN) + 4 > sizeof(pPvt->buffer)))
+	{
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, can't send %lu bytes.\n", __func__, pPvt->portName, (unsigned long) numchars);
+		return (asynError);
+	}
 	
 	memcpy(pPvt->fins_header, data, FINS_HEADER_LEN);	/* save the fins header */
 	
-	memset(pPvt->buffer, 0, sizeof(pPvt->buffer));		/* clear buffer */
-	strcpy(pPvt->buffer, "@00FA000000000");			/* short hostlink/fins header */
+	pPvt->command[0] = 0;
+	pPvt->mrc = data[MRC];
+	pPvt->src = data[SRC];
 	
-	for (i = 0; i < numchars - FINS_HEADER_LEN; i++)
+	if (pPvt->cmode && ((len = CmodeRequest(pPvt, (const epicsUInt8 *) data, numchars)) > 0))
 	{
-		sprintf(pPvt->buffer + HOST_HEADER_LEN + 2 * i, "%02X", (unsigned char) data[FINS_HEADER_LEN + i]);
+		status = pPvt->pasynOctet->write(pPvt->octetPvt, pasynUser, pPvt->buffer, len, &bytesTransfered);
+		
+		*nbytesTransfered = numchars;
+		return (status);
 	}
 	
-/* calculate and add checksum */
+	memcpy(pPvt->buffer, HOST_HEADER, HOST_HEADER_LEN);
 	
-	sprintf(pPvt->buffer + HOST_HEADER_LEN + 2 * (numchars - FINS_HEADER_LEN), "%02X*\r", checksum(pPvt->buffer));
+/* convert FINS to HOSTLINK, calculating the checksum as we go */
 
-/* convert FINS to HOSTLINK */
+	fcs = HexEncode(pPvt->buffer + HOST_HEADER_LEN, (const epicsUInt8 *) data + FINS_HEADER_LEN, numchars - FINS_HEADER_LEN, hostHeaderFcs);
+	len = HOST_HEADER_LEN + 2 * (numchars - FINS_HEADER_LEN);
+	
+	pPvt->buffer[len++] = hexDigits[fcs >> 4];
+	pPvt->buffer[len++] = hexDigits[fcs & 0x0f];
+	pPvt->buffer[len++] = '*';
+	pPvt->buffer[len++] = '\r';
 
-	status = pPvt->pasynOctet->write(pPvt->octetPvt, pasynUser, pPvt->buffer, strlen(pPvt->buffer), &bytesTransfered);
+	status = pPvt->pasynOctet->write(pPvt->octetPvt, pasynUser, pPvt->buffer, len, &bytesTransfered);
 
 	*nbytesTransfered = numchars;
 	return (status);
@@ -214,8 +439,7 @@ static asynStatus interposeRead(void *ppvt, asynUser *pasynUser, char *data, siz
 {
 	interposePvt *pPvt = (interposePvt *) ppvt;
 	asynStatus status = asynSuccess;
-	size_t bytesTransfered;
-	int i;
+	size_t bytesTransfered, nbytes;
 	
 	asynPrint(pasynUser, ASYN_TRACEIO_DRIVER, "%s: requesting %lu bytes\n", __func__, (unsigned long) maxchars);
 
@@ -230,6 +454,12 @@ static asynStatus interposeRead(void *ppvt, asynUser *pasynUser, char *data, siz
 	
 /* if the response is complete then it will end with the checksum plus an '*' */
 
+	if ((bytesTransfered < (pPvt->command[0] ? HOST_CMODE_HEADER_LEN_RESP : HOST_HEADER_LEN_RESP) + 3) || (maxchars < RESP))
+	{
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, short response of %lu bytes.\n", __func__, pPvt->portName, (unsigned long) bytesTransfered);
+		return (asynError);
+	}
+	
 	if (extractAndCompareChecksum(pPvt, bytesTransfered - 3) < 0)
 	{
 		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, checksum error.\n", __func__,pPvt ->portName);
@@ -251,17 +481,43 @@ static asynStatus interposeRead(void *ppvt, asynUser *pasynUser, char *data, siz
 		x = data[DNA]; data[DNA] = data[SNA]; data[SNA] = x;
 	}
 	
-/* convert ASCII to binary */
+/* convert ASCII to binary. A C-mode reply has no FINS command codes so we add them */
 
-	for (i = 0; i < bytesTransfered - HOST_HEADER_LEN_RESP - 2; i++)
+	if (pPvt->command[0])
 	{
-		unsigned short aa;
+		int n;
+		
+		if ((n = CmodeResponse(pPvt, pasynUser, (epicsUInt8 *) data + RESP, maxchars - RESP, bytesTransfered)) < 0)
+		{
+			return (asynError);
+		}
+		
+		data[MRC] = pPvt->mrc;
+		data[SRC] = pPvt->src;
+		data[MRES] = 0x00;
+		data[SRES] = 0x00;
+		
+		asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, pPvt->buffer, bytesTransfered, "%s: received %lu bytes of %lu.\n", __func__, (unsigned long) bytesTransfered, (unsigned long) maxchars);
 		
-		sscanf(pPvt->buffer + HOST_HEADER_LEN_RESP + 2 * i, "%02hx", &aa);
-		data[FINS_HEADER_LEN + i] = aa;
+		*nbytesTransfered = maxchars;
+		
+		return (asynSuccess);
+	}
+	
+	nbytes = (bytesTransfered - HOST_HEADER_LEN_RESP - 3) / 2;
+	
+	if (nbytes > maxchars - FINS_HEADER_LEN)
+	{
+		nbytes = maxchars - FINS_HEADER_LEN;
+	}
+	
+	if (HexDecode((epicsUInt8 *) data + FINS_HEADER_LEN, pPvt->buffer + HOST_HEADER_LEN_RESP, nbytes) < 0)
+	{
+		asynPrint(pasynUser, ASYN_TRACE_ERROR, "%s: port %s, illegal character in response.\n", __func__, pPvt->portName);
+		return (asynError);
 	}
 
-	asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, pPvt->buffer, *nbytesTransfered, "%s: received %lu bytes of %lu.\n", __func__, (unsigned long) bytesTransfered, (unsigned long) maxchars);
+	asynPrintIO(pasynUser, ASYN_TRACEIO_DRIVER, pPvt->buffer, bytesTransfered, "%s: received %lu bytes of %lu.\n", __func__, (unsigned long) bytesTransfered, (unsigned long) maxchars);
 
 	*nbytesTransfered	= maxchars;
 	
@@ -315,12 +571,13 @@ static asynStatus getOutputEos(void *ppvt, asynUser *pasynUser, char *eos, int e
 /* register interposeInterfaceInit */
 
 static const iocshArg interposeInterfaceInitArg0 = { "portName", iocshArgString };
-static const iocshArg *interposeInterfaceInitArgs[] = { &interposeInterfaceInitArg0};
-static const iocshFuncDef interposeInterfaceInitFuncDef = {"HostlinkInterposeInit", 1, interposeInterfaceInitArgs};
+static const iocshArg interposeInterfaceInitArg1 = { "C-mode", iocshArgInt };
+static const iocshArg *interposeInterfaceInitArgs[] = { &interposeInterfaceInitArg0, &interposeInterfaceInitArg1};
+static const iocshFuncDef interposeInterfaceInitFuncDef = {"HostlinkInterposeInit", 2, interposeInterfaceInitArgs};
 
 static void interposeInterfaceInitCallFunc(const iocshArgBuf *args)
 {
-	HostlinkInterposeInit(args[0].sval);
+	HostlinkInterposeInit(args[0].sval, args[1].ival);
 }
 
 static void HostlinkInterposeRegister(void)
@@ -335,3 +592,129 @@ static void HostlinkInterposeRegister(void)
 }
 
 epicsExportRegistrar(HostlinkInterposeRegister);
+
+/**************************************************************************************************/
+/*
+	Measure the hex conversion used for Hostlink messages against the sprintf/sscanf conversion
+	it replaced.
+	
+	HostlinkHexBench(536, 10000)
+*/
+
+int HostlinkHexBench(const int nbytes, const int iterations)
+{
+	epicsUInt8 *bin, *out;
+	char *hex;
+	epicsTimeStamp ts, te;
+	double tenc, tdec, tsprintf, tsscanf;
+	unsigned char fcs = 0;
+	int i, n;
+	
+	if ((nbytes < 1) || (iterations < 1))
+	{
+		printf("usage: HostlinkHexBench <bytes> <iterations>\n");
+		return (-1);
+	}
+	
+	epicsThreadOnce(&hexOnce, HexInit, NULL);
+	
+	bin = (epicsUInt8 *) callocMustSucceed(nbytes, sizeof(epicsUInt8), __func__);
+	out = (epicsUInt8 *) callocMustSucceed(nbytes, sizeof(epicsUInt8), __func__);
+	hex = (char *) callocMustSucceed(2 * nbytes + 1, sizeof(char), __func__);
+	
+	for (i = 0; i < nbytes; i++)
+	{
+		bin[i] = i * 7;
+	}
+	
+	epicsTimeGetCurrent(&ts);
+	
+	for (n = 0; n < iterations; n++)
+	{
+		fcs ^= HexEncode(hex, bin, nbytes, 0);
+	}
+	
+	epicsTimeGetCurrent(&te);
+	tenc = epicsTimeDiffInSeconds(&te, &ts);
+	
+	epicsTimeGetCurrent(&ts);
+	
+	for (n = 0; n < iterations; n++)
+	{
+		HexDecode(out, hex, nbytes);
+	}
+	
+	epicsTimeGetCurrent(&te);
+	tdec = epicsTimeDiffInSeconds(&te, &ts);
+	
+	if (memcmp(bin, out, nbytes) != 0)
+	{
+		printf("HostlinkHexBench: decoded data doesn't match\n");
+	}
+	
+/* the old conversions */
+
+	epicsTimeGetCurrent(&ts);
+	
+	for (n = 0; n < iterations; n++)
+	{
+		for (i = 0; i < nbytes; i++)
+		{
+			sprintf(hex + 2 * i, "%02X", bin[i]);
+		}
+		
+		fcs ^= checksum(hex, strlen(hex));
+	}
+	
+	epicsTimeGetCurrent(&te);
+	tsprintf = epicsTimeDiffInSeconds(&te, &ts);
+	
+	epicsTimeGetCurrent(&ts);
+	
+	for (n = 0; n < iterations; n++)
+	{
+		for (i = 0; i < nbytes; i++)
+		{
+			unsigned short aa;
+			
+			sscanf(hex + 2 * i, "%02hx", &aa);
+			out[i] = aa;
+		}
+	}
+	
+	epicsTimeGetCurrent(&te);
+	tsscanf = epicsTimeDiffInSeconds(&te, &ts);
+	
+	printf("%d bytes x %d (fcs %02X)\n", nbytes, iterations, fcs);
+	printf("    table   encode %8.4f bytes/ns  decode %8.4f bytes/ns\n", (double) nbytes * iterations / (tenc * 1e9), (double) nbytes * iterations / (tdec * 1e9));
+	printf("    printf  encode %8.4f bytes/ns  decode %8.4f bytes/ns\n", (double) nbytes * iterations / (tsprintf * 1e9), (double) nbytes * iterations / (tsscanf * 1e9));
+	
+	free(bin);
+	free(out);
+	free(hex);
+	
+	return (0);
+}
+
+static const iocshArg HostlinkHexBenchArg0 = { "bytes", iocshArgInt };
+static const iocshArg HostlinkHexBenchArg1 = { "iterations", iocshArgInt };
+static const iocshArg *HostlinkHexBenchArgs[] = { &HostlinkHexBenchArg0, &HostlinkHexBenchArg1};
+static const iocshFuncDef HostlinkHexBenchFuncDef = {"HostlinkHexBench", 2, HostlinkHexBenchArgs};
+
+static void HostlinkHexBenchCallFunc(const iocshArgBuf *args)
+{
+	HostlinkHexBench(args[0].ival, args[1].ival);
+}
+
+static void HostlinkHexBenchRegister(void)
+{
+	static int firstTime = 1;
+
+  	if (firstTime)
+	{
+		firstTime = 0;
+		iocshRegister(&HostlinkHexBenchFuncDef, HostlinkHexBenchCallFunc);
+	}
+}
+
+epicsExportRegistrar(HostlinkHexBenchRegister);